@@ -0,0 +1,65 @@
+/*
+ * cs219_index.cpp
+ *
+ * Builds the spaced seed index of a cs219 database for the hhblits
+ * prefilter (hhblits -pre_index).
+ */
+
+#include "hhprefilter_index.h"
+#include "log.h"
+
+#include <iostream>
+#include <getopt.h>
+#include <string>
+
+void usage() {
+  std::cout << "cs219_index -i [ffindex_db_prefix] [-s seed]" << std::endl;
+  std::cout << "  Writes [ffindex_db_prefix]_cs219.idx from [ffindex_db_prefix]_cs219.ffdata/.ffindex." << std::endl;
+  std::cout << "  The seed marks matching columns with 1 and ignored columns with 0 (default 11)." << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool iflag = false;
+  std::string db_prefix;
+  std::string seed = "11";
+
+  int c;
+  while ((c = getopt(argc, argv, "i:s:h")) != -1) {
+    switch (c) {
+      case 'i':
+        iflag = true;
+        db_prefix = optarg;
+        break;
+      case 's':
+        seed = optarg;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (optopt == 'i' || optopt == 's')
+          fprintf(stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!iflag) {
+    usage();
+    exit(0);
+  }
+
+  std::string cs219_data_filename = db_prefix + "_cs219.ffdata";
+  std::string cs219_index_filename = db_prefix + "_cs219.ffindex";
+  std::string seed_index_filename = db_prefix + "_cs219.idx";
+
+  FFindexDatabase cs219_database(cs219_data_filename.c_str(), cs219_index_filename.c_str(), false);
+  PrefilterIndex::build(&cs219_database, seed, seed_index_filename.c_str());
+
+  return 0;
+}
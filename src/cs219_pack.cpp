@@ -0,0 +1,61 @@
+/*
+ * cs219_pack.cpp
+ *
+ * Converts the cs219 ffindex of a database into the packed format,
+ * which hhblits maps for the prefilter without per-entry work.
+ */
+
+#include "hhprefilter_pack.h"
+#include "log.h"
+
+#include <iostream>
+#include <getopt.h>
+#include <string>
+
+void usage() {
+  std::cout << "cs219_pack -i [ffindex_db_prefix]" << std::endl;
+  std::cout << "  Writes [ffindex_db_prefix]_cs219.pack from [ffindex_db_prefix]_cs219.ffdata/.ffindex." << std::endl;
+  std::cout << "  hhblits uses it for the prefilter when it exists, rerun after changing the cs219 database." << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool iflag = false;
+  std::string db_prefix;
+
+  int c;
+  while ((c = getopt(argc, argv, "i:h")) != -1) {
+    switch (c) {
+      case 'i':
+        iflag = true;
+        db_prefix = optarg;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (optopt == 'i')
+          fprintf(stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!iflag) {
+    usage();
+    exit(0);
+  }
+
+  std::string cs219_data_filename = db_prefix + "_cs219.ffdata";
+  std::string cs219_index_filename = db_prefix + "_cs219.ffindex";
+  std::string packed_filename = db_prefix + "_cs219.pack";
+
+  FFindexDatabase cs219_database(cs219_data_filename.c_str(), cs219_index_filename.c_str(), false);
+  PackedCS219Database::build(&cs219_database, packed_filename.c_str());
+
+  return 0;
+}
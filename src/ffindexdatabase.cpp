@@ -5,7 +5,7 @@
 #include <sys/mman.h>
 
 FFindexDatabase::FFindexDatabase(const char* data_filename, const char* index_filename, bool isCompressed)
-    : data_filename(strdup(data_filename)), isCompressed(isCompressed) {
+    : data_filename(strdup(data_filename)), index_filename(strdup(index_filename)), isCompressed(isCompressed) {
     db_data_fh = fopen(data_filename, "r");
     if (db_data_fh == NULL) {
         OpenFileError(data_filename, __FILE__, __LINE__, __func__);
@@ -34,6 +34,7 @@ void FFindexDatabase::ensureLinearAccess() {
 
 FFindexDatabase::~FFindexDatabase() {
     free(data_filename);
+    free(index_filename);
     munmap(db_data, data_size);
     free(db_index);
     fclose(db_data_fh);
@@ -16,6 +16,7 @@ public:
     char* db_data;
 
     char* data_filename;
+    char* index_filename;
     const bool isCompressed;
 
 private:
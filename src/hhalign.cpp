@@ -31,7 +31,8 @@
 #include "hhsuite_config.h"
 
 std::vector<HHblitsDatabase*> empty;
-HHalign::HHalign(Parameters& par) : HHblits(par, empty), tfiles(par.tfiles) {
+HHalign::HHalign(Parameters& par, TemplateHMMCache* template_cache)
+    : HHblits(par, empty, template_cache), tfiles(par.tfiles) {
 
 }
 
@@ -188,7 +189,8 @@ void HHalign::help(Parameters& par, char all) {
     printf(" -atab   <file> write all alignments in tabular layout to file                   \n");
     printf(" -maxseq <int>  max number of input rows (def=%5i)\n", par.maxseq);
     printf(" -maxres <int>  max number of HMM columns (def=%5i)\n", par.maxres);
-    printf(" -maxmem [1,inf[ limit memory for realignment (in GB) (def=%.1f)          \n", par.maxmem);
+    printf(" -maxmem [1,inf[ limit memory for realignment and backtrace (in GB) (def=%.1f)\n", par.maxmem);
+    printf(" -tcache_mem [0,inf[ limit memory for cached template HMMs with pseudocounts (in GB) (def=%.1f)\n", par.template_cache_mem);
   }
   printf("\n");
 
@@ -534,6 +536,9 @@ void HHalign::ProcessArguments(Parameters& par) {
     else if (!strcmp(argv[i], "-maxmem") && (i < argc - 1)) {
       par.maxmem = atof(argv[++i]);
     }
+    else if (!strcmp(argv[i], "-tcache_mem") && (i < argc - 1)) {
+      par.template_cache_mem = atof(argv[++i]);
+    }
     else if (!strcmp(argv[i], "-corr") && (i < argc - 1))
       par.corr = atof(argv[++i]);
 
@@ -626,10 +631,10 @@ void HHalign::run(FILE* query_fh, char* query_path) {
 
   int max_template_length = getMaxTemplateLength(new_entries);
   for(int i = 0; i < par.threads; i++) {
-    viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
+    viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, std::min<long int>(max_template_length, getMaxMemTemplateLength()));
   }
 
-  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
   std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec, new_entries, par.qsc_db, pb, S, Sim, R, par.ssm, S73, S33, S37);
 
   hitlist.N_searched = new_entries.size();
@@ -12,7 +12,7 @@
 
 class HHalign : public HHblits {
 public:
-    HHalign(Parameters &par);
+    HHalign(Parameters &par, TemplateHMMCache *template_cache = NULL);
 
     virtual ~HHalign();
 
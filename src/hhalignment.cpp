@@ -1804,6 +1804,29 @@ int Alignment::Filter2(char keep[], int coverage, int qid, float qsc,
   if (seqid1 > seqid2)
     return nn;
 
+  // Bits of the columns with GAP, ANY or ENDGAP of each sequence, in words of 64 columns. They are
+  // computed once here instead of for each pair of sequences. Columns after the last simd_int
+  // that covers column L are marked as GAP.
+  const int COLS_SIMD = VECSIZE_INT * 4;       // columns per simd_int
+  const int CHUNKS_WORD = 64 / COLS_SIMD;      // simd_int per word
+  const unsigned long long CHUNK_BITS = (COLS_SIMD == 64 ? ~0ULL : (1ULL << (COLS_SIMD % 64)) - 1);
+  const int nwords = L / 64 + 1;
+  const int nchunks = L / COLS_SIMD + 1;
+  unsigned long long * noaa = new unsigned long long[(size_t) N_in * nwords];
+  // _mm_set1_epi8 pseudo-instruction is slow!
+  const simd_int NAAx16 = simdi8_set(NAA - 1);
+  for (k = 0; k < N_in; ++k) {
+    const simd_int * XK = (simd_int *) X[k];
+    unsigned long long * NOAA_K = noaa + (size_t) k * nwords;
+    for (int w = 0; w < nwords; ++w) {
+      NOAA_K[w] = ~0ULL;
+      for (int i = w * CHUNKS_WORD, shift = 0; shift < 64 && i < nchunks; ++i, shift += COLS_SIMD) {
+        const unsigned long long res = (unsigned long long) simdi8_movemask(simdi8_gt(XK[i], NAAx16)) & CHUNK_BITS;
+        NOAA_K[w] &= ~(CHUNK_BITS << shift) | (res << shift);
+      }
+    }
+  }
+
   // Successively increment idmax[i] at positons where N[i]<Ndiff
   seqid = seqid1;
   while (seqid <= seqid2) {
@@ -1874,21 +1897,13 @@ int Alignment::Filter2(char keep[], int coverage, int qid, float qsc,
         diff = 0;
         const simd_int * XK = (simd_int *) X[k];
         const simd_int * XJ = (simd_int *) X[j];
-        const int first_kj_simd = first_kj / (VECSIZE_INT * 4);
-        const int last_kj_simd = last_kj / (VECSIZE_INT * 4) + 1;
-        // coverage correction for simd
-        // because we do not always hit the right start with simd.
-        // This works because all sequence vector are initialized with GAPs so the sequnces is surrounded by GAPs
-        const int first_diff_simd_scalar = std::abs(
-            first_kj_simd * (VECSIZE_INT * 4) - first_kj);
-        const int last_diff_simd_scalar = std::abs(
-            last_kj_simd * (VECSIZE_INT * 4) - (last_kj + 1));
-
-        cov_kj += (first_diff_simd_scalar + last_diff_simd_scalar);
-
-        // _mm_set1_epi8 pseudo-instruction is slow!
-        const simd_int NAAx16 = simdi8_set(NAA - 1);
-        for (int i = first_kj_simd; i < last_kj_simd && diff < diff_suff; ++i) {
+        const unsigned long long * NOAA_K = noaa + (size_t) k * nwords;
+        const unsigned long long * NOAA_J = noaa + (size_t) j * nwords;
+        const int first_word = first_kj / 64;
+        const int last_word = last_kj / 64;
+        const int last_chunk = last_kj / COLS_SIMD;  // last simd_int read
+
+        for (int w = first_word; w <= last_word && diff < diff_suff; ++w) {
           // None SIMD function
           // enough different residues to accept? => break
           // if (X[k][i] >= NAA || X[j][i] >= NAA)
@@ -1896,28 +1911,33 @@ int Alignment::Filter2(char keep[], int coverage, int qid, float qsc,
           // else if (X[k][i] != X[j][i] && ++diff >= diff_suff)
           //    break; // accept (k,j)
 
-          const simd_int NO_AA_K = simdi8_gt(XK[i], NAAx16);  // pos without amino acid in seq k
-          const simd_int NO_AA_J = simdi8_gt(XJ[i], NAAx16);  // pos without amino acid in seq j
+          // 64 bits indicating positions with GAP, ANY or ENDGAP in seq k or j
+          const unsigned long long res = NOAA_K[w] | NOAA_J[w];
 
-          // Compute 16 bits indicating positions with GAP, ANY or ENDGAP in seq k or j
-          // int _mm_movemask_epi8(__m128i a) creates 16-bit mask from most significant bits of
-          // the 16 signed or unsigned 8-bit integers in a and zero-extends the upper bits.
-          int res = simdi8_movemask(simdi_or(NO_AA_K, NO_AA_J));
+          // Compute 64 bit mask that indicates positions where k and j have identical residues
+          // (columns after last_kj are not read, they are in res)
+          const int chunks = (w < last_word ? CHUNKS_WORD : last_chunk - w * CHUNKS_WORD + 1);
+          unsigned long long c = 0;
+          for (int i = 0; i < chunks; ++i)
+            c |= ((unsigned long long) simdi8_eq_mask(XK[w * CHUNKS_WORD + i], XJ[w * CHUNKS_WORD + i]) & CHUNK_BITS)
+                << (i * COLS_SIMD);
 
-          cov_kj -= NumberOfSetBits(res);  // subtract positions that should not contribute to coverage
-
-          // Compute 16 bit mask that indicates positions where k and j have identical residues
-          int c = simdi8_movemask(simdi8_eq(XK[i], XJ[i]));
-
-          // Count positions where  k and j have different amino acids, which is equal to 16 minus the
+          // Count positions where  k and j have different amino acids, which is equal to 64 minus the
           //  number of positions for which either j and k are equal or which contain ANY, GAP, or ENDGAP
-          diff += (VECSIZE_INT * 4) - NumberOfSetBits(c | res);
-
+          diff += 64 - NumberOfSetBits(c | res);
         }
 
         //dissimilarity < acceptace threshold? Reject!
-        if (diff < diff_suff && float(diff) <= diff_min_frac * cov_kj)
-          break;
+        if (diff < diff_suff) {
+          // coverage correction for the words of 64 columns, only needed if all of them were compared:
+          // subtract positions that should not contribute to coverage.
+          // This works because all sequence vector are initialized with GAPs so the sequnces is surrounded by GAPs
+          cov_kj = (last_word - first_word + 1) * 64;
+          for (int w = first_word; w <= last_word; ++w)
+            cov_kj -= NumberOfSetBits(NOAA_K[w] | NOAA_J[w]);
+          if (float(diff) <= diff_min_frac * cov_kj)
+            break;
+        }
       }
 
       // did loop reach end? => accept k. Otherwise reject k (the shorter of the two)
@@ -1957,6 +1977,7 @@ int Alignment::Filter2(char keep[], int coverage, int qid, float qsc,
     keep[k] = in[k];
   delete[] in;
   delete[] inkk;
+  delete[] noaa;
   //  delete[] idmax;
   delete[] Nmax;
   delete[] idmaxwin;
@@ -11,7 +11,7 @@
 #include <cmath>
 #include <cfloat>
 
-void PosteriorDecoder::writeProfilesToHits(HMM &q, HMM &t, PosteriorMatrix &p_mm, ViterbiMatrix & backtrace_matrix, Hit &hit) {
+void PosteriorDecoder::writeProfilesToHits(HMM &q, const int elem, Hit &hit) {
 	if(hit.forward_profile) {
 		delete[] hit.forward_profile;
 	}
@@ -49,14 +49,14 @@ void PosteriorDecoder::writeProfilesToHits(HMM &q, HMM &t, PosteriorMatrix &p_mm
   }
 
 
-  std::sort(m_backward_entries.begin(), m_backward_entries.end(), compareIndices);
-  hit.backward_entries = m_backward_entries.size();
+  std::sort(m_backward_entries[elem].begin(), m_backward_entries[elem].end(), compareIndices);
+  hit.backward_entries = m_backward_entries[elem].size();
   hit.backward_matrix = new float*[hit.backward_entries];
 
-  for(size_t i = 0; i < m_backward_entries.size(); i++) {
+  for(size_t i = 0; i < m_backward_entries[elem].size(); i++) {
     hit.backward_matrix[i] = new float[3];
 
-    MACTriple triple = m_backward_entries[i];
+    MACTriple triple = m_backward_entries[elem][i];
     hit.backward_matrix[i][0] = triple.i;
     hit.backward_matrix[i][1] = triple.j;
     hit.backward_matrix[i][2] = triple.value;
@@ -65,13 +65,13 @@ void PosteriorDecoder::writeProfilesToHits(HMM &q, HMM &t, PosteriorMatrix &p_mm
   }
 
 
-  std::sort(m_forward_entries.begin(), m_forward_entries.end(), compareIndices);
-  hit.forward_entries = m_forward_entries.size();
+  std::sort(m_forward_entries[elem].begin(), m_forward_entries[elem].end(), compareIndices);
+  hit.forward_entries = m_forward_entries[elem].size();
   hit.forward_matrix = new float*[hit.forward_entries];
-  for(size_t i = 0; i < m_forward_entries.size(); i++) {
+  for(size_t i = 0; i < m_forward_entries[elem].size(); i++) {
     hit.forward_matrix[i] = new float[3];
 
-    MACTriple triple = m_forward_entries[i];
+    MACTriple triple = m_forward_entries[elem][i];
     hit.forward_matrix[i][0] = triple.i;
     hit.forward_matrix[i][1] = triple.j;
     hit.forward_matrix[i][2] = triple.value;
@@ -79,30 +79,34 @@ void PosteriorDecoder::writeProfilesToHits(HMM &q, HMM &t, PosteriorMatrix &p_mm
     hit.forward_profile[triple.i] += triple.value;
   }
 
-  size_t posterior_entries = 0;
-  for(int i = 1; i <= q.L; i++) {
-    for(int j = 1; j <= t.L; j++) {
-      float posterior = p_mm.getPosteriorValue(i, j);
-      if(posterior >= POSTERIOR_PROBABILITY_THRESHOLD && !backtrace_matrix.getCellOff(i, j, 0) &&  std::isinf(posterior) == 0 && std::isnan(posterior) == 0) {
-        posterior_entries++;
-      }
-    }
-  }
-
-  hit.posterior_entries = posterior_entries;
+  hit.posterior_entries = m_posterior_entries[elem].size();
   hit.posterior_matrix = new float*[hit.posterior_entries];
+  for(size_t i = 0; i < m_posterior_entries[elem].size(); i++) {
+    hit.posterior_matrix[i] = new float[3];
+
+    MACTriple triple = m_posterior_entries[elem][i];
+    hit.posterior_matrix[i][0] = triple.i;
+    hit.posterior_matrix[i][1] = triple.j;
+    hit.posterior_matrix[i][2] = triple.value;
+  }
+}
 
-  size_t posterior_index = 0;
-	for(int i = 1; i <= q.L; i++) {
-		for(int j = 1; j <= t.L; j++) {
-			float posterior = p_mm.getPosteriorValue(i, j);
-
-			if(posterior >= POSTERIOR_PROBABILITY_THRESHOLD && !backtrace_matrix.getCellOff(i, j, 0) && std::isinf(posterior) == 0 && std::isnan(posterior) == 0) {
-			  hit.posterior_matrix[posterior_index] = new float[3];
-			  hit.posterior_matrix[posterior_index][0] = i;
-			  hit.posterior_matrix[posterior_index][1] = j;
-			  hit.posterior_matrix[posterior_index][2] = posterior;
-			  posterior_index++;
+/////////////////////////////////////////////////////////////////////////////////////
+// Collect the posterior probabilities of the rows first ... last that are written
+// to the hit, the cells turned off are skipped
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::posteriorEntries(PosteriorMatrix &p_mm, ViterbiMatrix & backtrace_matrix, const int elem,
+		const int first, const int last) {
+	for(int i = first; i <= last; i++) {
+		for(int j = m_band_lo[i]; j <= m_band_hi[i]; j++) {
+			float posterior = p_mm.getPosteriorValue(i, j, elem);
+
+			if(posterior >= POSTERIOR_PROBABILITY_THRESHOLD && !backtrace_matrix.getCellOff(i, j, elem) && std::isinf(posterior) == 0 && std::isnan(posterior) == 0) {
+			  MACTriple triple;
+			  triple.i = i;
+			  triple.j = j;
+			  triple.value = posterior;
+			  m_posterior_entries[elem].push_back(triple);
 			}
 		}
 	}
@@ -128,7 +132,23 @@ void PosteriorDecoder::backtraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, Vi
 	hit.state = ViterbiMatrix::MM;       // lowest state with maximum score must be match-match state
 	step = 0;         // steps through the matrix correspond to alignment columns (from 1 to nsteps)
 	i = hit.i2; j = hit.j2;     // last aligned pair is (i2,j2)
-	if (backtrace_matrix.getMatMat(i, j, elem) != ViterbiMatrix::MM) {		// b[i][j] != MM
+	m_step_posterior.assign(1, 0.0f);
+	if (followBacktraceMAC(q, t, p_mm, backtrace_matrix, elem, hit, 1, true, i, j, step))
+		actual_level = DEBUG1;
+
+	finishBacktraceMAC(q, t, hit, step, corr, actual_level);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Follow the MAC backtrace from (i,j) after step steps while i >= first_row, the
+// posterior probability of each step is recorded in m_step_posterior. The cells in
+// the direct neighbourhood of the path are turned off with exclude_cells.
+// Returns true if an unallowed state occurred.
+/////////////////////////////////////////////////////////////////////////////////////
+bool PosteriorDecoder::followBacktraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, ViterbiMatrix & backtrace_matrix,
+		const int elem, Hit & hit, const int first_row, const bool exclude_cells, int & i, int & j, int & step) {
+	bool unallowed = false;
+	if (step == 0 && backtrace_matrix.getMatMat(i, j, elem) != ViterbiMatrix::MM) {		// b[i][j] != MM
 		if (Log::reporting_level() > DEBUG)
 		  fprintf(stderr,"Error: backtrace does not start in match-match state, but in state %i, (i,j)=(%i,%i)\n",backtrace_matrix.getMatMat(i, j, elem),i,j);
 
@@ -139,19 +159,22 @@ void PosteriorDecoder::backtraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, Vi
 		hit.alt_j->push_back(j);
 		hit.state = ViterbiMatrix::STOP;
 	} else {
-		while (hit.state != ViterbiMatrix::STOP) {
+		while (hit.state != ViterbiMatrix::STOP && i >= first_row) {
 			step++;
 			hit.states[step] = hit.state = backtrace_matrix.getMatMat(i, j, elem); // b[i][j];
 			hit.i[step] = i;
 			hit.j[step] = j;
 			hit.alt_i->push_back(i);
 			hit.alt_j->push_back(j);
+			m_step_posterior.push_back(p_mm.getPosteriorValue(i, j, elem));
 			// Exclude cells in direct neighbourhood from all further alignments
-			for (int ii = imax(i-2,1); ii <= imin(i+2, q.L); ++ii)
-//				hit.cell_off[ii][j] = 1;
-				backtrace_matrix.setCellOff(ii, j, elem, true);
-			for (int jj = imax(j-2,1); jj <= imin(j+2, t.L); ++jj)
-				backtrace_matrix.setCellOff(i, jj, elem, true);
+			if (exclude_cells) {
+				for (int ii = imax(i-2,1); ii <= imin(i+2, q.L); ++ii)
+//					hit.cell_off[ii][j] = 1;
+					backtrace_matrix.setCellOff(ii, j, elem, true);
+				for (int jj = imax(j-2,1); jj <= imin(j+2, t.L); ++jj)
+					backtrace_matrix.setCellOff(i, jj, elem, true);
+			}
 
 			if (hit.state == ViterbiMatrix::MM) hit.matched_cols++;
 
@@ -163,11 +186,20 @@ void PosteriorDecoder::backtraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, Vi
 				default:
 					fprintf(stderr,"Error: unallowed state value %i occurred during backtracing at step %i, (i,j)=(%i,%i)\n", hit.state, step, i, j);
 					hit.state = 0;
-					actual_level = DEBUG1;
+					unallowed = true;
 					break;
 			} //end switch (state)
 		} //end while (state)
 	}
+	return unallowed;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Alignment scores of the backtraced path of step steps
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::finishBacktraceMAC(HMM & q, HMM & t, Hit & hit, int step, float corr, LogLevel actual_level) {
+	int i,j;       // query and template match state indices
+
 	hit.i1 = hit.i[step];
 	hit.j1 = hit.j[step];
 	hit.states[step] = ViterbiMatrix::MM;  // first state (STOP state) is set to MM state
@@ -198,7 +230,7 @@ void PosteriorDecoder::backtraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, Vi
             hit.S_ss[step] = Viterbi::ScoreSS(&q, &t, i, j, ssw, ssm, S73, S37, S33);
 			hit.score_ss += hit.S_ss[step];
 //			hit.P_posterior[step] = powf(2, p_mm.getPosteriorValue(hit.i[step], hit.j[step], elem));
-			hit.P_posterior[step] = p_mm.getPosteriorValue(hit.i[step], hit.j[step]);
+			hit.P_posterior[step] = m_step_posterior[step];
 
 			// Add probability to sum of probs if no dssp states given or dssp states exist and state is resolved in 3D structure
 			if (t.nss_dssp<0 || t.ss_dssp[j]>0)
@@ -9,42 +9,66 @@
 
 void PosteriorDecoder::backwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 		PosteriorMatrix & p_mm, ViterbiMatrix & celloff_matrix, float shift, const int elem) {
+	backwardLastRow(q, t, hit, p_mm, celloff_matrix, elem);
+	backwardRows(q, t, hit, p_mm, celloff_matrix, shift, q.L - 1, 1, true, elem);
+}
 
-	// Variable declarations
-	int i, j;      // query and template match state indices
-	double pmin; // this is the scaled 1 in the SW algorithm that represents a starting alignment
-	double Cshift = pow(2.0, shift); // score offset transformed into factor in lin-space
-	double scale_prod = scale[q.L + 1];
-	int jmin;
+/////////////////////////////////////////////////////////////////////////////////////
+// Row q.L of the backward algorithm, m_prev holds the cells of row q.L afterwards
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::backwardLastRow(HMM & q, HMM & t, Hit & hit,
+		PosteriorMatrix & p_mm, ViterbiMatrix & celloff_matrix, const int elem) {
+
+	// Cells outside of the band of a row stay zero
+	memset(m_curr, 0, (t.L + 2) * sizeof(PosteriorMatrixCol));
+	memset(m_prev, 0, (t.L + 2) * sizeof(PosteriorMatrixCol));
 
 	// Initialization of top row, i.e. cells (0,j)
-	for (int j = t.L; j >= 1; j--) {
+	for (int j = m_band_hi[q.L]; j >= m_band_lo[q.L]; j--) {
 		if (celloff_matrix.getCellOff(q.L,j,elem)){
-			p_mm.setPosteriorValue(q.L, j, 0.0);
+			p_mm.setPosteriorValue(q.L, j, elem, 0.0);
 			m_prev[j].mm = 0.0;
 		}else {
 			m_prev[j].mm = scale[q.L + 1];
-			p_mm.setPosteriorValue(q.L, j, p_mm.getPosteriorValue(q.L, j) * scale[q.L + 1] / hit.Pforward);
+			p_mm.setPosteriorValue(q.L, j, elem, p_mm.getPosteriorValue(q.L, j, elem) * scale[q.L + 1] / hit.Pforward);
 		}
 		m_prev[j].mi = m_prev[j].dg = 0.0;
 	}
 
-  double final_scale_prod = scale[q.L + 1];
+  m_bwd_final_scale_prod = scale[q.L + 1];
   for (int i = q.L - 1; i >= 1; i--) {
-    final_scale_prod *= scale[i + 1];
-    if (final_scale_prod < DBL_MIN * 100)
-      final_scale_prod = 0.0;
+    m_bwd_final_scale_prod *= scale[i + 1];
+    if (m_bwd_final_scale_prod < DBL_MIN * 100)
+      m_bwd_final_scale_prod = 0.0;
   }
 
+	m_bwd_scale_prod = scale[q.L + 1];
 	if (m_local)
-		pmin = scale[q.L + 1];
+		m_bwd_pmin = scale[q.L + 1];
 	else
-		pmin = 0.0; // transform pmin (for local alignment) to scale of present (i'th) row
+		m_bwd_pmin = 0.0; // transform pmin (for local alignment) to scale of present (i'th) row
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Rows first down to last of the backward algorithm, continued from the cells of
+// row first+1 in m_prev and the state in m_bwd_pmin and m_bwd_scale_prod. The
+// backward profile is saved if entries is set.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::backwardRows(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+		ViterbiMatrix & celloff_matrix, float shift, const int first, const int last,
+		const bool entries, const int elem) {
 
+	// Variable declarations
+	int i, j;      // query and template match state indices
+	double pmin = m_bwd_pmin; // this is the scaled 1 in the SW algorithm that represents a starting alignment
+	double Cshift = pow(2.0, shift); // score offset transformed into factor in lin-space
+	double scale_prod = m_bwd_scale_prod;
+	const double final_scale_prod = m_bwd_final_scale_prod;
+	int jmin;
 
 	// Backward algorithm
 	// Loop through query positions i
-	for (i = q.L - 1; i >= 1; i--) {
+	for (i = first; i >= last; i--) {
 		//       if (v>=5) printf("\n");
 
 		if (hit.self)
@@ -52,26 +76,34 @@ void PosteriorDecoder::backwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 		else
 			jmin = 1; // jmin = i+SELFEXCL and not (i+SELFEXCL+1) to set matrix element at boundary to zero
 
+		// Columns of the row in the band; a band that ends before t.L is entered
+		// from zero cells at jhi+1
+		const int jlo = imax(jmin, m_band_lo[i]);
+		const int jhi = (m_band_hi[i] < t.L ? m_band_hi[i] : t.L - 1);
+
 		// Initialize cells at (i,t.L+1)
 		scale_prod *= scale[i + 1];
 		if (scale_prod < DBL_MIN * 100)
 			scale_prod = 0.0;
 
-		if (celloff_matrix.getCellOff(i, t.L, elem)) {
-			p_mm.setPosteriorValue(i, t.L, 0.0);
+		if (m_band_hi[i] < t.L) {
+			memset(m_curr + (jhi + 1), 0, sizeof(PosteriorMatrixCol));
+		} else if (celloff_matrix.getCellOff(i, t.L, elem)) {
+			p_mm.setPosteriorValue(i, t.L, elem, 0.0);
 			m_curr[t.L].mm = 0.0;
 		} else {
 			m_curr[t.L].mm = scale_prod;
-			p_mm.setPosteriorValue(i, t.L, p_mm.getPosteriorValue(i, t.L) * scale_prod / hit.Pforward);
+			p_mm.setPosteriorValue(i, t.L, elem, p_mm.getPosteriorValue(i, t.L, elem) * scale_prod / hit.Pforward);
 		}
 		pmin *= scale[i + 1]; // transform pmin (for local alignment) to scale of present (i'th) row
 		if (pmin < DBL_MIN * 100)
 			pmin = 0.0;
 
-		m_curr[t.L].im = m_curr[t.L].mi = m_curr[t.L].dg = m_curr[t.L].gd = 0.0;
-		memset(m_curr+jmin, 0, (t.L - 1) * sizeof(PosteriorMatrixCol));
+		if (m_band_hi[i] == t.L)
+			m_curr[t.L].im = m_curr[t.L].mi = m_curr[t.L].dg = m_curr[t.L].gd = 0.0;
+		memset(m_curr + jlo, 0, imax(0, jhi - jlo + 1) * sizeof(PosteriorMatrixCol));
 		// Loop through template positions j
-		for (j = t.L - 1; j >= jmin; j--) {
+		for (j = jhi; j >= jlo; j--) {
 			// Recursion relations
 			//          printf("S[%i][%i]=%4.1f  ",i,j,Score(q->p[i],t->p[j]));
 
@@ -107,29 +139,34 @@ void PosteriorDecoder::backwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 						//           + B_IM[i][j+1] * q.tr[i][M2I] * t.tr[j][I2M]              // MI -> IM
 				);
 
-		    float substitutionScore = ProbFwd(q.p[i], t.p[j]);
-		    float actual_backward_single = substitutionScore * Cshift * m_curr[j].mm / hit.Pforward * final_scale_prod / scale_prod;
+		    if (entries) {
+		      float substitutionScore = ProbFwd(q.p[i], t.p[j]);
+		      float actual_backward_single = substitutionScore * Cshift * m_curr[j].mm / hit.Pforward * final_scale_prod / scale_prod;
 
-		    if(actual_backward_single > m_back_forward_matrix_threshold) {
-          MACTriple trip;
-          trip.i = i;
-          trip.j = j;
-          trip.value = actual_backward_single;
+		      if(actual_backward_single > m_back_forward_matrix_threshold) {
+            MACTriple trip;
+            trip.i = i;
+            trip.j = j;
+            trip.value = actual_backward_single;
 
-          m_backward_entries.push_back(trip);
+            m_backward_entries[elem].push_back(trip);
+		      }
 		    }
 			} // end else
 
 		} //end for j
 
 		// Calculate posterior probability from Forward and Backward matrix elements
-		for (int jj = jmin; jj <= (t.L - 1); jj++) {
-			p_mm.multiplyPosteriorValue(i, jj, m_curr[jj].mm / hit.Pforward);
+		for (int jj = jlo; jj <= jhi; jj++) {
+			p_mm.multiplyPosteriorValue(i, jj, elem, m_curr[jj].mm / hit.Pforward);
 		}
 
 		std::swap(m_prev, m_curr);
 	} // end for i
 
+	m_bwd_pmin = pmin;
+	m_bwd_scale_prod = scale_prod;
+
 	/*
        // Debugging output
        if (v>=6)
@@ -175,3 +212,171 @@ void PosteriorDecoder::backwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 
 }
 
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Backward algorithm of VECSIZE_FLOAT templates, one per lane, in double precision.
+// The last column of a template is initialized like (i,t.L) of the scalar version,
+// the columns to its right are turned off.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::backwardAlgorithmSimd(HMM & q, HMMSimd & q_simd, std::vector<HMM *> & t_hmm, HMMSimd & t_simd,
+		std::vector<Hit *> & hits, PosteriorMatrix & p_mm, ViterbiMatrix & celloff_matrix, float shift) {
+	const int t_L = t_simd.L;
+	const simd_double zero = simdf64_setzero(0);
+	const simd_double Cshift = simdf64_set(pow(2.0, shift)); // score offset transformed into factor in lin-space
+	const simd_double scale_min = simdf64_set(DBL_MIN * 100);
+	const simd_float threshold = simdf32_set(m_back_forward_matrix_threshold);
+
+	// forward probabilities and lengths of the templates (unused lanes are turned off)
+	double __attribute__((aligned(ALIGN_FLOAT))) p_forward_lanes[VECSIZE_FLOAT];
+	int __attribute__((aligned(ALIGN_FLOAT))) length_lanes[VECSIZE_FLOAT];
+	for (int elem = 0; elem < VECSIZE_FLOAT; elem++) {
+		const bool used = elem < (int) hits.size();
+		p_forward_lanes[elem] = used ? hits[elem]->Pforward : 1.0;
+		length_lanes[elem] = used ? t_hmm[elem]->L : 0;
+	}
+	const simd_int lengths = simdi_load((simd_int *) length_lanes);
+
+	simd_double p_forward[2];
+	simd_double scale_prod[2];
+	simd_double final_scale_prod[2];
+	simd_double pmin[2];    // this is the scaled 1 in the SW algorithm that represents a starting alignment
+	for (int h = 0; h < 2; h++) {
+		p_forward[h] = simdf64_load(p_forward_lanes + h * VECSIZE_DOUBLE);
+		scale_prod[h] = simdf64_load(m_scale_simd + (q.L + 1) * VECSIZE_FLOAT + h * VECSIZE_DOUBLE);
+		final_scale_prod[h] = scale_prod[h];
+		for (int i = q.L - 1; i >= 1; i--) {
+			final_scale_prod[h] = simdf64_mul(final_scale_prod[h],
+					simdf64_load(m_scale_simd + (i + 1) * VECSIZE_FLOAT + h * VECSIZE_DOUBLE));
+			final_scale_prod[h] = simdf64_andnot(simdf64_lt(final_scale_prod[h], scale_min), final_scale_prod[h]);
+		}
+		pmin[h] = m_local ? scale_prod[h] : zero;
+	}
+
+	PosteriorMatrixColSimd * prev = m_prev_simd;
+	PosteriorMatrixColSimd * curr = m_curr_simd;
+	simd_float * P_prev = m_p_prev_simd;   // profile scores of row i+1
+	simd_float * P_curr = m_p_curr_simd;   // profile scores of row i
+
+	// the column right of the longest template is read by the recursion of its last column
+	memset(&prev[t_L + 1], 0, sizeof(PosteriorMatrixColSimd));
+	memset(&curr[t_L + 1], 0, sizeof(PosteriorMatrixColSimd));
+	P_prev[t_L + 1] = P_curr[t_L + 1] = simdf32_setzero(0);
+
+	// Initialization of top row, i.e. cells (q.L,j)
+	float * p_row = p_mm.getRow(q.L);
+	for (int j = 1; j <= t_L; j++) {
+		const simd_int cell_off = celloff_matrix.getCellOffVec(q.L, j);
+		const simd_float p = simdf32_load(p_row + j * VECSIZE_FLOAT);
+		const simd_double p_d[2] = { simdf32_f2d_lo(p), simdf32_f2d_hi(p) };
+		simd_double posterior[2];
+		for (int h = 0; h < 2; h++) {
+			const simd_double off = (h == 0) ? simdi32_mask2d_lo(cell_off) : simdi32_mask2d_hi(cell_off);
+			prev[j].mm[h] = simdf64_andnot(off, scale_prod[h]);
+			prev[j].mi[h] = prev[j].dg[h] = prev[j].im[h] = prev[j].gd[h] = zero;
+			posterior[h] = simdf64_andnot(off, simdf64_div(simdf64_mul(p_d[h], scale_prod[h]), p_forward[h]));
+		}
+		simdf32_store(p_row + j * VECSIZE_FLOAT, simdf64_d2f(posterior[0], posterior[1]));
+		P_prev[j] = ProbFwdSimd((simd_float *) q_simd.p[q.L], (simd_float *) t_simd.p[j]);
+	}
+
+	// Backward algorithm
+	// Loop through query positions i
+	for (int i = q.L - 1; i >= 1; i--) {
+		simd_double scale_i1[2];
+		for (int h = 0; h < 2; h++) {
+			scale_i1[h] = simdf64_load(m_scale_simd + (i + 1) * VECSIZE_FLOAT + h * VECSIZE_DOUBLE);
+			scale_prod[h] = simdf64_mul(scale_prod[h], scale_i1[h]);
+			scale_prod[h] = simdf64_andnot(simdf64_lt(scale_prod[h], scale_min), scale_prod[h]);
+			pmin[h] = simdf64_mul(pmin[h], scale_i1[h]); // transform pmin (for local alignment) to scale of present (i'th) row
+			pmin[h] = simdf64_andnot(simdf64_lt(pmin[h], scale_min), pmin[h]);
+		}
+		const simd_double q_m2m = simdf64_set(q.tr[i][M2M]);
+		const simd_double q_m2i = simdf64_set(q.tr[i][M2I]);
+		const simd_double q_m2d = simdf64_set(q.tr[i][M2D]);
+		const simd_double q_i2m = simdf64_set(q.tr[i][I2M]);
+		const simd_double q_i2i = simdf64_set(q.tr[i][I2I]);
+		const simd_double q_d2m = simdf64_set(q.tr[i][D2M]);
+		const simd_double q_d2d = simdf64_set(q.tr[i][D2D]);
+		const simd_float * q_p = (simd_float *) q_simd.p[i];
+		p_row = p_mm.getRow(i);
+
+		// Loop through template positions j
+		for (int j = t_L; j >= 1; j--) {
+			const simd_int cell_off = celloff_matrix.getCellOffVec(i, j);
+			// lanes left of the last column of their template, the others are at (i,t.L) or turned off
+			const simd_int inner = simdi32_gt(lengths, simdi32_set(j));
+			P_curr[j] = ProbFwdSimd(q_p, (simd_float *) t_simd.p[j]);
+			const simd_double P_d[2] = { simdf32_f2d_lo(P_curr[j]), simdf32_f2d_hi(P_curr[j]) };
+			const simd_double P_next_d[2] = { simdf32_f2d_lo(P_prev[j + 1]), simdf32_f2d_hi(P_prev[j + 1]) };
+			const simd_float p = simdf32_load(p_row + j * VECSIZE_FLOAT);
+			const simd_double p_d[2] = { simdf32_f2d_lo(p), simdf32_f2d_hi(p) };
+			const simd_double * t_tr_j = m_t_tr_simd + j * 7 * 2;
+			simd_double last_posterior[2];
+			simd_double factor[2];
+			simd_double backward_single[2];
+			for (int h = 0; h < 2; h++) {
+				const simd_double off = (h == 0) ? simdi32_mask2d_lo(cell_off) : simdi32_mask2d_hi(cell_off);
+				const simd_double in = (h == 0) ? simdi32_mask2d_lo(inner) : simdi32_mask2d_hi(inner);
+				const simd_double t_m2m = t_tr_j[TR_M2M * 2 + h];
+				const simd_double pmatch = simdf64_mul(simdf64_mul(simdf64_mul(prev[j + 1].mm[h], P_next_d[h]), Cshift), scale_i1[h]);
+
+				// Recursion relations
+				simd_double mm = simdf64_add(pmin[h],                                                  // MM -> EE (End/End, for local alignment)
+						simdf64_mul(simdf64_mul(pmatch, q_m2m), t_m2m));                               // MM -> MM
+				mm = simdf64_add(mm, simdf64_mul(curr[j + 1].gd[h], t_tr_j[TR_M2D * 2 + h]));          // MM -> GD
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(curr[j + 1].im[h], q_m2i), t_m2m));       // MM -> IM
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(prev[j].dg[h], q_m2d), scale_i1[h]));     // MM -> DG
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(simdf64_mul(prev[j].mi[h], q_m2m), t_tr_j[TR_M2I * 2 + h]), scale_i1[h])); // MM -> MI
+				const simd_double gd = simdf64_add(
+						simdf64_mul(simdf64_mul(pmatch, q_m2m), t_tr_j[TR_D2M * 2 + h]),                 // GD -> MM
+						simdf64_mul(curr[j + 1].gd[h], t_tr_j[TR_D2D * 2 + h]));                         // DG -> DG
+				const simd_double im = simdf64_add(
+						simdf64_mul(simdf64_mul(pmatch, q_i2m), t_m2m),                                  // IM -> MM
+						simdf64_mul(simdf64_mul(curr[j + 1].im[h], q_i2i), t_m2m));                      // IM -> IM
+				const simd_double dg = simdf64_add(
+						simdf64_mul(simdf64_mul(pmatch, q_d2m), t_m2m),                                  // DG -> MM
+						simdf64_mul(simdf64_mul(prev[j].dg[h], q_d2d), scale_i1[h]));                    // DG -> DG
+				const simd_double mi = simdf64_add(
+						simdf64_mul(simdf64_mul(pmatch, q_m2m), t_tr_j[TR_I2M * 2 + h]),                 // MI -> MM
+						simdf64_mul(simdf64_mul(simdf64_mul(prev[j].mi[h], q_m2m), t_tr_j[TR_I2I * 2 + h]), scale_i1[h])); // MI -> MI
+
+				// Initialize cells at (i,t.L)
+				curr[j].mm[h] = simdf64_andnot(off, simdf64_or(simdf64_and(in, mm), simdf64_andnot(in, scale_prod[h])));
+				curr[j].gd[h] = simdf64_andnot(off, simdf64_and(in, gd));
+				curr[j].im[h] = simdf64_andnot(off, simdf64_and(in, im));
+				curr[j].dg[h] = simdf64_andnot(off, simdf64_and(in, dg));
+				curr[j].mi[h] = simdf64_andnot(off, simdf64_and(in, mi));
+
+				last_posterior[h] = simdf64_div(simdf64_mul(p_d[h], scale_prod[h]), p_forward[h]);
+				factor[h] = simdf64_div(curr[j].mm[h], p_forward[h]);
+				backward_single[h] = simdf64_div(simdf64_mul(simdf64_div(simdf64_mul(simdf64_mul(P_d[h], Cshift),
+						curr[j].mm[h]), p_forward[h]), final_scale_prod[h]), scale_prod[h]);
+			}
+
+			// Calculate posterior probability from Forward and Backward matrix elements
+			const simd_float off_f = simdi_i2fcast(cell_off);
+			const simd_float in_f = simdi_i2fcast(inner);
+			const simd_float posterior = simdf32_or(
+					simdf32_and(in_f, simdf32_mul(p, simdf64_d2f(factor[0], factor[1]))),
+					simdf32_andnot(in_f, simdf64_d2f(last_posterior[0], last_posterior[1])));
+			simdf32_store(p_row + j * VECSIZE_FLOAT, simdf32_andnot(off_f, posterior));
+
+			// save backward profile
+			const simd_float actual_backward_single = simdf64_d2f(backward_single[0], backward_single[1]);
+			unsigned int entries = simdf32_movemask(simdf32_andnot(off_f, simdf32_and(in_f,
+					simdf32_gt(actual_backward_single, threshold))));
+			while (entries) {
+				const int elem = __builtin_ctz(entries);
+				entries &= entries - 1;
+				MACTriple trip;
+				trip.i = i;
+				trip.j = j;
+				trip.value = ((float *) &actual_backward_single)[elem];
+				m_backward_entries[elem].push_back(trip);
+			}
+		} //end for j
+
+		std::swap(prev, curr);
+		std::swap(P_prev, P_curr);
+	} // end for i
+}
@@ -8,9 +8,16 @@
 #include "hhblits.h"
 #include "hhsuite_config.h"
 
-HHblits::HHblits(Parameters& par, std::vector<HHblitsDatabase*>& databases) : par(par) {
+HHblits::HHblits(Parameters& par, std::vector<HHblitsDatabase*>& databases,
+                 TemplateHMMCache* template_cache)
+    : par(par), template_cache(template_cache), own_template_cache(false) {
   dbs = databases;
 
+  if (this->template_cache == NULL) {
+    this->template_cache = new TemplateHMMCache((size_t) (par.template_cache_mem * 1024 * 1024 * 1024));
+    own_template_cache = true;
+  }
+
   context_lib = NULL;
   crf = NULL;
   pc_hhm_context_engine = NULL;
@@ -23,6 +30,9 @@ HHblits::HHblits(Parameters& par, std::vector<HHblitsDatabase*>& databases) : pa
 
   q = NULL;
   q_tmp = NULL;
+  input_format = 0;
+
+  has_first_prefilter_entries = false;
 
   // Set (global variable) substitution matrix and derived matrices
   SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
@@ -55,6 +65,10 @@ HHblits::~HHblits() {
   delete[] viterbiMatrices;
   delete[] posteriorMatrices;
 
+  if (own_template_cache) {
+    delete template_cache;
+  }
+
   DeletePseudocountsEngine(context_lib, crf, pc_hhm_context_engine, pc_hhm_context_mode, pc_prefilter_context_engine, pc_prefilter_context_mode);
 }
 
@@ -70,9 +84,10 @@ void HHblits::prepareDatabases(Parameters& par,
     par.dbsize += databases[i]->cs219_database->db_index->n_entries;
   }
 
-  if (par.prefilter) {
-    for (size_t i = 0; i < databases.size(); i++) {
-      databases[i]->initPrefilter(par.cs_library);
+  if (par.prefilter && !databases.empty()) {
+    HHblitsDatabase::initPrefilter(databases, par.cs_library);
+    if (par.prefilter_index) {
+      HHblitsDatabase::initPrefilterIndex(databases);
     }
   }
 }
@@ -163,6 +178,12 @@ void HHblits::Reset() {
     Qali_allseqs = NULL;
   }
 
+  for (size_t i = 0; i < first_prefilter_entries.size(); i++) {
+    delete first_prefilter_entries[i];
+  }
+  first_prefilter_entries.clear();
+  has_first_prefilter_entries = false;
+
   hitlist.Reset();
   while (!hitlist.End())
     hitlist.Delete().Delete();
@@ -266,6 +287,8 @@ void HHblits::help(Parameters& par, char all) {
     printf(" -pre_gap_open             gap open penalty in prefilter Smith-Waterman alignment (default=%i)\n", par.prefilter_gap_open);
     printf(" -pre_gap_extend           gap extend penalty in prefilter Smith-Waterman alignment (default=%i)\n", par.prefilter_gap_extend);
     printf(" -pre_score_offset         offset on sequence profile scores in prefilter S-W alignment (default=%i)\n", par.prefilter_score_offset);
+    printf(" -pre_index                use the seed index <db>_cs219.idx (see cs219_index) instead of the\n");
+    printf("                           full ungapped prefilter pass (default=off)                      \n");
 
     printf("\n");
   }
@@ -296,7 +319,14 @@ void HHblits::help(Parameters& par, char all) {
   if (all) {
     printf(" -realign             realign displayed hits with max. accuracy (MAC) algorithm \n");
     printf(" -realign_max <int>   realign max. <int> hits (default=%i)                        \n", par.realign_max);
+    printf(" -mac_simd [0,1]      realign hits of several templates at once, one per SIMD lane (def=%i)\n", par.mac_simd);
+    printf(" -mac_band <int>      banded realignment (local mode): F/B/MAC only within <int> of the Viterbi\n");
+    printf("                      alignment, doubled while the band border has posterior mass (def=%i: full)\n", par.mac_band);
     printf(" -ovlp <int>          banded alignment: forbid <ovlp> largest diagonals |i-j| of DP matrix (def=%i)\n", par.min_overlap);
+    printf(" -vband <int>         banded Viterbi: fill only diagonals within <int> of the prefilter alignment,\n");
+    printf("                      doubled while the best path touches the band (def=%i: full matrix)\n", par.viterbi_band);
+    printf(" -viterbi_score_tile [0,1] precompute the profile-profile scores of the Viterbi\n");
+    printf("                      in blocks of query rows (def=%i)\n", par.viterbi_score_tile);
     printf(" -alt <int>           show up to this many alternative alignments with raw score > smin(def=%i)  \n", par.altali);
     printf(" -smin <float>        minimum raw score for alternative alignments (def=%.1f)  \n", par.smin);
     printf(" -shift [-1,1]        profile-profile score offset (def=%-.2f)                         \n", par.shift);
@@ -393,7 +423,8 @@ void HHblits::help(Parameters& par, char all) {
     printf(" -atab   <file> write all alignments in tabular layout to file                   \n");
     printf(" -maxseq <int>  max number of input rows (def=%5i)\n", par.maxseq);
     printf(" -maxres <int>  max number of HMM columns (def=%5i)\n", par.maxres);
-    printf(" -maxmem [1,inf[ limit memory for realignment (in GB) (def=%.1f)          \n", par.maxmem);
+    printf(" -maxmem [1,inf[ limit memory for realignment and backtrace (in GB) (def=%.1f)\n", par.maxmem);
+    printf(" -tcache_mem [0,inf[ limit memory for cached template HMMs with pseudocounts (in GB) (def=%.1f)\n", par.template_cache_mem);
   }
   printf("\n");
 
@@ -618,6 +649,10 @@ void HHblits::ProcessArguments(Parameters& par) {
       par.cons = 1;
     else if (!strcmp(argv[i], "-realign_max") && (i < argc - 1))
       par.realign_max = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-mac_simd") && (i < argc - 1))
+      par.mac_simd = (atoi(argv[++i]) != 0);
+    else if (!strcmp(argv[i], "-mac_band") && (i < argc - 1))
+      par.mac_band = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-e") && (i < argc - 1))
       par.e = atof(argv[++i]);
     else if (!strcmp(argv[i], "-seq") && (i < argc - 1))
@@ -727,6 +762,8 @@ void HHblits::ProcessArguments(Parameters& par) {
       par.prefilter_gap_extend = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-pre_score_offset") && (i < argc - 1))
       par.prefilter_score_offset = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-pre_index"))
+      par.prefilter_index = true;
     else if (!strcmp(argv[i], "-realign_old_hits"))
       par.realign_old_hits = true;
     else if (!strcmp(argv[i], "-realign"))
@@ -772,6 +809,8 @@ void HHblits::ProcessArguments(Parameters& par) {
       par.threads = atoi(argv[++i]);
     } else if (!strcmp(argv[i], "-maxmem") && (i < argc - 1)) {
       par.maxmem = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-tcache_mem") && (i < argc - 1)) {
+      par.template_cache_mem = atof(argv[++i]);
     }
     else if (!strcmp(argv[i], "-nocontxt"))
       par.nocontxt = 1;
@@ -783,6 +822,10 @@ void HHblits::ProcessArguments(Parameters& par) {
       par.corr = atof(argv[++i]);
     else if (!strcmp(argv[i], "-ovlp") && (i < argc - 1))
       par.min_overlap = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-vband") && (i < argc - 1))
+      par.viterbi_band = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-viterbi_score_tile") && (i < argc - 1))
+      par.viterbi_score_tile = (atoi(argv[++i]) != 0);
     else if (!strcmp(argv[i], "-tags"))
       par.notags = 0;
     else if (!strcmp(argv[i], "-notags"))
@@ -918,7 +961,7 @@ void HHblits::RescoreWithViterbiKeepAlignment(HMMSimd& q_vec,
   // Start Viterbi search through db HMMs listed in dbfiles
 //	DoViterbiSearch(hits_to_rescore, previous_hits, false);
 
-  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
   std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
                                                          hits_to_rescore,
                                                          par.qsc_db, pb, S, Sim,
@@ -959,6 +1002,15 @@ void HHblits::RescoreWithViterbiKeepAlignment(HMMSimd& q_vec,
                                     par.alphac, par.prefilter_evalue_thresh);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Longest allowable length of database HMM (backtrace: 5 chars, fwd: 1 double, bwd: 1 double)
+// Longer templates are aligned with checkpoints, the rows between them are recomputed
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////
+long int HHblits::getMaxMemTemplateLength() {
+  return ((par.maxmem - 0.5) * 1024 * 1024 * 1024)
+      / (2 * sizeof(double) + 8) / q->L / par.threads;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Realign hits with MAC algorithm
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -969,9 +1021,7 @@ void HHblits::perform_realign(HMMSimd& q_vec, const char input_format,
   //  q->Log2LinTransitionProbs(1.0); // transform transition freqs to lin space if not already done
   int nhits = 0;
 
-  // Longest allowable length of database HMM (backtrace: 5 chars, fwd: 1 double, bwd: 1 double
-  long int Lmaxmem = ((par.maxmem - 0.5) * 1024 * 1024 * 1024)
-      / (2 * sizeof(double) + 8) / q->L / par.threads;
+  long int Lmaxmem = getMaxMemTemplateLength();
   int Lmax = 0;      // length of longest HMM to be realigned
 
   /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -999,23 +1049,20 @@ void HHblits::perform_realign(HMMSimd& q_vec, const char input_format,
     if (hit_cur.L > Lmax) {
       Lmax = hit_cur.L;
     }
-    if (hit_cur.L > Lmaxmem) {
-      nhits++;
-      continue;
-    }
 
     hit_vector.push_back(hitlist.ReadCurrentAddress());
     n_realignments++;
     nhits++;
   }
 
-  int t_maxres = Lmax + 2;
+  // templates longer than Lmaxmem are realigned with checkpoints
+  int t_maxres = std::min<long int>(Lmax, Lmaxmem) + 2;
   for (int i = 0; i < par.threads; i++) {
     posteriorMatrices[i]->allocateMatrix(q->L, t_maxres);
   }
 
   // Initialize a Null-value as a return value if not items are available anymore
-  PosteriorDecoderRunner runner(posteriorMatrices, viterbiMatrices, par.threads, par.ssw, S73, S33, S37);
+  PosteriorDecoderRunner runner(posteriorMatrices, viterbiMatrices, par.threads, par.ssw, S73, S33, S37, template_cache);
 
   HH_LOG(INFO)
       << "Realigning " << nhits
@@ -1055,24 +1102,19 @@ void HHblits::perform_realign(HMMSimd& q_vec, const char input_format,
 }
 
 void HHblits::run(FILE* query_fh, char* query_path) {
-  int cluster_found = 0;
-  int seqs_found = 0;
-
-  std::set<std::string> search_counter;
-
-  Hit hit_cur;
-  Hash<Hit>* previous_hits = new Hash<Hit>(1631, hit_cur);
+  prepareQuery(query_fh, query_path);
+  search();
+}
 
+void HHblits::prepareQuery(FILE* query_fh, char* query_path) {
   Qali = new Alignment(par.maxseq, par.maxres);
   Qali_allseqs = new Alignment(par.maxseq, par.maxres);
 
   q = new HMM(MAXSEQDIS, par.maxres);
-  HMMSimd q_vec(par.maxres);
   q_tmp = new HMM(MAXSEQDIS, par.maxres);
 
   // Read query input file (HHM or alignment format) without adding pseudocounts
   Qali->N_in = 0;
-  char input_format;
   ReadQueryFile(par, query_fh, input_format, par.wg, q, Qali, query_path, pb, S,
                 Sim);
 
@@ -1085,6 +1127,75 @@ void HHblits::run(FILE* query_fh, char* query_path) {
   // Set query columns in His-tags etc to Null model distribution
   if (par.notags)
     q->NeutralizeTags(pb);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Add prefilter pseudocounts and background to the (copied) query HMM q_tmp
+/////////////////////////////////////////////////////////////////////////////////////
+void HHblits::preparePrefilterProfile() {
+  // Add Pseudocounts to q_tmp
+  if (par.nocontxt) {
+    // Generate an amino acid frequency matrix from f[i][a] with full pseudocount admixture (tau=1) -> g[i][a]
+    q_tmp->PreparePseudocounts(R);
+    // Add amino acid pseudocounts to query: p[i][a] = (1-tau)*f[i][a] + tau*g[i][a]
+    q_tmp->AddAminoAcidPseudocounts(par.pc_prefilter_nocontext_mode,
+                                    par.pc_prefilter_nocontext_a,
+                                    par.pc_prefilter_nocontext_b,
+                                    par.pc_prefilter_nocontext_c);
+  } else {
+    // Add context specific pseudocounts (now always used, because clusterfile is necessary)
+    q_tmp->AddContextSpecificPseudocounts(pc_prefilter_context_engine,
+                                          pc_prefilter_context_mode);
+  }
+
+  q_tmp->CalculateAminoAcidBackground(pb);
+}
+
+HMM* HHblits::getFirstPrefilterProfile() {
+  *q_tmp = *q;
+  preparePrefilterProfile();
+  return q_tmp;
+}
+
+void HHblits::setFirstPrefilterHits(std::vector<HHEntry*>& entries) {
+  first_prefilter_entries = entries;
+  has_first_prefilter_entries = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Prefilter the first iteration of several queries with one pass over the databases
+/////////////////////////////////////////////////////////////////////////////////////
+void HHblits::prefilterBatch(std::vector<HMM*>& queries, const int threads,
+                             std::vector<std::vector<HHEntry*> >& entries) {
+  // no previous iterations in the first round
+  Hit hit_cur;
+  Hash<Hit> no_previous_hits(1631, hit_cur);
+  std::vector<Hash<Hit>*> previous_hits(queries.size(), &no_previous_hits);
+
+  entries.resize(queries.size());
+  std::vector<std::vector<HHEntry*> > old_entries(queries.size());
+
+  HHblitsDatabase::prefilter_db_batch(dbs, queries, previous_hits, threads,
+                                      par.prefilter_gap_open, par.prefilter_gap_extend,
+                                      par.prefilter_score_offset,
+                                      par.prefilter_bit_factor,
+                                      par.prefilter_evalue_thresh,
+                                      par.prefilter_evalue_coarse_thresh,
+                                      par.preprefilter_smax_thresh,
+                                      par.min_prefilter_hits, par.maxnumdb, R,
+                                      entries, old_entries);
+}
+
+void HHblits::search() {
+  int cluster_found = 0;
+  int seqs_found = 0;
+
+  std::set<std::string> search_counter;
+
+  Hit hit_cur;
+  Hash<Hit>* previous_hits = new Hash<Hit>(1631, hit_cur);
+
+  HMMSimd q_vec(par.maxres);
 
   //save all entries pointer in this vector to delete, when it's safe
   std::vector<HHEntry*> all_entries;
@@ -1131,33 +1242,24 @@ void HHblits::run(FILE* query_fh, char* query_path) {
       new_entries.clear();
       old_entries.clear();
 
-      // Add Pseudocounts to q_tmp
-      if (par.nocontxt) {
-        // Generate an amino acid frequency matrix from f[i][a] with full pseudocount admixture (tau=1) -> g[i][a]
-        q_tmp->PreparePseudocounts(R);
-        // Add amino acid pseudocounts to query: p[i][a] = (1-tau)*f[i][a] + tau*g[i][a]
-        q_tmp->AddAminoAcidPseudocounts(par.pc_prefilter_nocontext_mode,
-                                        par.pc_prefilter_nocontext_a,
-                                        par.pc_prefilter_nocontext_b,
-                                        par.pc_prefilter_nocontext_c);
+      if (round == 1 && has_first_prefilter_entries) {
+        // already prefiltered together with other queries (see prefilterBatch),
+        // q_tmp still gets its pseudocounts since it is printed with the results
+        preparePrefilterProfile();
+        new_entries.swap(first_prefilter_entries);
+        has_first_prefilter_entries = false;
       } else {
-        // Add context specific pseudocounts (now always used, because clusterfile is necessary)
-        q_tmp->AddContextSpecificPseudocounts(pc_prefilter_context_engine,
-                                              pc_prefilter_context_mode);
-      }
-
-      q_tmp->CalculateAminoAcidBackground(pb);
-
-      for (size_t i = 0; i < dbs.size(); i++) {
-        dbs[i]->prefilter_db(q_tmp, previous_hits, par.threads,
-                             par.prefilter_gap_open, par.prefilter_gap_extend,
-                             par.prefilter_score_offset,
-                             par.prefilter_bit_factor,
-                             par.prefilter_evalue_thresh,
-                             par.prefilter_evalue_coarse_thresh,
-                             par.preprefilter_smax_thresh,
-                             par.min_prefilter_hits, par.maxnumdb, R,
-                             new_entries, old_entries);
+        preparePrefilterProfile();
+
+        HHblitsDatabase::prefilter_db(dbs, q_tmp, previous_hits, par.threads,
+                                      par.prefilter_gap_open, par.prefilter_gap_extend,
+                                      par.prefilter_score_offset,
+                                      par.prefilter_bit_factor,
+                                      par.prefilter_evalue_thresh,
+                                      par.prefilter_evalue_coarse_thresh,
+                                      par.preprefilter_smax_thresh,
+                                      par.min_prefilter_hits, par.maxnumdb, R,
+                                      new_entries, old_entries);
       }
 
       for (size_t i = 0; i < new_entries.size(); i++) {
@@ -1179,7 +1281,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
     }
     max_template_length = std::min(max_template_length, par.maxres);
     for (int i = 0; i < par.threads; i++) {
-      viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
+      viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, std::min<long int>(max_template_length, getMaxMemTemplateLength()));
     }
 
     hitlist.N_searched = search_counter.size();
@@ -1198,7 +1300,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
     }
     HH_LOG(INFO) << "Scoring " << new_entries.size() << " HMMs using HMM-HMM Viterbi alignment" << std::endl;
     // Main Viterbi HMM-HMM search
-    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
     std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
                                                            new_entries,
                                                            par.qsc_db, pb, S,
@@ -1229,7 +1331,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
             << "Rescoring previously found HMMs with Viterbi algorithm"
             << std::endl;
 
-        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
         std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
                                                                   old_entries,
                                                                   par.qsc_db, pb,
@@ -1335,7 +1437,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
 //            << "Recalculating previously found HMMs with Viterbi algorithm"
 //            << std::endl;
 //
-//        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+//        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
 //        std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
 //                                                               old_entries,
 //                                                               par.qsc_db, pb,
@@ -1514,34 +1616,17 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
       new_entries.clear();
       old_entries.clear();
 
-      // Add Pseudocounts to q_tmp
-      if (par.nocontxt) {
-        // Generate an amino acid frequency matrix from f[i][a] with full pseudocount admixture (tau=1) -> g[i][a]
-        q_tmp->PreparePseudocounts(R);
-        // Add amino acid pseudocounts to query: p[i][a] = (1-tau)*f[i][a] + tau*g[i][a]
-        q_tmp->AddAminoAcidPseudocounts(par.pc_prefilter_nocontext_mode,
-                                        par.pc_prefilter_nocontext_a,
-                                        par.pc_prefilter_nocontext_b,
-                                        par.pc_prefilter_nocontext_c);
-      } else {
-        // Add context specific pseudocounts (now always used, because clusterfile is necessary)
-        q_tmp->AddContextSpecificPseudocounts(pc_prefilter_context_engine,
-                                              pc_prefilter_context_mode);
-      }
+      preparePrefilterProfile();
 
-      q_tmp->CalculateAminoAcidBackground(pb);
-
-      for (size_t i = 0; i < dbs.size(); i++) {
-        dbs[i]->prefilter_db(q_tmp, previous_hits, par.threads,
-                             par.prefilter_gap_open, par.prefilter_gap_extend,
-                             par.prefilter_score_offset,
-                             par.prefilter_bit_factor,
-                             par.prefilter_evalue_thresh,
-                             par.prefilter_evalue_coarse_thresh,
-                             par.preprefilter_smax_thresh,
-                             par.min_prefilter_hits, par.maxnumdb, R,
-                             new_entries, old_entries);
-      }
+      HHblitsDatabase::prefilter_db(dbs, q_tmp, previous_hits, par.threads,
+                                    par.prefilter_gap_open, par.prefilter_gap_extend,
+                                    par.prefilter_score_offset,
+                                    par.prefilter_bit_factor,
+                                    par.prefilter_evalue_thresh,
+                                    par.prefilter_evalue_coarse_thresh,
+                                    par.preprefilter_smax_thresh,
+                                    par.min_prefilter_hits, par.maxnumdb, R,
+                                    new_entries, old_entries);
 
       for (size_t i = 0; i < new_entries.size(); i++) {
         search_counter.insert(new_entries[i]->getName());
@@ -1562,7 +1647,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
     }
     max_template_length = std::min(max_template_length, par.maxres);
     for (int i = 0; i < par.threads; i++) {
-      viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
+      viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, std::min<long int>(max_template_length, getMaxMemTemplateLength()));
     }
 
     hitlist.N_searched = search_counter.size();
@@ -1585,7 +1670,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
                            << std::endl;
 
     // Main Viterbi HMM-HMM search
-    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
     std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
                                                            new_entries,
                                                            par.qsc_db, pb, S,
@@ -1616,7 +1701,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
             << "Rescoring previously found HMMs with Viterbi algorithm"
             << std::endl;
 
-        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
         std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
                                                                   old_entries,
                                                                   par.qsc_db, pb,
@@ -1723,7 +1808,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
 //            << "Recalculating previously found HMMs with Viterbi algorithm"
 //            << std::endl;
 //
-//        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
+//        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads, template_cache);
 //        std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
 //                                                               old_entries,
 //                                                               par.qsc_db, pb,
@@ -70,7 +70,9 @@ extern "C" {
 
 class HHblits {
 public:
-  HHblits(Parameters& parameters, std::vector<HHblitsDatabase*>& databases);
+  // template_cache may be shared with other instances, a private one is used if it is NULL
+  HHblits(Parameters& parameters, std::vector<HHblitsDatabase*>& databases,
+          TemplateHMMCache* template_cache = NULL);
   virtual ~HHblits();
 
   void Reset();
@@ -107,6 +109,16 @@ public:
   static void prepareDatabases(Parameters& par, std::vector<HHblitsDatabase*>& databases);
 
   virtual void run(FILE* query_fh, char* query_path);
+
+  // run() split into query preparation and search, so that the first prefilter
+  // iteration of several queries can be done in one database pass (hhblits_omp)
+  void prepareQuery(FILE* query_fh, char* query_path);
+  HMM* getFirstPrefilterProfile();
+  void prefilterBatch(std::vector<HMM*>& queries, const int threads,
+      std::vector<std::vector<HHEntry*> >& entries);
+  void setFirstPrefilterHits(std::vector<HHEntry*>& entries);
+  void search();
+
   void run(ffindex_entry_t* entry, char* data,
       ffindex_index_t* sequence_index, char* seq,
       ffindex_index_t* header_index, char* header);
@@ -140,6 +152,11 @@ protected:
 	HMM* q;
 	// Create query HMM with maximum of par.maxres match states (needed for prefiltering)
 	HMM* q_tmp;
+	char input_format;
+
+	// prefilter hits of the first iteration computed by prefilterBatch
+	std::vector<HHEntry*> first_prefilter_entries;
+	bool has_first_prefilter_entries;
 
 	// output A3M generated by merging A3M alignments for significant hits to the query alignment
 	Alignment* Qali;
@@ -149,12 +166,19 @@ protected:
 	ViterbiMatrix** viterbiMatrices;
 	PosteriorMatrix** posteriorMatrices;
 
+	// template HMMs with pseudocounts, possibly shared with other instances
+	TemplateHMMCache* template_cache;
+	bool own_template_cache;
+
 	HitList hitlist; // list of hits with one Hit object for each pairwise comparison done
 	std::map<int, Alignment*> alis;
 
 	void perform_realign(HMMSimd& q_vec, const char input_format, std::vector<HHEntry*>& hits_to_realign);
+	// longest template that fits into -maxmem for realignment and backtrace
+	long int getMaxMemTemplateLength();
 	void mergeHitsToQuery(Hash<Hit>* previous_hits, int& seqs_found, int& cluster_found);
 	void add_hits_to_hitlist(std::vector<Hit>& hits, HitList& hitlist);
+	void preparePrefilterProfile();
 
 
 private:
@@ -9,7 +9,12 @@ void checkOutput(Parameters& par) {
   }
 }
 
+#ifdef HH_MAIN
+// build for one instruction set, called by hhblits_dispatch.cpp
+extern "C" int HH_MAIN(int argc, const char **argv) {
+#else
 int main(int argc, const char **argv) {
+#endif
   Parameters par(argc, argv);
 
 #ifdef HHSEARCH
@@ -76,4 +81,6 @@ int main(int argc, const char **argv) {
     delete databases[i];
   }
   databases.clear();
+
+  return 0;
 }
@@ -0,0 +1,80 @@
+/*
+ * hhblits_dispatch.cpp
+ *
+ * main of hhblits, hhsearch and hhalign (and their _omp versions) in builds
+ * with HAVE_SIMD_DISPATCH. The program is linked once per instruction set
+ * (<program>_<isa>.o, see CMakeLists.txt), with all symbols local except its
+ * entry <program>_main_<isa>. The static initializers of a build are not run
+ * at startup but before its entry is called, so no code of a build runs on
+ * a cpu that does not support it.
+ * The environment variable HHSUITE_SIMD (sse2, avx2, avx512) selects a narrower build.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define HH_ENTRY_(program, isa) program##_main_##isa
+#define HH_ENTRY(program, isa) HH_ENTRY_(program, isa)
+
+typedef int (*EntryFunction)(int argc, const char **argv);
+typedef void (*InitFunction)();
+
+extern "C" {
+  int HH_ENTRY(HH_PROGRAM, sse2)(int argc, const char **argv);
+  extern InitFunction __start_hhsuite_init_sse2[], __stop_hhsuite_init_sse2[];
+
+  int HH_ENTRY(HH_PROGRAM, avx2)(int argc, const char **argv);
+  extern InitFunction __start_hhsuite_init_avx2[], __stop_hhsuite_init_avx2[];
+
+  int HH_ENTRY(HH_PROGRAM, avx512)(int argc, const char **argv);
+  extern InitFunction __start_hhsuite_init_avx512[], __stop_hhsuite_init_avx512[];
+}
+
+struct SimdBuild {
+  const char* name;
+  bool supported;
+  EntryFunction entry;
+  InitFunction* init_begin;
+  InitFunction* init_end;
+};
+
+int main(int argc, const char **argv) {
+  __builtin_cpu_init();
+
+  // widest instruction set first
+  const SimdBuild builds[] = {
+    { "avx512", __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"),
+      HH_ENTRY(HH_PROGRAM, avx512), __start_hhsuite_init_avx512, __stop_hhsuite_init_avx512 },
+    { "avx2", __builtin_cpu_supports("avx2") != 0, HH_ENTRY(HH_PROGRAM, avx2),
+      __start_hhsuite_init_avx2, __stop_hhsuite_init_avx2 },
+    { "sse2", __builtin_cpu_supports("sse2") != 0, HH_ENTRY(HH_PROGRAM, sse2),
+      __start_hhsuite_init_sse2, __stop_hhsuite_init_sse2 }
+  };
+  const size_t n_builds = sizeof(builds) / sizeof(builds[0]);
+
+  size_t b = 0;
+  const char* requested = getenv("HHSUITE_SIMD");
+  if (requested != NULL && *requested) {
+    while (b < n_builds && strcmp(builds[b].name, requested) != 0) {
+      b++;
+    }
+    if (b == n_builds || !builds[b].supported) {
+      fprintf(stderr, "ERROR: HHSUITE_SIMD=%s is not an instruction set supported by this cpu (avx512, avx2, sse2)\n", requested);
+      exit(1);
+    }
+  } else {
+    while (b < n_builds && !builds[b].supported) {
+      b++;
+    }
+    if (b == n_builds) {
+      fprintf(stderr, "ERROR: At least SSE2 instruction set support is required!\n");
+      exit(1);
+    }
+  }
+
+  for (InitFunction* init = builds[b].init_begin; init < builds[b].init_end; ++init) {
+    (*init)();
+  }
+  return builds[b].entry(argc, argv);
+}
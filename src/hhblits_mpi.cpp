@@ -183,19 +183,23 @@ int main(int argc, const char **argv) {
             makeOutputFFIndex(par.m8file, MPQ_rank, &HHblits::writeM8,
                               outputDatabases);
 
+            // kept for all queries of this worker
+            TemplateHMMCache template_cache((size_t) (par.template_cache_mem * 1024 * 1024 * 1024));
+
             std::vector<HHblitsDatabase*> databases;
 #ifdef HHSEARCH
             HHsearch::prepareDatabases(par, databases);
-            HHblits app(par, databases);
+            HHblits app(par, databases, &template_cache);
 #elif HHalign
-            HHalign app(par);
+            HHalign app(par, &template_cache);
 #else
             HHblits::prepareDatabases(par, databases);
-            HHblits app(par, databases);
+            HHblits app(par, databases, &template_cache);
 #endif
 
             HHblits_MPQ_Wrapper wrapper(reader.db_data, reader.db_index, app, outputDatabases);
             MPQ_Worker(payload, &wrapper);
+            template_cache.printStatistics();
 
             for (size_t i = 0; i < outputDatabases.size(); i++) {
                 outputDatabases[i].close();
@@ -77,7 +77,167 @@ void makeOutputFFIndex(char *par, void (*print)(HHblits &, std::stringstream &),
     }
 }
 
+void runPerQuery(Parameters &par, std::vector<HHblitsDatabase *> &databases, FFindexDatabase &reader,
+                 const int threads, std::vector<OutputFFIndex> &outputDatabases,
+                 TemplateHMMCache &template_cache) {
+#pragma omp parallel num_threads(threads)
+    {
+#ifdef HHSEARCH
+        HHblits app(par, databases, &template_cache);
+#elif HHALIGN
+        HHalign app(par, &template_cache);
+#else
+        HHblits app(par, databases, &template_cache);
+#endif
+
+        int bin = 0;
+#ifdef OPENMP
+        bin = omp_get_thread_num();
+        omp_set_num_threads(1);
+#endif
+
+#pragma omp for schedule(dynamic, 1)
+        for (size_t entry_index = 0; entry_index < reader.db_index->n_entries; entry_index++) {
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(reader.db_index, entry_index);
+            if (entry == NULL) {
+                HH_LOG(WARNING) << "Could not open entry " << entry_index << " from input ffindex!" << std::endl;
+                continue;
+            }
+
+            FILE *inf = ffindex_fopen_by_entry(reader.db_data, entry);
+            if (inf == NULL) {
+                HH_LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
+                continue;
+            }
+
+            HH_LOG(INFO) << "Thread " << bin << "\t" << entry->name << std::endl;
+            app.run(inf, entry->name);
+
+#pragma omp critical
+            {
+                for (size_t i = 0; i < outputDatabases.size(); ++i) {
+                    outputDatabases[i].saveOutput(app, entry->name);
+                }
+            }
+
+            app.Reset();
+        }
+    }
+}
+
+#if !defined(HHSEARCH) && !defined(HHALIGN)
+// Prepares the queries of a block and does their first prefilter iteration in
+// a single pass over the cs219 databases, both with a team of all threads
+void prefilterBlock(FFindexDatabase &reader, const size_t block_start, std::vector<HHblits *> &block_apps,
+                    const int threads, std::vector<ffindex_entry_t *> &block_entries) {
+    const size_t block_size = block_apps.size();
+    std::vector<HMM *> block_queries(block_size, NULL);
+    block_entries.assign(block_size, NULL);
+
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+    for (size_t i = 0; i < block_size; i++) {
+        size_t entry_index = block_start + i;
+        ffindex_entry_t *entry = ffindex_get_entry_by_index(reader.db_index, entry_index);
+        FILE *inf = NULL;
+        if (entry == NULL) {
+            HH_LOG(WARNING) << "Could not open entry " << entry_index << " from input ffindex!" << std::endl;
+        } else if ((inf = ffindex_fopen_by_entry(reader.db_data, entry)) == NULL) {
+            HH_LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
+        } else {
+            block_apps[i]->prepareQuery(inf, entry->name);
+            fclose(inf);
+
+            block_entries[i] = entry;
+            block_queries[i] = block_apps[i]->getFirstPrefilterProfile();
+        }
+    }
+
+    std::vector<HMM *> queries;
+    std::vector<size_t> query_bins;
+    for (size_t i = 0; i < block_size; i++) {
+        if (block_queries[i] != NULL) {
+            queries.push_back(block_queries[i]);
+            query_bins.push_back(i);
+        }
+    }
+
+    if (!queries.empty()) {
+        std::vector<std::vector<HHEntry *> > prefilter_entries;
+        block_apps[0]->prefilterBatch(queries, threads, prefilter_entries);
+        for (size_t i = 0; i < queries.size(); i++) {
+            block_apps[query_bins[i]]->setFirstPrefilterHits(prefilter_entries[i]);
+        }
+    }
+}
+
+// Queries are prefiltered in blocks of one query per thread (see prefilterBlock),
+// then all threads search the queries of the block before the next block is prefiltered.
+// Prefilter and searches never run at the same time, so there are never more than
+// threads busy threads and one HHblits instance per thread, as in runPerQuery,
+// but each block waits for its slowest search before the next one is prefiltered.
+void runWithBatchedPrefilter(Parameters &par, std::vector<HHblitsDatabase *> &databases, FFindexDatabase &reader,
+                             const int threads, std::vector<OutputFFIndex> &outputDatabases,
+                             TemplateHMMCache &template_cache) {
+    std::vector<HHblits *> apps(threads, NULL);
+
+#pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < threads; i++) {
+        // HHblits holds 32 byte aligned score matrices, which plain new does not guarantee
+        void *memory = mem_align(ALIGN_INT, sizeof(HHblits));
+        apps[i] = new (memory) HHblits(par, databases, &template_cache);
+    }
+
+    const size_t n_entries = reader.db_index->n_entries;
+    for (size_t block_start = 0; block_start < n_entries; block_start += threads) {
+        const size_t block_size = std::min(n_entries - block_start, (size_t) threads);
+        std::vector<HHblits *> block_apps(apps.begin(), apps.begin() + block_size);
+        std::vector<ffindex_entry_t *> block_entries;
+        prefilterBlock(reader, block_start, block_apps, threads, block_entries);
+
+#pragma omp parallel num_threads(threads)
+        {
+            int bin = 0;
+#ifdef OPENMP
+            bin = omp_get_thread_num();
+            omp_set_num_threads(1);
+#endif
+
+#pragma omp for schedule(dynamic, 1)
+            for (size_t i = 0; i < block_size; i++) {
+                ffindex_entry_t *entry = block_entries[i];
+                if (entry == NULL) {
+                    continue;
+                }
+
+                HHblits *app = block_apps[i];
+                HH_LOG(INFO) << "Thread " << bin << "\t" << entry->name << std::endl;
+                app->search();
+
+#pragma omp critical
+                {
+                    for (size_t j = 0; j < outputDatabases.size(); ++j) {
+                        outputDatabases[j].saveOutput(*app, entry->name);
+                    }
+                }
+
+                app->Reset();
+            }
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        apps[i]->~HHblits();
+        free(apps[i]);
+    }
+}
+#endif
+
+#ifdef HH_MAIN
+// build for one instruction set, called by hhblits_dispatch.cpp
+extern "C" int HH_MAIN(int argc, const char **argv) {
+#else
 int main(int argc, const char **argv) {
+#endif
     Parameters par(argc, argv);
 #ifdef HHSEARCH
     HHsearch::ProcessAllArguments(par);
@@ -119,49 +279,20 @@ int main(int argc, const char **argv) {
     int threads = par.threads;
     par.threads = 1;
 
-#pragma omp parallel num_threads(threads)
-    {
-#ifdef HHSEARCH
-        HHblits app(par, databases);
-#elif HHALIGN
-        HHalign app(par);
-#else
-        HHblits app(par, databases);
-#endif
+    // templates found by several queries are read and prepared only once
+    TemplateHMMCache template_cache((size_t) (par.template_cache_mem * 1024 * 1024 * 1024));
 
-        int bin = 0;
-#ifdef OPENMP
-        bin = omp_get_thread_num();
-        omp_set_num_threads(1);
+#if !defined(HHSEARCH) && !defined(HHALIGN)
+    if (par.prefilter) {
+        runWithBatchedPrefilter(par, databases, reader, threads, outputDatabases, template_cache);
+    } else {
+        runPerQuery(par, databases, reader, threads, outputDatabases, template_cache);
+    }
+#else
+    runPerQuery(par, databases, reader, threads, outputDatabases, template_cache);
 #endif
 
-#pragma omp for schedule(dynamic, 1)
-        for (size_t entry_index = 0; entry_index < reader.db_index->n_entries; entry_index++) {
-            ffindex_entry_t *entry = ffindex_get_entry_by_index(reader.db_index, entry_index);
-            if (entry == NULL) {
-                HH_LOG(WARNING) << "Could not open entry " << entry_index << " from input ffindex!" << std::endl;
-                continue;
-            }
-
-            FILE *inf = ffindex_fopen_by_entry(reader.db_data, entry);
-            if (inf == NULL) {
-                HH_LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
-                continue;
-            }
-
-            HH_LOG(INFO) << "Thread " << bin << "\t" << entry->name << std::endl;
-            app.run(inf, entry->name);
-
-#pragma omp critical
-            {
-                for (size_t i = 0; i < outputDatabases.size(); ++i) {
-                    outputDatabases[i].saveOutput(app, entry->name);
-                }
-            }
-
-            app.Reset();
-        }
-    }
+    template_cache.printStatistics();
 
     for (size_t i = 0; i < outputDatabases.size(); ++i) {
         outputDatabases[i].close();
@@ -171,5 +302,6 @@ int main(int argc, const char **argv) {
         delete databases[i];
     }
     databases.clear();
-}
 
+    return 0;
+}
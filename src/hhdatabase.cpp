@@ -20,6 +20,7 @@
 #include "hhprefilter.h"
 #include "hhdecl.h"
 #include "hhhmm.h"
+#include "hhfunc.h"
 #include "util-inl.h"
 
 
@@ -121,6 +122,39 @@ HHblitsDatabase::HHblitsDatabase(const char* base, bool initCs219) {
     query_database = cs219_database;
   }
 
+  text_fingerprint = FILE_FINGERPRINT_SEED;
+  FFindexDatabase* text_databases[] = {hhm_database, a3m_database, ca3m_database,
+                                       sequence_database, header_database};
+  for (size_t i = 0; i < sizeof(text_databases) / sizeof(text_databases[0]); i++) {
+    if (text_databases[i] != NULL) {
+      text_fingerprint = file_fingerprint(text_fingerprint, text_databases[i]->data_filename);
+      text_fingerprint = file_fingerprint(text_fingerprint, text_databases[i]->index_filename);
+    }
+  }
+
+  hhmbin_database = NULL;
+
+  char hhmbin_index_filename[NAMELEN];
+  char hhmbin_data_filename[NAMELEN];
+
+  buildDatabaseName(base, "hhmbin", ".ffdata", hhmbin_data_filename);
+  buildDatabaseName(base, "hhmbin", ".ffindex", hhmbin_index_filename);
+
+  if (file_exists(hhmbin_data_filename) && file_exists(hhmbin_index_filename)) {
+    hhmbin_database = new FFindexDatabase(hhmbin_data_filename, hhmbin_index_filename, false);
+
+    // the text databases changed after hhmbin_build, or it was written by an older version
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(hhmbin_database->db_index, 0);
+    if (entry != NULL && !HMM::IsBinaryFromSource(ffindex_get_data_by_entry(hhmbin_database->db_data, entry),
+                                                  entry->length, text_fingerprint)) {
+      HH_LOG(WARNING) << hhmbin_data_filename << " does not match the text databases of " << base
+                      << ", the template HMMs are read from the text databases." << std::endl;
+      HH_LOG(WARNING) << "\tPlease rebuild the _hhmbin database with hhmbin_build." << std::endl;
+      delete hhmbin_database;
+      hhmbin_database = NULL;
+    }
+  }
+
   prefilter = NULL;
 }
 
@@ -137,17 +171,40 @@ HHblitsDatabase::~HHblitsDatabase() {
     delete hhm_database;
   }
 
+  delete hhmbin_database;
+
   if (prefilter) {
     delete prefilter;
   }
 }
 
-void HHblitsDatabase::initPrefilter(const std::string& cs_library) {
-  prefilter = new Prefilter(cs_library, cs219_database);
+void HHblitsDatabase::initPrefilter(std::vector<HHblitsDatabase*>& databases,
+                                    const std::string& cs_library) {
+  std::vector<FFindexDatabase*> cs219_databases;
+  std::vector<std::string> cs219_packed_filenames;
+  for (size_t d = 0; d < databases.size(); d++) {
+    cs219_databases.push_back(databases[d]->cs219_database);
+
+    // use the packed column state sequences written by cs219_pack if available
+    char cs219_packed_filename[NAMELEN];
+    buildDatabaseName(databases[d]->basename, "cs219", ".pack", cs219_packed_filename);
+    cs219_packed_filenames.push_back(
+        file_exists(cs219_packed_filename) ? std::string(cs219_packed_filename) : std::string());
+  }
+
+  databases[0]->prefilter = new Prefilter(cs_library, cs219_databases, cs219_packed_filenames);
+}
+
+void HHblitsDatabase::initPrefilterIndex(std::vector<HHblitsDatabase*>& databases) {
+  for (size_t d = 0; d < databases.size(); d++) {
+    char cs219_seed_index_filename[NAMELEN];
+    buildDatabaseName(databases[d]->basename, "cs219", ".idx", cs219_seed_index_filename);
+    databases[0]->prefilter->load_index(d, cs219_seed_index_filename);
+  }
 }
 
 void HHblitsDatabase::initNoPrefilter(std::vector<HHEntry*>& new_entries) {
-  std::vector<std::pair<int, std::string> > new_entry_names;
+  std::vector<PrefilterEntry> new_entry_names;
   Prefilter::init_no_prefiltering(query_database, new_entry_names);
 
   getEntriesFromNames(new_entry_names, new_entries);
@@ -156,14 +213,15 @@ void HHblitsDatabase::initNoPrefilter(std::vector<HHEntry*>& new_entries) {
 void HHblitsDatabase::initSelected(std::vector<std::string>& selected_templates,
                                    std::vector<HHEntry*>& new_entries) {
 
-  std::vector<std::pair<int, std::string> > new_entry_names;
+  std::vector<PrefilterEntry> new_entry_names;
   Prefilter::init_selected(cs219_database, selected_templates,
                                new_entry_names);
 
   getEntriesFromNames(new_entry_names, new_entries);
 }
 
-void HHblitsDatabase::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
+void HHblitsDatabase::prefilter_db(std::vector<HHblitsDatabase*>& databases,
+                                   HMM* q_tmp, Hash<Hit>* previous_hits,
                                    const int threads,
                                    const int prefilter_gap_open,
                                    const int prefilter_gap_extend,
@@ -177,10 +235,14 @@ void HHblitsDatabase::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
                                    std::vector<HHEntry*>& new_entries,
                                    std::vector<HHEntry*>& old_entries) {
 
-  std::vector<std::pair<int, std::string> > prefiltered_new_entry_names;
-  std::vector<std::pair<int, std::string> > prefiltered_old_entry_names;
+  if (databases.empty()) {
+    return;
+  }
+
+  std::vector<PrefilterEntry> prefiltered_new_entry_names;
+  std::vector<PrefilterEntry> prefiltered_old_entry_names;
 
-  prefilter->prefilter_db(q_tmp, previous_hits, threads, prefilter_gap_open,
+  databases[0]->prefilter->prefilter_db(q_tmp, previous_hits, threads, prefilter_gap_open,
                           prefilter_gap_extend, prefilter_score_offset,
                           prefilter_bit_factor, prefilter_evalue_thresh,
                           prefilter_evalue_coarse_thresh,
@@ -188,50 +250,179 @@ void HHblitsDatabase::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
                           maxnumbdb, R, prefiltered_new_entry_names,
                           prefiltered_old_entry_names);
 
-  getEntriesFromNames(prefiltered_new_entry_names, new_entries);
-  getEntriesFromNames(prefiltered_old_entry_names, old_entries);
+  getEntriesFromHits(databases, prefiltered_new_entry_names, new_entries);
+  getEntriesFromHits(databases, prefiltered_old_entry_names, old_entries);
 }
 
-void HHblitsDatabase::getEntriesFromNames(std::vector<std::pair<int, std::string>>& hits, std::vector<HHEntry*>& entries) {
+void HHblitsDatabase::prefilter_db_batch(std::vector<HHblitsDatabase*>& databases,
+                                         std::vector<HMM*>& q_tmps,
+                                         std::vector<Hash<Hit>*>& previous_hits,
+                                         const int threads,
+                                         const int prefilter_gap_open,
+                                         const int prefilter_gap_extend,
+                                         const int prefilter_score_offset,
+                                         const int prefilter_bit_factor,
+                                         const double prefilter_evalue_thresh,
+                                         const double prefilter_evalue_coarse_thresh,
+                                         const int preprefilter_smax_thresh,
+                                         const int min_prefilter_hits,
+                                         const int maxnumbdb, const float R[20][20],
+                                         std::vector<std::vector<HHEntry*> >& new_entries,
+                                         std::vector<std::vector<HHEntry*> >& old_entries) {
+
+  if (databases.empty()) {
+    return;
+  }
+
+  std::vector<std::vector<PrefilterEntry> > prefiltered_new_entry_names(q_tmps.size());
+  std::vector<std::vector<PrefilterEntry> > prefiltered_old_entry_names(q_tmps.size());
+
+  databases[0]->prefilter->prefilter_db_batch(q_tmps, previous_hits, threads, prefilter_gap_open,
+                                prefilter_gap_extend, prefilter_score_offset,
+                                prefilter_bit_factor, prefilter_evalue_thresh,
+                                prefilter_evalue_coarse_thresh,
+                                preprefilter_smax_thresh, min_prefilter_hits,
+                                maxnumbdb, R, prefiltered_new_entry_names,
+                                prefiltered_old_entry_names);
+
+  for (size_t b = 0; b < q_tmps.size(); b++) {
+    getEntriesFromHits(databases, prefiltered_new_entry_names[b], new_entries[b]);
+    getEntriesFromHits(databases, prefiltered_old_entry_names[b], old_entries[b]);
+  }
+}
+
+void HHblitsDatabase::getEntriesFromHits(std::vector<HHblitsDatabase*>& databases,
+                                         std::vector<PrefilterEntry>& hits,
+                                         std::vector<HHEntry*>& entries) {
   for (size_t i = 0; i < hits.size(); i++) {
-    ffindex_entry_t* entry;
+    HHEntry* hhentry = databases[hits[i].database]->getEntryFromName(hits[i]);
+    if (hhentry != NULL) {
+      entries.push_back(hhentry);
+    }
+  }
+}
 
-    if (hhm_database != NULL) {
-      entry = ffindex_get_entry_by_name(hhm_database->db_index, const_cast<char*>(hits[i].second.c_str()));
+void HHblitsDatabase::getEntriesFromNames(std::vector<PrefilterEntry>& hits, std::vector<HHEntry*>& entries) {
+  for (size_t i = 0; i < hits.size(); i++) {
+    HHEntry* hhentry = getEntryFromName(hits[i]);
+    if (hhentry != NULL) {
+      entries.push_back(hhentry);
+    }
+  }
+}
 
-      if (entry != NULL) {
-        HHEntry* hhentry = new HHDatabaseEntry(hits[i].first, this, hhm_database, entry);
-        entries.push_back(hhentry);
-        continue;
-      }
+HHEntry* HHblitsDatabase::getEntryFromName(const PrefilterEntry& hit) {
+  char* name = const_cast<char*>(hit.name.c_str());
+  ffindex_entry_t* entry;
+
+  // binary template HMMs are read instead of the text ones
+  if (hhmbin_database != NULL) {
+    entry = ffindex_get_entry_by_name(hhmbin_database->db_index, name);
+    if (entry != NULL) {
+      return new HHDatabaseEntry(hit.length, hit.diagonal, this, hhmbin_database, entry);
+    }
+  }
+
+  FFindexDatabase* ffdatabase;
+  if (findTemplateEntry(name, ffdatabase, entry)) {
+    return new HHDatabaseEntry(hit.length, hit.diagonal, this, ffdatabase, entry);
+  }
+
+  //TODO: error
+  if (use_compressed) {
+    HH_LOG(WARNING) << "Could not fetch entry from compressed a3m!" << std::endl;
+    HH_LOG(WARNING) << "\tentry: " << hit.name << std::endl;
+    HH_LOG(WARNING) << "\tdb: " << ca3m_database->data_filename << std::endl;
+  } else {
+    HH_LOG(WARNING) << "Could not fetch entry from a3m or hhm!" << std::endl;
+    HH_LOG(WARNING) << "\tentry: " << hit.name << std::endl;
+    HH_LOG(WARNING) << "\ta3m_db: " << a3m_database->data_filename << std::endl;
+    HH_LOG(WARNING) << "\thhm_db: " << hhm_database->data_filename << std::endl;
+  }
+  return NULL;
+}
+
+bool HHblitsDatabase::findTemplateEntry(const char* name, FFindexDatabase*& ffdatabase,
+                                        ffindex_entry_t*& entry) {
+  if (hhm_database != NULL) {
+    entry = ffindex_get_entry_by_name(hhm_database->db_index, const_cast<char*>(name));
+    if (entry != NULL) {
+      ffdatabase = hhm_database;
+      return true;
     }
+  }
 
-    if (use_compressed) {
-      entry = ffindex_get_entry_by_name(ca3m_database->db_index, const_cast<char *>(hits[i].second.c_str()));
-      if (entry == NULL) {
-        //TODO: error
-        HH_LOG(WARNING) << "Could not fetch entry from compressed a3m!" << std::endl;
-        HH_LOG(WARNING) << "\tentry: " << hits[i].second << std::endl;
-        HH_LOG(WARNING) << "\tdb: " << ca3m_database->data_filename << std::endl;
+  ffdatabase = use_compressed ? ca3m_database : a3m_database;
+  entry = ffindex_get_entry_by_name(ffdatabase->db_index, const_cast<char*>(name));
+  return entry != NULL;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Write the _hhmbin database, the text databases are read for all entries
+////////////////////////////////////////////////////////////////////////
+void HHblitsDatabase::buildTemplateProfiles(Parameters& par, float* pb, const float S[20][20],
+                                            const float Sim[20][20], const float R[20][20]) {
+  // the binary HMMs being replaced are not read
+  delete hhmbin_database;
+  hhmbin_database = NULL;
+
+  char hhmbin_index_filename[NAMELEN];
+  char hhmbin_data_filename[NAMELEN];
+  buildDatabaseName(basename, "hhmbin", ".ffdata", hhmbin_data_filename);
+  buildDatabaseName(basename, "hhmbin", ".ffindex", hhmbin_index_filename);
+
+  FILE* data_fh = fopen(hhmbin_data_filename, "w");
+  FILE* index_fh = fopen(hhmbin_index_filename, "w");
+  if (data_fh == NULL) {
+    OpenFileError(hhmbin_data_filename, __FILE__, __LINE__, __func__);
+  }
+  if (index_fh == NULL) {
+    OpenFileError(hhmbin_index_filename, __FILE__, __LINE__, __func__);
+  }
+  size_t offset = 0;
+
+  // the Viterbi runner reads templates with global weights
+  const char use_global_weights = 1;
+  const TemplateProfileParameters parameters(par, use_global_weights, par.qsc_db, pb);
+
+  const size_t n_entries = query_database->db_index->n_entries;
+  size_t n_written = 0;
+#pragma omp parallel
+  {
+    HMM t(MAXSEQDIS, par.maxres);
+    std::string out;
+
+#pragma omp for schedule(dynamic, 16)
+    for (size_t n = 0; n < n_entries; n++) {
+      ffindex_entry_t* query_entry = ffindex_get_entry_by_index(query_database->db_index, n);
+
+      FFindexDatabase* ffdatabase;
+      ffindex_entry_t* entry;
+      if (!findTemplateEntry(query_entry->name, ffdatabase, entry)) {
+        HH_LOG(WARNING) << "Could not fetch template " << query_entry->name << "!" << std::endl;
         continue;
       }
 
-      HHEntry *hhentry = new HHDatabaseEntry(hits[i].first, this, ca3m_database, entry);
-      entries.push_back(hhentry);
-    } else {
-      entry = ffindex_get_entry_by_name(a3m_database->db_index, const_cast<char*>(hits[i].second.c_str()));
-      if (entry == NULL) {
-        //TODO: error
-        HH_LOG(WARNING) << "Could not fetch entry from a3m or hhm!" << std::endl;
-        HH_LOG(WARNING) << "\tentry: " << hits[i].second << std::endl;
-        HH_LOG(WARNING) << "\ta3m_db: " << a3m_database->data_filename << std::endl;
-        HH_LOG(WARNING) << "\thhm_db: " << hhm_database->data_filename << std::endl;
-        continue;
+      HHDatabaseEntry hhentry(query_entry->length, PrefilterEntry::NO_DIAGONAL, this, ffdatabase, entry);
+      int format = 0;
+      hhentry.getTemplateHMM(par, use_global_weights, par.qsc_db, format, pb, S, Sim, &t);
+      PrepareTemplateProfile(par, &t, format, pb, R);
+      t.WriteBinary(out, format, parameters, text_fingerprint);
+
+#pragma omp critical(hhmbin_write)
+      {
+        ffindex_insert_memory(data_fh, index_fh, &offset, const_cast<char*>(out.data()),
+                              out.size(), entry->name);
+        n_written++;
       }
-      HHEntry* hhentry = new HHDatabaseEntry(hits[i].first, this, a3m_database, entry);
-      entries.push_back(hhentry);
     }
   }
+
+  fclose(data_fh);
+  fclose(index_fh);
+  ffsort_index(hhmbin_index_filename);
+
+  HH_LOG(INFO) << "Wrote " << n_written << " binary HMMs to " << hhmbin_data_filename << std::endl;
 }
 
 bool HHblitsDatabase::checkAndBuildCompressedDatabase(const char* base) {
@@ -277,17 +468,19 @@ bool HHblitsDatabase::checkAndBuildCompressedDatabase(const char* base) {
   return false;
 }
 
-HHEntry::HHEntry(int sequence_length) : sequence_length(sequence_length) {
+HHEntry::HHEntry(int sequence_length, int prefilter_diagonal)
+    : sequence_length(sequence_length), prefilter_diagonal(prefilter_diagonal) {
 }
 
 HHEntry::~HHEntry() {
 }
 
 HHDatabaseEntry::HHDatabaseEntry(int sequence_length,
+                                 int prefilter_diagonal,
                                  HHblitsDatabase* hhdatabase,
                                  FFindexDatabase* ffdatabase,
                                  ffindex_entry_t* entry)
-    : HHEntry(sequence_length) {
+    : HHEntry(sequence_length, prefilter_diagonal) {
   this->hhdatabase = hhdatabase;
   this->ffdatabase = ffdatabase;
   this->entry = entry;
@@ -300,6 +493,36 @@ void HHDatabaseEntry::getTemplateHMM(Parameters& par, char use_global_weights,
                                      const float qsc, int& format, float* pb,
                                      const float S[20][20],
                                      const float Sim[20][20], HMM* t) {
+  if (ffdatabase == hhdatabase->hhmbin_database) {
+    char* data = ffindex_get_data_by_entry(ffdatabase->db_data, entry);
+    int binary_format;
+    if (t->ReadBinary(data, entry->length, TemplateProfileParameters(par, use_global_weights, qsc, pb),
+                      hhdatabase->text_fingerprint, binary_format)) {
+      if (binary_format == 1) {
+        par.hmmer_used = true;
+      }
+      format = 2;
+      return;
+    }
+
+    // built with other parameters or from other text databases, read the text HMM or alignment
+    FFindexDatabase* text_database;
+    ffindex_entry_t* text_entry;
+    if (!hhdatabase->findTemplateEntry(entry->name, text_database, text_entry)) {
+      HH_LOG(ERROR) << "Could not fetch template " << entry->name << " without binary HMM!" << std::endl;
+      exit(4);
+    }
+    readTemplateHMM(text_database, text_entry, par, use_global_weights, qsc, format, pb, S, Sim, t);
+  } else {
+    readTemplateHMM(ffdatabase, entry, par, use_global_weights, qsc, format, pb, S, Sim, t);
+  }
+}
+
+void HHDatabaseEntry::readTemplateHMM(FFindexDatabase* ffdatabase, ffindex_entry_t* entry,
+                                      Parameters& par, char use_global_weights,
+                                      const float qsc, int& format, float* pb,
+                                      const float S[20][20],
+                                      const float Sim[20][20], HMM* t) {
   if (ffdatabase->isCompressed) {
     Alignment tali(par.maxseq, par.maxres);
 
@@ -461,6 +684,10 @@ char* HHDatabaseEntry::getName() {
   return entry->name;
 }
 
+const char* HHDatabaseEntry::getDatabaseName() {
+  return hhdatabase->basename;
+}
+
 HHFileEntry::HHFileEntry(const char* file, int sequence_length)
     : HHEntry(sequence_length), file(strdup(file)) {
 }
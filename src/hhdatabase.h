@@ -13,7 +13,9 @@ class HHDatabaseEntry;
 class Alignment;
 class Prefilter;
 
+#include <climits>
 #include <cstdlib>
+#include <string>
 
 #include "ffindexdatabase.h"
 #include "hhutil.h"
@@ -34,17 +36,40 @@ protected:
                                   const char* suffix, char* databaseName);
 };
 
+// database entry passing the prefilter: sequence length, name, the diagonal
+// (template minus query position) of its best prefilter alignment if known
+// and the index of its database among the prefiltered databases
+struct PrefilterEntry {
+  static const int NO_DIAGONAL = INT_MIN;
+
+  int length;
+  std::string name;
+  int diagonal;
+  int database;
+
+  PrefilterEntry(const int length, const std::string& name,
+      const int diagonal = NO_DIAGONAL, const int database = 0)
+      : length(length), name(name), diagonal(diagonal), database(database) {
+  }
+};
+
 class HHblitsDatabase: HHDatabase {
   public:
     HHblitsDatabase(const char* base, bool initCs219 = true);
     ~HHblitsDatabase();
 
-    void initPrefilter(const std::string& cs_library);
+    // one prefilter searches the column state sequences of all databases and
+    // ranks their hits together, it is owned by databases[0]
+    static void initPrefilter(std::vector<HHblitsDatabase*>& databases,
+        const std::string& cs_library);
+    static void initPrefilterIndex(std::vector<HHblitsDatabase*>& databases);
     void initNoPrefilter(std::vector<HHEntry*>& new_prefilter_hits);
     void initSelected(std::vector<std::string>& selected_templates,
         std::vector<HHEntry*>& new_entries);
 
-    void prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits, const int threads,
+    // entries of the hits in all databases, in the order of the global ranking
+    static void prefilter_db(std::vector<HHblitsDatabase*>& databases,
+        HMM* q_tmp, Hash<Hit>* previous_hits, const int threads,
         const int prefilter_gap_open, const int prefilter_gap_extend,
         const int prefilter_score_offset, const int prefilter_bit_factor,
         const double prefilter_evalue_thresh,
@@ -53,6 +78,26 @@ class HHblitsDatabase: HHDatabase {
         const float R[20][20], std::vector<HHEntry*>& new_entries,
         std::vector<HHEntry*>& old_entries);
 
+    static void prefilter_db_batch(std::vector<HHblitsDatabase*>& databases,
+        std::vector<HMM*>& q_tmps,
+        std::vector<Hash<Hit>*>& previous_hits, const int threads,
+        const int prefilter_gap_open, const int prefilter_gap_extend,
+        const int prefilter_score_offset, const int prefilter_bit_factor,
+        const double prefilter_evalue_thresh,
+        const double prefilter_evalue_coarse_thresh,
+        const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
+        const float R[20][20], std::vector<std::vector<HHEntry*> >& new_entries,
+        std::vector<std::vector<HHEntry*> >& old_entries);
+
+    // write the _hhmbin database: the template HMMs of the database after
+    // PrepareTemplateProfile, as read by the Viterbi runner (global weights)
+    void buildTemplateProfiles(Parameters& par, float* pb, const float S[20][20],
+        const float Sim[20][20], const float R[20][20]);
+
+    // text HMM or alignment of a template, false if it is not in the database
+    bool findTemplateEntry(const char* name, FFindexDatabase*& ffdatabase,
+        ffindex_entry_t*& entry);
+
     char* basename;
 
     FFindexDatabase* cs219_database;
@@ -67,9 +112,18 @@ class HHblitsDatabase: HHDatabase {
     FFindexDatabase* sequence_database;
     FFindexDatabase* header_database;
 
+    // optional binary template HMMs written by hhmbin_build
+    FFindexDatabase* hhmbin_database;
+    // fingerprint of the text databases the binary HMMs are built from (see file_fingerprint)
+    uint64_t text_fingerprint;
+
   private:
-    void getEntriesFromNames(std::vector<std::pair<int, std::string> >& names,
+    void getEntriesFromNames(std::vector<PrefilterEntry>& names,
         std::vector<HHEntry*>& entries);
+    // NULL if the entry is not in the database
+    HHEntry* getEntryFromName(const PrefilterEntry& hit);
+    static void getEntriesFromHits(std::vector<HHblitsDatabase*>& databases,
+        std::vector<PrefilterEntry>& hits, std::vector<HHEntry*>& entries);
     bool checkAndBuildCompressedDatabase(const char* base);
 
     Prefilter* prefilter;
@@ -78,8 +132,10 @@ class HHblitsDatabase: HHDatabase {
 class HHEntry {
   public:
     int sequence_length;
+    // diagonal of the best prefilter alignment, PrefilterEntry::NO_DIAGONAL if unknown
+    int prefilter_diagonal;
 
-    HHEntry(int sequence_length);
+    HHEntry(int sequence_length, int prefilter_diagonal = PrefilterEntry::NO_DIAGONAL);
     virtual ~HHEntry();
 
     virtual void getTemplateA3M(Parameters& par, float* pb, const float S[20][20],
@@ -88,6 +144,8 @@ class HHEntry {
         float* pb, const float S[20][20], const float Sim[20][20], HMM* t) {};
 
     virtual char* getName() {return NULL;};
+    // base name of the database holding the template, NULL for template files
+    virtual const char* getDatabaseName() {return NULL;};
 
   protected:
     void getTemplateHMM(FILE* inf, char* name, Parameters& par, char use_global_weights,
@@ -97,7 +155,8 @@ class HHEntry {
 
 class HHDatabaseEntry : public HHEntry {
   public:
-    HHDatabaseEntry(int sequence_length, HHblitsDatabase* hhdatabase, FFindexDatabase* ffdatabase, ffindex_entry_t* entry);
+    HHDatabaseEntry(int sequence_length, int prefilter_diagonal, HHblitsDatabase* hhdatabase,
+        FFindexDatabase* ffdatabase, ffindex_entry_t* entry);
     ~HHDatabaseEntry();
 
     void getTemplateA3M(Parameters& par, float* pb, const float S[20][20],
@@ -106,8 +165,13 @@ class HHDatabaseEntry : public HHEntry {
         float* pb, const float S[20][20], const float Sim[20][20], HMM* t);
 
     char* getName();
+    const char* getDatabaseName();
 
   private:
+    void readTemplateHMM(FFindexDatabase* ffdatabase, ffindex_entry_t* entry, Parameters& par,
+        char use_global_weights, const float qsc, int& format, float* pb,
+        const float S[20][20], const float Sim[20][20], HMM* t);
+
     HHblitsDatabase* hhdatabase;
     FFindexDatabase* ffdatabase;
     ffindex_entry_t* entry;
@@ -22,7 +22,10 @@ Parameters::Parameters(const int argc, const char** argv) : argc(argc), argv(arg
 	Z = 500;                   // max number of lines in hit list
 	e = 1e-3f; // maximum E-value for inclusion in output alignment, output HMM, and PSI-BLAST checkpoint model
 	realign_max = 500;        // Maximum number of HMM hits to realign
+	mac_simd = true;          // Realign several templates at once, one per SIMD lane
+	mac_band = 0;             // F/B/MAC on the full matrix
 	maxmem = 3.0;            // 3GB
+	template_cache_mem = 0.5; // 0.5GB
 	showcons = 1;              // show consensus sequence
 	showdssp = 1;              // show predicted secondary structure ss_dssp
 	showpred = 1;              // show predicted secondary structure ss_pred
@@ -125,6 +128,9 @@ Parameters::Parameters(const int argc, const char** argv) : argc(argc), argv(arg
 	prefilter_evalue_coarse_thresh = 100000;
 	preprefilter_smax_thresh = 10;
 	min_prefilter_hits = 100;
+	prefilter_index = false;
+	viterbi_band = 0;
+	viterbi_score_tile = true;
 
 	// For filtering database alignments in HHsearch and HHblits
 	//JS: What are these used for? They are set to the options without _db anyway.
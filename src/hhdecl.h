@@ -35,6 +35,7 @@ const int NCOLMIN=10;   //min number of cols in subalignment for calculating pos
 const int ANY=20;       //number representing an X (any amino acid) internally
 const int GAP=21;       //number representing a gap internally
 const int FWD_BKW_PATHWITDH=40;       //cell off path width around viterbi alignment
+const float MAC_BAND_BORDER_MASS=0.01; //max posterior probability on the border of the band of banded F/B/MAC before the band is widened
 const int ENDGAP=22;    //Important to distinguish because end gaps do not contribute to tansition counts
 const int HMMSCALE=1000;//Scaling number for log2-values in HMMs
 const int MAXPROF=32766;//Maximum number of HMM scores for fitting EVD
@@ -240,7 +241,10 @@ public:
   float shift;            // Score offset for match-match states
   double mact;            // Probability threshold (negative offset) in MAC alignment determining greediness at ends of alignment
   int realign_max;        // Realign max ... hits
+  bool mac_simd;          // realign hits of up to VECSIZE_FLOAT templates at once with the SIMD Forward/Backward/MAC
+  int mac_band;           // half width of the F/B/MAC band around the Viterbi alignment (0: full matrix)
   float maxmem;           // maximum available memory in GB for realignment (approximately)
+  float template_cache_mem; // memory in GB for the template HMMs shared by all queries of a process
 
   int min_overlap;        // all cells of dyn. programming matrix with L_T-j+i or L_Q-i+j < min_overlap will be ignored
   char notags;            // neutralize His-tags, FLAG tags, C-myc tags?
@@ -297,6 +301,9 @@ public:
   int preprefilter_smax_thresh;
 
   int min_prefilter_hits;
+  bool prefilter_index;       // use the seed index <db>_cs219.idx in the 1st prefilter
+  int viterbi_band;           // half width of the Viterbi band around the prefilter diagonal (0: full matrix)
+  bool viterbi_score_tile;    // precompute the Viterbi profile-profile scores in blocks of query rows
 
   size_t max_number_matrices;
 
@@ -10,22 +10,26 @@
 void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 		PosteriorMatrix & p_mm, ViterbiMatrix & celloff_matrix,
 		float shift, const int elem) {
-	int i, j;      // query and template match state indices
-	double pmin = (m_local ? 1.0 : 0.0); // used to distinguish between SW and NW algorithms in maximization
+	forwardFirstRow(q, t, p_mm, celloff_matrix, shift, elem);
+	forwardRows(q, t, hit, p_mm, celloff_matrix, shift, 2, q.L, elem);
+	forwardScore(q, t, hit, p_mm, m_fwd_scale_prod, elem);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Row 1 of the forward algorithm, m_prev holds the cells of row 1 afterwards
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardFirstRow(HMM & q, HMM & t, PosteriorMatrix & p_mm,
+		ViterbiMatrix & celloff_matrix, float shift, const int elem) {
+	int j;
 	double Cshift = pow(2.0, shift); // score offset transformed into factor in lin-space
-	double Pmax_i;                        // maximum of F_MM in row i
-	double scale_prod = 1.0;                // Prod_i=1^i (scale[i])
-	int jmin;
 
 	// Initialize F_XX_prev (representing i=1) andhit.P_MM[1]
 	// Initialize F_XX_prev (representing i=1) and P_MM[1][j]
-	for (j=1; j<=t.L; ++j)
-		m_curr[j].mm = 0.0;
+	// Cells outside of the band of a row stay zero
+	memset(m_curr, 0, (t.L + 2) * sizeof(PosteriorMatrixCol));
+	memset(m_prev, 0, (t.L + 2) * sizeof(PosteriorMatrixCol));
 
-	m_curr[0].mm = 0.0;
-	m_curr[0].im = 0.0;
-	m_curr[0].gd = 0.0;
-	for (j=1; j<=t.L; ++j)
+	for (j=m_band_lo[1]; j<=m_band_hi[1]; ++j)
 	{
 		if (celloff_matrix.getCellOff(1,j,elem))
 			m_curr[j].mm = m_curr[j].mi = m_curr[j].dg = m_curr[j].im = m_curr[j].gd = 0.0;
@@ -41,10 +45,9 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 		}
 	}
 
-	for (int j = 0; j <= t.L; j++)
+	for (int j = m_band_lo[1] - 1; j <= m_band_hi[1]; j++)
 	{
-		p_mm.setPosteriorValue(0,j, m_prev[j].mm);
-		p_mm.setPosteriorValue(1,j, m_curr[j].mm);
+		p_mm.setPosteriorValue(1, j, elem, m_curr[j].mm);
 		m_prev[j].mm = m_curr[j].mm;
 		m_prev[j].mi = m_curr[j].mi;
 		m_prev[j].im = m_curr[j].im;
@@ -53,11 +56,27 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 	}
 
 	scale[0] = scale[1] = scale[2] = 1.0;
+	m_fwd_pmin = (m_local ? 1.0 : 0.0); // used to distinguish between SW and NW algorithms in maximization
+	m_fwd_scale_prod = 1.0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Rows first ... last of the forward algorithm, continued from the cells of row
+// first-1 in m_prev and the state in m_fwd_pmin and m_fwd_scale_prod
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardRows(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+		ViterbiMatrix & celloff_matrix, float shift, const int first, const int last, const int elem) {
+	int i, j;      // query and template match state indices
+	double pmin = m_fwd_pmin;
+	double Cshift = pow(2.0, shift); // score offset transformed into factor in lin-space
+	double Pmax_i;                        // maximum of F_MM in row i
+	double scale_prod = m_fwd_scale_prod;   // Prod_i=1^i (scale[i])
+	int jmin;
 
 	// Forward algorithm
 
 	// Loop through query positions i
-	for (i = 2; i <= q.L; ++i) {
+	for (i = first; i <= last; ++i) {
 		if (hit.self)
 			jmin = imin(i + SELFEXCL + 1, t.L);
 		else
@@ -68,8 +87,17 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 		else
 			scale_prod *= scale[i];
 
+		// Columns of the row in the band; a band that starts behind jmin is entered
+		// with the general recursion from zero cells at jlo-1
+		const int jlo = imax(jmin, m_band_lo[i]);
+		const int jhi = m_band_hi[i];
+		int jrec = jlo + 1;
+		if (jlo > jmin) {
+			memset(m_curr + (jlo - 1), 0, sizeof(PosteriorMatrixCol));
+			jrec = jlo;
+		}
 		// Initialize cells at (i,0)
-		if (celloff_matrix.getCellOff(i, jmin, elem))
+		else if (celloff_matrix.getCellOff(i, jmin, elem))
 			m_curr[jmin].mm = m_curr[jmin].mi = m_curr[jmin].dg = m_curr[jmin].im =
 					m_curr[jmin].gd = 0.0;
 		else {
@@ -83,13 +111,10 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 					+ m_prev[jmin].dg * q.tr[i - 1][D2D]);
 		}
 
-		/* copy back */
-		p_mm.setPosteriorValue(i, jmin, m_curr[jmin].mm);
-
 		Pmax_i = 0;
-		memset(m_curr+(jmin + 1), 0, (t.L ) * sizeof(PosteriorMatrixCol));
+		memset(m_curr + jrec, 0, imax(0, jhi - jrec + 1) * sizeof(PosteriorMatrixCol));
 		// Loop through template positions j
-		for (j = jmin + 1; j <= t.L; ++j) {
+		for (j = jrec; j <= jhi; ++j) {
 
 			// Recursion relations
 			if (!(celloff_matrix.getCellOff(i, j, elem)))
@@ -126,9 +151,9 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 			} // end else
 
 		} //end for j
-		for (int jj = 0; jj <= t.L; jj++) {
+		for (int jj = jlo - 1; jj <= jhi; jj++) {
 			// Fill posterior probability matrix with forward score
-			p_mm.setPosteriorValue(i, jj, m_curr[jj].mm);
+			p_mm.setPosteriorValue(i, jj, elem, m_curr[jj].mm);
 		}
 		std::swap(m_prev, m_curr);
 		/* F_MM_prev = m_mm_curr */
@@ -143,66 +168,88 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
 
 	} // end for i
 
-// Calculate P_forward * Product_{i=1}^{Lq+1}(scale[i])
+	m_fwd_pmin = pmin;
+	m_fwd_scale_prod = scale_prod;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Forward probability, score and forward profile of a hit from the forward matrix
+// in p_mm and the row scales in scale
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardScore(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+		const double scale_prod, const int elem) {
+	hit.Pforward = (m_local ? 1.0 : 0.0); // local: alignment contains no residues (see Mueckstein, Stadler et al.)
+	forwardProbability(q, t, hit, p_mm, 1, q.L, elem);
+
+	forwardHitScore(q, t, hit);
+
+	forwardEntries(q, t, hit, p_mm, scale_prod, 1, q.L, elem);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Add the rows first ... last of the forward matrix to hit.Pforward, which is
+// P_forward * Product_{i=1}^{Lq+1}(scale[i]) after the last row
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardProbability(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+		const int first, const int last, const int elem) {
+	int i, j;
+	int jmin;
+
 	if (m_local) {
-		hit.Pforward  = 1.0; // alignment contains no residues (see Mueckstein, Stadler et al.)
 		// Loop through query positions i
-		for (i = 1; i <= q.L; ++i) {
+		for (i = first; i <= last; ++i) {
 			if (hit.self)
 				jmin = imin(i + SELFEXCL + 1, t.L);
 			else
 				jmin = 1;
 
-			for (j = jmin; j <= t.L; ++j) // Loop through template positions j
-				hit.Pforward  += p_mm.getPosteriorValue(i, j);
+			for (j = imax(jmin, m_band_lo[i]); j <= m_band_hi[i]; ++j) // Loop through template positions j
+				hit.Pforward  += p_mm.getPosteriorValue(i, j, elem);
 
 			hit.Pforward *= scale[i + 1];
 		}
 	} else { // global alignment
-		hit.Pforward  = 0.0;
-		for (i = 1; i < q.L; ++i)
-			hit.Pforward  = (hit.Pforward  + p_mm.getPosteriorValue(i, t.L) * scale[i + 1]);
-		for (j = 1; j <= t.L; ++j)
-			hit.Pforward  += p_mm.getPosteriorValue(q.L, j);
-		hit.Pforward  *= scale[q.L + 1];
-	}
-
-	// Calculate log2(P_forward)
-	hit.score = log2(hit.Pforward) - 10.0f;
-	for (i = 1; i <= q.L + 1; ++i)
-		hit.score -= log2(scale[i]);
-
-	if (m_local) {
-		if (hit.self)
-			hit.score -= log(0.5 * t.L * q.L) / LAMDA + 14.; // +14.0 to get approx same mean as for -global
-		else
-			hit.score -= log(t.L * q.L) / LAMDA + 14.; // +14.0 to get approx same mean as for -global
+		for (i = first; i <= imin(last, q.L - 1); ++i)
+			hit.Pforward  = (hit.Pforward  + p_mm.getPosteriorValue(i, t.L, elem) * scale[i + 1]);
+		if (last == q.L) {
+			for (j = 1; j <= t.L; ++j)
+				hit.Pforward  += p_mm.getPosteriorValue(q.L, j, elem);
+			hit.Pforward  *= scale[q.L + 1];
+		}
 	}
+}
 
-	//save forward profile
+/////////////////////////////////////////////////////////////////////////////////////
+// Save the forward profile of the rows first ... last, scale_prod is the product of
+// the scales of all rows. The rows are passed in ascending order starting with row 1.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardEntries(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+		const double scale_prod, const int first, const int last, const int elem) {
   double scale_rate;
-  double scale_prod_curr = 1.0;
   double ffprob = 0.0;
 
-  for (int i = 1; i <= q.L; i++) {
+  if (first == 1)
+    m_fwd_entries_scale_prod = 1.0;
+
+  for (int i = first; i <= last; i++) {
     int jmin;
     if (hit.self)
       jmin = imin(i + SELFEXCL + 1, t.L);
     else
       jmin = 1;
 
-    if (scale_prod_curr < DBL_MIN * 100)
-      scale_prod_curr = 0.0;
+    if (m_fwd_entries_scale_prod < DBL_MIN * 100)
+      m_fwd_entries_scale_prod = 0.0;
     else
-      scale_prod_curr *= scale[i];
+      m_fwd_entries_scale_prod *= scale[i];
 
-    for (int j = jmin; j <= t.L; j++) {
-      if (scale_prod_curr == 0.0)
+    for (int j = imax(jmin, m_band_lo[i]); j <= m_band_hi[i]; j++) {
+      if (m_fwd_entries_scale_prod == 0.0)
         scale_rate = 0.0;
       else
-        scale_rate = (scale_prod * scale[q.L + 1]) / scale_prod_curr;
+        scale_rate = (scale_prod * scale[q.L + 1]) / m_fwd_entries_scale_prod;
 
-      ffprob = (p_mm.getPosteriorValue(i, j) / hit.Pforward) * scale_rate;
+      ffprob = (p_mm.getPosteriorValue(i, j, elem) / hit.Pforward) * scale_rate;
 
       if(ffprob > m_back_forward_matrix_threshold) {
         MACTriple trip;
@@ -210,8 +257,267 @@ void PosteriorDecoder::forwardAlgorithm(HMM & q, HMM & t, Hit & hit,
         trip.j = j;
         trip.value = ffprob;
 
-        m_forward_entries.push_back(trip);
+        m_forward_entries[elem].push_back(trip);
       }
     }
   }
 }
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Score of a hit from hit.Pforward and the row scales in scale
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardHitScore(HMM & q, HMM & t, Hit & hit) {
+	// Calculate log2(P_forward)
+	hit.score = log2(hit.Pforward) - 10.0f;
+	for (int i = 1; i <= q.L + 1; ++i)
+		hit.score -= log2(scale[i]);
+
+	if (m_local) {
+		if (hit.self)
+			hit.score -= log(0.5 * t.L * q.L) / LAMDA + 14.; // +14.0 to get approx same mean as for -global
+		else
+			hit.score -= log(t.L * q.L) / LAMDA + 14.; // +14.0 to get approx same mean as for -global
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Forward algorithm of VECSIZE_FLOAT templates, one per lane. The lanes are computed
+// in double precision like the scalar version, the lower and upper half of the lanes
+// in two simd_double. Cells beyond the length of a template are turned off.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardAlgorithmSimd(HMM & q, HMMSimd & q_simd, std::vector<HMM *> & t_hmm, HMMSimd & t_simd,
+		std::vector<Hit *> & hits, PosteriorMatrix & p_mm, ViterbiMatrix & celloff_matrix, float shift) {
+	const int t_L = t_simd.L;
+	const simd_double zero = simdf64_setzero(0);
+	const simd_double one = simdf64_set(1.0);
+	const simd_double Cshift = simdf64_set(pow(2.0, shift)); // score offset transformed into factor in lin-space
+	const simd_double scale_min = simdf64_set(DBL_MIN * 100);
+	simd_double pmin[2];                  // used to distinguish between SW and NW algorithms in maximization
+	simd_double scale_prod[2];            // Prod_i=1^i (scale[i])
+	simd_double Pmax_i[2];                // maximum of F_MM in row i
+	for (int h = 0; h < 2; h++) {
+		pmin[h] = simdf64_set(m_local ? 1.0 : 0.0);
+		scale_prod[h] = one;
+	}
+	PosteriorMatrixColSimd * prev = m_prev_simd;
+	PosteriorMatrixColSimd * curr = m_curr_simd;
+
+	// Initialize F_XX_prev (representing i=1) and P_MM[1][j]
+	memset(p_mm.getRow(0), 0, (t_L + 1) * VECSIZE_FLOAT * sizeof(float));
+	memset(curr, 0, sizeof(PosteriorMatrixColSimd));
+	float * p_row = p_mm.getRow(1);
+	simdf32_store(p_row, simdf32_setzero(0));
+	{
+		const simd_double q_m2i = simdf64_set(q.tr[1][M2I]);
+		const simd_double q_i2i = simdf64_set(q.tr[1][I2I]);
+		for (int j = 1; j <= t_L; j++) {
+			const simd_int cell_off = celloff_matrix.getCellOffVec(1, j);
+			const simd_float P = ProbFwdSimd((simd_float *) q_simd.p[1], (simd_float *) t_simd.p[j]);
+			const simd_double P_d[2] = { simdf32_f2d_lo(P), simdf32_f2d_hi(P) };
+			const simd_double * t_tr_j_1 = m_t_tr_simd + (j - 1) * 7 * 2;
+			for (int h = 0; h < 2; h++) {
+				const simd_double off = (h == 0) ? simdi32_mask2d_lo(cell_off) : simdi32_mask2d_hi(cell_off);
+				const simd_double t_m2m = t_tr_j_1[TR_M2M * 2 + h];
+				curr[j].mm[h] = simdf64_andnot(off, simdf64_mul(P_d[h], Cshift));
+				curr[j].im[h] = simdf64_andnot(off, simdf64_add(
+						simdf64_mul(simdf64_mul(curr[j - 1].mm[h], q_m2i), t_m2m),
+						simdf64_mul(simdf64_mul(curr[j - 1].im[h], q_i2i), t_m2m)));
+				curr[j].gd[h] = simdf64_andnot(off, simdf64_add(
+						simdf64_mul(curr[j - 1].mm[h], t_tr_j_1[TR_M2D * 2 + h]),
+						simdf64_mul(curr[j - 1].gd[h], t_tr_j_1[TR_D2D * 2 + h])));
+				curr[j].mi[h] = curr[j].dg[h] = zero;
+			}
+			simdf32_store(p_row + j * VECSIZE_FLOAT, simdf64_d2f(curr[j].mm[0], curr[j].mm[1]));
+		}
+	}
+	std::swap(prev, curr);
+
+	for (int i = 0; i <= 2; i++) {
+		for (int elem = 0; elem < VECSIZE_FLOAT; elem++)
+			m_scale_simd[i * VECSIZE_FLOAT + elem] = 1.0;
+	}
+
+	// Loop through query positions i
+	for (int i = 2; i <= q.L; i++) {
+		simd_double scale_i[2];
+		for (int h = 0; h < 2; h++) {
+			scale_i[h] = simdf64_load(m_scale_simd + i * VECSIZE_FLOAT + h * VECSIZE_DOUBLE);
+			scale_prod[h] = simdf64_andnot(simdf64_lt(scale_prod[h], scale_min), simdf64_mul(scale_prod[h], scale_i[h]));
+			Pmax_i[h] = zero;
+		}
+		const simd_double q_m2m_1 = simdf64_set(q.tr[i - 1][M2M]);
+		const simd_double q_m2d_1 = simdf64_set(q.tr[i - 1][M2D]);
+		const simd_double q_d2m_1 = simdf64_set(q.tr[i - 1][D2M]);
+		const simd_double q_d2d_1 = simdf64_set(q.tr[i - 1][D2D]);
+		const simd_double q_i2m_1 = simdf64_set(q.tr[i - 1][I2M]);
+		const simd_double q_m2i = simdf64_set(q.tr[i][M2I]);
+		const simd_double q_i2i = simdf64_set(q.tr[i][I2I]);
+		const simd_float * q_p = (simd_float *) q_simd.p[i];
+		p_row = p_mm.getRow(i);
+		simdf32_store(p_row, simdf32_setzero(0));
+
+		// Initialize cells at (i,1)
+		{
+			const simd_int cell_off = celloff_matrix.getCellOffVec(i, 1);
+			const simd_float P = ProbFwdSimd(q_p, (simd_float *) t_simd.p[1]);
+			const simd_double P_d[2] = { simdf32_f2d_lo(P), simdf32_f2d_hi(P) };
+			const simd_double * t_tr_j = m_t_tr_simd + 1 * 7 * 2;
+			for (int h = 0; h < 2; h++) {
+				const simd_double off = (h == 0) ? simdi32_mask2d_lo(cell_off) : simdi32_mask2d_hi(cell_off);
+				curr[1].mm[h] = simdf64_andnot(off, simdf64_mul(simdf64_mul(scale_prod[h], P_d[h]), Cshift));
+				curr[1].im[h] = curr[1].gd[h] = zero;
+				curr[1].mi[h] = simdf64_andnot(off, simdf64_mul(scale_i[h], simdf64_add(
+						simdf64_mul(simdf64_mul(prev[1].mm[h], q_m2m_1), t_tr_j[TR_M2I * 2 + h]),
+						simdf64_mul(simdf64_mul(prev[1].mi[h], q_m2m_1), t_tr_j[TR_I2I * 2 + h]))));
+				curr[1].dg[h] = simdf64_andnot(off, simdf64_mul(scale_i[h], simdf64_add(
+						simdf64_mul(prev[1].mm[h], q_m2d_1),
+						simdf64_mul(prev[1].dg[h], q_d2d_1))));
+			}
+			simdf32_store(p_row + VECSIZE_FLOAT, simdf64_d2f(curr[1].mm[0], curr[1].mm[1]));
+		}
+
+		// Loop through template positions j
+		for (int j = 2; j <= t_L; j++) {
+			const simd_int cell_off = celloff_matrix.getCellOffVec(i, j);
+			const simd_float P = ProbFwdSimd(q_p, (simd_float *) t_simd.p[j]);
+			const simd_double P_d[2] = { simdf32_f2d_lo(P), simdf32_f2d_hi(P) };
+			const simd_double * t_tr_j_1 = m_t_tr_simd + (j - 1) * 7 * 2;
+			const simd_double * t_tr_j = m_t_tr_simd + j * 7 * 2;
+			for (int h = 0; h < 2; h++) {
+				const simd_double off = (h == 0) ? simdi32_mask2d_lo(cell_off) : simdi32_mask2d_hi(cell_off);
+				const simd_double t_m2m_1 = t_tr_j_1[TR_M2M * 2 + h];
+				// Recursion relations
+				simd_double mm = simdf64_add(pmin[h],
+						simdf64_mul(simdf64_mul(prev[j - 1].mm[h], q_m2m_1), t_m2m_1));                    // BB -> MM
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(prev[j - 1].gd[h], q_m2m_1), t_tr_j_1[TR_D2M * 2 + h])); // GD -> MM
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(prev[j - 1].im[h], q_i2m_1), t_m2m_1));                // IM -> MM
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(prev[j - 1].dg[h], q_d2m_1), t_m2m_1));                // DG -> MM
+				mm = simdf64_add(mm, simdf64_mul(simdf64_mul(prev[j - 1].mi[h], q_m2m_1), t_tr_j_1[TR_I2M * 2 + h])); // MI -> MM
+				mm = simdf64_mul(simdf64_mul(simdf64_mul(P_d[h], Cshift), scale_i[h]), mm);
+				curr[j].mm[h] = simdf64_andnot(off, mm);
+				curr[j].gd[h] = simdf64_andnot(off, simdf64_add(
+						simdf64_mul(curr[j - 1].mm[h], t_tr_j_1[TR_M2D * 2 + h]),          // GD -> MM
+						simdf64_mul(curr[j - 1].gd[h], t_tr_j_1[TR_D2D * 2 + h])));        // GD -> GD
+				curr[j].im[h] = simdf64_andnot(off, simdf64_add(
+						simdf64_mul(simdf64_mul(curr[j - 1].mm[h], q_m2i), t_m2m_1),       // MM -> IM
+						simdf64_mul(simdf64_mul(curr[j - 1].im[h], q_i2i), t_m2m_1)));     // IM -> IM
+				curr[j].dg[h] = simdf64_andnot(off, simdf64_mul(scale_i[h], simdf64_add(
+						simdf64_mul(prev[j].mm[h], q_m2d_1),                               // DG -> MM
+						simdf64_mul(prev[j].dg[h], q_d2d_1))));                            // DG -> DG
+				curr[j].mi[h] = simdf64_andnot(off, simdf64_mul(scale_i[h], simdf64_add(
+						simdf64_mul(simdf64_mul(prev[j].mm[h], q_m2m_1), t_tr_j[TR_M2I * 2 + h]),  // MI -> MM
+						simdf64_mul(simdf64_mul(prev[j].mi[h], q_m2m_1), t_tr_j[TR_I2I * 2 + h])))); // MI -> MI
+				Pmax_i[h] = simdf64_max(Pmax_i[h], curr[j].mm[h]);
+			}
+			// Fill posterior probability matrix with forward score
+			simdf32_store(p_row + j * VECSIZE_FLOAT, simdf64_d2f(curr[j].mm[0], curr[j].mm[1]));
+		}
+		std::swap(prev, curr);
+
+		for (int h = 0; h < 2; h++) {
+			pmin[h] = simdf64_mul(pmin[h], scale_i[h]);
+			pmin[h] = simdf64_andnot(simdf64_lt(pmin[h], scale_min), pmin[h]);
+			simdf64_store(m_scale_simd + (i + 1) * VECSIZE_FLOAT + h * VECSIZE_DOUBLE,
+					simdf64_div(one, simdf64_add(Pmax_i[h], one)));
+		}
+	}
+
+	forwardScoreSimd(q, t_hmm, hits, p_mm, t_L, scale_prod);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// forwardScore of VECSIZE_FLOAT templates, the lanes of p_mm are read in one pass
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardScoreSimd(HMM & q, std::vector<HMM *> & t_hmm, std::vector<Hit *> & hits,
+		PosteriorMatrix & p_mm, const int t_L, const simd_double * scale_prod) {
+	const simd_double zero = simdf64_setzero(0);
+	const simd_double one = simdf64_set(1.0);
+	const simd_double scale_min = simdf64_set(DBL_MIN * 100);
+	const simd_double threshold = simdf64_set(m_back_forward_matrix_threshold);
+
+	// Calculate P_forward * Product_{i=1}^{Lq+1}(scale[i])
+	double __attribute__((aligned(ALIGN_FLOAT))) p_forward_lanes[VECSIZE_FLOAT];
+	if (m_local) {
+		simd_double p_forward[2] = { one, one }; // alignment contains no residues (see Mueckstein, Stadler et al.)
+		for (int i = 1; i <= q.L; ++i) {
+			const float * p_row = p_mm.getRow(i);
+			// the cells beyond the length of a template are 0
+			for (int j = 1; j <= t_L; ++j) {
+				const simd_float p = simdf32_load(p_row + j * VECSIZE_FLOAT);
+				p_forward[0] = simdf64_add(p_forward[0], simdf32_f2d_lo(p));
+				p_forward[1] = simdf64_add(p_forward[1], simdf32_f2d_hi(p));
+			}
+			for (int h = 0; h < 2; h++) {
+				p_forward[h] = simdf64_mul(p_forward[h],
+						simdf64_load(m_scale_simd + (i + 1) * VECSIZE_FLOAT + h * VECSIZE_DOUBLE));
+			}
+		}
+		simdf64_store(p_forward_lanes, p_forward[0]);
+		simdf64_store(p_forward_lanes + VECSIZE_DOUBLE, p_forward[1]);
+	} else { // global alignment
+		for (size_t elem = 0; elem < hits.size(); elem++) {
+			const int L = t_hmm[elem]->L;
+			double p_forward = 0.0;
+			for (int i = 1; i < q.L; ++i)
+				p_forward = (p_forward + p_mm.getPosteriorValue(i, L, elem) * m_scale_simd[(i + 1) * VECSIZE_FLOAT + elem]);
+			for (int j = 1; j <= L; ++j)
+				p_forward += p_mm.getPosteriorValue(q.L, j, elem);
+			p_forward_lanes[elem] = p_forward * m_scale_simd[(q.L + 1) * VECSIZE_FLOAT + elem];
+		}
+	}
+
+	double __attribute__((aligned(ALIGN_FLOAT))) scale_end_lanes[VECSIZE_FLOAT];
+	simdf64_store(scale_end_lanes, scale_prod[0]);
+	simdf64_store(scale_end_lanes + VECSIZE_DOUBLE, scale_prod[1]);
+	for (int elem = 0; elem < VECSIZE_FLOAT; elem++) {
+		if (elem < (int) hits.size()) {
+			Hit & hit = *hits[elem];
+			hit.Pforward = p_forward_lanes[elem];
+			for (int i = 0; i <= q.L + 1; i++)
+				scale[i] = m_scale_simd[i * VECSIZE_FLOAT + elem];
+			forwardHitScore(q, *t_hmm[elem], hit);
+		} else {
+			p_forward_lanes[elem] = 1.0;
+		}
+		scale_end_lanes[elem] *= m_scale_simd[(q.L + 1) * VECSIZE_FLOAT + elem];
+	}
+
+	//save forward profile
+	simd_double p_forward[2];
+	simd_double scale_end[2];
+	simd_double scale_prod_curr[2];
+	for (int h = 0; h < 2; h++) {
+		p_forward[h] = simdf64_load(p_forward_lanes + h * VECSIZE_DOUBLE);
+		scale_end[h] = simdf64_load(scale_end_lanes + h * VECSIZE_DOUBLE);
+		scale_prod_curr[h] = one;
+	}
+	for (int i = 1; i <= q.L; i++) {
+		simd_double scale_rate[2];
+		for (int h = 0; h < 2; h++) {
+			const simd_double scale_i = simdf64_load(m_scale_simd + i * VECSIZE_FLOAT + h * VECSIZE_DOUBLE);
+			scale_prod_curr[h] = simdf64_andnot(simdf64_lt(scale_prod_curr[h], scale_min),
+					simdf64_mul(scale_prod_curr[h], scale_i));
+			scale_rate[h] = simdf64_and(simdf64_gt(scale_prod_curr[h], zero), simdf64_div(scale_end[h], scale_prod_curr[h]));
+		}
+		const float * p_row = p_mm.getRow(i);
+		for (int j = 1; j <= t_L; j++) {
+			const simd_float p = simdf32_load(p_row + j * VECSIZE_FLOAT);
+			const simd_double ffprob_lo = simdf64_mul(simdf64_div(simdf32_f2d_lo(p), p_forward[0]), scale_rate[0]);
+			const simd_double ffprob_hi = simdf64_mul(simdf64_div(simdf32_f2d_hi(p), p_forward[1]), scale_rate[1]);
+			unsigned int entries = simdf64_movemask(simdf64_gt(ffprob_lo, threshold))
+					| (simdf64_movemask(simdf64_gt(ffprob_hi, threshold)) << VECSIZE_DOUBLE);
+			if (!entries)
+				continue;
+			const simd_float ffprob = simdf64_d2f(ffprob_lo, ffprob_hi);
+			while (entries) {
+				const int elem = __builtin_ctz(entries);
+				entries &= entries - 1;
+				MACTriple trip;
+				trip.i = i;
+				trip.j = j;
+				trip.value = ((float *) &ffprob)[elem];
+				m_forward_entries[elem].push_back(trip);
+			}
+		}
+	}
+}
@@ -159,10 +159,10 @@ void PrepareQueryHMM(Parameters& par, char& input_format, HMM* q,
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-// Do precalculations for q and t to prepare comparison
+// Add pseudocounts to t, the query-independent part of PrepareTemplateHMM
 /////////////////////////////////////////////////////////////////////////////////////
-void PrepareTemplateHMM(Parameters& par, HMM* q, HMM* t, int format, float linear_tranistion_probs,
-    const float* pb, const float R[20][20]) {
+void PrepareTemplateProfile(Parameters& par, HMM* t, int format, const float* pb,
+    const float R[20][20]) {
   // HHM format
   if (format == 0) {
     // Add transition pseudocounts to template
@@ -190,6 +190,17 @@ void PrepareTemplateHMM(Parameters& par, HMM* q, HMM* t, int format, float linea
         par.pc_hhm_nocontext_b, par.pc_hhm_nocontext_c);
   }
   t->CalculateAminoAcidBackground(pb);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Do precalculations for q and t to prepare comparison
+/////////////////////////////////////////////////////////////////////////////////////
+void PrepareTemplateHMM(Parameters& par, HMM* q, HMM* t, int format, float linear_tranistion_probs,
+    const float* pb, const float R[20][20]) {
+  // format 2: binary profile of a _hhmbin database, prepared by PrepareTemplateProfile
+  if (format != 2) {
+    PrepareTemplateProfile(par, t, format, pb, R);
+  }
 
   if (linear_tranistion_probs)
     t->Log2LinTransitionProbs(1.0);
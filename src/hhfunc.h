@@ -24,7 +24,10 @@ void ReadQueryFile(Parameters& par, char* infile, char& input_format, char use_g
 void PrepareQueryHMM(Parameters& par, char& input_format, HMM* q, cs::Pseudocounts<cs::AA>* pc_hhm_context_engine, cs::Admix* pc_hhm_context_mode,
 		const float* pb, const float R[20][20]);
 
-// Do precalculations for q and t to prepare comparison
+// Add transition and amino acid pseudocounts to template HMM (as stored in a _hhmbin database)
+void PrepareTemplateProfile(Parameters& par, HMM* t, int format, const float* pb, const float R[20][20]);
+
+// Do precalculations for q and t to prepare comparison (format 2: t was read from a _hhmbin database)
 void PrepareTemplateHMM(Parameters& par, HMM* q, HMM* t, int format, float linear_tranistion_probs, const float* pb, const float R[20][20]);
 
 // Read number of sequences in annotation, after second '|'
@@ -2292,6 +2292,282 @@ void HMM::WriteToFile(std::stringstream& out, const int max_seqid,
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Binary HMMs of a _hhmbin database
+/////////////////////////////////////////////////////////////////////////////////////
+static const char HMMBIN_MAGIC[8] = {'H', 'H', 'M', 'B', 'I', 'N', '0', '2'};
+static const size_t HMMBIN_ALIGNMENT = 64;
+
+struct HMMBinHeader {
+	char magic[8];
+	int32_t format;
+	int32_t L;
+	int32_t N_in;
+	int32_t N_filtered;
+	int32_t n_display;
+	int32_t n_seqs;
+	int32_t ncons;
+	int32_t nfirst;
+	int32_t nss_dssp;
+	int32_t nsa_dssp;
+	int32_t nss_pred;
+	int32_t nss_conf;
+	int32_t trans_lin;
+	int32_t has_pseudocounts;
+	int32_t divided_by_local_bg_freqs;
+	float Neff_HMM;
+	float lamda;
+	float mu;
+	float pav[NAA];
+	uint64_t strings_size;
+	uint64_t source;
+	char parameters[sizeof(TemplateProfileParameters)];
+};
+
+TemplateProfileParameters::TemplateProfileParameters(const Parameters& par,
+		const char use_global_weights, const float qsc, const float* pb) {
+	memset(this, 0, sizeof(TemplateProfileParameters));
+	this->use_global_weights = use_global_weights;
+	matrix = par.matrix;
+	maxcol = par.maxcol;
+	nseqdis = par.nseqdis;
+	mark = par.mark;
+	cons = par.cons;
+	showcons = par.showcons;
+	M_template = par.M_template;
+	Mgaps = par.Mgaps;
+	max_seqid_db = par.max_seqid_db;
+	coverage_db = par.coverage_db;
+	qid_db = par.qid_db;
+	Ndiff_db = par.Ndiff_db;
+	pc_hhm_nocontext_mode = par.pc_hhm_nocontext_mode;
+	this->qsc = qsc;
+	pc_hhm_nocontext_a = par.pc_hhm_nocontext_a;
+	pc_hhm_nocontext_b = par.pc_hhm_nocontext_b;
+	pc_hhm_nocontext_c = par.pc_hhm_nocontext_c;
+	gapb = par.gapb;
+	gapd = par.gapd;
+	gape = par.gape;
+	gapf = par.gapf;
+	gapg = par.gapg;
+	gaph = par.gaph;
+	gapi = par.gapi;
+	for (int a = 0; a < NAA; ++a)
+		this->pb[a] = pb[a];
+}
+
+static void hmmbin_append(std::string& out, const void* data, const size_t size) {
+	out.append((const char*) data, size);
+	out.append((HMMBIN_ALIGNMENT - out.size() % HMMBIN_ALIGNMENT) % HMMBIN_ALIGNMENT, '\0');
+}
+
+// NULL if the section does not end before end, position stays NULL for all following sections
+static const char* hmmbin_section(const char*& position, const size_t size, const char* end) {
+	const char* section = position;
+	if (position == NULL || position > end || size > (size_t) (end - position)) {
+		position = NULL;
+		return NULL;
+	}
+	position += (size + HMMBIN_ALIGNMENT - 1) / HMMBIN_ALIGNMENT * HMMBIN_ALIGNMENT;
+	return section;
+}
+
+void HMM::WriteBinary(std::string& out, const int format,
+		const TemplateProfileParameters& parameters, const uint64_t source) {
+	HMMBinHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HMMBIN_MAGIC, sizeof(HMMBIN_MAGIC));
+	header.format = format;
+	header.L = L;
+	header.N_in = N_in;
+	header.N_filtered = N_filtered;
+	header.n_display = n_display;
+	header.n_seqs = n_seqs;
+	header.ncons = ncons;
+	header.nfirst = nfirst;
+	header.nss_dssp = nss_dssp;
+	header.nsa_dssp = nsa_dssp;
+	header.nss_pred = nss_pred;
+	header.nss_conf = nss_conf;
+	header.trans_lin = trans_lin;
+	header.has_pseudocounts = has_pseudocounts;
+	header.divided_by_local_bg_freqs = divided_by_local_bg_freqs;
+	header.Neff_HMM = Neff_HMM;
+	header.lamda = lamda;
+	header.mu = mu;
+	for (int a = 0; a < NAA; ++a)
+		header.pav[a] = pav[a];
+	header.source = source;
+	memcpy(header.parameters, &parameters, sizeof(TemplateProfileParameters));
+
+	// names and display sequences, zero terminated
+	std::string strings;
+	const char* names[] = {longname, name, file, fam, sfam, fold, cl};
+	for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++)
+		strings.append(names[k], strlen(names[k]) + 1);
+	for (int k = 0; k < n_seqs; k++) {
+		strings.append(sname[k], strlen(sname[k]) + 1);
+		strings.append(seq[k], strlen(seq[k]) + 1);
+	}
+	header.strings_size = strings.size();
+
+	const int rows = L + 2;
+	std::vector<float> profile(rows * NAA);
+	std::vector<float> transitions(rows * NTRANS);
+
+	out.clear();
+	hmmbin_append(out, &header, sizeof(header));
+	float** profiles[] = {f, g, p};
+	for (size_t k = 0; k < sizeof(profiles) / sizeof(profiles[0]); k++) {
+		for (int i = 0; i < rows; ++i)
+			memcpy(&profile[i * NAA], profiles[k][i], NAA * sizeof(float));
+		hmmbin_append(out, &profile[0], rows * NAA * sizeof(float));
+	}
+	for (int i = 0; i < rows; ++i)
+		memcpy(&transitions[i * NTRANS], tr[i], NTRANS * sizeof(float));
+	hmmbin_append(out, &transitions[0], rows * NTRANS * sizeof(float));
+	hmmbin_append(out, Neff_M, rows * sizeof(float));
+	hmmbin_append(out, Neff_I, rows * sizeof(float));
+	hmmbin_append(out, Neff_D, rows * sizeof(float));
+	hmmbin_append(out, l, rows * sizeof(int));
+	hmmbin_append(out, ss_dssp, rows);
+	hmmbin_append(out, sa_dssp, rows);
+	hmmbin_append(out, ss_pred, rows);
+	hmmbin_append(out, ss_conf, rows);
+	// with at least one zero byte of padding: ffindex terminates every entry with
+	// a zero byte instead, the next entry stays aligned
+	hmmbin_append(out, strings.c_str(), strings.size() + 1);
+	out.resize(out.size() - 1);
+}
+
+bool HMM::IsBinaryFromSource(const char* data, const size_t size, const uint64_t source) {
+	const HMMBinHeader* header = (const HMMBinHeader*) data;
+	return size >= sizeof(HMMBinHeader)
+			&& memcmp(header->magic, HMMBIN_MAGIC, sizeof(HMMBIN_MAGIC)) == 0
+			&& header->source == source;
+}
+
+bool HMM::ReadBinary(const char* data, const size_t size,
+		const TemplateProfileParameters& parameters, const uint64_t source, int& format) {
+	const HMMBinHeader* header = (const HMMBinHeader*) data;
+	if (size < sizeof(HMMBinHeader)
+			|| memcmp(header->magic, HMMBIN_MAGIC, sizeof(HMMBIN_MAGIC)) != 0) {
+		HH_LOG(WARNING) << "Entry is not a binary HMM, reading the text entry instead." << std::endl;
+		HH_LOG(WARNING) << "\tPlease rebuild the _hhmbin database with hhmbin_build." << std::endl;
+		return false;
+	}
+	if (header->source != source
+			|| memcmp(header->parameters, &parameters, sizeof(TemplateProfileParameters)) != 0)
+		return false;
+	// the text reader truncates such HMMs to maxres - 2 columns and warns
+	if (header->L < 0 || header->L + 2 > maxres || header->n_seqs < 0 || header->n_seqs > maxseqdis)
+		return false;
+
+	// locate all sections before anything is changed, a truncated entry is read from the text database
+	const int rows = header->L + 2;
+	const char* end = data + size;
+	const char* position = data;
+	hmmbin_section(position, sizeof(HMMBinHeader), end);
+	const float* profiles_data[3];
+	for (size_t k = 0; k < 3; k++)
+		profiles_data[k] = (const float*) hmmbin_section(position, rows * NAA * sizeof(float), end);
+	const float* transitions = (const float*) hmmbin_section(position, rows * NTRANS * sizeof(float), end);
+	const char* Neff_data[3];
+	for (size_t k = 0; k < 3; k++)
+		Neff_data[k] = hmmbin_section(position, rows * sizeof(float), end);
+	const char* l_data = hmmbin_section(position, rows * sizeof(int), end);
+	const char* ss_data[4];
+	for (size_t k = 0; k < 4; k++)
+		ss_data[k] = hmmbin_section(position, rows, end);
+	const char* strings = hmmbin_section(position, header->strings_size, end);
+	// 7 names and a name and sequence per displayed sequence, zero terminated
+	if (strings == NULL
+			|| std::count(strings, strings + header->strings_size, '\0') < 7 + 2 * header->n_seqs) {
+		HH_LOG(WARNING) << "Binary HMM is truncated, reading the text entry instead." << std::endl;
+		HH_LOG(WARNING) << "\tPlease rebuild the _hhmbin database with hhmbin_build." << std::endl;
+		return false;
+	}
+
+	//Delete name and seq matrices
+	if (!dont_delete_seqs) // Delete all sname and seq if no flat copy to hit object has been made
+	{
+		for (int k = 0; k < n_seqs; k++)
+			delete[] sname[k];
+		for (int k = 0; k < n_seqs; k++)
+			delete[] seq[k];
+	} else // Otherwise, delete only sequences not diplayed (lost otherwise)
+	{
+		if (n_seqs > n_display) {
+			for (int k = n_display; k < n_seqs; k++)
+				delete[] sname[k];
+			for (int k = n_display; k < n_seqs; k++)
+				delete[] seq[k];
+		}
+	}
+
+	format = header->format;
+	L = header->L;
+	N_in = header->N_in;
+	N_filtered = header->N_filtered;
+	n_display = header->n_display;
+	n_seqs = header->n_seqs;
+	ncons = header->ncons;
+	nfirst = header->nfirst;
+	nss_dssp = header->nss_dssp;
+	nsa_dssp = header->nsa_dssp;
+	nss_pred = header->nss_pred;
+	nss_conf = header->nss_conf;
+	trans_lin = header->trans_lin;
+	has_pseudocounts = header->has_pseudocounts;
+	divided_by_local_bg_freqs = header->divided_by_local_bg_freqs;
+	dont_delete_seqs = false;
+	Neff_HMM = header->Neff_HMM;
+	lamda = header->lamda;
+	mu = header->mu;
+	for (int a = 0; a < NAA; ++a)
+		pav[a] = header->pav[a];
+
+	float** profiles[] = {f, g, p};
+	for (size_t k = 0; k < sizeof(profiles) / sizeof(profiles[0]); k++) {
+		for (int i = 0; i < rows; ++i)
+			memcpy(profiles[k][i], profiles_data[k] + i * NAA, NAA * sizeof(float));
+	}
+	for (int i = 0; i < rows; ++i)
+		memcpy(tr[i], transitions + i * NTRANS, NTRANS * sizeof(float));
+	memcpy(Neff_M, Neff_data[0], rows * sizeof(float));
+	memcpy(Neff_I, Neff_data[1], rows * sizeof(float));
+	memcpy(Neff_D, Neff_data[2], rows * sizeof(float));
+	memcpy(l, l_data, rows * sizeof(int));
+	memcpy(ss_dssp, ss_data[0], rows);
+	memcpy(sa_dssp, ss_data[1], rows);
+	memcpy(ss_pred, ss_data[2], rows);
+	memcpy(ss_conf, ss_data[3], rows);
+
+	strmcpy(longname, strings, DESCLEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(name, strings, NAMELEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(file, strings, NAMELEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(fam, strings, NAMELEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(sfam, strings, IDLEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(fold, strings, IDLEN - 1);
+	strings += strlen(strings) + 1;
+	strmcpy(cl, strings, IDLEN - 1);
+	strings += strlen(strings) + 1;
+	for (int k = 0; k < n_seqs; k++) {
+		sname[k] = new char[strlen(strings) + 1];
+		strcpy(sname[k], strings);
+		strings += strlen(strings) + 1;
+		seq[k] = new char[strlen(strings) + 1];
+		strcpy(seq[k], strings);
+		strings += strlen(strings) + 1;
+	}
+	return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Transform log to lin transition probs
 /////////////////////////////////////////////////////////////////////////////////////
@@ -16,6 +16,34 @@ class HMM;
 #include "hhutil.h"
 #include "log.h"
 
+// Parameters a template profile depends on before its query-dependent preparation
+// (see PrepareTemplateProfile), stored with every profile of a _hhmbin database
+struct TemplateProfileParameters {
+  int32_t use_global_weights;
+  int32_t matrix;
+  int32_t maxcol;
+  int32_t nseqdis;
+  int32_t mark;
+  int32_t cons;
+  int32_t showcons;
+  int32_t M_template;
+  int32_t Mgaps;
+  int32_t max_seqid_db;
+  int32_t coverage_db;
+  int32_t qid_db;
+  int32_t Ndiff_db;
+  int32_t pc_hhm_nocontext_mode;
+  float qsc;
+  float pc_hhm_nocontext_a;
+  float pc_hhm_nocontext_b;
+  float pc_hhm_nocontext_c;
+  float gapb, gapd, gape, gapf, gapg, gaph, gapi;
+  float pb[NAA];
+
+  TemplateProfileParameters(const Parameters& par, const char use_global_weights,
+                            const float qsc, const float* pb);
+};
+
 class HMM {
  public:
   HMM(int maxseqdis, int maxres);
@@ -121,6 +149,18 @@ class HMM {
                    const float qsc, const int argc, const char** argv,
                    const float* pb);
 
+  // Write the HMM in the binary format of a _hhmbin database (format of the source profile:
+  // 0 hhm or alignment, 1 HMMER), all arrays start at multiples of 64 bytes.
+  // source is the fingerprint of the text databases the HMM was read from (0 if none)
+  void WriteBinary(std::string& out, const int format,
+                   const TemplateProfileParameters& parameters, const uint64_t source);
+  // Read a binary HMM written by WriteBinary, false if it was built with other parameters, from
+  // another source, does not fit into maxres/maxseqdis or is truncated: read the text HMM instead
+  bool ReadBinary(const char* data, const size_t size,
+                  const TemplateProfileParameters& parameters, const uint64_t source, int& format);
+  // true if the binary HMM was written from the given source
+  static bool IsBinaryFromSource(const char* data, const size_t size, const uint64_t source);
+
   // Transform log to lin transition probs
   void Log2LinTransitionProbs(float beta = 1.0);
 
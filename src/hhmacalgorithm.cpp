@@ -16,6 +16,31 @@ if (var4>max)  { max=var4; varb=ViterbiMatrix::IM;};
 
 void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
         PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix, float par_mact,  const int elem) {
+    macFirstRow(t, hit, viterbi_matrix, elem);
+    macRows(q, t, hit, p_mm, viterbi_matrix, par_mact, 1, q.L, elem);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Top row of the MAC algorithm, i.e. cells (0,j), in m_mac_prev
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::macFirstRow(HMM & t, Hit & hit, ViterbiMatrix & viterbi_matrix, const int elem) {
+    // Initialization of top row, i.e. cells (0,j)
+    for (int j=0; j <= t.L; ++j)
+        m_mac_prev[j] = 0.0;
+
+    m_score_mac = -FLT_MAX;
+    hit.i2 = hit.j2 = 0;
+    //	hit.bMM[0][0] = STOP;	//
+    viterbi_matrix.setMatMat(0, 0, elem, ViterbiMatrix::STOP);
+    hit.min_overlap = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Rows first ... last of the MAC algorithm, continued from the scores of row first-1
+// in m_mac_prev. The best cell so far is in (hit.i2,hit.j2) with score m_score_mac.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::macRows(HMM & q, HMM & t, Hit & hit, PosteriorMatrix & p_mm,
+        ViterbiMatrix & viterbi_matrix, float par_mact, const int first, const int last, const int elem) {
 
     // Use Forward and Backward matrices to find that alignment which
     // maximizes the expected number of correctly aligned pairs of residues (mact=0)
@@ -26,32 +51,16 @@ void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
 
     int i,j;           // query and template match state indices
     int jmin,jmax;     // range of dynamic programming for j
-    float S_prev[t.L + 1];    // scores
-    float S_curr[t.L + 1];    // scores
-    float score_MAC;   // score of the best MAC alignment
-
-    //	fprintf(stdout, "%s\n", t.name);
-    //	char * nam = "PF07714";
-    //	bool eq = false;
-    //	if (!strcmp(t.name, nam)) {
-    //		eq = true;
-    //	}
+    float * S_prev = m_mac_prev;    // scores
+    float * S_curr = m_mac_curr;    // scores
+    float score_MAC = m_score_mac;   // score of the best MAC alignment
 
     float term1, term2, term3, term4 = 0.0f;
 
-    // Initialization of top row, i.e. cells (0,j)
-    for (j=0; j <= t.L; ++j)
-        S_prev[j] = 0.0;
-
-    score_MAC = -FLT_MAX;
-    hit.i2 = hit.j2 = 0;
-    //	hit.bMM[0][0] = STOP;	//
-    viterbi_matrix.setMatMat(0, 0, elem, ViterbiMatrix::STOP);
     //	char * c_ptr = new char;
     char val;
-    hit.min_overlap = 0;
     // Dynamic programming
-    for (i = 1; i <= q.L; ++i) { // Loop through query positions i
+    for (i = first; i <= last; ++i) { // Loop through query positions i
         // If q is compared to t, exclude regions where overlap of q with t < min_overlap residues
         jmin = imax( 1, i + hit.min_overlap - q.L);  // Lq-i+j>=Ovlap => j>=i+Ovlap-Lq => jmin=max{1, i+Ovlap-Lq}
         jmax = imin(t.L, i - hit.min_overlap + t.L);  // Lt-j+i>=Ovlap => j<=i-Ovlap+Lt => jmax=min{Lt,i-Ovlap+Lt}
@@ -61,8 +70,14 @@ void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
         if (jmax < t.L)
             S_prev[jmax] = 0.0; // initialize at (i-1,jmax) if upper right triagonal is excluded due to min overlap
 
+        // Cells left of the band are turned off
+        if (m_band_lo[i] > 1) {
+            S_curr[m_band_lo[i] - 1] = -FLT_MIN;
+            viterbi_matrix.setMatMat(i, m_band_lo[i] - 1, elem, ViterbiMatrix::STOP);
+        }
+
         //		for (j = jmin; j <= jmax; ++j) { // Loop through template positions j
-        for (j = 1; j <= t.L; ++j) { // Loop through template positions j
+        for (j = m_band_lo[i]; j <= m_band_hi[i]; ++j) { // Loop through template positions j
             //			hit.bMM[i][j] = 0x00;	//
             viterbi_matrix.setMatMat(i, j, elem, 0x00);
             //			printf("hit.bMM[%i][%i]: %i; m: %i\n", i, j, hit.bMM[i][j], viterbi_matrix.getMatMat(i, j, elem));
@@ -77,9 +92,9 @@ void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
                 //				unsigned char c = viterbi_matrix.getMatMat(i, j, elem);
                 // NOT the state before the first MM state)
                 //				term1 = fpow2(p_mm.getPosteriorValue(i, j, elem)) - par.mact;
-                term1 = p_mm.getPosteriorValue(i, j) - par_mact;
+                term1 = p_mm.getPosteriorValue(i, j, elem) - par_mact;
                 //				term2 = S_prev[j-1] + fpow2(p_mm.getPosteriorValue(i, j, elem)) - par.mact;
-                term2 = S_prev[j-1] + p_mm.getPosteriorValue(i, j) - par_mact;
+                term2 = S_prev[j-1] + p_mm.getPosteriorValue(i, j, elem) - par_mact;
                 term3 = S_prev[j] - 0.5 * par_mact;
                 term4 = S_curr[j-1] - 0.5 * par_mact;
 
@@ -146,10 +161,17 @@ void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
             score_MAC = S_curr[jmax];
         }
 
-        for (j = 0; j <= t.L; ++j)
+        for (j = m_band_lo[i] - 1; j <= m_band_hi[i]; ++j)
             S_prev[j] = S_curr[j];
+        // Cells right of the band that are read in the next row are turned off
+        for (j = m_band_hi[i] + 1; j <= m_band_hi[i + 1]; ++j) {
+            S_prev[j] = -FLT_MIN;
+            viterbi_matrix.setMatMat(i, j, elem, ViterbiMatrix::STOP);
+        }
     } // end for i
 
+    m_score_mac = score_MAC;
+
     /*
      // DEBUG
      if (v>=5)
@@ -178,4 +200,97 @@ void PosteriorDecoder::macAlgorithm(HMM & q, HMM & t, Hit & hit,
 
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// MAC algorithm of VECSIZE_FLOAT templates, one per lane. The columns beyond the
+// length of a template are turned off and do not change its best cell.
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::macAlgorithmSimd(HMM & q, std::vector<HMM *> & t_hmm, HMMSimd & t_simd, std::vector<Hit *> & hits,
+        PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix, float par_mact) {
+
+    const int t_L = t_simd.L;
+    simd_float * S_prev = m_s_prev_simd;    // scores
+    simd_float * S_curr = m_s_curr_simd;    // scores
+    const simd_float mact = simdf32_set(par_mact);
+    const simd_float mact_gap = simdf32_set(0.5f * par_mact);
+    const simd_float cell_off_score = simdf32_set(-FLT_MIN);
+    const simd_int state_mm = simdi32_set(ViterbiMatrix::MM);
+    const simd_int state_mi = simdi32_set(ViterbiMatrix::MI);
+    const simd_int state_im = simdi32_set(ViterbiMatrix::IM);
+
+    simd_float score_MAC = simdf32_set(-FLT_MAX);   // score of the best MAC alignment
+    simd_int i2 = simdi32_set(0);
+    simd_int j2 = simdi32_set(0);
+
+    // Initialization of top row, i.e. cells (0,j)
+    for (int j = 0; j <= t_L; ++j)
+        S_prev[j] = simdf32_setzero(0);
+    S_curr[0] = simdf32_setzero(0);
+
+    for (size_t elem = 0; elem < hits.size(); elem++) {
+        hits[elem]->min_overlap = 0;
+        viterbi_matrix.setMatMat(0, 0, elem, ViterbiMatrix::STOP);
+    }
+
+    // Dynamic programming
+    for (int i = 1; i <= q.L; ++i) { // Loop through query positions i
+        const float * p_row = p_mm.getRow(i);
+        const simd_int i_vec = simdi32_set(i);
+        const bool update_score = m_local || i == q.L;
+
+        for (int j = 1; j <= t_L; ++j) { // Loop through template positions j
+            const simd_float cell_off = simdi_i2fcast(viterbi_matrix.getCellOffVec(i, j));
+            const simd_float p = simdf32_load(p_row + j * VECSIZE_FLOAT);
+
+            // Recursion
+            const simd_float term1 = simdf32_sub(p, mact);
+            const simd_float term2 = simdf32_sub(simdf32_add(S_prev[j - 1], p), mact);
+            const simd_float term3 = simdf32_sub(S_prev[j], mact_gap);
+            const simd_float term4 = simdf32_sub(S_curr[j - 1], mact_gap);
+
+            // same ties as CALCULATE_MAX4 of the scalar version
+            simd_int state = simdi_andnot(simdf_f2icast(simdf32_gt(term1, term2)), state_mm);
+            simd_float max = simdf32_max(term1, term2);
+            simd_int gt = simdf_f2icast(simdf32_gt(term3, max));
+            state = simdi_or(simdi_and(gt, state_mi), simdi_andnot(gt, state));
+            max = simdf32_max(term3, max);
+            gt = simdf_f2icast(simdf32_gt(term4, max));
+            state = simdi_or(simdi_and(gt, state_im), simdi_andnot(gt, state));
+            max = simdf32_max(term4, max);
+
+            S_curr[j] = simdf32_or(simdf32_and(cell_off, cell_off_score), simdf32_andnot(cell_off, max));
+            viterbi_matrix.setMatMatVec(i, j, simdi_andnot(simdf_f2icast(cell_off), state));
+
+            // Find maximum score; global alignment: maximize only over last row and last column
+            if (update_score) {
+                const simd_float better = simdf32_andnot(cell_off, simdf32_gt(S_curr[j], score_MAC));
+                const simd_int better_int = simdf_f2icast(better);
+                score_MAC = simdf32_or(simdf32_and(better, S_curr[j]), simdf32_andnot(better, score_MAC));
+                i2 = simdi_or(simdi_and(better_int, i_vec), simdi_andnot(better_int, i2));
+                j2 = simdi_or(simdi_and(better_int, simdi32_set(j)), simdi_andnot(better_int, j2));
+            }
+        } //end for j
+
+        // if global alignment: look for best cell in last column
+        if (!m_local) {
+            for (size_t elem = 0; elem < hits.size(); elem++) {
+                const int jmax = t_hmm[elem]->L;
+                const float S_last = ((float *) &S_curr[jmax])[elem];
+                if (S_last > ((float *) &score_MAC)[elem]) {
+                    ((float *) &score_MAC)[elem] = S_last;
+                    ((int *) &i2)[elem] = i;
+                    ((int *) &j2)[elem] = jmax;
+                }
+            }
+        }
+
+        std::swap(S_prev, S_curr);
+        S_curr[0] = simdf32_setzero(0);
+    } // end for i
+
+    for (size_t elem = 0; elem < hits.size(); elem++) {
+        hits[elem]->i2 = ((int *) &i2)[elem];
+        hits[elem]->j2 = ((int *) &j2)[elem];
+    }
+}
+
 #undef CALCULATE_MAX4
@@ -0,0 +1,69 @@
+/*
+ * hhmbin_build.cpp
+ *
+ * Writes the binary template HMMs of a database, which hhblits and hhsearch
+ * read instead of parsing the hhm or a3m entries and adding pseudocounts.
+ */
+
+#include "hhdatabase.h"
+#include "hhdecl.h"
+#include "hhmatrices.h"
+#include "log.h"
+
+#include <iostream>
+#include <getopt.h>
+#include <string>
+
+void usage() {
+  std::cout << "hhmbin_build -i [ffindex_db_prefix]" << std::endl;
+  std::cout << "  Writes [ffindex_db_prefix]_hhmbin.ffdata/.ffindex from the hhm, a3m or ca3m ffindex of the database." << std::endl;
+  std::cout << "  The HMMs are built with the default template parameters of hhblits, searches with other" << std::endl;
+  std::cout << "  template or pseudocount parameters read the text entries. Rerun after changing the database." << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool iflag = false;
+  std::string db_prefix;
+
+  int c;
+  while ((c = getopt(argc, argv, "i:h")) != -1) {
+    switch (c) {
+      case 'i':
+        iflag = true;
+        db_prefix = optarg;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (optopt == 'i')
+          fprintf(stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!iflag) {
+    usage();
+    exit(0);
+  }
+
+  Parameters par(argc, (const char**) argv);
+
+  float pb[21];
+  float P[20][20];
+  float R[20][20];
+  float S[20][20];
+  float Sim[20][20];
+  SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
+
+  HHblitsDatabase database(db_prefix.c_str());
+  database.buildTemplateProfiles(par, pb, S, Sim, R);
+
+  return 0;
+}
@@ -9,10 +9,12 @@
  *  Info:
  *		This class contains the needed algorithms to perform the
  *		MAC algorithm:
- *			+ Forward (scalar linear),
- *			+ Backward (scalar linear),
- *			+ MAC (scalar linear) and
+ *			+ Forward (scalar linear / SIMD linear),
+ *			+ Backward (scalar linear / SIMD linear),
+ *			+ MAC (scalar linear / SIMD linear) and
  *			+ MAC backtrace (scalar).
+ *		The SIMD versions realign the hits of up to VECSIZE_FLOAT templates
+ *		at once, one template per lane.
  *
  *		The realign method is called by the posterior consumer thread.
  *		It prepares all needed matrices and parameters. This includes the
@@ -53,6 +55,9 @@ PosteriorDecoder::PosteriorDecoder(int maxres, bool local, int q_length, const f
 	this->m_s_curr = (double*) malloc_simd_float((m_max_res + 2 ) * sizeof(double));
 	this->m_s_prev = (double*) malloc_simd_float((m_max_res + 2 ) * sizeof(double));
 
+	this->m_mac_curr = (float*) malloc_simd_float((m_max_res + 2 ) * sizeof(float));
+	this->m_mac_prev = (float*) malloc_simd_float((m_max_res + 2 ) * sizeof(float));
+
 	this->p_last_col = (double*) malloc_simd_float(q_length * sizeof(double));
 
 	//m_p_min = (m_local ? simdf32_set(0.0f) : simdf32_set(-FLT_MAX));
@@ -60,11 +65,30 @@ PosteriorDecoder::PosteriorDecoder(int maxres, bool local, int q_length, const f
 	this->m_p_forward = malloc_simd_float( sizeof(float));
 
 	this->m_back_forward_matrix_threshold = 0.0001;
-	this->m_backward_entries.clear();
-	this->m_forward_entries.clear();
 
 	this->scale = new double[q_length + 2];
-	this->m_temp_hit = new Hit;
+	this->m_band_lo = new int[q_length + 2];
+	this->m_band_hi = new int[q_length + 2];
+	this->m_band_first = new int[q_length + 2];
+	this->m_band_last = new int[q_length + 2];
+	this->m_temp_hit = new Hit[VECSIZE_FLOAT];
+
+	this->m_prev_simd = NULL;
+	this->m_curr_simd = NULL;
+	this->m_t_tr_simd = NULL;
+	this->m_p_prev_simd = NULL;
+	this->m_p_curr_simd = NULL;
+	this->m_s_prev_simd = NULL;
+	this->m_s_curr_simd = NULL;
+	this->m_scale_simd = (double *) malloc_simd_float((q_length + 2) * VECSIZE_FLOAT * sizeof(double));
+	this->m_simd_max_res = 0;
+
+	this->m_fwd_checkpoints = NULL;
+	this->m_bwd_checkpoints = NULL;
+	this->m_fwd_checkpoint_state = NULL;
+	this->m_bwd_checkpoint_state = NULL;
+	this->m_mac_checkpoints = NULL;
+	this->m_checkpoint_cols = 0;
 }
 
 PosteriorDecoder::~PosteriorDecoder() {
@@ -72,26 +96,96 @@ PosteriorDecoder::~PosteriorDecoder() {
 	free(m_prev);
 	free(m_s_curr);
 	free(m_s_prev);
+	free(m_mac_curr);
+	free(m_mac_prev);
 	free(p_last_col);
 	free(m_p_forward);
 
 	delete [] scale;
-	delete m_temp_hit;
+	delete [] m_band_lo;
+	delete [] m_band_hi;
+	delete [] m_band_first;
+	delete [] m_band_last;
+	delete [] m_temp_hit;
+
+	free(m_prev_simd);
+	free(m_curr_simd);
+	free(m_t_tr_simd);
+	free(m_p_prev_simd);
+	free(m_p_curr_simd);
+	free(m_s_prev_simd);
+	free(m_s_curr_simd);
+	free(m_scale_simd);
+
+	free(m_fwd_checkpoints);
+	free(m_bwd_checkpoints);
+	free(m_fwd_checkpoint_state);
+	free(m_bwd_checkpoint_state);
+	free(m_mac_checkpoints);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Grow the buffers of the SIMD algorithms to templates of length t_max_L
+/////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::allocateSimdBuffers(const int t_max_L) {
+	if (t_max_L <= m_simd_max_res)
+		return;
+
+	free(m_prev_simd);
+	free(m_curr_simd);
+	free(m_t_tr_simd);
+	free(m_p_prev_simd);
+	free(m_p_curr_simd);
+	free(m_s_prev_simd);
+	free(m_s_curr_simd);
+
+	m_simd_max_res = t_max_L;
+	const size_t cols = m_simd_max_res + 2;
+	m_prev_simd = (PosteriorMatrixColSimd *) malloc_simd_float(cols * sizeof(PosteriorMatrixColSimd));
+	m_curr_simd = (PosteriorMatrixColSimd *) malloc_simd_float(cols * sizeof(PosteriorMatrixColSimd));
+	m_t_tr_simd = (simd_double *) malloc_simd_float(cols * 7 * 2 * sizeof(simd_double));
+	m_p_prev_simd = malloc_simd_float(cols * sizeof(simd_float));
+	m_p_curr_simd = malloc_simd_float(cols * sizeof(simd_float));
+	m_s_prev_simd = malloc_simd_float(cols * sizeof(simd_float));
+	m_s_curr_simd = malloc_simd_float(cols * sizeof(simd_float));
+	if (!m_prev_simd || !m_curr_simd || !m_t_tr_simd || !m_p_prev_simd || !m_p_curr_simd
+			|| !m_s_prev_simd || !m_s_curr_simd)
+		MemoryError("SIMD posterior decoder", __FILE__, __LINE__, __func__);
 }
 
 
 /////////////////////////////////////////////////////////////////////////////////////
-// Realign hits: compute F/B/MAC and MAC-backtrace algorithms
+// Realign hits: compute F/B/MAC and MAC-backtrace algorithms.
+// With par_mac_band > 0 (local alignment), F/B/MAC are restricted to a band of
+// half width par_mac_band around the Viterbi alignment, which is doubled while
+// the posterior probabilities on the border of the band exceed MAC_BAND_BORDER_MASS.
+// Templates that do not fit into the ViterbiMatrix are realigned with checkpoints.
 /////////////////////////////////////////////////////////////////////////////////////
 void PosteriorDecoder::realign(HMM &q, HMM &t, Hit &hit,
 							   PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
 							   std::vector<PosteriorDecoder::MACBacktraceResult> alignment_to_exclude,
-							   char * exclstr, char* template_exclstr, int par_min_overlap, float shift, float mact, float corr) {
+							   char * exclstr, char* template_exclstr, int par_min_overlap, int par_mac_band,
+							   float shift, float mact, float corr) {
 
 	HMM & curr_q_hmm = q;
 	HMM & curr_t_hmm = t;
-	memorizeHitValues(hit);
-	initializeForAlignment(curr_q_hmm, curr_t_hmm, hit, viterbi_matrix, 0, t.L, par_min_overlap);
+	viterbi_matrix.SetAlignmentSize(q.L, t.L);
+	const bool checkpointed = viterbi_matrix.isCheckpointed();
+	bool banded = (par_mac_band > 0 && m_local && !hit.self && hit.nsteps > 0 && !checkpointed);
+	if (banded) {
+		banded = !setViterbiBand(q.L, t.L, hit, par_mac_band);
+	}
+	if (banded) {
+		setBandedPosteriorMatrix(q.L, p_mm);
+	} else if (checkpointed) {
+		setFullBand(q.L, t.L);
+		p_mm.SetSegmentRows(q.L, t.L, viterbi_matrix.getSegmentLastRow(0));
+	} else {
+		setFullBand(q.L, t.L);
+		p_mm.SetAlignmentSize(q.L, t.L, 1);
+	}
+	memorizeHitValues(hit, 0);
+	initializeForAlignment(curr_q_hmm, curr_t_hmm, hit, viterbi_matrix, 0, t.L, par_min_overlap, banded);
 	for (size_t ibt = 0; ibt < alignment_to_exclude.size(); ibt++) {
 		// Mask out previous found MAC alignments
 		excludeMACAlignment(q.L, hit.L, viterbi_matrix, 0, alignment_to_exclude.at(ibt));
@@ -99,27 +193,113 @@ void PosteriorDecoder::realign(HMM &q, HMM &t, Hit &hit,
 
 	if(exclstr) {
 		// Mask excluded regions
-		exclude_regions(exclstr, curr_q_hmm, curr_t_hmm, viterbi_matrix);
+		exclude_regions(exclstr, curr_q_hmm, curr_t_hmm, viterbi_matrix, 0);
 	}
         
         if(template_exclstr) {
                  // Mask excluded regions
-                 exclude_template_regions(template_exclstr, curr_q_hmm, curr_t_hmm, viterbi_matrix);
+                 exclude_template_regions(template_exclstr, curr_q_hmm, curr_t_hmm, viterbi_matrix, 0);
         }
 
+	if (checkpointed) {
+		realignCheckpointed(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, shift, mact, corr);
+		restoreHitValues(hit, 0);
+		writeProfilesToHits(curr_q_hmm, 0, hit);
+		return;
+	}
+
 	forwardAlgorithm(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, shift, 0);
 	//std::cout << hit->score << hit[elem]->Pforward << std::endl;
 
 	backwardAlgorithm(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, shift, 0);
+
+	// Widen the band while too much posterior probability sits on its border
+	for (int width = 2 * par_mac_band; banded && bandBorderMass(q.L, t.L, p_mm) > MAC_BAND_BORDER_MASS; width *= 2) {
+		if (setViterbiBand(q.L, t.L, hit, width)) {
+			setFullBand(q.L, t.L);
+			p_mm.SetAlignmentSize(q.L, t.L, 1);
+			banded = false;
+		} else {
+			setBandedPosteriorMatrix(q.L, p_mm);
+		}
+		m_forward_entries[0].clear();
+		m_backward_entries[0].clear();
+		forwardAlgorithm(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, shift, 0);
+		backwardAlgorithm(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, shift, 0);
+	}
+
 	macAlgorithm(curr_q_hmm, curr_t_hmm, hit, p_mm, viterbi_matrix, mact, 0);
 	backtraceMAC(curr_q_hmm, curr_t_hmm, p_mm, viterbi_matrix, 0, hit, corr);
-	restoreHitValues(hit);
-	writeProfilesToHits(curr_q_hmm, curr_t_hmm, p_mm, viterbi_matrix, hit);
+	restoreHitValues(hit, 0);
+	posteriorEntries(p_mm, viterbi_matrix, 0, 1, q.L);
+	writeProfilesToHits(curr_q_hmm, 0, hit);
 	// add result to exclution paths (needed to align 2nd, 3rd, ... best alignment)
 
 }
 
-void PosteriorDecoder::exclude_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix) {
+void PosteriorDecoder::realign(HMM &q, HMMSimd &q_simd, std::vector<HMM *> &t, HMMSimd &t_simd,
+							   std::vector<Hit *> &hits, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+							   std::vector<std::vector<PosteriorDecoder::MACBacktraceResult> > &alignment_to_exclude,
+							   char * exclstr, char* template_exclstr, int par_min_overlap, float shift, float mact, float corr) {
+
+	const int lanes = hits.size();
+	int t_max_L = 0;
+	for (int elem = 0; elem < lanes; elem++)
+		t_max_L = imax(t_max_L, t[elem]->L);
+
+	allocateSimdBuffers(t_max_L);
+	// the templates of a batch fit into the ViterbiMatrix (see PosteriorDecoderRunner)
+	viterbi_matrix.SetAlignmentSize(q.L, t_max_L);
+	p_mm.SetAlignmentSize(q.L, t_max_L, VECSIZE_FLOAT);
+
+	for (int elem = 0; elem < lanes; elem++) {
+		memorizeHitValues(*hits[elem], elem);
+		initializeForAlignment(q, *t[elem], *hits[elem], viterbi_matrix, elem, t_max_L, par_min_overlap, false);
+		for (size_t ibt = 0; ibt < alignment_to_exclude[elem].size(); ibt++) {
+			// Mask out previous found MAC alignments
+			excludeMACAlignment(q.L, hits[elem]->L, viterbi_matrix, elem, alignment_to_exclude[elem].at(ibt));
+		}
+		if(exclstr) {
+			exclude_regions(exclstr, q, *t[elem], viterbi_matrix, elem);
+		}
+		if(template_exclstr) {
+			exclude_template_regions(template_exclstr, q, *t[elem], viterbi_matrix, elem);
+		}
+	}
+	// unused lanes take part in the computation with all cells turned off
+	for (int elem = lanes; elem < VECSIZE_FLOAT; elem++) {
+		for (int i = 0; i <= q.L; i++) {
+			for (int j = 0; j <= t_max_L; j++) {
+				viterbi_matrix.setCellOff(i, j, elem, true);
+			}
+		}
+	}
+
+	// initializeForAlignment has set the begin and end transitions of the templates
+	t_simd.MapHMMVector(t);
+	// the recursions of F/B are computed in double precision
+	for (int j = 0; j <= t_max_L; j++) {
+		for (int idx = 0; idx < 7; idx++) {
+			const simd_float tr = simdf32_load((float *) (t_simd.tr + j * 7 + idx));
+			m_t_tr_simd[(j * 7 + idx) * 2 + 0] = simdf32_f2d_lo(tr);
+			m_t_tr_simd[(j * 7 + idx) * 2 + 1] = simdf32_f2d_hi(tr);
+		}
+	}
+
+	forwardAlgorithmSimd(q, q_simd, t, t_simd, hits, p_mm, viterbi_matrix, shift);
+	backwardAlgorithmSimd(q, q_simd, t, t_simd, hits, p_mm, viterbi_matrix, shift);
+	macAlgorithmSimd(q, t, t_simd, hits, p_mm, viterbi_matrix, mact);
+
+	for (int elem = 0; elem < lanes; elem++) {
+		backtraceMAC(q, *t[elem], p_mm, viterbi_matrix, elem, *hits[elem], corr);
+		restoreHitValues(*hits[elem], elem);
+		setFullBand(q.L, t[elem]->L);
+		posteriorEntries(p_mm, viterbi_matrix, elem, 1, q.L);
+		writeProfilesToHits(q, elem, *hits[elem]);
+	}
+}
+
+void PosteriorDecoder::exclude_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix, const int elem) {
 	char* ptr = exclstr;
 	while (true) {
 		const int i0 = abs(strint(ptr));
@@ -129,13 +309,13 @@ void PosteriorDecoder::exclude_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm,
 
 		for (int i = i0; i <= std::min(i1, q_hmm.L); ++i) {
 			for (int j = 1; j <= t_hmm.L; ++j) {
-				viterbiMatrix.setCellOff(i, j, 0, true);
+				viterbiMatrix.setCellOff(i, j, elem, true);
 			}
 		}
 	}
 }
 
-void PosteriorDecoder::exclude_template_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix) {
+void PosteriorDecoder::exclude_template_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix, const int elem) {
         char* ptr = exclstr;
         while (true) {
                 const int j0 = abs(strint(ptr));
@@ -145,7 +325,7 @@ void PosteriorDecoder::exclude_template_regions(char* exclstr, HMM & q_hmm, HMM
 
                 for (int j = j0; j <= std::min(j1, t_hmm.L); ++j) {
                         for (int i = 1; i <= q_hmm.L; ++i) {
-                                viterbiMatrix.setCellOff(i, j, 0, true);
+                                viterbiMatrix.setCellOff(i, j, elem, true);
                         }
                 }
         }
@@ -160,10 +340,11 @@ void PosteriorDecoder::exclude_template_regions(char* exclstr, HMM & q_hmm, HMM
 //			--> Initialization of cell off matrix
 /////////////////////////////////////////////////////////////////////////////////////////////////
 void PosteriorDecoder::initializeForAlignment(HMM &q, HMM &t, Hit &hit, ViterbiMatrix &celloff_matrix,
-											  const int elem, const int t_max_L, int par_min_overlap) {
+											  const int elem, const int t_max_L, int par_min_overlap, const bool banded) {
 
-	m_backward_entries.clear();
-	m_forward_entries.clear();
+	m_backward_entries[elem].clear();
+	m_forward_entries[elem].clear();
+	m_posterior_entries[elem].clear();
 
 	// First alignment of this pair of HMMs?
 	t.tr[0][M2M] = 1.0f;
@@ -187,12 +368,18 @@ void PosteriorDecoder::initializeForAlignment(HMM &q, HMM &t, Hit &hit, ViterbiM
 	hit.alt_j = new std::vector<int>();
 	hit.realign_around_viterbi = true;
 
-	// Call Viterbi - InitializeForAlignment
-	Viterbi::InitializeForAlignment(&q, &t, &celloff_matrix, elem, hit.self, par_min_overlap);
-
-	// Mask out the Viterbi alignment of the current hit
-	if (hit.realign_around_viterbi) {
-		maskViterbiAlignment(q.L, t.L, celloff_matrix, elem, hit);
+	if (celloff_matrix.isCheckpointed()) {
+		// The Viterbi alignment is masked out by maskViterbiAlignmentRows when the rows of a segment
+		// are computed, the mask replaces the cells turned off by Viterbi::InitializeForAlignment
+		celloff_matrix.setCellOff(true);
+	} else {
+		// Call Viterbi - InitializeForAlignment
+		Viterbi::InitializeForAlignment(&q, &t, &celloff_matrix, elem, hit.self, par_min_overlap);
+
+		// Mask out the Viterbi alignment of the current hit (a band around it restricts the computation instead)
+		if (hit.realign_around_viterbi && !banded) {
+			maskViterbiAlignment(q.L, t.L, celloff_matrix, elem, hit);
+		}
 	}
 
 	// Mask out the outstanding matrix elements (t_hmm_vec_L - t_L)
@@ -242,6 +429,371 @@ void PosteriorDecoder::maskViterbiAlignment(const int q_length, const int t_leng
 
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// maskViterbiAlignment for the rows first ... last of the current segment of a checkpointed
+// ViterbiMatrix (template in lane 0), with the Viterbi alignment saved by realignCheckpointed
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::maskViterbiAlignmentRows(const int q_length, const int t_length,
+												ViterbiMatrix &celloff_matrix, const int first, const int last) {
+	m_mask_row.resize(t_length + 1);
+	char * cell_on = &m_mask_row[0];
+	for (int i = first; i <= last; ++i) {
+		// the upper left rectangle above (i1,j1) and the lower right rectangle below (i2,j2)
+		memset(cell_on, 0, t_length + 1);
+		if (i < m_viterbi_i1)
+			memset(cell_on + 1, 1, imax(0, imin(t_length, m_viterbi_j1 - 1)));
+		else if (i > m_viterbi_i2 && m_viterbi_j2 < t_length)
+			memset(cell_on + m_viterbi_j2 + 1, 1, t_length - m_viterbi_j2);
+		// vicinity of the Viterbi path
+		for (int row = imax(1, i - FWD_BKW_PATHWITDH); row <= imin(q_length, i + FWD_BKW_PATHWITDH); ++row)
+			for (int step = m_path_row_first[row]; step <= m_path_row_last[row]; ++step)
+				cell_on[m_viterbi_j[step]] = 1;
+		for (int step = m_path_row_first[i]; step <= m_path_row_last[i]; ++step)
+			for (int j = imax(1, m_viterbi_j[step] - FWD_BKW_PATHWITDH); j <= imin(t_length, m_viterbi_j[step] + FWD_BKW_PATHWITDH); ++j)
+				cell_on[j] = 1;
+
+		for (int j = 1; j <= t_length; ++j)
+			if (!cell_on[j])
+				celloff_matrix.setSegmentCellOff(i, j, 0);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Band of the full matrix
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::setFullBand(const int q_length, const int t_length) {
+	for (int i = 0; i <= q_length + 1; ++i) {
+		m_band_lo[i] = 1;
+		m_band_hi[i] = t_length;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Band of half width around the Viterbi alignment of a hit: row i contains the columns of the
+// alignment in the rows i-width ... i+width, widened by width on both sides. Before (i1,j1)
+// and after (i2,j2) the alignment is extended along the diagonal up to the matrix edge.
+// Returns true if the band covers the whole matrix.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool PosteriorDecoder::setViterbiBand(const int q_length, const int t_length, Hit const &hit, const int width) {
+
+	// first and last column of the alignment in row i, in m_band_lo[i] and m_band_hi[i]
+	for (int i = 1; i < hit.i1; ++i) {
+		m_band_lo[i] = m_band_hi[i] = imax(1, hit.j1 - (hit.i1 - i));
+	}
+	for (int i = hit.i2 + 1; i <= q_length; ++i) {
+		m_band_lo[i] = m_band_hi[i] = imin(t_length, hit.j2 + (i - hit.i2));
+	}
+	for (int i = hit.i1; i <= hit.i2; ++i) {
+		m_band_lo[i] = INT_MAX;
+		m_band_hi[i] = INT_MIN;
+	}
+	for (int step = hit.nsteps; step >= 1; step--) {
+		m_band_lo[hit.i[step]] = imin(m_band_lo[hit.i[step]], hit.j[step]);
+		m_band_hi[hit.i[step]] = imax(m_band_hi[hit.i[step]], hit.j[step]);
+	}
+
+	// both are non-decreasing in i, the window minimum of the first columns is in row i-width
+	// and the window maximum of the last columns in row i+width (computed in place, the first
+	// columns from the last row on, the last columns from the first row on)
+	bool full = true;
+	for (int i = q_length; i >= 1; --i) {
+		m_band_lo[i] = imax(1, m_band_lo[imax(1, i - width)] - width);
+		full &= (m_band_lo[i] == 1);
+	}
+	for (int i = 1; i <= q_length; ++i) {
+		m_band_hi[i] = imin(t_length, m_band_hi[imin(q_length, i + width)] + width);
+		full &= (m_band_hi[i] == t_length);
+	}
+	m_band_lo[0] = m_band_lo[1];
+	m_band_hi[0] = m_band_hi[1];
+	m_band_lo[q_length + 1] = m_band_lo[q_length];
+	m_band_hi[q_length + 1] = m_band_hi[q_length];
+	return full;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Banded posterior matrix for the current band. Besides the band, row i stores column
+// m_band_lo[i]-1 and the columns up to m_band_hi[i+1], where the MAC backtrace may end.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::setBandedPosteriorMatrix(const int q_length, PosteriorMatrix & p_mm) {
+	for (int i = 0; i <= q_length; ++i) {
+		m_band_first[i] = m_band_lo[i] - 1;
+		m_band_last[i] = m_band_hi[i + 1];
+	}
+	p_mm.SetBand(q_length, m_band_first, m_band_last);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Posterior probability on the border of the band (first and last column of each row,
+// unless the band reaches the edge of the matrix there)
+///////////////////////////////////////////////////////////////////////////////////////////////////
+double PosteriorDecoder::bandBorderMass(const int q_length, const int t_length, PosteriorMatrix & p_mm) const {
+	double mass = 0.0;
+	for (int i = 1; i <= q_length; ++i) {
+		if (m_band_lo[i] > 1)
+			mass += p_mm.getPosteriorValue(i, m_band_lo[i], 0);
+		if (m_band_hi[i] < t_length)
+			mass += p_mm.getPosteriorValue(i, m_band_hi[i], 0);
+	}
+	return mass;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Realign a hit whose template does not fit into the ViterbiMatrix, which provides the rows of
+// one segment of the query at a time, and into the posterior matrix, which stores the rows of
+// one segment. The forward pass stores the F state after the last row of each segment and the
+// backward pass the B state after the row behind the first row of each segment. The MAC pass
+// recomputes F and B of each segment for its posterior probabilities and stores the MAC scores
+// after the last row of each segment, from which the backtrace recomputes the MAC states of
+// the segments it passes.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::realignCheckpointed(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm,
+										   ViterbiMatrix &viterbi_matrix, float shift, float mact, float corr) {
+	const int segments = viterbi_matrix.getSegments();
+	allocateCheckpoints(segments, t.L);
+
+	// Viterbi alignment and its steps in each row, for maskViterbiAlignmentRows
+	m_viterbi_i1 = hit.i1;
+	m_viterbi_j1 = hit.j1;
+	m_viterbi_i2 = hit.i2;
+	m_viterbi_j2 = hit.j2;
+	m_viterbi_j.assign(hit.j, hit.j + hit.nsteps + 1);
+	m_path_row_first.assign(q.L + 2, hit.nsteps + 1);
+	m_path_row_last.assign(q.L + 2, 0);
+	for (int step = 1; step <= hit.nsteps; step++) {
+		m_path_row_first[hit.i[step]] = imin(m_path_row_first[hit.i[step]], step);
+		m_path_row_last[hit.i[step]] = imax(m_path_row_last[hit.i[step]], step);
+	}
+
+	// Forward
+	hit.Pforward = (m_local ? 1.0 : 0.0); // local: alignment contains no residues (see Mueckstein, Stadler et al.)
+	for (int segment = 0; segment < segments; segment++) {
+		setSegment(q, t, viterbi_matrix, segment);
+		forwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment);
+		forwardProbability(q, t, hit, p_mm, viterbi_matrix.getSegmentFirstRow(segment),
+				viterbi_matrix.getSegmentLastRow(segment), 0);
+	}
+	forwardHitScore(q, t, hit);
+	const double scale_prod = m_fwd_scale_prod;
+
+	// Backward, the posterior probabilities of this pass are not used
+	for (int segment = segments - 1; segment >= 0; segment--) {
+		setSegment(q, t, viterbi_matrix, segment);
+		backwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment, true);
+	}
+
+	// MAC
+	macFirstRow(t, hit, viterbi_matrix, 0);
+	for (int segment = 0; segment < segments; segment++) {
+		const int first = viterbi_matrix.getSegmentFirstRow(segment);
+		const int last = viterbi_matrix.getSegmentLastRow(segment);
+		setSegment(q, t, viterbi_matrix, segment);
+		forwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment);
+		forwardEntries(q, t, hit, p_mm, scale_prod, first, last, 0);
+		backwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment, false);
+		posteriorEntries(p_mm, viterbi_matrix, 0, first, last);
+		macSegment(q, t, hit, p_mm, viterbi_matrix, mact, segment);
+	}
+
+	backtraceMACCheckpointed(q, t, hit, p_mm, viterbi_matrix, shift, mact, corr);
+	removePathNeighbours(q.L, t.L, hit, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory of the checkpoints (see allocateCheckpoints) and of the segment rows of the posterior matrix
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t PosteriorDecoder::getCheckpointedMemory(const int q_length, const int t_length) {
+	const int rows = ViterbiMatrix::getCheckpointDistance(q_length);
+	const size_t segments = (q_length + rows - 1) / rows;
+	return segments * (t_length + 2) * (2 * sizeof(PosteriorMatrixCol) + 4 * sizeof(double) + sizeof(float))
+			+ (size_t) rows * (t_length + 1) * sizeof(float);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Grow the checkpoints to segments segments of a template of length t_length
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::allocateCheckpoints(const int segments, const int t_length) {
+	const size_t cols = (size_t) segments * (t_length + 2);
+	if (cols <= m_checkpoint_cols)
+		return;
+
+	free(m_fwd_checkpoints);
+	free(m_bwd_checkpoints);
+	free(m_fwd_checkpoint_state);
+	free(m_bwd_checkpoint_state);
+	free(m_mac_checkpoints);
+
+	// the two doubles of state per segment fit into 2 * cols
+	m_checkpoint_cols = cols;
+	m_fwd_checkpoints = (PosteriorMatrixCol *) malloc_simd_float(cols * sizeof(PosteriorMatrixCol));
+	m_bwd_checkpoints = (PosteriorMatrixCol *) malloc_simd_float(cols * sizeof(PosteriorMatrixCol));
+	m_fwd_checkpoint_state = (double *) malloc_simd_float(2 * cols * sizeof(double));
+	m_bwd_checkpoint_state = (double *) malloc_simd_float(2 * cols * sizeof(double));
+	m_mac_checkpoints = (float *) malloc_simd_float(cols * sizeof(float));
+	if (!m_fwd_checkpoints || !m_bwd_checkpoints || !m_fwd_checkpoint_state || !m_bwd_checkpoint_state
+			|| !m_mac_checkpoints)
+		MemoryError("checkpoints of the posterior decoder", __FILE__, __LINE__, __func__);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Make the rows of a segment of the checkpointed ViterbiMatrix available, with the Viterbi
+// alignment masked out
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::setSegment(HMM &q, HMM &t, ViterbiMatrix &viterbi_matrix, const int segment) {
+	viterbi_matrix.SetSegment(segment);
+	maskViterbiAlignmentRows(q.L, t.L, viterbi_matrix, viterbi_matrix.getSegmentFirstRow(segment),
+			viterbi_matrix.getSegmentLastRow(segment));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Forward algorithm of the rows of a segment, from the checkpoint of the segment before
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::forwardSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm,
+									  ViterbiMatrix &viterbi_matrix, float shift, const int segment) {
+	const size_t cols = t.L + 2;
+	const int last = viterbi_matrix.getSegmentLastRow(segment);
+	if (segment == 0) {
+		forwardFirstRow(q, t, p_mm, viterbi_matrix, shift, 0);
+		forwardRows(q, t, hit, p_mm, viterbi_matrix, shift, 2, last, 0);
+	} else {
+		memset(m_curr, 0, cols * sizeof(PosteriorMatrixCol));
+		memcpy(m_prev, m_fwd_checkpoints + (segment - 1) * cols, cols * sizeof(PosteriorMatrixCol));
+		m_fwd_pmin = m_fwd_checkpoint_state[2 * (segment - 1)];
+		m_fwd_scale_prod = m_fwd_checkpoint_state[2 * (segment - 1) + 1];
+		forwardRows(q, t, hit, p_mm, viterbi_matrix, shift, viterbi_matrix.getSegmentFirstRow(segment), last, 0);
+	}
+	memcpy(m_fwd_checkpoints + segment * cols, m_prev, cols * sizeof(PosteriorMatrixCol));
+	m_fwd_checkpoint_state[2 * segment] = m_fwd_pmin;
+	m_fwd_checkpoint_state[2 * segment + 1] = m_fwd_scale_prod;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Backward algorithm of the rows of a segment, from the checkpoint of the segment behind. The
+// rows must hold the forward matrix for the posterior probabilities.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::backwardSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm,
+									   ViterbiMatrix &viterbi_matrix, float shift, const int segment, const bool entries) {
+	const size_t cols = t.L + 2;
+	const int first = viterbi_matrix.getSegmentFirstRow(segment);
+	if (segment == viterbi_matrix.getSegments() - 1) {
+		backwardLastRow(q, t, hit, p_mm, viterbi_matrix, 0);
+		backwardRows(q, t, hit, p_mm, viterbi_matrix, shift, q.L - 1, first, entries, 0);
+	} else {
+		memset(m_curr, 0, cols * sizeof(PosteriorMatrixCol));
+		memcpy(m_prev, m_bwd_checkpoints + segment * cols, cols * sizeof(PosteriorMatrixCol));
+		m_bwd_pmin = m_bwd_checkpoint_state[2 * segment];
+		m_bwd_scale_prod = m_bwd_checkpoint_state[2 * segment + 1];
+		backwardRows(q, t, hit, p_mm, viterbi_matrix, shift, viterbi_matrix.getSegmentLastRow(segment), first,
+				entries, 0);
+	}
+	if (segment > 0) {
+		memcpy(m_bwd_checkpoints + (segment - 1) * cols, m_prev, cols * sizeof(PosteriorMatrixCol));
+		m_bwd_checkpoint_state[2 * (segment - 1)] = m_bwd_pmin;
+		m_bwd_checkpoint_state[2 * (segment - 1) + 1] = m_bwd_scale_prod;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MAC algorithm of the rows of a segment, from the checkpoint of the segment before. The best
+// cell of the rows is compared with the best cell of the segments before (macFirstRow).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::macSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm,
+								  ViterbiMatrix &viterbi_matrix, float mact, const int segment) {
+	const size_t cols = t.L + 2;
+	if (segment == 0) {
+		for (int j = 0; j <= t.L; ++j)
+			m_mac_prev[j] = 0.0;
+	} else {
+		memcpy(m_mac_prev, m_mac_checkpoints + (segment - 1) * cols, (t.L + 1) * sizeof(float));
+	}
+	macRows(q, t, hit, p_mm, viterbi_matrix, mact, viterbi_matrix.getSegmentFirstRow(segment),
+			viterbi_matrix.getSegmentLastRow(segment), 0);
+	memcpy(m_mac_checkpoints + segment * cols, m_mac_prev, (t.L + 1) * sizeof(float));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MAC backtrace through the segments of a checkpointed realignment. The MAC states of a segment
+// are recomputed when the path enters it, the last segment is still available from the MAC pass.
+// The cells in the neighbourhood of the path are removed from the posterior probabilities by
+// removePathNeighbours instead of being turned off.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::backtraceMACCheckpointed(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm,
+												ViterbiMatrix &viterbi_matrix, float shift, float mact, float corr) {
+	LogLevel actual_level = Log::reporting_level();
+	const int segments = viterbi_matrix.getSegments();
+
+	initializeBacktrace(t, hit);
+
+	// In contrast to the Viterbi-Backtracing, STOP signifies the first Match-Match state, NOT the state before the first MM state
+	hit.matched_cols = 1; // for each MACTH (or STOP) state matched_col is incremented by 1
+	hit.state = ViterbiMatrix::MM;       // lowest state with maximum score must be match-match state
+	int step = 0;         // steps through the matrix correspond to alignment columns (from 1 to nsteps)
+	int i = hit.i2;
+	int j = hit.j2;       // last aligned pair is (i2,j2)
+	m_step_posterior.assign(1, 0.0f);
+
+	int segment = segments - 1;
+	while (segment > 0 && viterbi_matrix.getSegmentFirstRow(segment) > i)
+		segment--;
+	while (true) {
+		const int first = viterbi_matrix.getSegmentFirstRow(segment);
+		const int last = viterbi_matrix.getSegmentLastRow(segment);
+		if (segment < segments - 1) {
+			setSegment(q, t, viterbi_matrix, segment);
+			forwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment);
+			backwardSegment(q, t, hit, p_mm, viterbi_matrix, shift, segment, false);
+			macSegment(q, t, hit, p_mm, viterbi_matrix, mact, segment);
+		}
+
+		// Make sure that backtracing stops when t:M1 or q:M1 is reached (Start state)
+		for (int row = first; row <= last; ++row)
+			viterbi_matrix.setMatMat(row, 1, 0, ViterbiMatrix::STOP);
+		if (segment == 0) {
+			for (int col = 1; col <= t.L; ++col)
+				viterbi_matrix.setMatMat(1, col, 0, ViterbiMatrix::STOP);
+		}
+
+		if (followBacktraceMAC(q, t, p_mm, viterbi_matrix, 0, hit, first, false, i, j, step))
+			actual_level = DEBUG1;
+		if (hit.state == ViterbiMatrix::STOP || segment == 0)
+			break;
+		segment--;
+	}
+
+	finishBacktraceMAC(q, t, hit, step, corr, actual_level);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Remove the posterior probabilities of the cells that backtraceMAC turns off around the path
+// (two cells up and down in the column, two cells left and right in the row of each step).
+// The steps of the path in a row and in a column are consecutive.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorDecoder::removePathNeighbours(const int q_length, const int t_length, Hit const &hit, const int elem) {
+	std::vector<int> row_first(q_length + 1, INT_MAX);
+	std::vector<int> row_last(q_length + 1, INT_MIN);
+	std::vector<int> col_first(t_length + 1, INT_MAX);
+	std::vector<int> col_last(t_length + 1, INT_MIN);
+	for (int step = 1; step <= hit.nsteps; step++) {
+		const int i = hit.i[step];
+		const int j = hit.j[step];
+		row_first[i] = imin(row_first[i], j);
+		row_last[i] = imax(row_last[i], j);
+		col_first[j] = imin(col_first[j], i);
+		col_last[j] = imax(col_last[j], i);
+	}
+
+	std::vector<MACTriple> & entries = m_posterior_entries[elem];
+	size_t kept = 0;
+	for (size_t k = 0; k < entries.size(); k++) {
+		const int i = entries[k].i;
+		const int j = entries[k].j;
+		if ((j >= row_first[i] - 2 && j <= row_last[i] + 2) || (i >= col_first[j] - 2 && i <= col_last[j] + 2))
+			continue;
+		entries[kept++] = entries[k];
+	}
+	entries.resize(kept);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Mask previous found alternative MAC alignments
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -267,35 +819,35 @@ void PosteriorDecoder::excludeMACAlignment(const int q_length, const int t_lengt
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Memorize values that are going to be restored after computation
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void PosteriorDecoder::memorizeHitValues(Hit &curr_hit) {
-	m_temp_hit->score      = curr_hit.score;
-	m_temp_hit->score_ss   = curr_hit.score_ss;
-	m_temp_hit->score_aass = curr_hit.score_aass;
-	m_temp_hit->score_sort = curr_hit.score_sort;
-	m_temp_hit->Pval       = curr_hit.Pval;
-	m_temp_hit->Pvalt      = curr_hit.Pvalt;
-	m_temp_hit->logPval    = curr_hit.logPval;
-	m_temp_hit->logPvalt   = curr_hit.logPvalt;
-	m_temp_hit->Eval       = curr_hit.Eval;
-	m_temp_hit->logEval    = curr_hit.logEval;
-	m_temp_hit->Probab     = curr_hit.Probab;
+void PosteriorDecoder::memorizeHitValues(Hit &curr_hit, const int elem) {
+	m_temp_hit[elem].score      = curr_hit.score;
+	m_temp_hit[elem].score_ss   = curr_hit.score_ss;
+	m_temp_hit[elem].score_aass = curr_hit.score_aass;
+	m_temp_hit[elem].score_sort = curr_hit.score_sort;
+	m_temp_hit[elem].Pval       = curr_hit.Pval;
+	m_temp_hit[elem].Pvalt      = curr_hit.Pvalt;
+	m_temp_hit[elem].logPval    = curr_hit.logPval;
+	m_temp_hit[elem].logPvalt   = curr_hit.logPvalt;
+	m_temp_hit[elem].Eval       = curr_hit.Eval;
+	m_temp_hit[elem].logEval    = curr_hit.logEval;
+	m_temp_hit[elem].Probab     = curr_hit.Probab;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Restore the current hit with Viterbi scores, probabilities etc. of hit_cur
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void PosteriorDecoder::restoreHitValues(Hit &curr_hit) {
-	curr_hit.score = m_temp_hit->score;
-	curr_hit.score_ss = m_temp_hit->score_ss;
-	curr_hit.score_aass = m_temp_hit->score_aass;
-	curr_hit.score_sort = m_temp_hit->score_sort;
-	curr_hit.Pval = m_temp_hit->Pval;
-	curr_hit.Pvalt = m_temp_hit->Pvalt;
-	curr_hit.logPval = m_temp_hit->logPval;
-	curr_hit.logPvalt = m_temp_hit->logPvalt;
-	curr_hit.Eval = m_temp_hit->Eval;
-	curr_hit.logEval = m_temp_hit->logEval;
-	curr_hit.Probab = m_temp_hit->Probab;
+void PosteriorDecoder::restoreHitValues(Hit &curr_hit, const int elem) {
+	curr_hit.score = m_temp_hit[elem].score;
+	curr_hit.score_ss = m_temp_hit[elem].score_ss;
+	curr_hit.score_aass = m_temp_hit[elem].score_aass;
+	curr_hit.score_sort = m_temp_hit[elem].score_sort;
+	curr_hit.Pval = m_temp_hit[elem].Pval;
+	curr_hit.Pvalt = m_temp_hit[elem].Pvalt;
+	curr_hit.logPval = m_temp_hit[elem].logPval;
+	curr_hit.logPvalt = m_temp_hit[elem].logPvalt;
+	curr_hit.Eval = m_temp_hit[elem].Eval;
+	curr_hit.logEval = m_temp_hit[elem].logEval;
+	curr_hit.Probab = m_temp_hit[elem].Probab;
 }
 
 void PosteriorDecoder::printVector(float * vec) {
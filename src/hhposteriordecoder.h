@@ -62,13 +62,25 @@ public:
 	virtual ~PosteriorDecoder();
 
 	/////////////////////////////////////////////////////////////////////////////////////
-	// Realign hits: compute F/B/MAC and MAC-backtrace algorithms SIMD
+	// Realign hits: compute F/B/MAC and MAC-backtrace algorithms, with par_mac_band > 0
+	// in an adaptive band around the Viterbi alignment (local alignment only). Templates
+	// that do not fit into viterbi_matrix are realigned with checkpoints.
 	/////////////////////////////////////////////////////////////////////////////////////
 	void realign(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
 				 std::vector<PosteriorDecoder::MACBacktraceResult> alignment_to_exclude, char * exclstr,
+				 char* template_exclstr, int par_min_overlap, int par_mac_band, float shift, float mact, float corr);
+	/////////////////////////////////////////////////////////////////////////////////////
+	// Realign up to VECSIZE_FLOAT hits of different templates at once: F/B/MAC run with
+	// one template per SIMD lane, the MAC backtrace per template
+	/////////////////////////////////////////////////////////////////////////////////////
+	void realign(HMM &q, HMMSimd &q_simd, std::vector<HMM *> &t, HMMSimd &t_simd, std::vector<Hit *> &hits,
+				 PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+				 std::vector<std::vector<PosteriorDecoder::MACBacktraceResult> > &alignment_to_exclude, char * exclstr,
 				 char* template_exclstr, int par_min_overlap, float shift, float mact, float corr);
 	void excludeMACAlignment(const int q_length, const int t_length, ViterbiMatrix &celloff_matrix, const int elem,
 			MACBacktraceResult & alignment);
+	// bytes allocated by the posterior decoder and the posterior matrix for a checkpointed realignment
+	static size_t getCheckpointedMemory(const int q_length, const int t_length);
 
 private:
 
@@ -83,6 +95,28 @@ private:
 	PosteriorMatrixCol * m_prev;
 	PosteriorMatrixCol * m_curr;
 
+	// order of the transitions of a column in m_t_tr_simd (as in HMMSimd::tr)
+	enum { TR_I2I = 0, TR_M2I = 1, TR_M2M = 2, TR_M2D = 3, TR_D2M = 4, TR_D2D = 5, TR_I2M = 6 };
+
+	// the lower and upper half of the VECSIZE_FLOAT templates in double precision
+	struct PosteriorMatrixColSimd {
+		simd_double mm[2];
+		simd_double gd[2];
+		simd_double im[2];
+		simd_double dg[2];
+		simd_double mi[2];
+	};
+
+	PosteriorMatrixColSimd * m_prev_simd;
+	PosteriorMatrixColSimd * m_curr_simd;
+	simd_double * m_t_tr_simd;	// template transitions of the lanes in double precision
+	simd_float * m_p_prev_simd;	// profile scores of row i+1 (backward)
+	simd_float * m_p_curr_simd;	// profile scores of row i (backward)
+	simd_float * m_s_prev_simd;	// MAC scores - previous
+	simd_float * m_s_curr_simd;	// MAC scores - current
+	double * m_scale_simd;		// row scales, scale[i] of lane elem at [i * VECSIZE_FLOAT + elem]
+	int m_simd_max_res;			// template length the SIMD buffers are allocated for
+
 	//	sec. structure data
 	float ssw;
 	//  SCORE_ALIGNMENT SCORE_BACKTRACE
@@ -99,12 +133,50 @@ private:
 	double * m_s_prev;		// MAC scores - previous
 	double * p_last_col;
 
+	float * m_mac_curr;		// MAC scores of the scalar version - current
+	float * m_mac_prev;		// MAC scores of the scalar version - previous
+	float m_score_mac;		// score of the best MAC alignment so far
+
+	// state of the scalar F/B between calls of forwardRows and backwardRows
+	double m_fwd_pmin;
+	double m_fwd_scale_prod;
+	double m_fwd_entries_scale_prod;
+	double m_bwd_pmin;
+	double m_bwd_scale_prod;
+	double m_bwd_final_scale_prod;
+
 	float m_back_forward_matrix_threshold;
-	std::vector<MACTriple> m_backward_entries;
-	std::vector<MACTriple> m_forward_entries;
+	std::vector<MACTriple> m_backward_entries[VECSIZE_FLOAT];
+	std::vector<MACTriple> m_forward_entries[VECSIZE_FLOAT];
+	std::vector<MACTriple> m_posterior_entries[VECSIZE_FLOAT];
+	std::vector<float> m_step_posterior;	// posterior probability of the steps of the MAC backtrace
 
 	double * scale;
 
+	// Checkpointed realignment of templates that do not fit into the matrices: the state of F
+	// after the last row, of B after the row following the first row and the MAC scores after
+	// the last row of each segment of the ViterbiMatrix. The other rows are recomputed.
+	PosteriorMatrixCol * m_fwd_checkpoints;
+	PosteriorMatrixCol * m_bwd_checkpoints;
+	double * m_fwd_checkpoint_state;		// m_fwd_pmin and m_fwd_scale_prod per segment
+	double * m_bwd_checkpoint_state;		// m_bwd_pmin and m_bwd_scale_prod per segment
+	float * m_mac_checkpoints;
+	size_t m_checkpoint_cols;				// allocated cells of the checkpoints
+	// Viterbi alignment of the hit for maskViterbiAlignmentRows (the hit holds the MAC alignment later)
+	int m_viterbi_i1, m_viterbi_j1, m_viterbi_i2, m_viterbi_j2;
+	std::vector<int> m_viterbi_j;			// column of each step
+	std::vector<int> m_path_row_first;		// steps of the Viterbi alignment in a row
+	std::vector<int> m_path_row_last;
+	std::vector<char> m_mask_row;
+
+	// Columns m_band_lo[i] ... m_band_hi[i] of row i are computed by the scalar F/B/MAC, the
+	// other cells are zero. Both bounds are non-decreasing in i, entries 0 and q.L+1 repeat
+	// the bounds of row 1 and q.L.
+	int * m_band_lo;
+	int * m_band_hi;
+	int * m_band_first;		// stored columns of the banded posterior matrix
+	int * m_band_last;
+
 //	PosteriorSharedVariables m_column_vars;
 
 //	simd_float m_p_min;    // used to distinguish between SW and NW algorithms in maximization
@@ -117,30 +189,93 @@ private:
 
 	simd_float * m_p_forward;
 
-	Hit * m_temp_hit;
+	Hit * m_temp_hit;				// one per lane
 
 	void forwardAlgorithm(HMM & q_hmm, HMM & t_hmm, Hit & hit_vec, PosteriorMatrix & p_mm,
 			ViterbiMatrix & viterbi_matrix, float shift, const int elem);
+	void forwardFirstRow(HMM & q_hmm, HMM & t_hmm, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix,
+			float shift, const int elem);
+	void forwardRows(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix,
+			float shift, const int first, const int last, const int elem);
+	void forwardScore(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm, const double scale_prod, const int elem);
+	void forwardProbability(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm,
+			const int first, const int last, const int elem);
+	void forwardEntries(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm, const double scale_prod,
+			const int first, const int last, const int elem);
+	void forwardHitScore(HMM & q_hmm, HMM & t_hmm, Hit & hit);
 	void backwardAlgorithm(HMM & q_hmm,HMM & t_hmm, Hit & hit_vec, PosteriorMatrix & p_mm,
 			ViterbiMatrix & viterbi_matrix, float shift, const int elem);
+	void backwardLastRow(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm,
+			ViterbiMatrix & viterbi_matrix, const int elem);
+	void backwardRows(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix,
+			float shift, const int first, const int last, const bool entries, const int elem);
 	void macAlgorithm(HMM & q_hmm, HMM & t_hmm, Hit & hit_vec, PosteriorMatrix & p_mm,
 			ViterbiMatrix & viterbi_matrix, float par_mact, const int elem);
+	void macFirstRow(HMM & t_hmm, Hit & hit, ViterbiMatrix & viterbi_matrix, const int elem);
+	void macRows(HMM & q_hmm, HMM & t_hmm, Hit & hit, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix,
+			float par_mact, const int first, const int last, const int elem);
+	void forwardAlgorithmSimd(HMM & q_hmm, HMMSimd & q_simd, std::vector<HMM *> & t_hmm, HMMSimd & t_simd,
+			std::vector<Hit *> & hits, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix, float shift);
+	void forwardScoreSimd(HMM & q_hmm, std::vector<HMM *> & t_hmm, std::vector<Hit *> & hits, PosteriorMatrix & p_mm,
+			const int t_L, const simd_double * scale_prod);
+	void backwardAlgorithmSimd(HMM & q_hmm, HMMSimd & q_simd, std::vector<HMM *> & t_hmm, HMMSimd & t_simd,
+			std::vector<Hit *> & hits, PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix, float shift);
+	void macAlgorithmSimd(HMM & q_hmm, std::vector<HMM *> & t_hmm, HMMSimd & t_simd, std::vector<Hit *> & hits,
+			PosteriorMatrix & p_mm, ViterbiMatrix & viterbi_matrix, float par_mact);
+	void allocateSimdBuffers(const int t_max_L);
+
+	// ProbFwd of VECSIZE_FLOAT templates, the products are summed in the order of ScalarProd20
+	static inline simd_float ProbFwdSimd(const simd_float * qi, const simd_float * tj) {
+		simd_float res[4];
+		for (int k = 0; k < 4; k++) {
+			const simd_float r1 = simdf32_add(simdf32_mul(qi[k], tj[k]), simdf32_mul(qi[k + 4], tj[k + 4]));
+			const simd_float r2 = simdf32_add(simdf32_mul(qi[k + 8], tj[k + 8]), simdf32_mul(qi[k + 12], tj[k + 12]));
+			res[k] = simdf32_add(simdf32_add(r1, r2), simdf32_mul(qi[k + 16], tj[k + 16]));
+		}
+		return simdf32_add(simdf32_add(res[0], res[1]), simdf32_add(res[2], res[3]));
+	}
 	void backtraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, ViterbiMatrix & backtrace_matrix, const int elem, Hit & hit, float corr);
-	void writeProfilesToHits(HMM &q, HMM &t, PosteriorMatrix &p_mm, ViterbiMatrix & backtrace_matrix, Hit &hit);
+	bool followBacktraceMAC(HMM & q, HMM & t, PosteriorMatrix & p_mm, ViterbiMatrix & backtrace_matrix, const int elem,
+			Hit & hit, const int first_row, const bool exclude_cells, int & i, int & j, int & step);
+	void finishBacktraceMAC(HMM & q, HMM & t, Hit & hit, int step, float corr, LogLevel actual_level);
+	void posteriorEntries(PosteriorMatrix &p_mm, ViterbiMatrix & backtrace_matrix, const int elem,
+			const int first, const int last);
+	void writeProfilesToHits(HMM &q, const int elem, Hit &hit);
 	void initializeBacktrace(HMM & t, Hit & hit);
 
-	void initializeForAlignment(HMM &q, HMM &t, Hit &hit, ViterbiMatrix &viterbi_matrix, const int elem, const int t_max_L, int par_min_overlap);
+	void realignCheckpointed(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+			float shift, float mact, float corr);
+	void allocateCheckpoints(const int segments, const int t_length);
+	void setSegment(HMM &q, HMM &t, ViterbiMatrix &viterbi_matrix, const int segment);
+	void forwardSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+			float shift, const int segment);
+	void backwardSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+			float shift, const int segment, const bool entries);
+	void macSegment(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+			float mact, const int segment);
+	void backtraceMACCheckpointed(HMM &q, HMM &t, Hit &hit, PosteriorMatrix &p_mm, ViterbiMatrix &viterbi_matrix,
+			float shift, float mact, float corr);
+	void removePathNeighbours(const int q_length, const int t_length, Hit const &hit, const int elem);
+
+	void initializeForAlignment(HMM &q, HMM &t, Hit &hit, ViterbiMatrix &viterbi_matrix, const int elem, const int t_max_L,
+			int par_min_overlap, const bool banded);
+	void setFullBand(const int q_length, const int t_length);
+	bool setViterbiBand(const int q_length, const int t_length, Hit const &hit, const int width);
+	void setBandedPosteriorMatrix(const int q_length, PosteriorMatrix & p_mm);
+	double bandBorderMass(const int q_length, const int t_length, PosteriorMatrix & p_mm) const;
     void maskViterbiAlignment(const int q_length, const int t_length, ViterbiMatrix &celloff_matrix,
 			const int elem, Hit const &hit) const;
-	void memorizeHitValues(Hit & curr_hit);
-	void restoreHitValues(Hit &curr_hit);
+	void maskViterbiAlignmentRows(const int q_length, const int t_length, ViterbiMatrix &celloff_matrix,
+			const int first, const int last);
+	void memorizeHitValues(Hit & curr_hit, const int elem);
+	void restoreHitValues(Hit &curr_hit, const int elem);
 
 	void printVector(simd_float * vec);
 	void printVector(simd_int * vec);
 	void printVector(float * vec);
 
-	void exclude_regions(char *exclstr, HMM &q_hmm, HMM &t_hmm, ViterbiMatrix &viterbiMatrix);
-        void exclude_template_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix);
+	void exclude_regions(char *exclstr, HMM &q_hmm, HMM &t_hmm, ViterbiMatrix &viterbiMatrix, const int elem);
+        void exclude_template_regions(char* exclstr, HMM & q_hmm, HMM & t_hmm, ViterbiMatrix& viterbiMatrix, const int elem);
 };
 
 #endif /* HHPOSTERIORDECODER_H_ */
@@ -29,13 +29,42 @@ int compareIrep(const void * a, const void * b) {
     return (pa.irep < pb.irep);
 }
 
+// Higher cost first, ties in the order of the batches
+static bool compareCost(const std::pair<size_t, size_t> & a, const std::pair<size_t, size_t> & b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Estimated cost of realigning a batch of alignment vectors: the cells of the dynamic programming
+// matrices of each round of the batch, a round realigns the idb-th alignments of all templates
+// at once and takes as long as its longest template
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static size_t batchCost(const std::vector<std::vector<Hit *> > & alignment, const std::vector<size_t> & batch,
+        const int q_length) {
+    size_t cost = 0;
+    for (size_t idb = 0; ; idb++) {
+        int t_length = 0;
+        for (size_t k = 0; k < batch.size(); k++) {
+            if (idb < alignment[batch[k]].size()) {
+                t_length = std::max(t_length, alignment[batch[k]][idb]->L);
+            }
+        }
+        if (t_length == 0) {
+            break;
+        }
+        cost += (size_t) q_length * t_length;
+    }
+    return cost;
+}
+
 PosteriorDecoderRunner::PosteriorDecoderRunner( PosteriorMatrix **posterior_matrices,
         ViterbiMatrix **backtrace_matrix, const int n_threads, const float ssw,
         const float S73[NDSSP][NSSPRED][MAXCF], const float S33[NSSPRED][MAXCF][NSSPRED][MAXCF],
-        const float S37[NSSPRED][MAXCF][NDSSP])
+        const float S37[NSSPRED][MAXCF][NDSSP], TemplateHMMCache* template_cache)
         : m_posterior_matrices(posterior_matrices),
           m_backtrace_matrix(backtrace_matrix),
-          m_n_threads(n_threads), S73(S73), S33(S33), S37(S37) {}
+          m_n_threads(n_threads), m_template_cache(template_cache),
+          S73(S73), S33(S33), S37(S37) {}
 
 PosteriorDecoderRunner::~PosteriorDecoderRunner() {
 }
@@ -65,55 +94,174 @@ void PosteriorDecoderRunner::executeComputation(HMM &q, std::vector<Hit *>  hits
 
     // Routine to start consumer threads
     std::vector<PosteriorDecoder *> *threads = initializeConsumerThreads(par.loc, target_max_length, q.L, par.ssw, S73, S33, S37);
-    // create one hmm for each threads
-    HMM **t_hmm = new HMM *[m_n_threads];
-    for (int i = 0; i < m_n_threads; i++) {
+    // banded realignment is computed by the scalar F/B/MAC
+    const bool mac_simd = par.mac_simd && !(par.mac_band > 0 && par.loc);
+    // create one hmm for each lane of the threads
+    const int lanes = mac_simd ? VECSIZE_FLOAT : 1;
+    HMM **t_hmm = new HMM *[m_n_threads * lanes];
+    for (int i = 0; i < m_n_threads * lanes; i++) {
         t_hmm[i] = new HMM(MAXSEQDIS, par.maxres);
     }
 
+    // Templates that do not fit into the backtrace matrix are realigned with checkpoints after
+    // all others, by as many threads as their checkpoints fit into -maxmem
+    const double maxmem = (par.maxmem - 0.5) * 1024 * 1024 * 1024;
+    std::vector<std::vector<size_t> > checkpointed_batches;
+    std::vector<bool> checkpointed(alignment.size(), false);
+    size_t checkpointed_memory = 0;
+    for (size_t idx = 0; idx < alignment.size(); idx++) {
+        if (!m_backtrace_matrix[0]->fitsFullMatrix(q.L, alignment[idx][0]->L)) {
+            checkpointed[idx] = true;
+            checkpointed_batches.push_back(std::vector<size_t>(1, idx));
+            checkpointed_memory = std::max(checkpointed_memory,
+                    PosteriorDecoder::getCheckpointedMemory(q.L, alignment[idx][0]->L));
+        }
+    }
+    int checkpointed_threads = m_n_threads;
+    if (checkpointed_memory > 0) {
+        checkpointed_threads = imax(1, imin(m_n_threads, (int) (maxmem / checkpointed_memory)));
+    }
+
+    // Batches of alignment vectors that are realigned together, one template per SIMD lane.
+    // Templates of similar length share a batch, so that few cells of the lanes are turned off.
+    // Self hits and templates too long for the memory of VECSIZE_FLOAT posterior matrices
+    // are realigned on their own.
+    std::vector<std::vector<size_t> > batches;
+    HMMSimd **t_hmm_simd = NULL;
+    HMMSimd *q_simd = NULL;
+    if (mac_simd) {
+        const long int Lmaxmem_simd = maxmem / (VECSIZE_FLOAT * (sizeof(float) + 1)) / q.L / m_n_threads;
+        std::vector<std::pair<int, size_t> > lengths;
+        for (size_t idx = 0; idx < alignment.size(); idx++) {
+            if (checkpointed[idx]) {
+                continue;
+            }
+            bool self = false;
+            for (size_t idb = 0; idb < alignment[idx].size(); idb++) {
+                self |= alignment[idx][idb]->self;
+            }
+            if (self || alignment[idx][0]->L > Lmaxmem_simd) {
+                batches.push_back(std::vector<size_t>(1, idx));
+            } else {
+                lengths.push_back(std::make_pair(alignment[idx][0]->L, idx));
+            }
+        }
+        // longest first; a batch takes templates of at least 3/4 of the length of its first one
+        std::sort(lengths.rbegin(), lengths.rend());
+        int batch_length = 0;
+        for (size_t i = 0; i < lengths.size(); i++) {
+            if (i == 0 || batches.back().size() == VECSIZE_FLOAT || 4 * lengths[i].first < 3 * batch_length) {
+                batches.push_back(std::vector<size_t>());
+                batch_length = lengths[i].first;
+            }
+            batches.back().push_back(lengths[i].second);
+        }
+
+        q_simd = new HMMSimd(q.L + 2);
+        q_simd->MapOneHMM(q_hmm);
+        t_hmm_simd = new HMMSimd *[m_n_threads];
+        for (int i = 0; i < m_n_threads; i++) {
+            t_hmm_simd[i] = new HMMSimd(par.maxres);
+        }
+    } else {
+        for (size_t idx = 0; idx < alignment.size(); idx++) {
+            if (!checkpointed[idx]) {
+                batches.push_back(std::vector<size_t>(1, idx));
+            }
+        }
+    }
+
     /////////////////////////////////////////////////////////////////////////////////////////////////
-    // Iterate over all alignment vectors.
+    // Iterate over all batches of alignment vectors, then over the checkpointed ones.
     // Each vector contains all alternative alignments for one Target
-#pragma omp parallel for schedule(static)
-    for (size_t idx = 0; idx < alignment.size(); idx++) {
-        std::vector<Hit *> hits = alignment[idx];
-        // find next free worker thread
-        int current_thread_id = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        const std::vector<std::vector<size_t> > & pass_batches = (pass == 0 ? batches : checkpointed_batches);
+        // Longest processing time first: the costs of the batches differ by orders of magnitude,
+        // the most expensive ones are started first and each thread takes the next batch when done
+        std::vector<std::pair<size_t, size_t> > costs;
+        for (size_t ibatch = 0; ibatch < pass_batches.size(); ibatch++) {
+            costs.push_back(std::make_pair(batchCost(alignment, pass_batches[ibatch], q.L), ibatch));
+        }
+        std::sort(costs.begin(), costs.end(), compareCost);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(pass == 0 ? m_n_threads : checkpointed_threads)
+        for (size_t icost = 0; icost < costs.size(); icost++) {
+            const std::vector<size_t> & batch = pass_batches[costs[icost].second];
+            // find next free worker thread
+            int current_thread_id = 0;
 #ifdef OPENMP
-        current_thread_id = omp_get_thread_num();
+            current_thread_id = omp_get_thread_num();
 #endif
-        PosteriorDecoder * decoder = threads->at(current_thread_id);
-        std::vector<PosteriorDecoder::MACBacktraceResult> alignment_to_exclude;
-        for(size_t idb = 0; idb < hits.size(); idb++){
-            Hit *hit_cur = hits.at(idb);
-            int format_tmp = 0;
-            //char wg = 0;
-            if(idb == 0){ // just read in the first time (less IO/CPU usage)
-                hit_cur->entry->getTemplateHMM(par, par.wg, qsc, format_tmp, pb, S, Sim, t_hmm[current_thread_id]);
-                PrepareTemplateHMM(par, q_hmm, t_hmm[current_thread_id], format_tmp, true, pb, R);
+            PosteriorDecoder * decoder = threads->at(current_thread_id);
+            HMM ** thread_t_hmm = t_hmm + current_thread_id * lanes;
+            std::vector<std::vector<PosteriorDecoder::MACBacktraceResult> > alignment_to_exclude(batch.size());
+            size_t max_hits = 0;
+            for (size_t k = 0; k < batch.size(); k++) {
+                // just read in the first time (less IO/CPU usage)
+                Hit *hit_cur = alignment[batch[k]].at(0);
+                int format_tmp = 0;
+                m_template_cache->getTemplateHMM(hit_cur->entry, par, par.wg, qsc, format_tmp, pb, S, Sim, R, thread_t_hmm[k]);
+                PrepareTemplateHMM(par, q_hmm, thread_t_hmm[k], format_tmp, true, pb, R);
+                max_hits = std::max(max_hits, alignment[batch[k]].size());
             }
 
-            //TODO: par.ssw_realign not used???
-            // start realignment process
-            decoder->realign(*q_hmm, *t_hmm[current_thread_id],
-                    *hit_cur, *m_posterior_matrices[current_thread_id],
-                    *m_backtrace_matrix[current_thread_id], alignment_to_exclude, par.exclstr, par.template_exclstr, par.min_overlap, par.shift, par.mact, par.corr);
-            // add result to exclution paths (needed to align 2nd, 3rd, ... best alignment)
-            alignment_to_exclude.push_back(PosteriorDecoder::MACBacktraceResult(hit_cur->alt_i, hit_cur->alt_j));
-        } // end idb
-        // clear all backtrace paths
-        for (size_t ibt = 0; ibt < alignment_to_exclude.size(); ibt++) {
-            alignment_to_exclude[ibt].alt_i->clear();
-            alignment_to_exclude[ibt].alt_j->clear();
-        }
-        // remove all backtrace paths
-        alignment_to_exclude.clear();
-    }    // end - alignment vector
+            for(size_t idb = 0; idb < max_hits; idb++){
+                if (batch.size() == 1) {
+                    //TODO: par.ssw_realign not used???
+                    // start realignment process
+                    Hit *hit_cur = alignment[batch[0]].at(idb);
+                    decoder->realign(*q_hmm, *thread_t_hmm[0],
+                            *hit_cur, *m_posterior_matrices[current_thread_id],
+                            *m_backtrace_matrix[current_thread_id], alignment_to_exclude[0], par.exclstr, par.template_exclstr, par.min_overlap, par.mac_band, par.shift, par.mact, par.corr);
+                    // add result to exclution paths (needed to align 2nd, 3rd, ... best alignment)
+                    alignment_to_exclude[0].push_back(PosteriorDecoder::MACBacktraceResult(hit_cur->alt_i, hit_cur->alt_j));
+                    continue;
+                }
 
-    for (int i = 0; i < m_n_threads; i++) {
+                // the idb-th hits of the alignment vectors that have one
+                std::vector<HMM *> t_lanes;
+                std::vector<Hit *> hit_lanes;
+                std::vector<std::vector<PosteriorDecoder::MACBacktraceResult> > exclude_lanes;
+                std::vector<size_t> lane_index;
+                for (size_t k = 0; k < batch.size(); k++) {
+                    if (idb < alignment[batch[k]].size()) {
+                        t_lanes.push_back(thread_t_hmm[k]);
+                        hit_lanes.push_back(alignment[batch[k]].at(idb));
+                        exclude_lanes.push_back(alignment_to_exclude[k]);
+                        lane_index.push_back(k);
+                    }
+                }
+                decoder->realign(*q_hmm, *q_simd, t_lanes, *t_hmm_simd[current_thread_id],
+                        hit_lanes, *m_posterior_matrices[current_thread_id],
+                        *m_backtrace_matrix[current_thread_id], exclude_lanes, par.exclstr, par.template_exclstr, par.min_overlap, par.shift, par.mact, par.corr);
+                // add results to exclution paths (needed to align 2nd, 3rd, ... best alignment)
+                for (size_t lane = 0; lane < hit_lanes.size(); lane++) {
+                    alignment_to_exclude[lane_index[lane]].push_back(
+                            PosteriorDecoder::MACBacktraceResult(hit_lanes[lane]->alt_i, hit_lanes[lane]->alt_j));
+                }
+            } // end idb
+            // clear all backtrace paths
+            for (size_t k = 0; k < alignment_to_exclude.size(); k++) {
+                for (size_t ibt = 0; ibt < alignment_to_exclude[k].size(); ibt++) {
+                    alignment_to_exclude[k][ibt].alt_i->clear();
+                    alignment_to_exclude[k][ibt].alt_j->clear();
+                }
+            }
+            // remove all backtrace paths
+            alignment_to_exclude.clear();
+        }    // end - batch of alignment vectors
+    }    // end - pass
+
+    for (int i = 0; i < m_n_threads * lanes; i++) {
         delete t_hmm[i];
     }
     delete[] t_hmm;
+    if (mac_simd) {
+        for (int i = 0; i < m_n_threads; i++) {
+            delete t_hmm_simd[i];
+        }
+        delete[] t_hmm_simd;
+        delete q_simd;
+    }
 
     cleanupThread(threads);
 }
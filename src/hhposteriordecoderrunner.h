@@ -11,13 +11,14 @@
 #include "hhposteriormatrix.h"
 #include "hhviterbimatrix.h"
 #include "hhfunc.h"
+#include "hhtemplatecache.h"
 
 class PosteriorDecoderRunner {
 public:
 	PosteriorDecoderRunner(PosteriorMatrix **posterior_matrices, ViterbiMatrix **backtrace_matrix,
 						   const int n_threadsconst, float ssw, const float S73[NDSSP][NSSPRED][MAXCF],
 						   const float S33[NSSPRED][MAXCF][NSSPRED][MAXCF],
-						   const float S37[NSSPRED][MAXCF][NDSSP]);
+						   const float S37[NSSPRED][MAXCF][NDSSP], TemplateHMMCache* template_cache);
 	virtual ~PosteriorDecoderRunner();
 
 	void executeComputation(HMM &q, std::vector<Hit *> hits, Parameters &par,
@@ -37,6 +38,7 @@ private:
 	PosteriorMatrix** m_posterior_matrices;
 	ViterbiMatrix ** m_backtrace_matrix;		// ViterbiMatrix used as backtrace and celloff matrix
 	const int m_n_threads;			// Number of threads used to process m_worker_queue
+	TemplateHMMCache* m_template_cache;	// prepared template HMMs of the query
 
 	std::vector<PosteriorDecoder*> * initializeConsumerThreads(char loc, size_t max_target_size, size_t query_size,
 			           										   const float ssw, const float S73[NDSSP][NSSPRED][MAXCF],
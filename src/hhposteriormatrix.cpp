@@ -9,12 +9,24 @@
 
 PosteriorMatrix::PosteriorMatrix() {
 		m_probabilities = NULL;
+		m_rows = NULL;
+		m_row_offset = NULL;
+		m_full_offset = NULL;
+		m_band = NULL;
+		m_band_size = 0;
+		m_band_rows = NULL;
+		m_band_offset = NULL;
+		m_band_q_max = 0;
 		m_q_max_length = 0;
 		m_t_max_length = 0;
+		m_lanes = 1;
 }
 
 PosteriorMatrix::~PosteriorMatrix() {
   DeleteProbabilityMatrix();
+  free(m_band);
+  delete[] m_band_rows;
+  delete[] m_band_offset;
 }
 
 
@@ -40,9 +52,90 @@ void PosteriorMatrix::allocateMatrix(int q_length_max, int t_length_max) {
     m_probabilities = malloc_matrix<float>(m_q_max_length+2, m_t_max_length+2);
     if (!m_probabilities)
         MemoryError("m_probabilities", __FILE__, __LINE__, __func__);
+    m_full_offset = new int[m_q_max_length + 2]();
+    m_rows = m_probabilities;
+    m_row_offset = m_full_offset;
 
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Select the number of templates per cell: element (i,j) of template elem is stored at
+// row i, column j * lanes + elem, so that a cell of all lanes can be loaded as simd_float
+///////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorMatrix::SetAlignmentSize(const int q_length, const int t_length, const int lanes) {
+    m_lanes = lanes;
+    m_rows = m_probabilities;
+    m_row_offset = m_full_offset;
+    const int row_length = (t_length + 1) * lanes;
+    if (q_length + 1 <= m_q_max_length && row_length <= m_t_max_length)
+        return;
+    allocateMatrix(imax(q_length, m_q_max_length), imax(row_length, m_t_max_length));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Banded matrix of one template: the columns first_col[i] ... last_col[i] of the rows
+// i = 0 ... q_length are stored one row after the other, the column index is shifted by
+// the first column of the row. The full matrix stays allocated for the next alignment.
+///////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorMatrix::SetBand(const int q_length, const int * first_col, const int * last_col) {
+    size_t size = 0;
+    for (int i = 0; i <= q_length; i++) {
+        size += last_col[i] - first_col[i] + 1;
+    }
+    allocateBand(q_length, size);
+
+    size_t start = 0;
+    for (int i = 0; i <= q_length; i++) {
+        m_band_rows[i] = m_band + start;
+        m_band_offset[i] = first_col[i];
+        start += last_col[i] - first_col[i] + 1;
+    }
+    m_lanes = 1;
+    m_rows = m_band_rows;
+    m_row_offset = m_band_offset;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Segment of a checkpointed realignment: the rows of one segment of the query are stored
+// at a time in the storage of the banded matrix, row i in row (i - 1) % rows.
+///////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorMatrix::SetSegmentRows(const int q_length, const int t_length, const int rows) {
+    const size_t row_length = t_length + 1;
+    allocateBand(q_length, rows * row_length);
+
+    m_band_rows[0] = m_band;
+    m_band_offset[0] = 0;
+    for (int i = 1; i <= q_length; i++) {
+        m_band_rows[i] = m_band + ((i - 1) % rows) * row_length;
+        m_band_offset[i] = 0;
+    }
+    m_lanes = 1;
+    m_rows = m_band_rows;
+    m_row_offset = m_band_offset;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Grow the storage of the banded matrix to size floats of q_length + 1 rows, set to zero
+///////////////////////////////////////////////////////////////////////////////////////////////
+void PosteriorMatrix::allocateBand(const int q_length, const size_t size) {
+    if (q_length + 1 > m_band_q_max) {
+        delete[] m_band_rows;
+        delete[] m_band_offset;
+        m_band_q_max = q_length + 1;
+        m_band_rows = new float*[m_band_q_max];
+        m_band_offset = new int[m_band_q_max];
+    }
+
+    if (size > m_band_size) {
+        free(m_band);
+        m_band_size = size;
+        m_band = (float *) malloc_simd_float(m_band_size * sizeof(float));
+        if (!m_band)
+            MemoryError("m_band", __FILE__, __LINE__, __func__);
+    }
+    memset(m_band, 0, size * sizeof(float));
+}
+
 
 void PosteriorMatrix::DeleteProbabilityMatrix() {
     if(m_q_max_length == 0)
@@ -54,7 +147,11 @@ void PosteriorMatrix::DeleteProbabilityMatrix() {
 //  delete[] m_probabilities;
  
     free(m_probabilities);
+    delete[] m_full_offset;
     m_probabilities = NULL;
+    m_full_offset = NULL;
+    m_rows = NULL;
+    m_row_offset = NULL;
     m_q_max_length = 0;
     m_t_max_length = 0;
 }
@@ -20,28 +20,37 @@ public:
 	virtual ~PosteriorMatrix();
 
 	void allocateMatrix(const int q_length_max, const int t_length_max);
+	// Select the number of templates stored per cell (interleaved), grows the matrix if needed
+	void SetAlignmentSize(const int q_length, const int t_length, const int lanes);
+	// Store the rows banded (one template): row i keeps only the columns first_col[i] ... last_col[i],
+	// initialized to zero. The other columns of the row must not be accessed.
+	void SetBand(const int q_length, const int * first_col, const int * last_col);
+	// Store rows rows of one template of length t_length (checkpointed realignment): row i lies
+	// in row (i - 1) % rows, row 0 in row 0. Initialized to zero.
+	void SetSegmentRows(const int q_length, const int t_length, const int rows);
 
+	// Rows of the full matrix (not banded)
 	float * getRow(const int row) const;
     float * getColScoreRow(const int row) const;
 	///////////////////////////////////////////////////////////////////////////////////////////////
 	// Return a float value of a selected element of matrix
 	///////////////////////////////////////////////////////////////////////////////////////////////
-	inline float getPosteriorValue(const int row, const int col) const {
-		return m_probabilities[row][col];
+	inline float getPosteriorValue(const int row, const int col, const int elem) const {
+		return m_rows[row][col * m_lanes + elem - m_row_offset[row]];
 	}
 
 	///////////////////////////////////////////////////////////////////////////////////////////////
 	// Set a single float value to an element of matrix
 	///////////////////////////////////////////////////////////////////////////////////////////////
-	inline void setPosteriorValue(const int row, const int col, const float value) {
-		m_probabilities[row][col] = value;
+	inline void setPosteriorValue(const int row, const int col, const int elem, const float value) {
+		m_rows[row][col * m_lanes + elem - m_row_offset[row]] = value;
 	}
 
 	///////////////////////////////////////////////////////////////////////////////////////////////
 	// Multiply a single float value to an element of matrix
 	///////////////////////////////////////////////////////////////////////////////////////////////
-	inline void multiplyPosteriorValue(const int row, const int col, const float value) {
-		m_probabilities[row][col] *= value;
+	inline void multiplyPosteriorValue(const int row, const int col, const int elem, const float value) {
+		m_rows[row][col * m_lanes + elem - m_row_offset[row]] *= value;
 	}
 
 	void DeleteProbabilityMatrix();
@@ -49,7 +58,18 @@ public:
 private:
 	int m_q_max_length;
 	int m_t_max_length;
+	int m_lanes;				// templates per cell
 	float ** m_probabilities;
+	float ** m_rows;			// rows of the full or of the banded matrix
+	int * m_row_offset;			// first stored column of each row (0 unless banded)
+	int * m_full_offset;		// all 0, m_row_offset of the full matrix
+	float * m_band;				// storage of the banded rows
+	size_t m_band_size;
+	float ** m_band_rows;
+	int * m_band_offset;
+	int m_band_q_max;
+
+	void allocateBand(const int q_length, const size_t size);
 
 };
 
@@ -8,12 +8,71 @@
 #include "hhprefilter.h"
 #include "ext/fmemopen.h"
 #include "cs219.lib.h"
+#include "hhprefilter_kernels.h"
 
-#define SWAP(tmp, arg1, arg2) tmp = arg1; arg1 = arg2; arg2 = tmp;
+#include <unistd.h>
 
-Prefilter::Prefilter(const std::string& cs_library, FFindexDatabase* cs219_database) {
+// queries up to this length use the inter-sequence kernel in the 1st prefilter
+static const int INTERSEQ_MAX_QUERY_LENGTH = 80;
+
+// index lookups: all seeds scoring at least 4 bits are looked up,
+// candidates need 2 seed hits on one diagonal
+static const int INDEX_SEED_BITS = 4;
+static const int INDEX_MIN_DIAGONAL_HITS = 2;
+
+// number of chunks of similar cost the db is cut into for the 1st prefilter and
+// the per-sequence overhead of the kernels in residues
+static const size_t PREFILTER_CHUNKS = 4096;
+static const size_t PREFILTER_SEQUENCE_COST = 16;
+
+// size of the striped query profile of one tile if the L2 cache size is unknown,
+// otherwise half of the L2 cache; longer queries are split into tiles
+static const long PREFILTER_TILE_BYTES = 256 * 1024;
+
+// orders db sequence indices by decreasing length
+struct LongerSequence {
+  const int* length;
+  LongerSequence(const int* length) : length(length) {}
+  bool operator()(const uint32_t a, const uint32_t b) const {
+    return length[a] > length[b];
+  }
+};
+
+Prefilter::Prefilter(const std::string& cs_library,
+    const std::vector<FFindexDatabase*>& cs219_databases,
+    const std::vector<std::string>& packed_filenames) {
   num_dbs = 0;
 
+  // stripe the query profiles for the widest byte kernels the cpu supports
+  element_count = VECSIZE_INT * 4;
+  use_avx512 = false;
+#ifdef PREFILTER_AVX512
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) {
+    element_count = 64;
+    use_avx512 = true;
+    HH_LOG(DEBUG) << "Using AVX-512BW prefilter kernels" << std::endl;
+  }
+#endif
+
+  // tiles are a multiple of the vector size, only the last tile of a query has padding
+  long tile_bytes = PREFILTER_TILE_BYTES;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  const long l2_cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (l2_cache_size > 0) {
+    tile_bytes = l2_cache_size / 2;
+  }
+#endif
+  max_tile_length = std::max((long) element_count,
+      tile_bytes / (long) (cs::AS219::kSize + 1) / element_count * element_count);
+  HH_LOG(DEBUG) << "Query profiles are striped in tiles of " << max_tile_length << " positions" << std::endl;
+
+  // short queries are scored against 64 db sequences at once in the 1st prefilter
+  use_interseq = false;
+#ifdef PREFILTER_AVX512
+  use_interseq = use_avx512 && __builtin_cpu_supports("avx512vbmi");
+#endif
+
   FILE* fin;
   if (cs_library.empty()) {
     fin = fmemopen((void*)cs219_lib, cs219_lib_len, "r");
@@ -29,240 +88,78 @@ Prefilter::Prefilter(const std::string& cs_library, FFindexDatabase* cs219_datab
 
   cs::TransformToLin(*cs_lib);
 
-  init_prefilter(cs219_database);
+  init_prefilter(cs219_databases, packed_filenames);
 }
 
 Prefilter::~Prefilter() {
-  free(length);
-  free(first);
-
-  for (size_t n = 0; n < num_dbs; n++)
-    delete[] dbnames[n];
-  free(dbnames);
+  for (size_t d = 0; d < indexes.size(); d++) {
+    delete indexes[d];
+  }
+  for (size_t d = 0; d < cs219_sequences.size(); d++) {
+    delete cs219_sequences[d];
+  }
 
   delete cs_lib;
 }
 
-int Prefilter::swStripedByte(unsigned char *querySeq, int queryLength,
-                             unsigned char *dbSeq, int dbLength, unsigned short gapOpen,
-                             unsigned short gapExtend, simd_int *pvHLoad, simd_int *pvHStore,
-                             simd_int *pvE, unsigned short bias) {
-    const int element_count = (VECSIZE_INT * 4);
-
-    uint8_t max = 0;		                     /* the max alignment score */
-    int32_t end_query = queryLength - 1;
-    int32_t end_db = -1; /* 0_based best alignment ending point; Initialized as isn't aligned -1. */
-    int32_t segLen = (queryLength + element_count-1) / element_count; /* number of segment */
-    /* array to record the largest score of each reference position */
-    simd_int *pvQueryProf = (simd_int*) querySeq;
-
-    /* Define 16 byte 0 vector. */
-    simd_int vZero = simdi32_set(0);
-    memset(pvHStore,0,segLen*sizeof(simd_int));
-    memset(pvHLoad,0,segLen*sizeof(simd_int));
-    memset(pvE,0,segLen*sizeof(simd_int));
-
-    int32_t i, j;
-    /* 16 byte insertion begin vector */
-    simd_int vGapO = simdi8_set(gapOpen);
-
-    /* 16 byte insertion extension vector */
-    simd_int vGapE = simdi8_set(gapExtend);
-
-    /* 16 byte bias vector */
-    simd_int vBias = simdi8_set(bias);
-
-    simd_int vMaxScore = vZero; /* Trace the highest score of the whole SW matrix. */
-    simd_int vMaxMark = vZero; /* Trace the highest score till the previous column. */
-    simd_int vTemp;
-    int32_t edge, begin = 0, end = dbLength, step = 1;
-    //	int32_t distance = query_length * 2 / 3;
-    //	int32_t distance = query_length / 2;
-    //	int32_t distance = query_length;
-
-    /* outer loop to process the reference sequence */
-
-    for (i = begin; i != end; i += step) {
-        simd_int e, vF = vZero, vMaxColumn = vZero; /* Initialize F value to 0.
-                                                    Any errors to vH values will be corrected in the Lazy_F loop.
-                                                    */
-        //		max16(maxColumn[i], vMaxColumn);
-        //		fprintf(stderr, "middle[%d]: %d\n", i, maxColumn[i]);
-
-        simd_int vH = pvHStore[segLen - 1];
-        vH = simdi8_shiftl (vH, 1); /* Shift the 128-bit value in vH left by 1 byte. */
-        const simd_int* vP = pvQueryProf + dbSeq[i] * segLen; /* Right part of the query_profile_byte */
-        //	int8_t* t;
-        //	int32_t ti;
-        //        fprintf(stderr, "i: %d of %d:\t ", i,segLen);
-        //for (t = (int8_t*)vP, ti = 0; ti < segLen; ++ti) fprintf(stderr, "%d\t", *t++);
-        //fprintf(stderr, "\n");
-
-        /* Swap the 2 H buffers. */
-        simd_int* pv = pvHLoad;
-        pvHLoad = pvHStore;
-        pvHStore = pv;
-
-        /* inner loop to process the query sequence */
-        for (j = 0; j < segLen; ++j) {
-            vH = simdui8_adds(vH, simdi_load(vP + j));
-            vH = simdui8_subs(vH, vBias); /* vH will be always > 0 */
-            //	max16(maxColumn[i], vH);
-            //	fprintf(stderr, "H[%d]: %d\n", i, maxColumn[i]);
-            //	int8_t* t;
-            //	int32_t ti;
-            //for (t = (int8_t*)&vH, ti = 0; ti < 16; ++ti) fprintf(stderr, "%d\t", *t++);
-
-            /* Get max from vH, vE and vF. */
-            e = simdi_load(pvE + j);
-            vH = simdui8_max(vH, e);
-            vH = simdui8_max(vH, vF);
-            vMaxColumn = simdui8_max(vMaxColumn, vH);
-
-            //	max16(maxColumn[i], vMaxColumn);
-            //	fprintf(stderr, "middle[%d]: %d\n", i, maxColumn[i]);
-            //	for (t = (int8_t*)&vMaxColumn, ti = 0; ti < 16; ++ti) fprintf(stderr, "%d\t", *t++);
-
-            /* Save vH values. */
-            simdi_store(pvHStore + j, vH);
-
-            /* Update vE value. */
-            vH = simdui8_subs(vH, vGapO); /* saturation arithmetic, result >= 0 */
-            e = simdui8_subs(e, vGapE);
-            e = simdui8_max(e, vH);
-            simdi_store(pvE + j, e);
-
-            /* Update vF value. */
-            vF = simdui8_subs(vF, vGapE);
-            vF = simdui8_max(vF, vH);
-
-            /* Load the next vH. */
-            vH = simdi_load(pvHLoad + j);
-        }
-
-        /* Lazy_F loop: has been revised to disallow adjecent insertion and then deletion, so don't update E(i, j), learn from SWPS3 */
-        /* reset pointers to the start of the saved data */
-        j = 0;
-        vH = simdi_load (pvHStore + j);
-
-        /*  the computed vF value is for the given column.  since */
-        /*  we are at the end, we need to shift the vF value over */
-        /*  to the next column. */
-        vF = simdi8_shiftl (vF, 1);
-        vTemp = simdui8_subs (vH, vGapO);
-        vTemp = simdui8_subs (vF, vTemp);
-        vTemp = simdi8_eq (vTemp, vZero);
-        uint32_t cmp = simdi8_movemask (vTemp);
-#ifdef AVX2
-        while (cmp != 0xffffffff)
-#else
-        while (cmp != 0xffff)
-#endif
-        {
-            vH = simdui8_max (vH, vF);
-            vMaxColumn = simdui8_max(vMaxColumn, vH);
-            simdi_store (pvHStore + j, vH);
-            vF = simdui8_subs (vF, vGapE);
-            j++;
-            if (j >= segLen)
-            {
-                j = 0;
-                vF = simdi8_shiftl (vF, 1);
-            }
-            vH = simdi_load (pvHStore + j);
-
-            vTemp = simdui8_subs (vH, vGapO);
-            vTemp = simdui8_subs (vF, vTemp);
-            vTemp = simdi8_eq (vTemp, vZero);
-            cmp  = simdi8_movemask (vTemp);
-        }
-
-        vMaxScore = simdui8_max(vMaxScore, vMaxColumn);
-
+int Prefilter::swStripedByte(unsigned char *querySeq, int queryLength, int tileLength,
+                             const unsigned char *dbSeq, int dbLength, unsigned short gapOpen,
+                             unsigned short gapExtend, unsigned char *workspace, unsigned short bias,
+                             int *diagonal) {
+    // H load, H store and E vectors, each segLen vectors long, followed by the tile boundary
+    const int segLen = (std::min(queryLength, tileLength) + element_count - 1) / element_count;
+    unsigned char *pvHLoad = workspace;
+    unsigned char *pvHStore = workspace + segLen * element_count;
+    unsigned char *pvE = workspace + 2 * segLen * element_count;
+    unsigned char *boundary = workspace + 3 * segLen * element_count;
+
+    int score;
+    int end_query;
+    int end_db;
+#ifdef PREFILTER_AVX512
+    if (use_avx512) {
+        score = sw_striped_byte_avx512(querySeq, queryLength, tileLength, dbSeq, dbLength, gapOpen, gapExtend,
+                                       pvHLoad, pvHStore, pvE, boundary, bias, &end_query, &end_db);
+        *diagonal = end_db - end_query;
+        return score;
     }
-
-
-    int score = simd_hmax((unsigned char *) &vMaxScore, element_count);
-
+#endif
+    score = sw_striped_byte(querySeq, queryLength, tileLength, dbSeq, dbLength, gapOpen, gapExtend,
+                            (simd_int *) pvHLoad, (simd_int *) pvHStore, (simd_int *) pvE, boundary, bias,
+                            &end_query, &end_db);
+    *diagonal = end_db - end_query;
     return score;
 }
 
 int Prefilter::ungapped_sse_score(const unsigned char* query_profile,
-    const int query_length, const unsigned char* db_sequence,
+    const int query_length, const int tile_length, const unsigned char* db_sequence,
     const int dbseq_length, const unsigned char score_offset,
-    simd_int* workspace) {
-  int i; // position in query bands (0,..,W-1)
-  int j; // position in db sequence (0,..,dbseq_length-1)
-  int element_count = (VECSIZE_INT * 4);
-  const int W = (query_length + (element_count - 1)) / element_count; // width of bands in query and score matrix = hochgerundetes LQ/16
-
-  simd_int *p;
-  simd_int S;              // 16 unsigned bytes holding S(b*W+i,j) (b=0,..,15)
-  simd_int Smax = simdi_setzero();
-  simd_int Soffset; // all scores in query profile are shifted up by Soffset to obtain pos values
-  simd_int *s_prev, *s_curr; // pointers to Score(i-1,j-1) and Score(i,j), resp.
-  simd_int *qji;             // query profile score in row j (for residue x_j)
-  simd_int *s_prev_it, *s_curr_it;
-  simd_int *query_profile_it = (simd_int *) query_profile;
-  simd_int Zero = simdi_setzero();
-
-  // Load the score offset to all 16 unsigned byte elements of Soffset
-  Soffset = simdi8_set(score_offset);
-
-  // Initialize  workspace to zero
-  for (i = 0, p = workspace; i < 2 * W; ++i)
-    simdi_store(p++, Zero);
-
-  s_curr = workspace;
-  s_prev = workspace + W;
-
-  for (j = 0; j < dbseq_length; ++j) // loop over db sequence positions
-      {
-
-    // Get address of query scores for row j
-    qji = query_profile_it + db_sequence[j] * W;
-
-    // Load the next S value
-    S = simdi_load(s_curr + W - 1);
-    S = simdi8_shiftl(S, 1);
-
-    // Swap s_prev and s_curr, smax_prev and smax_curr
-    SWAP(p, s_prev, s_curr);
-
-    s_curr_it = s_curr;
-    s_prev_it = s_prev;
-
-    for (i = 0; i < W; ++i) // loop over query band positions
-        {
-      // Saturated addition and subtraction to score S(i,j)
-      S = simdui8_adds(S, *(qji++)); // S(i,j) = S(i-1,j-1) + (q(i,x_j) + Soffset)
-      S = simdui8_subs(S, Soffset);       // S(i,j) = max(0, S(i,j) - Soffset)
-      simdi_store(s_curr_it++, S);       // store S to s_curr[i]
-      Smax = simdui8_max(Smax, S);       // Smax(i,j) = max(Smax(i,j), S(i,j))
-
-      // Load the next S and Smax values
-      S = simdi_load(s_prev_it++);
-    }
+    unsigned char* workspace) {
+  // two columns of the tile, followed by the tile boundary
+  const int W = (std::min(query_length, tile_length) + element_count - 1) / element_count;
+  unsigned char* boundary = workspace + 2 * W * element_count;
+#ifdef PREFILTER_AVX512
+  if (use_avx512) {
+    return ungapped_sse_score_avx512(query_profile, query_length, tile_length, db_sequence,
+        dbseq_length, score_offset, workspace, boundary);
   }
-  int score = simd_hmax((unsigned char *) &Smax, element_count);
-
-  /* return largest score */
-  return score;
+#endif
+  return ungapped_sse_score_striped(query_profile, query_length, tile_length, db_sequence,
+      dbseq_length, score_offset, (simd_int *) workspace, boundary);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // Pull out all names from prefilter db file and copy into dbfiles_new for full HMM-HMM comparison
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void Prefilter::init_no_prefiltering(FFindexDatabase* query_database,
-    std::vector<std::pair<int, std::string> >& prefiltered_entries) {
+    std::vector<PrefilterEntry>& prefiltered_entries) {
   ffindex_index_t* db_index = query_database->db_index;
 
   for (size_t n = 0; n < db_index->n_entries; n++) {
     ffindex_entry_t* entry = ffindex_get_entry_by_index(db_index, n);
 
     prefiltered_entries.push_back(
-        std::make_pair<int, std::string>(entry->length,
-            std::string(entry->name)));
+        PrefilterEntry(entry->length, std::string(entry->name)));
   }
 
   HH_LOG(INFO) << "Searching " << prefiltered_entries.size()
@@ -271,7 +168,7 @@ void Prefilter::init_no_prefiltering(FFindexDatabase* query_database,
 
 void Prefilter::init_selected(FFindexDatabase* cs219_database,
     std::vector<std::string> templates,
-    std::vector<std::pair<int, std::string> >& prefiltered_entries) {
+    std::vector<PrefilterEntry>& prefiltered_entries) {
 
   ffindex_index_t* db_index = cs219_database->db_index;
 
@@ -279,45 +176,106 @@ void Prefilter::init_selected(FFindexDatabase* cs219_database,
     ffindex_entry_t* entry = ffindex_get_entry_by_name(db_index, const_cast<char *>(templates[n].c_str()));
 
     prefiltered_entries.push_back(
-        std::make_pair<int, std::string>(entry->length,
-            std::string(entry->name)));
+        PrefilterEntry(entry->length, std::string(entry->name)));
   }
 }
 
 //////////////////////////////////////////////////////////////
 // Reading in column state sequences for prefiltering
 //////////////////////////////////////////////////////////////
-void Prefilter::init_prefilter(FFindexDatabase* cs219_database) {
+void Prefilter::init_prefilter(const std::vector<FFindexDatabase*>& cs219_databases,
+    const std::vector<std::string>& packed_filenames) {
   // Set up variables for prefiltering
-  num_dbs = cs219_database->db_index->n_entries;
-  first = (unsigned char**) mem_align(ALIGN_FLOAT, num_dbs * sizeof(unsigned char*));
-  length = (int*) mem_align(ALIGN_FLOAT, num_dbs * sizeof(int));
-  dbnames = (char**) mem_align(ALIGN_FLOAT, num_dbs * sizeof(char*));
-  for (size_t n = 0; n < num_dbs; n++) {
-    ffindex_entry_t* entry = ffindex_get_entry_by_index(
-        cs219_database->db_index, n);
-    first[n] = (unsigned char*) ffindex_get_data_by_entry(
-        cs219_database->db_data, entry);
-    length[n] = entry->length - 1;
-    dbnames[n] = new char[strlen(entry->name) + 1];
-    strcpy(dbnames[n], entry->name);
+  db_begin.assign(1, 0);
+  max_dblength = 0;
+  for (size_t d = 0; d < cs219_databases.size(); d++) {
+    PackedCS219Database* sequences;
+    if (!packed_filenames[d].empty()
+        && PackedCS219Database::isBuiltFrom(packed_filenames[d].c_str(), cs219_databases[d])) {
+      sequences = new PackedCS219Database(packed_filenames[d].c_str());
+    } else {
+      if (!packed_filenames[d].empty()) {
+        HH_LOG(WARNING) << "The packed cs219 database " << packed_filenames[d] << " does not match "
+            << cs219_databases[d]->data_filename << ", the column state sequences are read from the ffindex." << std::endl;
+        HH_LOG(WARNING) << "\tPlease rebuild it with cs219_pack." << std::endl;
+      }
+      sequences = new PackedCS219Database(cs219_databases[d]);
+    }
+
+    cs219_sequences.push_back(sequences);
+    db_begin.push_back(db_begin.back() + sequences->num_dbs);
+    max_dblength = std::max(max_dblength, sequences->max_length);
   }
+  num_dbs = db_begin.back();
 
   //check if cs219 format is new binary format
   checkCSFormat(5);
 
+  // db sequences sorted by decreasing length: the prefilter loops start with
+  // the most expensive sequences, groups of 64 form the lanes of the inter-sequence kernel
+  if (cs219_sequences.size() == 1) {
+    length = cs219_sequences[0]->lengths;
+    length_order = cs219_sequences[0]->length_order;
+  } else {
+    // concatenate the lengths and merge the length orders of the databases
+    length_storage.resize(num_dbs);
+    length_order_storage.resize(num_dbs);
+    for (size_t d = 0; d < cs219_sequences.size(); d++) {
+      for (size_t k = 0; k < cs219_sequences[d]->num_dbs; k++) {
+        length_storage[db_begin[d] + k] = cs219_sequences[d]->lengths[k];
+        length_order_storage[db_begin[d] + k] = db_begin[d] + cs219_sequences[d]->length_order[k];
+      }
+      std::inplace_merge(length_order_storage.begin(),
+          length_order_storage.begin() + db_begin[d],
+          length_order_storage.begin() + db_begin[d + 1],
+          LongerSequence(num_dbs ? &length_storage[0] : NULL));
+    }
+    length = num_dbs ? &length_storage[0] : NULL;
+    length_order = num_dbs ? &length_order_storage[0] : NULL;
+  }
+
+  // chunks of length_order with similar total length for the dynamic schedule of the 1st prefilter
+  size_t total_length = 0;
+  for (size_t n = 0; n < num_dbs; n++) {
+    total_length += length[n] + PREFILTER_SEQUENCE_COST;
+  }
+  const size_t chunk_length = std::max(total_length / PREFILTER_CHUNKS, (size_t) 1);
+
+  chunk_begin.clear();
+  size_t cumulative_length = 0;
+  for (size_t k = 0; k < num_dbs; k++) {
+    if (cumulative_length >= chunk_begin.size() * chunk_length) {
+      chunk_begin.push_back(k);
+    }
+    cumulative_length += length[length_order[k]] + PREFILTER_SEQUENCE_COST;
+  }
+  chunk_begin.push_back(num_dbs);
+
   HH_LOG(INFO) << "Searching " << num_dbs
       << " column state sequences." << std::endl;
 }
 
+void Prefilter::load_index(const size_t d, const char* filename) {
+  indexes.resize(cs219_sequences.size(), NULL);
+  delete indexes[d];
+  indexes[d] = new PrefilterIndex(filename, db_begin[d + 1] - db_begin[d]);
+}
+
 void Prefilter::checkCSFormat(size_t nr_checks) {
-  for (size_t n = 0; n < std::min(nr_checks, num_dbs); n++) {
-    if (first[n][0] == '>') {
-      nr_checks--;
+  // the first sequences of every database
+  bool old_format = false;
+  for (size_t d = 0; d < cs219_sequences.size(); d++) {
+    const size_t end = std::min(db_begin[d] + nr_checks, db_begin[d + 1]);
+    size_t old_sequences = 0;
+    for (size_t n = db_begin[d]; n < end; n++) {
+      if (first(n)[0] == '>') {
+        old_sequences++;
+      }
     }
+    old_format |= (old_sequences == nr_checks);
   }
 
-  if (nr_checks == 0) {
+  if (old_format) {
     HH_LOG(ERROR) << "In " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
     HH_LOG(ERROR) << "\tYour cs database is in an old format!" << std::endl;
     HH_LOG(ERROR) << "\tThis format is no longer supportet!" << std::endl;
@@ -331,7 +289,7 @@ void Prefilter::checkCSFormat(size_t nr_checks) {
 ////////////////////////////////////////////////////////////////////////
 void Prefilter::stripe_query_profile(HMM* q_tmp,
     const int prefilter_score_offset, const int prefilter_bit_factor,
-    const int W, unsigned char* qc) {
+    const int tile_length, unsigned char* qc) {
   int LQ = q_tmp->L;
   float** query_profile = NULL;
   int a, h, i, j, k;
@@ -354,52 +312,193 @@ void Prefilter::stripe_query_profile(HMM* q_tmp,
     }
 
   /////////////////////////////////////////
-  // Stripe query profile with chars
-  int element_count = (VECSIZE_INT * 4);
+  // Stripe query profile with chars, tile by tile
+  h = 0;
+  for (int tile_begin = 0; tile_begin < LQ; tile_begin += tile_length) {
+    const int L = std::min(tile_length, LQ - tile_begin);
+    const int W = (L + (element_count - 1)) / element_count;
+
+    for (a = 0; a < cs::AS219::kSize; ++a) {
+      for (i = 0; i < W; ++i) {
+        j = i;
+        for (k = 0; k < element_count; ++k) {
+          if (j >= L)
+            qc[h] = (unsigned char) prefilter_score_offset;
+          else {
+            float dummy = flog2(query_profile[tile_begin + j + 1][a])
+                * prefilter_bit_factor + prefilter_score_offset + 0.5;
+            if (dummy > 255.0)
+              qc[h] = 255;
+            else if (dummy < 0)
+              qc[h] = 0;
+            else
+              qc[h] = (unsigned char) dummy; // 1/3 bits & make scores >=0 everywhere
+          }
+          ++h;
+          j += W;
+        }
+      }
+    }
 
-  for (a = 0; a < cs::AS219::kSize; ++a) {
-    h = a * W * element_count;
+    // Add extra ANY-state (220'th state)
     for (i = 0; i < W; ++i) {
       j = i;
       for (k = 0; k < element_count; ++k) {
-        if (j >= LQ)
+        if (j >= L)
           qc[h] = (unsigned char) prefilter_score_offset;
-        else {
-          float dummy = flog2(query_profile[j + 1][a])
-              * prefilter_bit_factor + prefilter_score_offset + 0.5;
-          if (dummy > 255.0)
-            qc[h] = 255;
-          else if (dummy < 0)
-            qc[h] = 0;
-          else
-            qc[h] = (unsigned char) dummy; // 1/3 bits & make scores >=0 everywhere
-        }
-        ++h;
+        else
+          qc[h] = (unsigned char) (prefilter_score_offset - 1);
+        h++;
         j += W;
       }
     }
   }
 
-  // Add extra ANY-state (220'th state)
-  h = cs::AS219::kSize * W * element_count;
-  for (i = 0; i < W; ++i) {
-    j = i;
-    for (k = 0; k < element_count; ++k) {
-      if (j >= LQ)
-        qc[h] = (unsigned char) prefilter_score_offset;
-      else
-        qc[h] = (unsigned char) (prefilter_score_offset - 1);
-      h++;
-      j += W;
-    }
-  }
-
   for (i = 0; i < LQ + 1; ++i)
     free(query_profile[i]);
   delete[] query_profile;
 }
 
 
+////////////////////////////////////////////////////////////////////////
+// Rearrange the striped query profile into one row of 256 column state
+// scores per query position (inter-sequence kernel and index lookups)
+////////////////////////////////////////////////////////////////////////
+void Prefilter::row_query_profile(const unsigned char* qc,
+    const int LQ, const int tile_length, unsigned char* rows) {
+  for (int i = 0; i < LQ; ++i) {
+    unsigned char* row = rows + i * 256;
+    // tile of position i and its stripes
+    const int t = i / tile_length;
+    const int L = std::min(tile_length, LQ - t * tile_length);
+    const int W = (L + (element_count - 1)) / element_count;
+    const int k = i - t * tile_length;
+    const unsigned char* column = qc + (size_t) t * (cs::AS219::kSize + 1) * tile_length
+        + (k % W) * element_count + k / W;
+    for (int a = 0; a <= cs::AS219::kSize; ++a) {
+      row[a] = column[a * W * element_count];
+    }
+    // unused states and the padding of db sequences never increase a score
+    for (int a = cs::AS219::kSize + 1; a < 256; ++a) {
+      row[a] = 0;
+    }
+  }
+}
+////////////////////////////////////////////////////////////////////////
+// Keep the best min_prefilter_hits and all hits with score above preprefilter_smax_thresh
+// (the passed hits of all threads and, if too few, the best of their heaps)
+////////////////////////////////////////////////////////////////////////
+int Prefilter::select_first_prefilter_hits(
+    std::vector<std::vector<FirstPrefilterHits> >& thread_hits, const size_t b,
+    const int min_prefilter_hits, std::vector<std::pair<int, int> >& first_prefilter) {
+  first_prefilter.clear();
+  std::vector<std::pair<int, int> > best;
+  for (size_t t = 0; t < thread_hits.size(); t++) {
+    FirstPrefilterHits& hits = thread_hits[t][b];
+    first_prefilter.insert(first_prefilter.end(), hits.passed.begin(), hits.passed.end());
+    best.insert(best.end(), hits.best.begin(), hits.best.end());
+    std::vector<std::pair<int, int> >().swap(hits.passed);
+    std::vector<std::pair<int, int> >().swap(hits.best);
+  }
+
+  const size_t missing = std::max(min_prefilter_hits - (int) first_prefilter.size(), 0);
+  if (missing > 0) {
+    const size_t count = std::min(missing, best.size());
+    std::nth_element(best.begin(), best.begin() + count, best.end(),
+        std::greater<std::pair<int, int> >());
+    first_prefilter.insert(first_prefilter.end(), best.begin(), best.begin() + count);
+  }
+
+  return first_prefilter.size();
+}
+
+////////////////////////////////////////////////////////////////////////
+// Keep the best min_prefilter_hits and all hits with E-value below prefilter_evalue_thresh,
+// sorted by E-value
+////////////////////////////////////////////////////////////////////////
+void Prefilter::select_second_prefilter_hits(
+    std::vector<std::vector<std::vector<SecondPrefilterHit> > >& thread_hits,
+    const size_t b, std::vector<SecondPrefilterHit>& hits,
+    const int min_prefilter_hits, const double prefilter_evalue_thresh) {
+  hits.clear();
+  size_t count_passed = 0;
+  for (size_t t = 0; t < thread_hits.size(); t++) {
+    std::vector<SecondPrefilterHit>& thread_b = thread_hits[t][b];
+    for (size_t i = 0; i < thread_b.size(); i++) {
+      if (thread_b[i].evalue <= prefilter_evalue_thresh) {
+        count_passed++;
+      }
+    }
+    hits.insert(hits.end(), thread_b.begin(), thread_b.end());
+    std::vector<SecondPrefilterHit>().swap(thread_b);
+  }
+
+  const size_t count = std::min(std::max(count_passed, (size_t) std::max(min_prefilter_hits, 0)), hits.size());
+  if (count < hits.size()) {
+    std::nth_element(hits.begin(), hits.begin() + count, hits.end());
+    hits.erase(hits.begin() + count, hits.end());
+  }
+  sort(hits.begin(), hits.end());
+}
+
+////////////////////////////////////////////////////////////////////////
+// Translate prefilter hits into database names, split by previous rounds
+////////////////////////////////////////////////////////////////////////
+void Prefilter::collect_prefilter_hits(
+    std::vector<SecondPrefilterHit>& hits, Hash<Hit>* previous_hits,
+    const int maxnumdb,
+    std::vector<PrefilterEntry>& new_prefilter_hits,
+    std::vector<PrefilterEntry>& old_prefilter_hits) {
+  // names of the hits per database
+  std::vector<Hash<char>*> doubled(cs219_sequences.size());
+  for (size_t d = 0; d < doubled.size(); d++) {
+    doubled[d] = new Hash<char>;
+    doubled[d]->New(16381, 0);
+  }
+
+  int count_dbs = 0;
+  std::vector<SecondPrefilterHit>::iterator it2;
+  for (it2 = hits.begin(); it2 < hits.end(); it2++) {
+    // Add hit to dbfiles
+    count_dbs++;
+    char db_name[NAMELEN];
+    strcpy(db_name, dbname((*it2).n));
+
+    char name[NAMELEN];
+    RemoveExtension(name, db_name);
+
+    const size_t d = database((*it2).n);
+    if (!doubled[d]->Contains(db_name)) {
+      doubled[d]->Add(db_name);
+
+      PrefilterEntry result(length[(*it2).n], std::string(db_name), (*it2).diagonal, d);
+
+      // check, if DB was searched in previous rounds
+
+      std::stringstream ss_tmp;
+      ss_tmp << name << "__" << 1;
+
+      if (previous_hits->Contains((char*) ss_tmp.str().c_str())) {
+        old_prefilter_hits.push_back(result);
+      }
+      else {
+        new_prefilter_hits.push_back(result);
+      }
+    }
+    if (count_dbs >= maxnumdb)
+    {
+      HH_LOG(WARNING)
+      << "Number of hits passing 2nd prefilter (reduced from " << hits.size() << " to allowed maximum of " << maxnumdb << ").\n"
+      <<"You can increase the allowed maximum using the -maxfilt <max> option.\n";
+      break;
+    }
+  }
+
+  for (size_t d = 0; d < doubled.size(); d++) {
+    delete doubled[d];
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Main prefilter function
 ////////////////////////////////////////////////////////////////////////
@@ -410,172 +509,347 @@ void Prefilter::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
     const double prefilter_evalue_coarse_thresh,
     const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
     const float R[20][20],
-    std::vector<std::pair<int, std::string> >& new_prefilter_hits,
-    std::vector<std::pair<int, std::string> >& old_prefilter_hits) {
-
-  Hash<char>* doubled = new Hash<char>;
-  doubled->New(16381, 0);
-
-  int element_count = (VECSIZE_INT * 4);
-  //W = (LQ+15) / 16;   // band width = hochgerundetes LQ/16
-  int W = (q_tmp->L + (element_count - 1)) / element_count;
-  // query profile (states + 1 because of ANY char)
-  unsigned char* qc = (unsigned char*)malloc_simd_int((cs::AS219::kSize+1)*(q_tmp->L+element_count)*sizeof(unsigned char));
-  stripe_query_profile(q_tmp, prefilter_score_offset, prefilter_bit_factor, W, qc);
-
-  simd_int ** workspace = new simd_int *[threads];
-
-  std::vector<std::pair<int, int> > first_prefilter;
-  std::vector<std::pair<double, int> > hits;
+    std::vector<PrefilterEntry>& new_prefilter_hits,
+    std::vector<PrefilterEntry>& old_prefilter_hits) {
+
+  std::vector<HMM*> q_tmps(1, q_tmp);
+  std::vector<Hash<Hit>*> previous_hits_batch(1, previous_hits);
+  std::vector<std::vector<PrefilterEntry> > new_prefilter_hits_batch(1);
+  std::vector<std::vector<PrefilterEntry> > old_prefilter_hits_batch(1);
+
+  prefilter_db_batch(q_tmps, previous_hits_batch, threads, prefilter_gap_open,
+      prefilter_gap_extend, prefilter_score_offset, prefilter_bit_factor,
+      prefilter_evalue_thresh, prefilter_evalue_coarse_thresh,
+      preprefilter_smax_thresh, min_prefilter_hits, maxnumdb, R,
+      new_prefilter_hits_batch, old_prefilter_hits_batch);
+
+  new_prefilter_hits.insert(new_prefilter_hits.end(),
+      new_prefilter_hits_batch[0].begin(), new_prefilter_hits_batch[0].end());
+  old_prefilter_hits.insert(old_prefilter_hits.end(),
+      old_prefilter_hits_batch[0].begin(), old_prefilter_hits_batch[0].end());
+}
 
-  int count_dbs = 0;
-  int gap_init = prefilter_gap_open + prefilter_gap_extend;
-  int gap_extend = prefilter_gap_extend;
-  int LQ = q_tmp->L;
-  const float log_qlen = flog2(LQ);
-  const double factor = (double) num_dbs * LQ;
+////////////////////////////////////////////////////////////////////////
+// 1st prefilter with the seed index: only db sequences with enough seed
+// hits on one diagonal are scored with the ungapped kernel
+////////////////////////////////////////////////////////////////////////
+void Prefilter::index_prefilter(const std::vector<unsigned char*>& qc,
+    const std::vector<int>& LQ, const std::vector<int>& tile,
+    const std::vector<float>& log_qlen, const int prefilter_score_offset,
+    const int prefilter_bit_factor, unsigned char** workspace,
+    std::vector<std::vector<FirstPrefilterHits> >& thread_hits) {
+  const size_t nqueries = qc.size();
+  std::vector<std::vector<int> > candidates(nqueries);
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t b = 0; b < nqueries; b++) {
+    unsigned char* rows = (unsigned char*) mem_align(ALIGN_INT, LQ[b] * 256 * sizeof(unsigned char));
+    row_query_profile(qc[b], LQ[b], tile[b], rows);
+    // candidates of all databases as sequences of the prefilter
+    for (size_t d = 0; d < indexes.size(); d++) {
+      std::vector<int> db_candidates;
+      indexes[d]->find_candidates(rows, LQ[b], prefilter_score_offset,
+          INDEX_SEED_BITS * prefilter_bit_factor, INDEX_MIN_DIAGONAL_HITS, db_candidates);
+      for (size_t i = 0; i < db_candidates.size(); i++) {
+        candidates[b].push_back(db_begin[d] + db_candidates[i]);
+      }
+    }
+    free(rows);
+  }
 
-  for (int i = 0; i < threads; i++)
-    workspace[i] = (simd_int*) malloc_simd_int(
-        3 * (LQ + element_count) * sizeof(char));
+  // (db sequence, query) pairs
+  std::vector<std::pair<int, int> > pairs;
+  for (size_t b = 0; b < nqueries; b++) {
+    HH_LOG(DEBUG) << "Candidates from the prefilter index: " << candidates[b].size() << std::endl;
+    for (size_t i = 0; i < candidates[b].size(); i++) {
+      pairs.push_back(std::pair<int, int>(candidates[b][i], b));
+    }
+  }
 
-#pragma omp parallel for schedule(static)
-  // Loop over all database sequences
-  for (size_t n = 0; n < num_dbs; n++) {
+#pragma omp parallel for schedule(dynamic, 64)
+  for (size_t i = 0; i < pairs.size(); i++) {
     int thread_id = 0;
 #ifdef OPENMP
     thread_id = omp_get_thread_num();
 #endif
-    // Perform search step
-    int score = ungapped_sse_score(qc, LQ, first[n], length[n],
+    const int n = pairs[i].first;
+    const int b = pairs[i].second;
+    int score = ungapped_sse_score(qc[b], LQ[b], tile[b], first(n), length[n],
         prefilter_score_offset, workspace[thread_id]);
+    score -= (int) (prefilter_bit_factor * (log_qlen[b] + flog2(length[n])));
 
-    score = score
-        - (int) (prefilter_bit_factor * (log_qlen + flog2(length[n])));
-
-#pragma omp critical
-    first_prefilter.push_back(std::pair<int, int>(score, n));
+    thread_hits[thread_id][b].add(score, n);
   }
-  //filter after calculation of ungapped sse score to include at least min_prefilter_hits
-  std::vector<std::pair<int, int> >::iterator it;
-
-  sort(first_prefilter.begin(), first_prefilter.end());
-  std::reverse(first_prefilter.begin(), first_prefilter.end());
-
-  std::vector<std::pair<int, int> >::iterator first_prefilter_begin_erase =
-      first_prefilter.end();
-  std::vector<std::pair<int, int> >::iterator first_prefilter_end_erase =
-      first_prefilter.end();
-  count_dbs = 0;
-  for (it = first_prefilter.begin(); it < first_prefilter.end(); it++) {
-    if (count_dbs >= min_prefilter_hits
-        && (*it).first <= preprefilter_smax_thresh) {
-      first_prefilter_begin_erase = it;
-      break;
-    }
-    else {
-      count_dbs++;
-    }
+}
+
+#ifdef PREFILTER_AVX512
+////////////////////////////////////////////////////////////////////////
+// 1st prefilter for short queries: groups of 64 db sequences of similar
+// length are interleaved and scored with the inter-sequence kernel
+////////////////////////////////////////////////////////////////////////
+void Prefilter::interseq_prefilter(const std::vector<size_t>& queries,
+    const std::vector<unsigned char*>& qc, const std::vector<int>& LQ,
+    const std::vector<int>& tile, const std::vector<float>& log_qlen,
+    const int threads, const int prefilter_score_offset,
+    const int prefilter_bit_factor,
+    std::vector<std::vector<FirstPrefilterHits> >& thread_hits) {
+  const int lanes = 64;
+  const unsigned char padding = 255;
+  const size_t nqueries = queries.size();
+
+  std::vector<unsigned char*> rows(nqueries);
+  for (size_t i = 0; i < nqueries; i++) {
+    const size_t b = queries[i];
+    rows[i] = (unsigned char*) mem_align(lanes, LQ[b] * 256 * sizeof(unsigned char));
+    row_query_profile(qc[b], LQ[b], tile[b], rows[i]);
   }
 
-  first_prefilter.erase(first_prefilter_begin_erase,
-      first_prefilter_end_erase);
+  // interleaved residues and one column of scores for each thread
+  unsigned char** residues = new unsigned char*[threads];
+  unsigned char** workspace = new unsigned char*[threads];
+  for (int i = 0; i < threads; i++) {
+    residues[i] = (unsigned char*) mem_align(lanes, (size_t) max_dblength * lanes);
+    workspace[i] = (unsigned char*) mem_align(lanes, ((size_t) max_dblength + 1) * lanes);
+  }
 
-  HH_LOG(INFO)
-      << "HMMs passed 1st prefilter (gapless profile-profile alignment)  : "
-      << count_dbs << std::endl;
+  const size_t ngroups = (num_dbs + lanes - 1) / lanes;
 
-#pragma omp parallel for schedule(static)
-  // Loop over all database sequences
-//  for (int n = 0; n < count_dbs; n++) {
-  for (size_t i = 0; i < first_prefilter.size(); i++) {
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t g = 0; g < ngroups; g++) {
     int thread_id = 0;
 #ifdef OPENMP
     thread_id = omp_get_thread_num();
 #endif
+    const size_t begin = g * lanes;
+    const int nseqs = (int) std::min((size_t) lanes, num_dbs - begin);
+    const uint32_t* group = &length_order[begin];
+    // sorted by decreasing length, the first sequence is the longest
+    const int group_length = length[group[0]];
+
+    unsigned char* res = residues[thread_id];
+    for (int k = 0; k < lanes; k++) {
+      const unsigned char* seq = (k < nseqs) ? first(group[k]) : NULL;
+      const int seq_length = (k < nseqs) ? length[group[k]] : 0;
+      for (int j = 0; j < group_length; j++) {
+        res[j * lanes + k] = (j < seq_length) ? seq[j] : padding;
+      }
+    }
 
-    int n = first_prefilter[i].second;
-
-    // Perform search step
-    int score = swStripedByte(qc, LQ, first[n], length[n], gap_init,
-        gap_extend, workspace[thread_id], workspace[thread_id] + W,
-        workspace[thread_id] + 2 * W, prefilter_score_offset);
+    float log_dblen[lanes];
+    for (int k = 0; k < nseqs; k++) {
+      log_dblen[k] = flog2(length[group[k]]);
+    }
 
-    double evalue = factor * length[n] * fpow2(-score / prefilter_bit_factor);
+    for (size_t i = 0; i < nqueries; i++) {
+      const size_t b = queries[i];
+      unsigned char scores[lanes];
+      ungapped_interseq_score_avx512(rows[i], LQ[b], res, group_length,
+          prefilter_score_offset, workspace[thread_id], scores);
 
-    if (evalue < prefilter_evalue_coarse_thresh) {
-#pragma omp critical
-      hits.push_back(std::pair<double, int>(evalue, n));
+      for (int k = 0; k < nseqs; k++) {
+        int score = scores[k]
+            - (int) (prefilter_bit_factor * (log_qlen[b] + log_dblen[k]));
+        thread_hits[thread_id][b].add(score, group[k]);
+      }
     }
   }
 
-  //filter after calculation of evalues to include at least min_prefilter_hits
-  sort(hits.begin(), hits.end());
+  for (int i = 0; i < threads; i++) {
+    free(residues[i]);
+    free(workspace[i]);
+  }
+  delete[] residues;
+  delete[] workspace;
+  for (size_t i = 0; i < nqueries; i++) {
+    free(rows[i]);
+  }
+}
+#endif
 
-  std::vector<std::pair<double, int> >::iterator second_prefilter_begin_erase =
-      hits.end();
-  std::vector<std::pair<double, int> >::iterator second_prefilter_end_erase =
-      hits.end();
-  std::vector<std::pair<double, int> >::iterator it2;
+////////////////////////////////////////////////////////////////////////
+// Prefilter several queries in one pass over the database:
+// all query profiles are scored against a database sequence while it is in cache
+////////////////////////////////////////////////////////////////////////
+void Prefilter::prefilter_db_batch(std::vector<HMM*>& q_tmps,
+    std::vector<Hash<Hit>*>& previous_hits,
+    const int threads, const int prefilter_gap_open,
+    const int prefilter_gap_extend, const int prefilter_score_offset,
+    const int prefilter_bit_factor, const double prefilter_evalue_thresh,
+    const double prefilter_evalue_coarse_thresh,
+    const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
+    const float R[20][20],
+    std::vector<std::vector<PrefilterEntry> >& new_prefilter_hits,
+    std::vector<std::vector<PrefilterEntry> >& old_prefilter_hits) {
+
+  const size_t nqueries = q_tmps.size();
+
+  std::vector<int> LQ(nqueries);
+  std::vector<int> tile(nqueries);
+  std::vector<float> log_qlen(nqueries);
+  std::vector<double> factor(nqueries);
+  std::vector<unsigned char*> qc(nqueries);
+
+  int LQ_max = 0;
+  for (size_t b = 0; b < nqueries; b++) {
+    LQ[b] = q_tmps[b]->L;
+    // long queries are striped in tiles that fit into the cache
+    tile[b] = std::min(LQ[b], max_tile_length);
+    log_qlen[b] = flog2(LQ[b]);
+    factor[b] = (double) num_dbs * LQ[b];
+    // query profile (states + 1 because of ANY char)
+    qc[b] = (unsigned char*)mem_align(element_count, (cs::AS219::kSize+1)*(LQ[b]+element_count)*sizeof(unsigned char));
+    stripe_query_profile(q_tmps[b], prefilter_score_offset, prefilter_bit_factor, tile[b], qc[b]);
+    LQ_max = std::max(LQ_max, LQ[b]);
+  }
 
-  count_dbs = 0;
-  for (it2 = hits.begin(); it2 < hits.end(); it2++) {
-    if (count_dbs >= min_prefilter_hits
-        && (*it2).first > prefilter_evalue_thresh) {
-      second_prefilter_begin_erase = it2;
-      break;
-    }
-    else {
-      count_dbs++;
+  unsigned char ** workspace = new unsigned char *[threads];
+
+  // results are collected per thread and query, merged after each stage
+  std::vector<std::vector<FirstPrefilterHits> > thread_first_hits(threads,
+      std::vector<FirstPrefilterHits>(nqueries,
+          FirstPrefilterHits(min_prefilter_hits, preprefilter_smax_thresh)));
+  std::vector<std::vector<std::vector<SecondPrefilterHit> > > thread_second_hits(threads,
+      std::vector<std::vector<SecondPrefilterHit> >(nqueries));
+
+  std::vector<std::vector<std::pair<int, int> > > first_prefilter(nqueries);
+  std::vector<std::vector<SecondPrefilterHit> > hits(nqueries);
+
+  int gap_init = prefilter_gap_open + prefilter_gap_extend;
+  int gap_extend = prefilter_gap_extend;
+
+  for (int i = 0; i < threads; i++) {
+    workspace[i] = (unsigned char*) mem_align(element_count,
+        (3 * (LQ_max + element_count) + 2 * max_dblength) * sizeof(char));
+  }
+
+  // with an index only its candidates are scored, otherwise short queries
+  // are scored with the inter-sequence kernel and the others striped
+  std::vector<size_t> striped_queries;
+  std::vector<size_t> interseq_queries;
+  if (!indexes.empty()) {
+    index_prefilter(qc, LQ, tile, log_qlen, prefilter_score_offset,
+        prefilter_bit_factor, workspace, thread_first_hits);
+  } else {
+    for (size_t b = 0; b < nqueries; b++) {
+      if (use_interseq && LQ[b] <= INTERSEQ_MAX_QUERY_LENGTH) {
+        interseq_queries.push_back(b);
+      } else {
+        striped_queries.push_back(b);
+      }
     }
   }
+  const size_t nstriped = striped_queries.size();
+
+  if (nstriped > 0) {
+    const size_t nchunks = chunk_begin.size() - 1;
+#pragma omp parallel for schedule(dynamic, 1)
+    // Loop over all database sequences, in chunks of similar cost starting with the longest sequences
+    for (size_t c = 0; c < nchunks; c++) {
+      int thread_id = 0;
+#ifdef OPENMP
+      thread_id = omp_get_thread_num();
+#endif
+      std::vector<FirstPrefilterHits>& thread_hits = thread_first_hits[thread_id];
 
-  hits.erase(second_prefilter_begin_erase, second_prefilter_end_erase);
+      for (size_t k = chunk_begin[c]; k < chunk_begin[c + 1]; k++) {
+        const size_t n = length_order[k];
+        const float log_dblen = flog2(length[n]);
 
-  count_dbs = 0;
+        // Perform search step for all queries while the db sequence is hot in cache
+        for (size_t i = 0; i < nstriped; i++) {
+          const size_t b = striped_queries[i];
+          int score = ungapped_sse_score(qc[b], LQ[b], tile[b], first(n), length[n],
+              prefilter_score_offset, workspace[thread_id]);
 
-  for (it2 = hits.begin(); it2 < hits.end(); it2++) {
-    // Add hit to dbfiles
-    count_dbs++;
-    char db_name[NAMELEN];
-    strcpy(db_name, dbnames[(*it2).second]);
+          score -= (int) (prefilter_bit_factor * (log_qlen[b] + log_dblen));
+          thread_hits[b].add(score, n);
+        }
+      }
+    }
+  }
 
-    char name[NAMELEN];
-    RemoveExtension(name, db_name);
+#ifdef PREFILTER_AVX512
+  if (!interseq_queries.empty()) {
+    interseq_prefilter(interseq_queries, qc, LQ, tile, log_qlen, threads,
+        prefilter_score_offset, prefilter_bit_factor, thread_first_hits);
+  }
+#endif
+
+  //filter after calculation of ungapped sse score to include at least min_prefilter_hits
+  // second_prefilter holds (db sequence, query) pairs, grouped by db sequence
+  std::vector<std::pair<int, int> > second_prefilter;
+  for (size_t b = 0; b < nqueries; b++) {
+    int count_dbs = select_first_prefilter_hits(thread_first_hits, b,
+        min_prefilter_hits, first_prefilter[b]);
+
+    HH_LOG(INFO)
+        << "HMMs passed 1st prefilter (gapless profile-profile alignment)  : "
+        << count_dbs << std::endl;
+
+    for (size_t i = 0; i < first_prefilter[b].size(); i++) {
+      second_prefilter.push_back(std::pair<int, int>(first_prefilter[b][i].second, b));
+    }
+    std::vector<std::pair<int, int> >().swap(first_prefilter[b]);
+  }
+  sort(second_prefilter.begin(), second_prefilter.end());
 
-    if (!doubled->Contains(db_name)) {
-      doubled->Add(db_name);
+  std::vector<size_t> group_begin;
+  for (size_t i = 0; i < second_prefilter.size(); i++) {
+    if (i == 0 || second_prefilter[i].first != second_prefilter[i - 1].first) {
+      group_begin.push_back(i);
+    }
+  }
+  const size_t ngroups = group_begin.size();
+  group_begin.push_back(second_prefilter.size());
+
+  // most expensive groups first (db length times number of queries)
+  std::vector<std::pair<size_t, size_t> > group_order(ngroups);
+  for (size_t g = 0; g < ngroups; g++) {
+    const int n = second_prefilter[group_begin[g]].first;
+    group_order[g] = std::pair<size_t, size_t>(
+        (size_t) length[n] * (group_begin[g + 1] - group_begin[g]), g);
+  }
+  sort(group_order.begin(), group_order.end(), std::greater<std::pair<size_t, size_t> >());
 
-      std::pair<int, std::string> result;
-      result.first = length[(*it2).second];
-      result.second = std::string(db_name);
+#pragma omp parallel for schedule(dynamic, 1)
+  // Loop over all database sequences that passed the 1st prefilter for any query
+  for (size_t o = 0; o < ngroups; o++) {
+    int thread_id = 0;
+#ifdef OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    const size_t g = group_order[o].second;
 
-      // check, if DB was searched in previous rounds
+    for (size_t i = group_begin[g]; i < group_begin[g + 1]; i++) {
+      int n = second_prefilter[i].first;
+      int b = second_prefilter[i].second;
 
-      std::stringstream ss_tmp;
-      ss_tmp << name << "__" << 1;
+      // Perform search step
+      int diagonal;
+      int score = swStripedByte(qc[b], LQ[b], tile[b], first(n), length[n], gap_init,
+          gap_extend, workspace[thread_id], prefilter_score_offset, &diagonal);
 
-      if (previous_hits->Contains((char*) ss_tmp.str().c_str())) {
-        old_prefilter_hits.push_back(result);
-      }
-      else {
-        new_prefilter_hits.push_back(result);
+      double evalue = factor[b] * length[n] * fpow2(-score / prefilter_bit_factor);
+
+      if (evalue < prefilter_evalue_coarse_thresh) {
+        thread_second_hits[thread_id][b].push_back(SecondPrefilterHit(evalue, n, diagonal));
       }
     }
-    if (count_dbs >= maxnumdb)
-    {
-      HH_LOG(WARNING)
-      << "Number of hits passing 2nd prefilter (reduced from " << hits.size() << " to allowed maximum of " << maxnumdb << ").\n"
-      <<"You can increase the allowed maximum using the -maxfilt <max> option.\n";
-      break;
-    }
+  }
+
+  //filter after calculation of evalues to include at least min_prefilter_hits
+  for (size_t b = 0; b < nqueries; b++) {
+    select_second_prefilter_hits(thread_second_hits, b, hits[b],
+        min_prefilter_hits, prefilter_evalue_thresh);
+    collect_prefilter_hits(hits[b], previous_hits[b], maxnumdb,
+        new_prefilter_hits[b], old_prefilter_hits[b]);
   }
 
   // Free memory
-  free(qc);
-  for (int i = 0; i < threads; i++)
+  for (size_t b = 0; b < nqueries; b++)
+    free(qc[b]);
+  for (int i = 0; i < threads; i++) {
     free(workspace[i]);
+  }
   delete[] workspace;
-  if (doubled)
-    delete doubled;
 }
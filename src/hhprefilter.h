@@ -9,6 +9,8 @@
 
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <functional>
 
 #ifdef OPENMP
 #include <omp.h>
@@ -19,6 +21,8 @@
 #include "hhhit.h"
 #include "simd.h"
 #include "ffindexdatabase.h"
+#include "hhprefilter_index.h"
+#include "hhprefilter_pack.h"
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //   The function swStripedByte contains code adapted from Mengyao Zhao
@@ -69,59 +73,188 @@
 //   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
+// 1st prefilter scores of one query collected by one thread: all hits with a score
+// above preprefilter_smax_thresh and a min-heap with the best min_prefilter_hits others
+class FirstPrefilterHits {
+public:
+	FirstPrefilterHits(const int min_prefilter_hits, const int preprefilter_smax_thresh)
+		: min_prefilter_hits(min_prefilter_hits), preprefilter_smax_thresh(preprefilter_smax_thresh) {};
+
+	// (score, db sequence) pairs
+	std::vector<std::pair<int, int> > passed;
+	std::vector<std::pair<int, int> > best;
+
+	inline void add(const int score, const int n) {
+		const std::pair<int, int> hit(score, n);
+		if (score > preprefilter_smax_thresh) {
+			passed.push_back(hit);
+		} else if (best.size() < (size_t) min_prefilter_hits) {
+			best.push_back(hit);
+			std::push_heap(best.begin(), best.end(), std::greater<std::pair<int, int> >());
+		} else if (min_prefilter_hits > 0 && best.front() < hit) {
+			std::pop_heap(best.begin(), best.end(), std::greater<std::pair<int, int> >());
+			best.back() = hit;
+			std::push_heap(best.begin(), best.end(), std::greater<std::pair<int, int> >());
+		}
+	}
+
+private:
+	int min_prefilter_hits;
+	int preprefilter_smax_thresh;
+};
+
+// 2nd prefilter hit: E-value of db sequence n and the diagonal of its best Smith-Waterman cell
+struct SecondPrefilterHit {
+	double evalue;
+	int n;
+	int diagonal;
+
+	SecondPrefilterHit(const double evalue, const int n, const int diagonal)
+		: evalue(evalue), n(n), diagonal(diagonal) {
+	}
+
+	bool operator<(const SecondPrefilterHit& other) const {
+		return evalue < other.evalue || (evalue == other.evalue && n < other.n);
+	}
+};
+
 class Prefilter {
 public:
-	Prefilter(const std::string& cs_library, FFindexDatabase* cs219_database);
+	// The column state sequences of all cs219 databases are searched as one database, the
+	// hits are ranked together. Database d is read from packed_filenames[d] (written by
+	// cs219_pack) unless it is empty.
+	Prefilter(const std::string& cs_library, const std::vector<FFindexDatabase*>& cs219_databases,
+			const std::vector<std::string>& packed_filenames);
 	virtual ~Prefilter();
 
-	static void init_no_prefiltering(FFindexDatabase* cs219_database, std::vector<std::pair<int, std::string> >& prefiltered_entries);
-	static void init_selected(FFindexDatabase* cs219_database, std::vector<std::string> templates, std::vector<std::pair<int, std::string> >& prefiltered_entries);
+	static void init_no_prefiltering(FFindexDatabase* cs219_database, std::vector<PrefilterEntry>& prefiltered_entries);
+	static void init_selected(FFindexDatabase* cs219_database, std::vector<std::string> templates, std::vector<PrefilterEntry>& prefiltered_entries);
 
 	void prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
 			const int threads, const int prefilter_gap_open, const int prefilter_gap_extend,
 			const int prefilter_score_offset, const int prefilter_bit_factor, const double prefilter_evalue_thresh,
 			const double prefilter_evalue_coarse_thresh, const int preprefilter_smax_thresh,
             const int min_prefilter_hits, const int maxnumdb, const float R[20][20],
-			std::vector<std::pair<int, std::string> >& new_prefilter_hits, std::vector<std::pair<int, std::string> >& old_prefilter_hits);
+			std::vector<PrefilterEntry>& new_prefilter_hits, std::vector<PrefilterEntry>& old_prefilter_hits);
+
+	// use a seed index built by cs219_index for database d in the 1st prefilter
+	// (needs an index for every database)
+	void load_index(const size_t d, const char* filename);
+
+	// prefilter several queries with a single pass over the database (results per query as in prefilter_db)
+	void prefilter_db_batch(std::vector<HMM*>& q_tmps, std::vector<Hash<Hit>*>& previous_hits,
+			const int threads, const int prefilter_gap_open, const int prefilter_gap_extend,
+			const int prefilter_score_offset, const int prefilter_bit_factor, const double prefilter_evalue_thresh,
+			const double prefilter_evalue_coarse_thresh, const int preprefilter_smax_thresh,
+			const int min_prefilter_hits, const int maxnumdb, const float R[20][20],
+			std::vector<std::vector<PrefilterEntry> >& new_prefilter_hits,
+			std::vector<std::vector<PrefilterEntry> >& old_prefilter_hits);
 
 private:
 	cs::ContextLibrary<cs::AA> *cs_lib;
 
-	// number of sequences in prefilter database file
+	// number of sequences in all prefilter databases
 	size_t num_dbs;
 
-	// array containing all sequence names in prefilter db file
-	char** dbnames;
+	// column state sequences and names of the prefilter databases, sequence n
+	// is sequence n - db_begin[d] of database d = database(n)
+	std::vector<PackedCS219Database*> cs219_sequences;
+	std::vector<size_t> db_begin;
+	// lengths of all sequences
+	const int* length;
 
-	// pointer to first letter of next sequence in db_data
-	unsigned char** first;
-
-	// length of next sequence
-	int* length;
+	inline size_t database(const size_t n) const {
+		size_t d = 0;
+		while (n >= db_begin[d + 1]) {
+			d++;
+		}
+		return d;
+	}
+	inline const unsigned char* first(const size_t n) const {
+		const size_t d = database(n);
+		return cs219_sequences[d]->sequences + cs219_sequences[d]->offsets[n - db_begin[d]];
+	}
+	inline const char* dbname(const size_t n) const {
+		const size_t d = database(n);
+		return cs219_sequences[d]->names + cs219_sequences[d]->name_offsets[n - db_begin[d]];
+	}
 
 	// extended column state query profile as char
 //	unsigned char* qc;
 //	int W;
 
-	void init_prefilter(FFindexDatabase* cs219_database);
+	void init_prefilter(const std::vector<FFindexDatabase*>& cs219_databases,
+			const std::vector<std::string>& packed_filenames);
+
+	// number of bytes per vector of the byte kernels, query profiles are striped accordingly
+	int element_count;
+
+	// number of query positions per tile of the query profile
+	int max_tile_length;
+
+	// AVX-512BW kernels selected at runtime
+	bool use_avx512;
+
+	// inter-sequence kernel for short queries (AVX-512VBMI)
+	bool use_interseq;
 
+	// optional seed indices of the databases for the 1st prefilter
+	std::vector<PrefilterIndex*> indexes;
+
+	// db sequence indices sorted by decreasing length and the longest length
+	const uint32_t* length_order;
+	int max_dblength;
+
+	// lengths and length order of several databases, a single database uses its own arrays
+	std::vector<int> length_storage;
+	std::vector<uint32_t> length_order_storage;
+
+	// chunks [chunk_begin[c], chunk_begin[c+1]) of length_order with similar total length
+	std::vector<size_t> chunk_begin;
+
+	// the query profile is striped in tiles of tile_length positions, see stripe_query_profile
 	int ungapped_sse_score(const unsigned char* query_profile,
-		const int query_length, const unsigned char* db_sequence,
-		const int dbseq_length, const unsigned char score_offset, simd_int* workspace);
+		const int query_length, const int tile_length, const unsigned char* db_sequence,
+		const int dbseq_length, const unsigned char score_offset, unsigned char* workspace);
 
+	// workspace holds H load, H store and E vectors of a query tile and the tile boundary,
+	// diagonal receives db minus query position of the cell with the best score
 	int swStripedByte(unsigned char *querySeq,
 		int queryLength,
-		unsigned char *dbSeq,
+		int tileLength,
+		const unsigned char *dbSeq,
 		int dbLength,
 		unsigned short gapOpen,
 		unsigned short gapExtend,
-		simd_int *pvHLoad,
-		simd_int *pvHStore,
-		simd_int *pvE,
-		unsigned short bias);
+		unsigned char *workspace,
+		unsigned short bias,
+		int *diagonal);
+
+	// merge the per-thread hits of one query (indexed [thread][query])
+	int select_first_prefilter_hits(std::vector<std::vector<FirstPrefilterHits> >& thread_hits,
+		const size_t b, const int min_prefilter_hits, std::vector<std::pair<int, int> >& first_prefilter);
+	void select_second_prefilter_hits(std::vector<std::vector<std::vector<SecondPrefilterHit> > >& thread_hits,
+		const size_t b, std::vector<SecondPrefilterHit>& hits, const int min_prefilter_hits, const double prefilter_evalue_thresh);
+	void collect_prefilter_hits(std::vector<SecondPrefilterHit>& hits, Hash<Hit>* previous_hits,
+		const int maxnumdb, std::vector<PrefilterEntry>& new_prefilter_hits,
+		std::vector<PrefilterEntry>& old_prefilter_hits);
 
 	void checkCSFormat(size_t nr_checks);
-	void stripe_query_profile(HMM* q_tmp, const int prefilter_score_offset, const int prefilter_bit_factor, const int W, unsigned char* qc);
+	// stripe the profile in tiles of tile_length positions, stored one after the other
+	void stripe_query_profile(HMM* q_tmp, const int prefilter_score_offset, const int prefilter_bit_factor, const int tile_length, unsigned char* qc);
+	void index_prefilter(const std::vector<unsigned char*>& qc,
+		const std::vector<int>& LQ, const std::vector<int>& tile,
+		const std::vector<float>& log_qlen, const int prefilter_score_offset,
+		const int prefilter_bit_factor, unsigned char** workspace,
+		std::vector<std::vector<FirstPrefilterHits> >& thread_hits);
+#ifdef PREFILTER_AVX512
+	void interseq_prefilter(const std::vector<size_t>& queries,
+		const std::vector<unsigned char*>& qc, const std::vector<int>& LQ,
+		const std::vector<int>& tile, const std::vector<float>& log_qlen,
+		const int threads, const int prefilter_score_offset, const int prefilter_bit_factor,
+		std::vector<std::vector<FirstPrefilterHits> >& thread_hits);
+#endif
+	void row_query_profile(const unsigned char* qc, const int LQ, const int tile_length, unsigned char* rows);
 };
 
 #endif /* HHPREFILTER_H_ */
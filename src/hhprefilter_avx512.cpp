@@ -0,0 +1,77 @@
+/*
+ * hhprefilter_avx512.cpp
+ *
+ * AVX-512BW build of the prefilter byte kernels. Compiled with AVX-512
+ * flags independently of the rest of hh-suite and selected at runtime
+ * by the Prefilter if the cpu supports it.
+ */
+
+#ifndef AVX512
+#define AVX512
+#endif
+
+#include "hhprefilter_kernels.h"
+
+int ungapped_sse_score_avx512(const unsigned char* query_profile,
+    const int query_length, const int tile_length, const unsigned char* db_sequence,
+    const int dbseq_length, const unsigned char score_offset,
+    unsigned char* workspace, unsigned char* boundary) {
+  return ungapped_sse_score_striped(query_profile, query_length, tile_length, db_sequence,
+      dbseq_length, score_offset, (simd_int *) workspace, boundary);
+}
+
+int sw_striped_byte_avx512(unsigned char *querySeq, int queryLength, int tile_length,
+    const unsigned char *dbSeq, int dbLength, unsigned short gapOpen,
+    unsigned short gapExtend, unsigned char *pvHLoad, unsigned char *pvHStore,
+    unsigned char *pvE, unsigned char *boundary, unsigned short bias,
+    int *end_query, int *end_db) {
+  return sw_striped_byte(querySeq, queryLength, tile_length, dbSeq, dbLength, gapOpen,
+      gapExtend, (simd_int *) pvHLoad, (simd_int *) pvHStore, (simd_int *) pvE, boundary, bias,
+      end_query, end_db);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Inter-sequence ungapped kernel: lane k scores the query against db
+// sequence k, so short queries use all 64 lanes instead of padding.
+// The column state scores of query position i are looked up for all lanes
+// with two 128 entry byte permutes (AVX-512VBMI) over the 256 byte row i.
+// Cells are computed in the same order of saturated operations as
+// ungapped_sse_score_striped, therefore the scores are identical.
+////////////////////////////////////////////////////////////////////////
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void ungapped_interseq_score_avx512(const unsigned char* query_rows,
+    const int query_length, const unsigned char* db_residues,
+    const int dbseq_length, const unsigned char score_offset,
+    unsigned char* workspace, unsigned char* scores) {
+  // S[j + 1] holds S(i, j) of all lanes, S[0] = S(i, -1) = 0
+  __m512i* S = (__m512i*) workspace;
+  const __m512i* R = (const __m512i*) db_residues;
+  const __m512i Soffset = _mm512_set1_epi8(score_offset);
+  __m512i Smax = _mm512_setzero_si512();
+
+  for (int j = 0; j <= dbseq_length; ++j)
+    _mm512_store_si512(S + j, Smax);
+
+  for (int i = 0; i < query_length; ++i) {
+    const __m512i* row = (const __m512i*) (query_rows + i * 256);
+    const __m512i t0 = _mm512_load_si512(row);
+    const __m512i t1 = _mm512_load_si512(row + 1);
+    const __m512i t2 = _mm512_load_si512(row + 2);
+    const __m512i t3 = _mm512_load_si512(row + 3);
+
+    // S(i, j) only depends on S(i - 1, j - 1): update in place from the end
+    for (int j = dbseq_length - 1; j >= 0; --j) {
+      const __m512i x = _mm512_load_si512(R + j);
+      const __m512i lo = _mm512_permutex2var_epi8(t0, x, t1);
+      const __m512i hi = _mm512_permutex2var_epi8(t2, x, t3);
+      const __m512i q = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi);
+
+      __m512i s = _mm512_adds_epu8(_mm512_load_si512(S + j), q);
+      s = _mm512_subs_epu8(s, Soffset);
+      _mm512_store_si512(S + j + 1, s);
+      Smax = _mm512_max_epu8(Smax, s);
+    }
+  }
+
+  _mm512_storeu_si512((__m512i*) scores, Smax);
+}
@@ -0,0 +1,363 @@
+/*
+ * hhprefilter_index.cpp
+ *
+ * Spaced seed index over the column state sequences of a cs219 database.
+ *
+ * Index file layout, all sections start at multiples of INDEX_ALIGNMENT:
+ *   header            magic, seed_length, num_dbs, num_keys, num_positions
+ *   seed              seed characters
+ *   key_offsets       uint64[num_keys + 1] into the positions
+ *   position_seqs     uint32[num_positions]
+ *   position_columns  uint32[num_positions]
+ */
+
+#include "hhprefilter_index.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "cs.h"
+#include "hhutil.h"
+#include "log.h"
+
+static const char INDEX_MAGIC[8] = {'H', 'H', 'C', 'S', 'I', 'D', 'X', '2'};
+static const size_t INDEX_ALIGNMENT = 8;
+
+// seeds with more matching columns need too many keys for 219 column states
+static const size_t MAX_SEED_WEIGHT = 3;
+
+// seed hits of a block of db sequences are counted together, the block size
+// is chosen so that about this many hits of a query fall into one block
+static const size_t CANDIDATE_BLOCK_HITS = 1 << 16;
+
+struct IndexHeader {
+  char magic[8];
+  uint64_t seed_length;
+  uint64_t num_dbs;
+  uint64_t num_keys;
+  uint64_t num_positions;
+};
+
+// index positions [begin, end) of a seed looked up at query position i
+struct SeedLookup {
+  uint64_t begin;
+  uint64_t end;
+  int i;
+};
+
+static size_t index_align(const size_t size) {
+  return (size + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+}
+
+static void index_write(FILE* fh, const void* data, const size_t size, size_t& position) {
+  static const char padding[INDEX_ALIGNMENT] = {0};
+  if (size > 0 && fwrite(data, 1, size, fh) != size) {
+    HH_LOG(ERROR) << "Could not write the prefilter index!" << std::endl;
+    exit(1);
+  }
+  position += size;
+  const size_t padding_size = index_align(position) - position;
+  if (padding_size > 0 && fwrite(padding, 1, padding_size, fh) != padding_size) {
+    HH_LOG(ERROR) << "Could not write the prefilter index!" << std::endl;
+    exit(1);
+  }
+  position += padding_size;
+}
+
+bool PrefilterIndex::parse_seed(const std::string& seed, std::vector<int>& seed_columns, int& seed_span) {
+  seed_columns.clear();
+  for (size_t i = 0; i < seed.size(); i++) {
+    if (seed[i] == '1') {
+      seed_columns.push_back(i);
+    } else if (seed[i] != '0') {
+      return false;
+    }
+  }
+  seed_span = seed.size();
+
+  return !seed_columns.empty() && seed_columns.size() <= MAX_SEED_WEIGHT
+      && seed[0] == '1' && seed[seed.size() - 1] == '1';
+}
+
+size_t PrefilterIndex::count_keys(const size_t seed_weight) {
+  size_t keys = 1;
+  for (size_t m = 0; m < seed_weight; m++) {
+    keys *= cs::AS219::kSize;
+  }
+  return keys;
+}
+
+int64_t PrefilterIndex::seed_key(const unsigned char* seq, const int j, const std::vector<int>& seed_columns) {
+  int64_t key = 0;
+  for (size_t m = 0; m < seed_columns.size(); m++) {
+    const unsigned char state = seq[j + seed_columns[m]];
+    if (state >= cs::AS219::kSize) {
+      return -1;
+    }
+    key = key * cs::AS219::kSize + state;
+  }
+  return key;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Write the index: all positions of all db sequences, sorted by seed key
+////////////////////////////////////////////////////////////////////////
+void PrefilterIndex::build(FFindexDatabase* cs219_database, const std::string& seed, const char* filename) {
+  std::vector<int> seed_columns;
+  int seed_span;
+  if (!parse_seed(seed, seed_columns, seed_span)) {
+    HH_LOG(ERROR) << "Invalid seed " << seed << "! Use 1 for matching and 0 for ignored columns, "
+                  << "starting and ending with 1 and at most " << MAX_SEED_WEIGHT << " matching columns." << std::endl;
+    exit(1);
+  }
+
+  const size_t num_dbs = cs219_database->db_index->n_entries;
+  const size_t num_keys = count_keys(seed_columns.size());
+
+  // count positions per key
+  uint64_t* key_offsets = (uint64_t*) calloc(num_keys + 1, sizeof(uint64_t));
+  for (size_t n = 0; n < num_dbs; n++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(cs219_database->db_index, n);
+    const unsigned char* seq = (unsigned char*) ffindex_get_data_by_entry(cs219_database->db_data, entry);
+    const int length = entry->length - 1;
+    for (int j = 0; j + seed_span <= length; j++) {
+      int64_t key = seed_key(seq, j, seed_columns);
+      if (key >= 0) {
+        key_offsets[key + 1]++;
+      }
+    }
+  }
+  for (size_t k = 0; k < num_keys; k++) {
+    key_offsets[k + 1] += key_offsets[k];
+  }
+  const size_t num_positions = key_offsets[num_keys];
+
+  // fill positions, sorted by key and db sequence
+  uint32_t* position_seqs = (uint32_t*) malloc(std::max(num_positions, (size_t) 1) * sizeof(uint32_t));
+  uint32_t* position_columns = (uint32_t*) malloc(std::max(num_positions, (size_t) 1) * sizeof(uint32_t));
+  uint64_t* next = (uint64_t*) malloc(num_keys * sizeof(uint64_t));
+  memcpy(next, key_offsets, num_keys * sizeof(uint64_t));
+  for (size_t n = 0; n < num_dbs; n++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(cs219_database->db_index, n);
+    const unsigned char* seq = (unsigned char*) ffindex_get_data_by_entry(cs219_database->db_data, entry);
+    const int length = entry->length - 1;
+    for (int j = 0; j + seed_span <= length; j++) {
+      int64_t key = seed_key(seq, j, seed_columns);
+      if (key >= 0) {
+        position_seqs[next[key]] = n;
+        position_columns[next[key]] = j;
+        next[key]++;
+      }
+    }
+  }
+  free(next);
+
+  FILE* fh = fopen(filename, "wb");
+  if (!fh) {
+    OpenFileError(filename, __FILE__, __LINE__, __func__);
+  }
+
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.seed_length = seed.size();
+  header.num_dbs = num_dbs;
+  header.num_keys = num_keys;
+  header.num_positions = num_positions;
+
+  size_t position = 0;
+  index_write(fh, &header, sizeof(header), position);
+  index_write(fh, seed.c_str(), seed.size(), position);
+  index_write(fh, key_offsets, (num_keys + 1) * sizeof(uint64_t), position);
+  index_write(fh, position_seqs, num_positions * sizeof(uint32_t), position);
+  index_write(fh, position_columns, num_positions * sizeof(uint32_t), position);
+  fclose(fh);
+
+  HH_LOG(INFO) << "Indexed " << num_positions << " seed positions of " << num_dbs
+               << " column state sequences with seed " << seed << std::endl;
+
+  free(key_offsets);
+  free(position_seqs);
+  free(position_columns);
+}
+
+PrefilterIndex::PrefilterIndex(const char* filename, const size_t num_dbs) {
+  data_fh = fopen(filename, "rb");
+  if (data_fh == NULL) {
+    OpenFileError(filename, __FILE__, __LINE__, __func__);
+  }
+  data = ffindex_mmap_data(data_fh, &data_size);
+  if (data == MAP_FAILED) {
+    HH_LOG(ERROR) << "Could not map the prefilter index " << filename << "!" << std::endl;
+    exit(1);
+  }
+
+  const IndexHeader* header = (const IndexHeader*) data;
+  if (data_size < sizeof(IndexHeader) || memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+    HH_LOG(ERROR) << filename << " is not a cs219 prefilter index of this version, rebuild it with cs219_index!" << std::endl;
+    exit(1);
+  }
+
+  size_t position = index_align(sizeof(IndexHeader));
+  if (position + header->seed_length > data_size) {
+    HH_LOG(ERROR) << "The prefilter index " << filename << " is truncated!" << std::endl;
+    exit(1);
+  }
+  const std::string seed(data + position, header->seed_length);
+  if (!parse_seed(seed, seed_columns, seed_span) || header->num_keys != count_keys(seed_columns.size())) {
+    HH_LOG(ERROR) << "Could not read the header of the prefilter index " << filename << "!" << std::endl;
+    exit(1);
+  }
+
+  if (header->num_dbs != num_dbs) {
+    HH_LOG(ERROR) << "The prefilter index " << filename << " was built for " << header->num_dbs
+                  << " column state sequences, but the database has " << num_dbs << "!" << std::endl;
+    exit(1);
+  }
+
+  this->num_dbs = num_dbs;
+  num_keys = header->num_keys;
+  num_positions = header->num_positions;
+
+  position += index_align(header->seed_length);
+  key_offsets = (const uint64_t*) (data + position);
+  position += index_align((num_keys + 1) * sizeof(uint64_t));
+  position_seqs = (const uint32_t*) (data + position);
+  position += index_align(num_positions * sizeof(uint32_t));
+  position_columns = (const uint32_t*) (data + position);
+  position += num_positions * sizeof(uint32_t);
+
+  if (position > data_size) {
+    HH_LOG(ERROR) << "The prefilter index " << filename << " is truncated!" << std::endl;
+    exit(1);
+  }
+
+  HH_LOG(INFO) << "Using prefilter index " << filename << " (seed " << seed << ")" << std::endl;
+}
+
+PrefilterIndex::~PrefilterIndex() {
+  munmap(data, data_size);
+  fclose(data_fh);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Look up all seeds of the query neighbourhood and count the hits per
+// db sequence and diagonal, block by block of db sequences
+////////////////////////////////////////////////////////////////////////
+void PrefilterIndex::find_candidates(const unsigned char* rows, const int LQ, const int score_offset,
+    const int seed_score_thresh, const int min_diagonal_hits, std::vector<int>& candidates) const {
+  const size_t weight = seed_columns.size();
+
+  // column states with a positive score per query position, best first
+  std::vector<std::vector<std::pair<int, int> > > states(LQ);
+  std::vector<int> best(LQ, 0);
+  for (int i = 0; i < LQ; i++) {
+    const unsigned char* row = rows + i * 256;
+    for (int a = 0; a < (int) cs::AS219::kSize; a++) {
+      const int score = row[a] - score_offset;
+      if (score > 0) {
+        states[i].push_back(std::pair<int, int>(score, a));
+      }
+    }
+    std::sort(states[i].begin(), states[i].end());
+    std::reverse(states[i].begin(), states[i].end());
+    best[i] = states[i].empty() ? 0 : states[i][0].first;
+  }
+
+  std::vector<SeedLookup> lookups;
+  size_t num_hits = 0;
+  std::vector<size_t> choice(weight, 0);
+  std::vector<int> bound(weight + 1, 0);
+
+  for (int i = 0; i + seed_span <= LQ; i++) {
+    // best possible score of the seed columns m, m+1, ...
+    for (int m = weight - 1; m >= 0; m--) {
+      bound[m] = bound[m + 1] + best[i + seed_columns[m]];
+    }
+    if (bound[0] < seed_score_thresh) {
+      continue;
+    }
+
+    // enumerate all seeds above the threshold, depth first over the seed columns
+    std::vector<int> score(weight + 1, 0);
+    std::vector<int64_t> key(weight + 1, 0);
+    int m = 0;
+    choice[0] = 0;
+    while (m >= 0) {
+      const std::vector<std::pair<int, int> >& column = states[i + seed_columns[m]];
+      if (choice[m] >= column.size()
+          || score[m] + column[choice[m]].first + bound[m + 1] < seed_score_thresh) {
+        // states are sorted, no further seed from this column can pass
+        m--;
+        if (m >= 0) {
+          choice[m]++;
+        }
+        continue;
+      }
+
+      score[m + 1] = score[m] + column[choice[m]].first;
+      key[m + 1] = key[m] * cs::AS219::kSize + column[choice[m]].second;
+
+      if (m + 1 < (int) weight) {
+        m++;
+        choice[m] = 0;
+        continue;
+      }
+
+      SeedLookup lookup;
+      lookup.begin = key_offsets[key[weight]];
+      lookup.end = key_offsets[key[weight] + 1];
+      lookup.i = i;
+      if (lookup.begin < lookup.end) {
+        lookups.push_back(lookup);
+        num_hits += lookup.end - lookup.begin;
+      }
+      choice[m]++;
+    }
+  }
+
+  // The positions of each seed are sorted by db sequence, so the hits of a block
+  // of db sequences are the next ones of every lookup. Only the hits of one block
+  // are kept and sorted, as db sequence (high 32 bits) and diagonal shifted by LQ.
+  const size_t num_blocks = num_hits / CANDIDATE_BLOCK_HITS + 1;
+  const size_t block_seqs = (num_dbs + num_blocks - 1) / num_blocks;
+  std::vector<uint64_t> hits;
+
+  candidates.clear();
+  for (size_t block_begin = 0; block_begin < num_dbs && !lookups.empty(); block_begin += block_seqs) {
+    const uint32_t block_end = std::min(block_begin + block_seqs, num_dbs);
+
+    hits.clear();
+    size_t remaining = 0;
+    for (size_t l = 0; l < lookups.size(); l++) {
+      SeedLookup lookup = lookups[l];
+      for (; lookup.begin < lookup.end && position_seqs[lookup.begin] < block_end; lookup.begin++) {
+        const uint64_t diagonal = position_columns[lookup.begin] + LQ - lookup.i;
+        hits.push_back(((uint64_t) position_seqs[lookup.begin] << 32) | diagonal);
+      }
+      // drop lookups without hits in the following blocks
+      if (lookup.begin < lookup.end) {
+        lookups[remaining++] = lookup;
+      }
+    }
+    lookups.resize(remaining);
+
+    std::sort(hits.begin(), hits.end());
+
+    size_t run_start = 0;
+    int last_candidate = -1;
+    for (size_t h = 1; h <= hits.size(); h++) {
+      if (h == hits.size() || hits[h] != hits[run_start]) {
+        const int n = hits[run_start] >> 32;
+        if ((int) (h - run_start) >= min_diagonal_hits && n != last_candidate) {
+          candidates.push_back(n);
+          last_candidate = n;
+        }
+        run_start = h;
+      }
+    }
+  }
+}
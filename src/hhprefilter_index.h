@@ -0,0 +1,62 @@
+/*
+ * hhprefilter_index.h
+ *
+ * Spaced seed index over the column state sequences of a cs219 database.
+ * Used by the 1st prefilter to find candidate db sequences through
+ * diagonal hit counting instead of scoring every db sequence.
+ */
+
+#ifndef HHPREFILTER_INDEX_H_
+#define HHPREFILTER_INDEX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "ffindexdatabase.h"
+
+class PrefilterIndex {
+public:
+	// map an index written by build() for a cs219 database with num_dbs sequences
+	PrefilterIndex(const char* filename, const size_t num_dbs);
+	virtual ~PrefilterIndex();
+
+	// index all column state sequences of cs219_database with the spaced seed,
+	// e.g. "11" for 2-mers or "1101" (1 = matching column, 0 = don't care)
+	static void build(FFindexDatabase* cs219_database, const std::string& seed, const char* filename);
+
+	// Find db sequences with at least min_diagonal_hits seed hits on one diagonal.
+	// rows holds 256 column state scores per query position (shifted by score_offset),
+	// all seeds with a summed score of at least seed_score_thresh are looked up.
+	void find_candidates(const unsigned char* rows, const int LQ, const int score_offset,
+			const int seed_score_thresh, const int min_diagonal_hits, std::vector<int>& candidates) const;
+
+private:
+	// query/db offsets of the matching columns of the seed
+	std::vector<int> seed_columns;
+	int seed_span;
+
+	size_t num_dbs;
+	size_t num_keys;
+	size_t num_positions;
+
+	// positions with key k are in [key_offsets[k], key_offsets[k+1]),
+	// sorted by db sequence and column
+	const uint64_t* key_offsets;
+	const uint32_t* position_seqs;
+	const uint32_t* position_columns;
+
+	// mapped index file
+	FILE* data_fh;
+	char* data;
+	size_t data_size;
+
+	static bool parse_seed(const std::string& seed, std::vector<int>& seed_columns, int& seed_span);
+	static size_t count_keys(const size_t seed_weight);
+
+	// key of the seed starting at sequence position j, -1 if it includes an ANY state
+	static int64_t seed_key(const unsigned char* seq, const int j, const std::vector<int>& seed_columns);
+};
+
+#endif /* HHPREFILTER_INDEX_H_ */
@@ -0,0 +1,325 @@
+/*
+ * hhprefilter_kernels.h
+ *
+ * Striped 8 bit prefilter kernels written against the simd.h macros.
+ * The header is compiled once per instruction set (hhprefilter.cpp for the
+ * build target, hhprefilter_avx512.cpp for AVX-512BW), therefore everything
+ * in here has internal linkage and must not call inline or template code
+ * shared with other translation units.
+ */
+
+#ifndef HHPREFILTER_KERNELS_H_
+#define HHPREFILTER_KERNELS_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+#define SWAP(tmp, arg1, arg2) tmp = arg1; arg1 = arg2; arg2 = tmp;
+
+// horizontal max over the unsigned bytes of a vector
+static int hmax_byte(const simd_int& v) {
+  const unsigned char* in = (const unsigned char*) &v;
+  unsigned char current = 0;
+  for (int k = 0; k < VECSIZE_INT * 4; ++k) {
+    current = (in[k] > current) ? in[k] : current;
+  }
+  return current;
+}
+
+// Query tiles: a query longer than tile_length (a multiple of the vector size) is split
+// into tiles that are striped separately and stored one after the other in the profile
+// (PROFILE_ROWS rows each), so the profile of one tile stays in cache while a db sequence
+// is scored. The last query row of a tile is carried to the next tile for every db
+// position in boundary, which is not used if the query fits into one tile.
+
+// column states + ANY
+static const int PROFILE_ROWS = 220;
+
+// last lane of vector v
+static unsigned char last_byte(const simd_int& v) {
+  return ((const unsigned char*) &v)[VECSIZE_INT * 4 - 1];
+}
+
+// boundary holds the H scores and then the F scores of the last query row of a tile (2 * dbLength bytes),
+// end_query and end_db receive the (0 based) cell where the best score was reached first
+static int sw_striped_byte(unsigned char *querySeq, int queryLength, int tile_length,
+                           const unsigned char *dbSeq, int dbLength, unsigned short gapOpen,
+                           unsigned short gapExtend, simd_int *pvHLoad, simd_int *pvHStore,
+                           simd_int *pvE, unsigned char *boundary, unsigned short bias,
+                           int *end_query, int *end_db) {
+    const int element_count = (VECSIZE_INT * 4);
+    const int ntiles = (queryLength + tile_length - 1) / tile_length;
+
+    /* Define 16 byte 0 vector. */
+    simd_int vZero = simdi32_set(0);
+
+    /* vector with only lane 0 set, to insert the boundary of the previous tile */
+    simd_int vOnes = simdi8_set(-1);
+    simd_int vFirst = simdi_andnot(simdi8_shiftl(vOnes, 1), vOnes);
+
+    int32_t i, j;
+    /* 16 byte insertion begin vector */
+    simd_int vGapO = simdi8_set(gapOpen);
+
+    /* 16 byte insertion extension vector */
+    simd_int vGapE = simdi8_set(gapExtend);
+
+    /* 16 byte bias vector */
+    simd_int vBias = simdi8_set(bias);
+
+    int maxScore = 0; /* Trace the highest score of the whole SW matrix. */
+    simd_int vMaxScore = vZero; /* maxScore in all lanes */
+    simd_int vTemp;
+    *end_query = 0;
+    *end_db = 0;
+
+    unsigned char *pHBoundary = boundary;
+    unsigned char *pFBoundary = boundary + dbLength;
+
+    simd_int *pvQueryProf = (simd_int*) querySeq;
+    for (int t = 0; t < ntiles; ++t) {
+        const int tileLength = (queryLength - t * tile_length < tile_length) ? queryLength - t * tile_length : tile_length;
+        const int32_t segLen = (tileLength + element_count-1) / element_count; /* number of segment */
+        /* position of the last query row of the tile */
+        const int32_t lastSeg = (tileLength - 1) % segLen;
+        const int32_t lastLane = (tileLength - 1) / segLen;
+        const bool carry = (t + 1 < ntiles);
+
+        memset(pvHStore,0,segLen*sizeof(simd_int));
+        memset(pvHLoad,0,segLen*sizeof(simd_int));
+        memset(pvE,0,segLen*sizeof(simd_int));
+
+        /* H of the previous tile's last query row at the previous db position */
+        unsigned char hDiagonal = 0;
+
+        /* outer loop to process the reference sequence */
+        for (i = 0; i != dbLength; ++i) {
+            simd_int e, vF = vZero, vMaxColumn = vZero; /* Initialize F value to 0.
+                                                        Any errors to vH values will be corrected in the Lazy_F loop.
+                                                        */
+
+            simd_int vH = pvHStore[segLen - 1];
+            vH = simdi8_shiftl (vH, 1); /* Shift the 128-bit value in vH left by 1 byte. */
+            if (t > 0) {
+                vH = simdi_or(vH, simdi_and(simdi8_set(hDiagonal), vFirst));
+                vF = simdi_and(simdi8_set(pFBoundary[i]), vFirst);
+                hDiagonal = pHBoundary[i];
+            }
+            const simd_int* vP = pvQueryProf + dbSeq[i] * segLen; /* Right part of the query_profile_byte */
+
+            /* Swap the 2 H buffers. */
+            simd_int* pv = pvHLoad;
+            pvHLoad = pvHStore;
+            pvHStore = pv;
+
+            /* inner loop to process the query sequence */
+            for (j = 0; j < segLen; ++j) {
+                vH = simdui8_adds(vH, simdi_load(vP + j));
+                vH = simdui8_subs(vH, vBias); /* vH will be always > 0 */
+
+                /* Get max from vH, vE and vF. */
+                e = simdi_load(pvE + j);
+                vH = simdui8_max(vH, e);
+                vH = simdui8_max(vH, vF);
+                vMaxColumn = simdui8_max(vMaxColumn, vH);
+
+                /* Save vH values. */
+                simdi_store(pvHStore + j, vH);
+
+                /* Update vE value. */
+                vH = simdui8_subs(vH, vGapO); /* saturation arithmetic, result >= 0 */
+                e = simdui8_subs(e, vGapE);
+                e = simdui8_max(e, vH);
+                simdi_store(pvE + j, e);
+
+                /* Update vF value. */
+                vF = simdui8_subs(vF, vGapE);
+                vF = simdui8_max(vF, vH);
+
+                /* Load the next vH. */
+                vH = simdi_load(pvHLoad + j);
+            }
+
+            /* F entering the next tile: the last lane continues there (the tile is full) */
+            unsigned char fNext = carry ? last_byte(vF) : 0;
+
+            /* Lazy_F loop: has been revised to disallow adjecent insertion and then deletion, so don't update E(i, j), learn from SWPS3 */
+            /* reset pointers to the start of the saved data */
+            j = 0;
+            vH = simdi_load (pvHStore + j);
+
+            /*  the computed vF value is for the given column.  since */
+            /*  we are at the end, we need to shift the vF value over */
+            /*  to the next column. */
+            vF = simdi8_shiftl (vF, 1);
+            vTemp = simdui8_subs (vH, vGapO);
+            vTemp = simdui8_subs (vF, vTemp);
+            uint64_t cmp = simdi8_eq_mask (vTemp, vZero);
+            while (cmp != SIMD_MOVEMASK_MAX)
+            {
+                vH = simdui8_max (vH, vF);
+                vMaxColumn = simdui8_max(vMaxColumn, vH);
+                simdi_store (pvHStore + j, vH);
+                vF = simdui8_subs (vF, vGapE);
+                j++;
+                if (j >= segLen)
+                {
+                    j = 0;
+                    if (carry && last_byte(vF) > fNext) {
+                        fNext = last_byte(vF);
+                    }
+                    vF = simdi8_shiftl (vF, 1);
+                }
+                vH = simdi_load (pvHStore + j);
+
+                vTemp = simdui8_subs (vH, vGapO);
+                vTemp = simdui8_subs (vF, vTemp);
+                cmp  = simdi8_eq_mask (vTemp, vZero);
+            }
+
+            /* a new best score: find the query position of the cell in this column */
+            vTemp = simdui8_subs(vMaxColumn, vMaxScore);
+            if (simdi8_eq_mask(vTemp, vZero) != SIMD_MOVEMASK_MAX) {
+                maxScore = hmax_byte(vMaxColumn);
+                vMaxScore = simdi8_set(maxScore);
+                int endQuery = tileLength;
+                for (j = 0; j < segLen; ++j) {
+                    uint64_t lanes = simdi8_eq_mask(simdi_load(pvHStore + j), vMaxScore);
+                    for (int k = 0; lanes != 0; ++k, lanes >>= 1) {
+                        if ((lanes & 1) && k * segLen + j < endQuery) {
+                            endQuery = k * segLen + j;
+                        }
+                    }
+                }
+                *end_query = t * tile_length + endQuery;
+                *end_db = i;
+            }
+
+            if (carry) {
+                pHBoundary[i] = ((unsigned char*) (pvHStore + lastSeg))[lastLane];
+                pFBoundary[i] = fNext;
+            }
+        }
+
+        pvQueryProf += PROFILE_ROWS * segLen;
+    }
+
+    return maxScore;
+}
+
+// boundary holds the scores of the last query row of a tile (dbseq_length bytes)
+static int ungapped_sse_score_striped(const unsigned char* query_profile,
+    const int query_length, const int tile_length, const unsigned char* db_sequence,
+    const int dbseq_length, const unsigned char score_offset,
+    simd_int* workspace, unsigned char* boundary) {
+  int i; // position in query bands (0,..,W-1)
+  int j; // position in db sequence (0,..,dbseq_length-1)
+  int element_count = (VECSIZE_INT * 4);
+  const int ntiles = (query_length + tile_length - 1) / tile_length;
+
+  simd_int *p;
+  simd_int S;              // 16 unsigned bytes holding S(b*W+i,j) (b=0,..,15)
+  simd_int Smax = simdi_setzero();
+  simd_int Soffset; // all scores in query profile are shifted up by Soffset to obtain pos values
+  simd_int *s_prev, *s_curr; // pointers to Score(i-1,j-1) and Score(i,j), resp.
+  simd_int *qji;             // query profile score in row j (for residue x_j)
+  simd_int *s_prev_it, *s_curr_it;
+  simd_int *query_profile_it = (simd_int *) query_profile;
+  simd_int Zero = simdi_setzero();
+
+  // only lane 0 set, to insert the boundary of the previous tile
+  simd_int Ones = simdi8_set(-1);
+  simd_int First = simdi_andnot(simdi8_shiftl(Ones, 1), Ones);
+
+  // Load the score offset to all 16 unsigned byte elements of Soffset
+  Soffset = simdi8_set(score_offset);
+
+  for (int t = 0; t < ntiles; ++t) {
+    const int L = (query_length - t * tile_length < tile_length) ? query_length - t * tile_length : tile_length;
+    const int W = (L + (element_count - 1)) / element_count; // width of bands in query and score matrix = hochgerundetes LQ/16
+    // position of the last query row of the tile
+    const int last_band = (L - 1) % W;
+    const int last_lane = (L - 1) / W;
+    const bool carry = (t + 1 < ntiles);
+
+    // Initialize  workspace to zero
+    for (i = 0, p = workspace; i < 2 * W; ++i)
+      simdi_store(p++, Zero);
+
+    s_curr = workspace;
+    s_prev = workspace + W;
+
+    // score of the previous tile's last query row at the previous db position
+    unsigned char diagonal = 0;
+
+    for (j = 0; j < dbseq_length; ++j) // loop over db sequence positions
+        {
+
+      // Get address of query scores for row j
+      qji = query_profile_it + db_sequence[j] * W;
+
+      // Load the next S value
+      S = simdi_load(s_curr + W - 1);
+      S = simdi8_shiftl(S, 1);
+      if (t > 0) {
+        S = simdi_or(S, simdi_and(simdi8_set(diagonal), First));
+        diagonal = boundary[j];
+      }
+
+      // Swap s_prev and s_curr, smax_prev and smax_curr
+      SWAP(p, s_prev, s_curr);
+
+      s_curr_it = s_curr;
+      s_prev_it = s_prev;
+
+      for (i = 0; i < W; ++i) // loop over query band positions
+          {
+        // Saturated addition and subtraction to score S(i,j)
+        S = simdui8_adds(S, *(qji++)); // S(i,j) = S(i-1,j-1) + (q(i,x_j) + Soffset)
+        S = simdui8_subs(S, Soffset);       // S(i,j) = max(0, S(i,j) - Soffset)
+        simdi_store(s_curr_it++, S);       // store S to s_curr[i]
+        Smax = simdui8_max(Smax, S);       // Smax(i,j) = max(Smax(i,j), S(i,j))
+
+        // Load the next S and Smax values
+        S = simdi_load(s_prev_it++);
+      }
+
+      if (carry) {
+        boundary[j] = ((unsigned char*) (s_curr + last_band))[last_lane];
+      }
+    }
+
+    query_profile_it += PROFILE_ROWS * W;
+  }
+  int score = hmax_byte(Smax);
+
+  /* return largest score */
+  return score;
+}
+
+#ifdef PREFILTER_AVX512
+// AVX-512BW builds of the kernels above (hhprefilter_avx512.cpp),
+// the query profile and workspace have to be striped and aligned for 64 byte vectors
+int ungapped_sse_score_avx512(const unsigned char* query_profile,
+    const int query_length, const int tile_length, const unsigned char* db_sequence,
+    const int dbseq_length, const unsigned char score_offset,
+    unsigned char* workspace, unsigned char* boundary);
+
+int sw_striped_byte_avx512(unsigned char *querySeq, int queryLength, int tile_length,
+    const unsigned char *dbSeq, int dbLength, unsigned short gapOpen,
+    unsigned short gapExtend, unsigned char *pvHLoad, unsigned char *pvHStore,
+    unsigned char *pvE, unsigned char *boundary, unsigned short bias,
+    int *end_query, int *end_db);
+
+// scores a query against 64 db sequences, one per lane (needs AVX-512VBMI);
+// query_rows holds 256 scores per query position (column states, ANY, 0 for the rest),
+// db_residues the interleaved sequences (padded with 255), 64 bytes per position
+void ungapped_interseq_score_avx512(const unsigned char* query_rows,
+    const int query_length, const unsigned char* db_residues,
+    const int dbseq_length, const unsigned char score_offset,
+    unsigned char* workspace, unsigned char* scores);
+#endif
+
+#endif /* HHPREFILTER_KERNELS_H_ */
@@ -0,0 +1,206 @@
+/*
+ * hhprefilter_pack.cpp
+ *
+ * Column state sequences of a cs219 database for the prefilter.
+ *
+ * Packed file layout, all sections start at multiples of PACK_ALIGNMENT:
+ *   header        magic, num_dbs, max_length, names_size, sequences_size,
+ *                 source (fingerprint of the cs219 ffdata and ffindex)
+ *   lengths       int32[num_dbs]
+ *   length_order  uint32[num_dbs]
+ *   offsets       uint64[num_dbs] into sequences
+ *   name_offsets  uint64[num_dbs] into names
+ *   names         zero terminated names
+ *   sequences     state bytes, every sequence starts at a multiple of PACK_ALIGNMENT
+ */
+
+#include "hhprefilter_pack.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hhutil.h"
+#include "log.h"
+
+static const char PACK_MAGIC[8] = {'H', 'H', 'C', 'S', 'P', 'A', 'K', '2'};
+static const size_t PACK_ALIGNMENT = 64;
+
+struct PackHeader {
+  char magic[8];
+  uint64_t num_dbs;
+  uint64_t max_length;
+  uint64_t names_size;
+  uint64_t sequences_size;
+  uint64_t source;
+};
+
+static size_t pack_align(const size_t size) {
+  return (size + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+static uint64_t pack_source(FFindexDatabase* cs219_database) {
+  uint64_t source = file_fingerprint(FILE_FINGERPRINT_SEED, cs219_database->data_filename);
+  return file_fingerprint(source, cs219_database->index_filename);
+}
+
+static void pack_write(FILE* fh, const void* data, const size_t size, size_t& position) {
+  static const char padding[PACK_ALIGNMENT] = {0};
+  if (size > 0 && fwrite(data, 1, size, fh) != size) {
+    HH_LOG(ERROR) << "Could not write the packed cs219 database!" << std::endl;
+    exit(1);
+  }
+  position += size;
+  const size_t padding_size = pack_align(position) - position;
+  if (padding_size > 0 && fwrite(padding, 1, padding_size, fh) != padding_size) {
+    HH_LOG(ERROR) << "Could not write the packed cs219 database!" << std::endl;
+    exit(1);
+  }
+  position += padding_size;
+}
+
+PackedCS219Database::PackedCS219Database(FFindexDatabase* cs219_database)
+    : data_fh(NULL), data(NULL), data_size(0) {
+  num_dbs = cs219_database->db_index->n_entries;
+
+  offsets_storage.resize(num_dbs);
+  lengths_storage.resize(num_dbs);
+  name_offsets_storage.resize(num_dbs);
+  for (size_t n = 0; n < num_dbs; n++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(cs219_database->db_index, n);
+    offsets_storage[n] = entry->offset;
+    lengths_storage[n] = entry->length - 1;
+    name_offsets_storage[n] = names_storage.size();
+    names_storage.insert(names_storage.end(), entry->name, entry->name + strlen(entry->name) + 1);
+  }
+
+  std::vector<std::pair<int32_t, uint32_t> > by_length(num_dbs);
+  for (size_t n = 0; n < num_dbs; n++) {
+    by_length[n] = std::pair<int32_t, uint32_t>(lengths_storage[n], n);
+  }
+  std::sort(by_length.begin(), by_length.end(), std::greater<std::pair<int32_t, uint32_t> >());
+
+  length_order_storage.resize(num_dbs);
+  for (size_t n = 0; n < num_dbs; n++) {
+    length_order_storage[n] = by_length[n].second;
+  }
+  max_length = (num_dbs > 0) ? by_length[0].first : 0;
+
+  sequences = (const unsigned char*) cs219_database->db_data;
+  offsets = num_dbs ? &offsets_storage[0] : NULL;
+  lengths = num_dbs ? &lengths_storage[0] : NULL;
+  names = num_dbs ? &names_storage[0] : NULL;
+  name_offsets = num_dbs ? &name_offsets_storage[0] : NULL;
+  length_order = num_dbs ? &length_order_storage[0] : NULL;
+}
+
+PackedCS219Database::PackedCS219Database(const char* filename) {
+  data_fh = fopen(filename, "rb");
+  if (data_fh == NULL) {
+    OpenFileError(filename, __FILE__, __LINE__, __func__);
+  }
+  data = ffindex_mmap_data(data_fh, &data_size);
+  if (data == MAP_FAILED) {
+    HH_LOG(ERROR) << "Could not map the packed cs219 database " << filename << "!" << std::endl;
+    exit(1);
+  }
+
+  const PackHeader* header = (const PackHeader*) data;
+  if (data_size < pack_align(sizeof(PackHeader))
+      || memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) {
+    HH_LOG(ERROR) << filename << " is not a packed cs219 database!" << std::endl;
+    exit(1);
+  }
+
+  num_dbs = header->num_dbs;
+  max_length = header->max_length;
+
+  size_t position = pack_align(sizeof(PackHeader));
+  lengths = (const int32_t*) (data + position);
+  position += pack_align(num_dbs * sizeof(int32_t));
+  length_order = (const uint32_t*) (data + position);
+  position += pack_align(num_dbs * sizeof(uint32_t));
+  offsets = (const uint64_t*) (data + position);
+  position += pack_align(num_dbs * sizeof(uint64_t));
+  name_offsets = (const uint64_t*) (data + position);
+  position += pack_align(num_dbs * sizeof(uint64_t));
+  names = data + position;
+  position += pack_align(header->names_size);
+  sequences = (const unsigned char*) (data + position);
+  position += header->sequences_size;
+
+  if (position > data_size) {
+    HH_LOG(ERROR) << "The packed cs219 database " << filename << " is truncated!" << std::endl;
+    exit(1);
+  }
+
+  HH_LOG(INFO) << "Using packed cs219 database " << filename << std::endl;
+}
+
+PackedCS219Database::~PackedCS219Database() {
+  if (data != NULL) {
+    munmap(data, data_size);
+  }
+  if (data_fh != NULL) {
+    fclose(data_fh);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Write the packed file, sequences are copied into one aligned blob
+////////////////////////////////////////////////////////////////////////
+void PackedCS219Database::build(FFindexDatabase* cs219_database, const char* filename) {
+  PackedCS219Database db(cs219_database);
+
+  std::vector<uint64_t> packed_offsets(db.num_dbs);
+  size_t sequences_size = 0;
+  for (size_t n = 0; n < db.num_dbs; n++) {
+    packed_offsets[n] = sequences_size;
+    sequences_size = pack_align(sequences_size + db.lengths[n]);
+  }
+
+  FILE* fh = fopen(filename, "wb");
+  if (!fh) {
+    OpenFileError(filename, __FILE__, __LINE__, __func__);
+  }
+
+  PackHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  header.num_dbs = db.num_dbs;
+  header.max_length = db.max_length;
+  header.names_size = db.names_storage.size();
+  header.sequences_size = sequences_size;
+  header.source = pack_source(cs219_database);
+
+  size_t position = 0;
+  pack_write(fh, &header, sizeof(header), position);
+  pack_write(fh, db.lengths, db.num_dbs * sizeof(int32_t), position);
+  pack_write(fh, db.length_order, db.num_dbs * sizeof(uint32_t), position);
+  pack_write(fh, packed_offsets.empty() ? NULL : &packed_offsets[0], db.num_dbs * sizeof(uint64_t), position);
+  pack_write(fh, db.name_offsets, db.num_dbs * sizeof(uint64_t), position);
+  pack_write(fh, db.names, db.names_storage.size(), position);
+  for (size_t n = 0; n < db.num_dbs; n++) {
+    pack_write(fh, db.sequences + db.offsets[n], db.lengths[n], position);
+  }
+  fclose(fh);
+
+  HH_LOG(INFO) << "Packed " << db.num_dbs << " column state sequences ("
+               << sequences_size << " bytes) into " << filename << std::endl;
+}
+
+bool PackedCS219Database::isBuiltFrom(const char* filename, FFindexDatabase* cs219_database) {
+  FILE* fh = fopen(filename, "rb");
+  if (fh == NULL) {
+    return false;
+  }
+  PackHeader header;
+  const bool complete = fread(&header, sizeof(header), 1, fh) == 1;
+  fclose(fh);
+
+  return complete && memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0
+      && header.num_dbs == cs219_database->db_index->n_entries
+      && header.source == pack_source(cs219_database);
+}
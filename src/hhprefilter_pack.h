@@ -0,0 +1,61 @@
+/*
+ * hhprefilter_pack.h
+ *
+ * Column state sequences of a cs219 database for the prefilter: one blob of
+ * state bytes with offsets and lengths, a name table and the sequences sorted
+ * by length. Read from the cs219 ffindex or mapped from a packed file written
+ * by cs219_pack, which needs no per-entry work when it is opened.
+ */
+
+#ifndef HHPREFILTER_PACK_H_
+#define HHPREFILTER_PACK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "ffindexdatabase.h"
+
+class PackedCS219Database {
+public:
+	// arrays over the entries of the cs219 ffindex, the sequences stay in its data
+	PackedCS219Database(FFindexDatabase* cs219_database);
+	// map a packed file written by build()
+	PackedCS219Database(const char* filename);
+	virtual ~PackedCS219Database();
+
+	// write the packed file for the cs219 ffindex
+	static void build(FFindexDatabase* cs219_database, const char* filename);
+	// true if the packed file was written by build() from the cs219 ffindex as it is now
+	static bool isBuiltFrom(const char* filename, FFindexDatabase* cs219_database);
+
+	size_t num_dbs;
+	int max_length;
+
+	// sequence n has lengths[n] states starting at sequences + offsets[n]
+	const unsigned char* sequences;
+	const uint64_t* offsets;
+	const int32_t* lengths;
+
+	// zero terminated name of sequence n at names + name_offsets[n]
+	const char* names;
+	const uint64_t* name_offsets;
+
+	// sequence indices sorted by decreasing length
+	const uint32_t* length_order;
+
+private:
+	// mapped packed file
+	FILE* data_fh;
+	char* data;
+	size_t data_size;
+
+	// arrays read from the ffindex
+	std::vector<uint64_t> offsets_storage;
+	std::vector<int32_t> lengths_storage;
+	std::vector<char> names_storage;
+	std::vector<uint64_t> name_offsets_storage;
+	std::vector<uint32_t> length_order_storage;
+};
+
+#endif /* HHPREFILTER_PACK_H_ */
@@ -135,6 +135,11 @@ void HHsearch::help(Parameters& par, char all) {
     printf(" -realign            realign displayed hits with max. accuracy (MAC) algorithm \n");
     printf(" -excl <range>       exclude query positions from the alignment, e.g. '1-33,97-168' \n");
     printf(" -realign_max <int>  realign max. <int> hits (default=%i)                        \n", par.realign_max);
+    printf(" -mac_simd [0,1]     realign hits of several templates at once, one per SIMD lane (def=%i)\n", par.mac_simd);
+    printf(" -mac_band <int>     banded realignment (local mode): F/B/MAC only within <int> of the Viterbi\n");
+    printf("                     alignment, doubled while the band border has posterior mass (def=%i: full)\n", par.mac_band);
+    printf(" -viterbi_score_tile [0,1] precompute the profile-profile scores of the Viterbi\n");
+    printf("                     in blocks of query rows (def=%i)\n", par.viterbi_score_tile);
     printf(" -alt <int>          show up to this many alternative alignments with raw score > smin(def=%i)  \n", par.altali);
     printf(" -smin <float>       minimum raw score for alternative alignments (def=%.1f)  \n", par.smin);
     printf(" -shift [-1,1]       profile-profile score offset (def=%-.2f)                         \n", par.shift);
@@ -205,7 +210,8 @@ void HHsearch::help(Parameters& par, char all) {
     printf(" -atab   <file> write all alignments in tabular layout to file                   \n");
 	printf(" -maxseq <int>  max number of input rows (def=%5i)\n", par.maxseq);
     printf(" -maxres <int>  max number of HMM columns (def=%5i)\n", par.maxres);
-    printf(" -maxmem [1,inf[ limit memory for realignment (in GB) (def=%.1f)          \n", par.maxmem);
+    printf(" -maxmem [1,inf[ limit memory for realignment and backtrace (in GB) (def=%.1f)\n", par.maxmem);
+    printf(" -tcache_mem [0,inf[ limit memory for cached template HMMs with pseudocounts (in GB) (def=%.1f)\n", par.template_cache_mem);
   }
   printf("\n");
 
@@ -468,6 +474,12 @@ void HHsearch::ProcessArguments(Parameters& par) {
 			par.loc = 1;
 		else if (!strncmp(argv[i], "-alt", 4) && (i < argc - 1))
 			par.altali = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-viterbi_score_tile") && (i < argc - 1))
+			par.viterbi_score_tile = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-mac_simd") && (i < argc - 1))
+			par.mac_simd = (atoi(argv[++i]) != 0);
+		else if (!strcmp(argv[i], "-mac_band") && (i < argc - 1))
+			par.mac_band = atoi(argv[++i]);
     else if (!strncmp(argv[i], "-smin", 4) && (i < argc - 1))
       par.smin = atof(argv[++i]);
 		else if (!strcmp(argv[i], "-M") && (i < argc - 1)) {
@@ -502,6 +514,8 @@ void HHsearch::ProcessArguments(Parameters& par) {
 			par.threads = atoi(argv[++i]);
 		else if (!strcmp(argv[i], "-maxmem") && (i < argc - 1)) {
 			par.maxmem = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-tcache_mem") && (i < argc - 1)) {
+			par.template_cache_mem = atof(argv[++i]);
 		} else if (!strcmp(argv[i], "-corr") && (i < argc - 1))
 			par.corr = atof(argv[++i]);
 		else if (!strcmp(argv[i], "-ovlp") && (i < argc - 1))
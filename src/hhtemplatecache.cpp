@@ -0,0 +1,137 @@
+/*
+ * hhtemplatecache.cpp
+ *
+ * Binary template HMMs shared between queries, evicted in CLOCK order.
+ */
+
+#include "hhtemplatecache.h"
+#include "hhfunc.h"
+
+#include <iomanip>
+
+TemplateHMMCache::TemplateHMMCache(const size_t max_bytes)
+    : clock_hand(0), max_bytes(max_bytes), size(0), hits(0), misses(0), evictions(0) {
+}
+
+TemplateHMMCache::~TemplateHMMCache() {
+}
+
+void TemplateHMMCache::getTemplateHMM(HHEntry* entry, Parameters& par,
+    char use_global_weights, const float qsc, int& format, float* pb,
+    const float S[20][20], const float Sim[20][20], const float R[20][20], HMM* t) {
+  const TemplateProfileParameters parameters(par, use_global_weights, qsc, pb);
+  std::string key;
+  if (entry->getDatabaseName() != NULL) {
+    key += entry->getDatabaseName();
+    key += ":";
+  }
+  key += entry->getName();
+  key += use_global_weights ? ":g" : ":l";
+
+  std::shared_ptr<const std::string> profile;
+#pragma omp critical(template_hmm_cache)
+  {
+    std::map<std::string, size_t>::const_iterator it = slot_index.find(key);
+    if (it != slot_index.end()) {
+      Slot& slot = slots[it->second];
+      slot.referenced = true;
+      profile = slot.profile;
+    }
+  }
+
+  // decoded outside of the critical section, profile stays valid if it is evicted
+  int profile_format;
+  if (profile && t->ReadBinary(profile->data(), profile->size(), parameters, 0, profile_format)) {
+#pragma omp atomic
+    hits++;
+    format = 2;
+    return;
+  }
+
+  entry->getTemplateHMM(par, use_global_weights, qsc, format, pb, S, Sim, t);
+  if (format != 2) {
+    PrepareTemplateProfile(par, t, format, pb, R);
+  }
+  profile_format = (format == 1) ? 1 : 0;
+  format = 2;
+
+  std::string* binary = new std::string();
+  t->WriteBinary(*binary, profile_format, parameters, 0);
+  std::shared_ptr<const std::string> new_profile(binary);
+#pragma omp critical(template_hmm_cache)
+  {
+    misses++;
+    insert(key, new_profile);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Add or replace a profile, evicting others until it fits
+////////////////////////////////////////////////////////////////////////
+void TemplateHMMCache::insert(const std::string& key, std::shared_ptr<const std::string>& profile) {
+  if (profile->size() > max_bytes) {
+    return;
+  }
+
+  std::map<std::string, size_t>::iterator it = slot_index.find(key);
+  if (it != slot_index.end()) {
+    // prepared with other parameters, or read concurrently by another thread
+    Slot& slot = slots[it->second];
+    size -= slot.profile->size();
+    size += profile->size();
+    slot.profile = profile;
+    slot.referenced = true;
+  } else {
+    size_t n;
+    if (!free_slots.empty()) {
+      n = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      n = slots.size();
+      slots.push_back(Slot());
+    }
+    slots[n].key = key;
+    slots[n].profile = profile;
+    slots[n].referenced = false;
+    slot_index[key] = n;
+    size += profile->size();
+  }
+
+  while (size > max_bytes) {
+    evict();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Evict the next profile not referenced since the clock hand last passed
+////////////////////////////////////////////////////////////////////////
+void TemplateHMMCache::evict() {
+  while (true) {
+    Slot& slot = slots[clock_hand];
+    clock_hand = (clock_hand + 1) % slots.size();
+
+    if (!slot.profile) {
+      continue;
+    }
+    if (slot.referenced) {
+      slot.referenced = false;
+      continue;
+    }
+
+    size -= slot.profile->size();
+    slot.profile.reset();
+    slot_index.erase(slot.key);
+    slot.key.clear();
+    free_slots.push_back(&slot - &slots[0]);
+    evictions++;
+    return;
+  }
+}
+
+void TemplateHMMCache::printStatistics() {
+  const size_t requests = hits + misses;
+  HH_LOG(INFO) << "Template HMM cache: " << hits << " hits, " << misses << " misses ("
+               << std::fixed << std::setprecision(1) << (requests ? 100.0 * hits / requests : 0.0)
+               << "% hit rate), " << evictions << " evictions, "
+               << slot_index.size() << " templates in " << size / (1024 * 1024) << " MB" << std::endl;
+}
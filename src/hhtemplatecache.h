@@ -0,0 +1,64 @@
+/*
+ * hhtemplatecache.h
+ *
+ * Template HMMs after PrepareTemplateProfile, kept in the binary format of
+ * the _hhmbin databases. They do not depend on the query: the Viterbi passes,
+ * the MAC realignment and the rescoring of previous hits read and prepare a
+ * template only once, and one cache can be shared by all HHblits instances
+ * of a process (see hhblits_omp), so templates found by many queries are
+ * read from the database only once. When the memory limit is reached,
+ * templates are evicted in CLOCK order.
+ */
+
+#ifndef HHTEMPLATECACHE_H_
+#define HHTEMPLATECACHE_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hhdatabase.h"
+#include "hhhmm.h"
+
+class TemplateHMMCache {
+public:
+	// holds at most max_bytes of binary HMMs
+	TemplateHMMCache(const size_t max_bytes);
+	virtual ~TemplateHMMCache();
+
+	// like HHEntry::getTemplateHMM, but t has its pseudocounts and format is 2
+	// (see PrepareTemplateHMM); safe to call from several threads
+	void getTemplateHMM(HHEntry* entry, Parameters& par, char use_global_weights,
+			const float qsc, int& format, float* pb, const float S[20][20],
+			const float Sim[20][20], const float R[20][20], HMM* t);
+
+	// hits, misses and evictions so far
+	void printStatistics();
+
+private:
+	struct Slot {
+		std::string key;
+		// readers keep evicted profiles alive until they are decoded
+		std::shared_ptr<const std::string> profile;
+		bool referenced;
+	};
+
+	void insert(const std::string& key, std::shared_ptr<const std::string>& profile);
+	void evict();
+
+	// binary HMMs by database, template name and weighting
+	std::map<std::string, size_t> slot_index;
+	std::vector<Slot> slots;
+	std::vector<size_t> free_slots;
+	size_t clock_hand;
+
+	const size_t max_bytes;
+	size_t size;
+
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+};
+
+#endif /* HHTEMPLATECACHE_H_ */
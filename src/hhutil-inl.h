@@ -25,19 +25,27 @@ inline int  WordChr(char c) {
 	return (int)((c>='A' && c<='Z') || (c>='a' && c<='z'));
 }
 
-// Compute the sum of bits of one or two integers
+// Compute the sum of bits of one or two integers (popcnt instruction if the target has it)
 inline int NumberOfSetBits(int i)
 {
+#ifdef __POPCNT__
+    return __builtin_popcount((unsigned int) i);
+#else
     i = i - ((i >> 1) & 0x55555555);
     i = (i & 0x33333333) + ((i >> 2) & 0x33333333);
     return (((i + (i >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
 }
 
-//TODO: check
-//inline int NumberOfSetBits(int i)
-//{
-//  return _mm_popcnt_u32(i);
-//}
+// Compute the sum of bits of a 64-bit mask (simdi8_movemask with AVX-512, words of Alignment::Filter2)
+inline int NumberOfSetBits(unsigned long long i)
+{
+#ifdef __POPCNT__
+    return __builtin_popcountll(i);
+#else
+    return NumberOfSetBits((int) (i & 0xffffffffULL)) + NumberOfSetBits((int) (i >> 32));
+#endif
+}
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Transforms the one-letter amino acid code into an integer between 0 and 22
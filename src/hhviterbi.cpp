@@ -10,6 +10,10 @@
 #include "hhutil.h"
 #include "hhhmm.h"
 
+#include <unistd.h>
+
+static const long VITERBI_STRIPE_BYTES = 256 * 1024;
+
 Viterbi::Viterbi(int max_seq_length,bool local,float penalty_gap_query,float penalty_gap_template,
         float correlation, int par_min_overlap, float shift, const int ss_mode, float ssw,
         const float S73[NDSSP][NSSPRED][MAXCF], const float S33[NSSPRED][MAXCF][NSSPRED][MAXCF],
@@ -21,12 +25,27 @@ Viterbi::Viterbi(int max_seq_length,bool local,float penalty_gap_query,float pen
     this->penalty_gap_query = penalty_gap_query;
     this->penalty_gap_template = penalty_gap_template;
     this->sMM_DG_MI_GD_IM_vec = (simd_float *) malloc_simd_float(VECSIZE_FLOAT*max_seq_length*5*sizeof(float));
+    // the scores, transitions and profiles of the columns of a stripe fill half of the L2 cache
+    long stripe_bytes = VITERBI_STRIPE_BYTES;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    const long l2_cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2_cache_size > 0) {
+        stripe_bytes = l2_cache_size / 2;
+    }
+#endif
+    this->stripe_width = imax(64, (int) (stripe_bytes / (long) ((5 + 7 + NAA) * sizeof(simd_float))));
+    this->stripe_boundary = (simd_float *) malloc_simd_float(VECSIZE_FLOAT*(max_seq_length+1)*5*sizeof(float));
+    this->use_score_tile = false;
+    this->score_tile = NULL;
 
     this->correlation = correlation;
     this->par_min_overlap = par_min_overlap;
 //    this->exclstr = new char[strlen(exclstr)+1];
 //    strcpy(this->exclstr, exclstr);
     this->shift = shift;
+    this->banded = false;
+    this->band_lo = 0;
+    this->band_hi = 0;
     this->ssw = ssw;
 //    //  S73[NDSSP][NSSPRED][MAXCF]
 //    //  7 * 3 * 10
@@ -48,6 +67,8 @@ Viterbi::Viterbi(int max_seq_length,bool local,float penalty_gap_query,float pen
 
 Viterbi::~Viterbi(){
     free(sMM_DG_MI_GD_IM_vec);
+    free(stripe_boundary);
+    free(score_tile);
 //    free(ss73_lookup);
 //    free(ss33_lookup);
     free(ss_score);
@@ -57,6 +78,93 @@ Viterbi::~Viterbi(){
 
 
 
+void Viterbi::SetBand(int diagonal_lo, int diagonal_hi){
+    this->banded = local;
+    this->band_lo = diagonal_lo;
+    this->band_hi = diagonal_hi;
+}
+
+void Viterbi::ClearBand(){
+    this->banded = false;
+}
+
+void Viterbi::SetScoreTile(bool score_tile){
+    this->use_score_tile = score_tile;
+    if (score_tile && this->score_tile == NULL) {
+        this->score_tile = (simd_float *) malloc_simd_float(VECSIZE_FLOAT*SCORE_TILE_ROWS*max_seq_length*sizeof(float));
+    }
+}
+
+// ScalarProd20Vec of the query columns q0, q1 with the template columns t0, t1 in one pass,
+// every template column is loaded once for both query columns. The products are added
+// in the same order as in ScalarProd20Vec, so the scores are the same.
+static inline void ScalarProd20Vec2x2(const simd_float* q0, const simd_float* q1,
+                                      const simd_float* t0, const simd_float* t1, simd_float res[4])
+{
+    simd_float sum[4];
+    for (int part = 0; part < 4; part++) {
+        simd_float res00 = simdf32_mul(t0[part], q0[part]);
+        simd_float res01 = simdf32_mul(t1[part], q0[part]);
+        simd_float res10 = simdf32_mul(t0[part], q1[part]);
+        simd_float res11 = simdf32_mul(t1[part], q1[part]);
+        for (int a = part + 4; a < 20; a += 4) {
+            res00 = simdf32_add(simdf32_mul(t0[a], q0[a]), res00);
+            res01 = simdf32_add(simdf32_mul(t1[a], q0[a]), res01);
+            res10 = simdf32_add(simdf32_mul(t0[a], q1[a]), res10);
+            res11 = simdf32_add(simdf32_mul(t1[a], q1[a]), res11);
+        }
+        if (part == 0 || part == 2) {
+            sum[0] = res00;
+            sum[1] = res01;
+            sum[2] = res10;
+            sum[3] = res11;
+        } else if (part == 1) {
+            res[0] = simdf32_add(sum[0], res00);
+            res[1] = simdf32_add(sum[1], res01);
+            res[2] = simdf32_add(sum[2], res10);
+            res[3] = simdf32_add(sum[3], res11);
+        } else {
+            res[0] = simdf32_add(res[0], simdf32_add(sum[0], res00));
+            res[1] = simdf32_add(res[1], simdf32_add(sum[1], res01));
+            res[2] = simdf32_add(res[2], simdf32_add(sum[2], res10));
+            res[3] = simdf32_add(res[3], simdf32_add(sum[3], res11));
+        }
+    }
+}
+
+// static
+void Viterbi::ComputeScoreTile(HMMSimd* q, HMMSimd* t, int i_first, int rows,
+                               int jmin, int jmax, simd_float* tile, int stride)
+{
+    // blocks of 2 query rows x 2 template columns
+    int i = i_first;
+    for (; i + 1 < i_first + rows; i += 2) {
+        simd_float * tile_i0 = tile + (i - i_first) * stride;
+        simd_float * tile_i1 = tile_i0 + stride;
+        simd_float * q0 = (simd_float *) q->p[i];
+        simd_float * q1 = (simd_float *) q->p[i + 1];
+        int j = jmin;
+        for (; j < jmax; j += 2) {
+            simd_float res[4];
+            ScalarProd20Vec2x2(q0, q1, (simd_float *) t->p[j], (simd_float *) t->p[j + 1], res);
+            tile_i0[j]     = log2f4(res[0]);
+            tile_i0[j + 1] = log2f4(res[1]);
+            tile_i1[j]     = log2f4(res[2]);
+            tile_i1[j + 1] = log2f4(res[3]);
+        }
+        if (j == jmax) {
+            tile_i0[j] = log2f4(ScalarProd20Vec(q0, (simd_float *) t->p[j]));
+            tile_i1[j] = log2f4(ScalarProd20Vec(q1, (simd_float *) t->p[j]));
+        }
+    }
+    if (i < i_first + rows) {
+        simd_float * tile_i = tile + (i - i_first) * stride;
+        for (int j = jmin; j <= jmax; j++) {
+            tile_i[j] = log2f4(ScalarProd20Vec((simd_float *) q->p[i], (simd_float *) t->p[j]));
+        }
+    }
+}
+
 // static
 void Viterbi::ExcludeAlignment(ViterbiMatrix * matrix,HMMSimd* q_four, HMMSimd* t_four,int elem,
         int * i_steps, int * j_steps, int nsteps){
@@ -82,25 +190,45 @@ void Viterbi::ExcludeAlignment(ViterbiMatrix * matrix,HMMSimd* q_four, HMMSimd*
 //TODO inline
 Viterbi::BacktraceResult Viterbi::Backtrace(ViterbiMatrix * matrix,int elem,int start_i[VECSIZE_FLOAT], int start_j[VECSIZE_FLOAT])
 {
-    // Trace back trough the matrices bXY[i][j] until first match state is found (STOP-state)
-    int step;      // counts steps in path through 5-layered dynamic programming matrix
-    int i,j;       // query and template match state indices
-    //    InitializeBacktrace(q,t);
-
-    const int maxAlignmentLength = start_i[elem]+start_j[elem]+2;
-    int * i_steps  = new int[maxAlignmentLength];
-    int * j_steps  = new int[maxAlignmentLength];
-    char * states  = new char[maxAlignmentLength];
+    BacktraceResult result;
+    BacktracePosition position;
+    StartBacktrace(start_i[elem], start_j[elem], result, position);
+    BacktraceRows(matrix, elem, 0, result, position);
+    return result;
+}
 
+void Viterbi::StartBacktrace(int start_i, int start_j, BacktraceResult& result, BacktracePosition& position)
+{
+    const int maxAlignmentLength = start_i+start_j+2;
+    result.i_steps  = new int[maxAlignmentLength];
+    result.j_steps  = new int[maxAlignmentLength];
+    result.states  = new char[maxAlignmentLength];
+    result.count = 0;               // steps through the matrix correspond to alignment columns (from 1 to nsteps)
+    result.matched_cols = 0;        // for each MACTH (or STOP) state matched_col is incremented by 1
+
+    position.state = ViterbiMatrix::MM;     // state with maximum score must be MM state  // already set at the end of Viterbi()
+    position.i = start_i;                   // last aligned pair is (i2,j2)
+    position.j = start_j;
+}
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Trace back trough the matrices bXY[i][j] until first match state is found (STOP-state)
+// or until row first_row is left, returns true if the backtrace has finished
+/////////////////////////////////////////////////////////////////////////////////////
+bool Viterbi::BacktraceRows(ViterbiMatrix * matrix, int elem, int first_row,
+                            BacktraceResult& result, BacktracePosition& position)
+{
+    int step = result.count;
+    int matched_cols = result.matched_cols;
+    char state = position.state;
+    int i = position.i;
+    int j = position.j;
+    int * i_steps = result.i_steps;
+    int * j_steps = result.j_steps;
+    char * states = result.states;
 
     // Back-tracing loop
-    int matched_cols=0;         // for each MACTH (or STOP) state matched_col is incremented by 1
-    step=0;                 // steps through the matrix correspond to alignment columns (from 1 to nsteps)
-    char state=ViterbiMatrix::MM;           // state with maximum score must be MM state  // already set at the end of Viterbi()
-    i=start_i[elem]; j=start_j[elem];   // last aligned pair is (i2,j2)
-
-    while (state!=ViterbiMatrix::STOP)     // while (state!=STOP)  because STOP=0
+    while (state!=ViterbiMatrix::STOP && i >= first_row)     // while (state!=STOP)  because STOP=0
     {
         step++;
         states[step] = state;
@@ -145,18 +273,62 @@ Viterbi::BacktraceResult Viterbi::Backtrace(ViterbiMatrix * matrix,int elem,int
         } //end switch (state)
     } //end while (state)
 
+    result.count = step;
+    result.matched_cols = matched_cols;
+    position.state = state;
+    position.i = i;
+    position.j = j;
+    if (state != ViterbiMatrix::STOP) {
+        return false;
+    }
+
     states[step] = ViterbiMatrix::MM;  // first state (STOP state) is set to MM state
-    int nsteps=step;
+    return true;
+}
 
-    Viterbi::BacktraceResult result;
+void Viterbi::Backtrace(HMMSimd* q, HMMSimd* t, ViterbiMatrix * viterbiMatrix, int maxres, int ss_hmm_mode,
+                        ViterbiResult* viterbiResult, std::vector<BacktraceResult>& backtraceResults)
+{
+    if (viterbiMatrix->isCheckpointed() == false) {
+        for (int elem = 0; elem < maxres; elem++) {
+            backtraceResults[elem] = Backtrace(viterbiMatrix, elem, viterbiResult->i, viterbiResult->j);
+        }
+        return;
+    }
 
-    result.i_steps = i_steps;
-    result.j_steps = j_steps;
-    result.states = states;
-    result.count = nsteps;
-    result.matched_cols = matched_cols;
+    // The backtraces of all elements move up through the segments together,
+    // each segment is recomputed from the checkpoint above it
+    BacktracePosition positions[VECSIZE_FLOAT];
+    bool finished[VECSIZE_FLOAT];
+    for (int elem = 0; elem < maxres; elem++) {
+        StartBacktrace(viterbiResult->i[elem], viterbiResult->j[elem], backtraceResults[elem], positions[elem]);
+        finished[elem] = false;
+    }
+    for (int segment = viterbiMatrix->getSegments() - 1; segment >= 0; segment--) {
+        const int first_row = viterbiMatrix->getSegmentFirstRow(segment);
+        bool reached = false;
+        for (int elem = 0; elem < maxres; elem++) {
+            reached = reached || (finished[elem] == false && positions[elem].i >= first_row);
+        }
+        if (reached == false) {
+            continue;
+        }
 
-    return result;
+        viterbiMatrix->SetSegment(segment);
+        ViterbiResult segmentResult;
+        AlignRows(q, t, viterbiMatrix, maxres, &segmentResult, ss_hmm_mode);
+        for (int elem = 0; elem < maxres; elem++) {
+            if (finished[elem] == false) {
+                finished[elem] = BacktraceRows(viterbiMatrix, elem, first_row, backtraceResults[elem], positions[elem]);
+            }
+        }
+    }
+    // backtraces starting above the first row stop without reading the matrix
+    for (int elem = 0; elem < maxres; elem++) {
+        if (finished[elem] == false) {
+            BacktraceRows(viterbiMatrix, elem, 0, backtraceResults[elem], positions[elem]);
+        }
+    }
 }
 
 //TODO: inline
@@ -164,6 +336,32 @@ Viterbi::ViterbiResult* Viterbi::Align(HMMSimd* q, HMMSimd* t,ViterbiMatrix * vi
                                        int maxres, int ss_hmm_mode){
     Viterbi::ViterbiResult* result = new Viterbi::ViterbiResult();
 
+    if (viterbiMatrix->isCheckpointed()) {
+        // the best cells of all segments, ties go to the first cell as in a single pass;
+        // the cells stay turned off for the recomputation in Backtrace
+        for (int segment = 0; segment < viterbiMatrix->getSegments(); segment++) {
+            viterbiMatrix->SetSegment(segment);
+            ViterbiResult segmentResult;
+            AlignRows(q, t, viterbiMatrix, maxres, &segmentResult, ss_hmm_mode);
+            for (int elem = 0; elem < maxres; elem++) {
+                if (segment == 0 || segmentResult.score[elem] > result->score[elem]) {
+                    result->score[elem] = segmentResult.score[elem];
+                    result->i[elem] = segmentResult.i[elem];
+                    result->j[elem] = segmentResult.j[elem];
+                }
+            }
+        }
+        return result;
+    }
+
+    AlignRows(q, t, viterbiMatrix, maxres, result, ss_hmm_mode);
+    viterbiMatrix->setCellOff(false); // the ViterbiAlign set all Cell of values to false
+
+    return result;
+}
+
+void Viterbi::AlignRows(HMMSimd* q, HMMSimd* t,ViterbiMatrix * viterbiMatrix,
+                        int maxres, ViterbiResult* result, int ss_hmm_mode){
     /* TODO: @Martin: Should be done for ss_mode == 2 and ss_mode == 4?
      *            if ss_hmm_mode == 0, there is no need to do call the more expensive ss-version?
      *            it might be bad, that templates with secondary information are treated like with no ss-information
@@ -185,9 +383,6 @@ Viterbi::ViterbiResult* Viterbi::Align(HMMSimd* q, HMMSimd* t,ViterbiMatrix * vi
             this->AlignWithOutCellOff(q,t,viterbiMatrix, maxres, result);
         }
     }
-    viterbiMatrix->setCellOff(false); // the ViterbiAlign set all Cell of values to false
-
-    return result;
 }
 
 
@@ -8,6 +8,7 @@
 #ifndef HHVITERBI4_h
 #define HHVITERBI4_h
 #include <float.h>
+#include <vector>
 #include "hhhit.h"
 #include "hhviterbimatrix.h"
 #include "simd.h"
@@ -92,6 +93,21 @@ class Viterbi {
     void AlignWithCellOffAndSS(HMMSimd* q, HMMSimd* t,
             ViterbiMatrix * viterbiMatrix, int maxres, ViterbiResult* result, int ss_hmm_mode);
 
+    /////////////////////////////////////////////////////////////////////////////////////
+    // SetBand
+    // Restricts the following Align calls to the cells with
+    // diagonal_lo <= j - i <= diagonal_hi (local alignment only), ClearBand fills all cells
+    /////////////////////////////////////////////////////////////////////////////////////
+    void SetBand(int diagonal_lo, int diagonal_hi);
+    void ClearBand();
+
+    /////////////////////////////////////////////////////////////////////////////////////
+    // SetScoreTile
+    // With score_tile, the Align calls compute the profile-profile scores of
+    // SCORE_TILE_ROWS query rows in one blocked pass before the recursion runs over them
+    /////////////////////////////////////////////////////////////////////////////////////
+    void SetScoreTile(bool score_tile);
+
     /////////////////////////////////////////////////////////////////////////////////////
     // Backtrace
     // Makes backtrace from start i, j position.
@@ -99,6 +115,14 @@ class Viterbi {
     static BacktraceResult Backtrace(ViterbiMatrix * matrix, int elem,
         int start_i[VECSIZE_FLOAT], int start_j[VECSIZE_FLOAT]);
 
+    /////////////////////////////////////////////////////////////////////////////////////
+    // Backtrace
+    // Makes the backtraces of all elements after Align, a checkpointed matrix
+    // is recomputed segment by segment
+    /////////////////////////////////////////////////////////////////////////////////////
+    void Backtrace(HMMSimd* q, HMMSimd* t, ViterbiMatrix * viterbiMatrix, int maxres,
+        int ss_hmm_mode, ViterbiResult* viterbiResult, std::vector<BacktraceResult>& backtraceResults);
+
     /////////////////////////////////////////////////////////////////////////////////////
     // ScoreForBacktrace
     // Computes the score from a backtrace result
@@ -278,6 +302,31 @@ class Viterbi {
 
 private:
 
+    // cell and state of a backtrace that has left the rows of the matrix computed so far
+    struct BacktracePosition {
+        int i;
+        int j;
+        char state;
+    };
+
+    static void StartBacktrace(int start_i, int start_j, BacktraceResult& result,
+        BacktracePosition& position);
+
+    static bool BacktraceRows(ViterbiMatrix * matrix, int elem, int first_row,
+        BacktraceResult& result, BacktracePosition& position);
+
+    // query rows per tile of precomputed profile-profile scores
+    static const int SCORE_TILE_ROWS = 4;
+
+    // log2 of the profile-profile scores of the query rows i_first..i_first+rows-1 and the
+    // template columns jmin..jmax, row i at tile + (i - i_first) * stride
+    static void ComputeScoreTile(HMMSimd* q, HMMSimd* t, int i_first, int rows,
+        int jmin, int jmax, simd_float* tile, int stride);
+
+    // Align without resetting the cells turned off
+    void AlignRows(HMMSimd* q, HMMSimd* t, ViterbiMatrix * viterbiMatrix,
+        int maxres, ViterbiResult* result, int ss_hmm_mode);
+
     void PrintDebug(const HMM * q, const HMM *t,
         Viterbi::BacktraceScore * backtraceScore,
         Viterbi::BacktraceResult * backtraceResult, const int ssm);
@@ -289,6 +338,17 @@ private:
     int par_min_overlap;
     int max_seq_length;
     float shift;
+    // template columns per stripe of the DP traversal, see AlignWithOutCellOff
+    int stripe_width;
+    // cells of the last column of the previous stripe, one row after the other
+    simd_float * stripe_boundary;
+    // precomputed profile-profile scores, see SetScoreTile
+    bool use_score_tile;
+    simd_float * score_tile;
+    // band of filled diagonals j - i
+    bool banded;
+    int band_lo;
+    int band_hi;
 //    char* exclstr;
     // sMM[i][j] = score of best alignment up to indices (i,j) ending in (Match,Match)
     // sGD[i][j] = score of best alignment up to indices (i,j) ending in (Gap,Delete)
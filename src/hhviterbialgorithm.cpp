@@ -7,6 +7,8 @@
 #include "hhviterbi.h"
 #include "hhviterbimatrix.h"
 
+#include <cstring>
+
 
 #define MAX2_SET_MASK(vec1, vec2, vec3, res)        \
 res_gt_vec = (simd_int)simdf32_gt(vec1,vec2);      \
@@ -99,12 +101,16 @@ void Viterbi::AlignWithOutCellOff(HMMSimd* q, HMMSimd* t,ViterbiMatrix * viterbi
     simd_float * ss_score_vec = (simd_float *) ss_score;
 #endif
     
-#ifdef AVX2
+#if defined(AVX2) && !defined(AVX512)
     const simd_int shuffle_mask_extract = _mm256_setr_epi8(0,  4,  8,  12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
                                                            -1, -1, -1,  -1,  0,  4,  8, 12, -1, -1, -1, -1, -1, -1, -1, -1);
 #endif
 #ifdef VITERBI_CELLOFF
-#ifdef AVX2
+#ifdef AVX512
+    // the cell off bit of the 16 backtrace bytes, widened to 32 bit lanes
+    const simd_int co_vec            = simdi32_set(0x80);
+    const simd_int float_min_vec     = (simd_int) simdf32_set(-FLT_MAX);
+#elif defined(AVX2)
     const __m128i tmp_vec = _mm_set_epi32(0x40000000,0x00400000,0x00004000,0x00000040);//01000000010000000100000001000000
     const simd_int co_vec               = _mm256_inserti128_si256(_mm256_castsi128_si256(tmp_vec), tmp_vec, 1);
     const simd_int float_min_vec     = (simd_int) _mm256_set1_ps(-FLT_MAX);
@@ -153,291 +159,444 @@ void Viterbi::AlignWithOutCellOff(HMMSimd* q, HMMSimd* t,ViterbiMatrix * viterbi
     }
     // Viterbi algorithm
     const int queryLength = q->L;
-    for (i=1; i <= queryLength; ++i) // Loop through query positions i
+    const int targetLength = t->L;
+    // Banded alignment: only cells with diagonal_lo <= j-i <= diagonal_hi are filled,
+    // the cells next to the band are set to -FLT_MAX (the band moves one column per row)
+    const int diagonal_lo = (banded ? band_lo : -queryLength);
+    const int diagonal_hi = (banded ? band_hi : targetLength);
+    const int imin_band = imax(1, 1 - diagonal_hi);
+    const int imax_band = imin(queryLength, targetLength - diagonal_lo);
+    int i_first = imin_band;
+    int i_last = imax_band;
+    // Checkpointed backtrace: only the rows of the current segment are computed, starting from
+    // the scores of the row above it, and the scores of its last row are kept for the next one
+    int segment = -1;
+    if (viterbiMatrix->isCheckpointed()) {
+        segment = viterbiMatrix->getSegment();
+        i_first = imax(imin_band, viterbiMatrix->getSegmentFirstRow(segment));
+        i_last = imin(imax_band, viterbiMatrix->getSegmentLastRow(segment));
+        if (i_first > imin_band && i_first <= i_last) {
+            memcpy(sMM_DG_MI_GD_IM_vec, viterbiMatrix->getCheckpoint(segment - 1),
+                   (targetLength + 1) * 5 * sizeof(simd_float));
+        }
+    }
+    // Local alignments of long templates are computed in stripes of stripe_width columns, all rows
+    // of a stripe before the next one, so that the scores and template columns of the stripe stay
+    // in the cache. stripe_boundary keeps the cells of row i_first - 1 + r in the last column of
+    // the previous stripe at r * 5.
+    const int stripe_columns = (local && !banded) ? stripe_width : targetLength;
+    for (int j_first = 1; j_first <= targetLength; j_first += stripe_columns)
     {
+        const int j_last = imin(targetLength, j_first + stripe_columns - 1);
+        // cells (i-1,j_first-1) of the current row i
+        simd_float sMM_DG_MI_GD_IM_boundary[5];
+        for (int state = 0; state < 5; state++) {
+            if (j_first > 1) {
+                sMM_DG_MI_GD_IM_boundary[state] = stripe_boundary[state];
+            }
+            stripe_boundary[state] = sMM_DG_MI_GD_IM_vec[j_last * 5 + state];
+        }
+        for (i=i_first; i <= i_last; ++i) // Loop through query positions i
+        {
+            const int jmin = imax(j_first, i + diagonal_lo);
+            const int jmax = imin(j_last, i + diagonal_hi);
+            simd_float * stripe_boundary_i = stripe_boundary + (i - i_first + 1) * 5;
+
+            // profile-profile scores of row i from the tile of the next SCORE_TILE_ROWS rows
+            const simd_float * score_tile_i = NULL;
+            if (use_score_tile) {
+                const int tile_row = (i - i_first) % SCORE_TILE_ROWS;
+                if (tile_row == 0) {
+                    const int rows = imin(SCORE_TILE_ROWS, i_last - i + 1);
+                    ComputeScoreTile(q, t, i, rows, jmin, imin(j_last, i + rows - 1 + diagonal_hi),
+                                     score_tile, targetLength + 1);
+                }
+                score_tile_i = score_tile + tile_row * (targetLength + 1);
+            }
 
-        // If q is compared to t, exclude regions where overlap of q with t < min_overlap residues
-        // Initialize cells
-        sMM_i_1_j_1 = simdf32_set(-(i - 1) * penalty_gap_query);  // initialize at (i-1,0)
-        sIM_i_1_j_1 = simdf32_set(-FLT_MAX); // initialize at (i-1,jmin-1)
-        sMI_i_1_j_1 = simdf32_set(-FLT_MAX);
-        sDG_i_1_j_1 = simdf32_set(-FLT_MAX);
-        sGD_i_1_j_1 = simdf32_set(-FLT_MAX);
-
-        // initialize at (i,jmin-1)
-        const unsigned int index_pos_i = 0 * 5;
-        sMM_DG_MI_GD_IM_vec[index_pos_i + 0] = simdf32_set(-i * penalty_gap_query);           // initialize at (i,0)
-        sMM_DG_MI_GD_IM_vec[index_pos_i + 1] = simdf32_set(-FLT_MAX);
-        sMM_DG_MI_GD_IM_vec[index_pos_i + 2] = simdf32_set(-FLT_MAX);
-        sMM_DG_MI_GD_IM_vec[index_pos_i + 3] = simdf32_set(-FLT_MAX);
-        sMM_DG_MI_GD_IM_vec[index_pos_i + 4] = simdf32_set(-FLT_MAX);
-#ifdef AVX2
-        unsigned long long * sCO_MI_DG_IM_GD_MM_vec = (unsigned long long *) viterbiMatrix->getRow(i);
+            if (jmin == 1) {
+                // If q is compared to t, exclude regions where overlap of q with t < min_overlap residues
+                // Initialize cells
+                sMM_i_1_j_1 = simdf32_set(-(i - 1) * penalty_gap_query);  // initialize at (i-1,0)
+                sIM_i_1_j_1 = simdf32_set(-FLT_MAX); // initialize at (i-1,jmin-1)
+                sMI_i_1_j_1 = simdf32_set(-FLT_MAX);
+                sDG_i_1_j_1 = simdf32_set(-FLT_MAX);
+                sGD_i_1_j_1 = simdf32_set(-FLT_MAX);
+
+                // initialize at (i,jmin-1)
+                const unsigned int index_pos_i = 0 * 5;
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 0] = simdf32_set(-i * penalty_gap_query);           // initialize at (i,0)
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 1] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 2] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 3] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 4] = simdf32_set(-FLT_MAX);
+            } else if (jmin == j_first) {
+                // (i-1,jmin-1) and (i,jmin-1) are the last cells of rows i-1 and i in the previous stripe
+                const unsigned int index_pos_i = (jmin - 1) * 5;
+                sMM_i_1_j_1 = sMM_DG_MI_GD_IM_boundary[0];
+                sDG_i_1_j_1 = sMM_DG_MI_GD_IM_boundary[1];
+                sMI_i_1_j_1 = sMM_DG_MI_GD_IM_boundary[2];
+                sGD_i_1_j_1 = sMM_DG_MI_GD_IM_boundary[3];
+                sIM_i_1_j_1 = sMM_DG_MI_GD_IM_boundary[4];
+                for (int state = 0; state < 5; state++) {
+                    sMM_DG_MI_GD_IM_boundary[state] = stripe_boundary_i[state];
+                    sMM_DG_MI_GD_IM_vec[index_pos_i + state] = stripe_boundary_i[state];
+                }
+            } else {
+                // (i-1,jmin-1) is the first cell of the band in row i-1, (i,jmin-1) lies left of the band
+                const unsigned int index_pos_i = (jmin - 1) * 5;
+                sMM_i_1_j_1 = sMM_DG_MI_GD_IM_vec[index_pos_i + 0];
+                sDG_i_1_j_1 = sMM_DG_MI_GD_IM_vec[index_pos_i + 1];
+                sMI_i_1_j_1 = sMM_DG_MI_GD_IM_vec[index_pos_i + 2];
+                sGD_i_1_j_1 = sMM_DG_MI_GD_IM_vec[index_pos_i + 3];
+                sIM_i_1_j_1 = sMM_DG_MI_GD_IM_vec[index_pos_i + 4];
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 0] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 1] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 2] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 3] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_i + 4] = simdf32_set(-FLT_MAX);
+            }
+#ifdef AVX512
+            __m128i * sCO_MI_DG_IM_GD_MM_vec = (__m128i *) viterbiMatrix->getRow(i);
+#elif defined(AVX2)
+            unsigned long long * sCO_MI_DG_IM_GD_MM_vec = (unsigned long long *) viterbiMatrix->getRow(i);
 #else
-        unsigned int *sCO_MI_DG_IM_GD_MM_vec = (unsigned int *) viterbiMatrix->getRow(i);
+            unsigned int *sCO_MI_DG_IM_GD_MM_vec = (unsigned int *) viterbiMatrix->getRow(i);
 #endif
 
-        const unsigned int start_pos_tr_i_1 = (i - 1) * 7;
-        const unsigned int start_pos_tr_i = (i) * 7;
-        const simd_float q_m2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 2)); // M2M
-        const simd_float q_m2d = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 3)); // M2D
-        const simd_float q_d2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 4)); // D2M
-        const simd_float q_d2d = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 5)); // D2D
-        const simd_float q_i2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 6)); // I2m
-        const simd_float q_i2i = simdf32_load((float *) (q->tr + start_pos_tr_i)); // I2I
-        const simd_float q_m2i = simdf32_load((float *) (q->tr + start_pos_tr_i + 1)); // M2I
+            const unsigned int start_pos_tr_i_1 = (i - 1) * 7;
+            const unsigned int start_pos_tr_i = (i) * 7;
+            const simd_float q_m2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 2)); // M2M
+            const simd_float q_m2d = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 3)); // M2D
+            const simd_float q_d2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 4)); // D2M
+            const simd_float q_d2d = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 5)); // D2D
+            const simd_float q_i2m = simdf32_load((float *) (q->tr + start_pos_tr_i_1 + 6)); // I2m
+            const simd_float q_i2i = simdf32_load((float *) (q->tr + start_pos_tr_i)); // I2I
+            const simd_float q_m2i = simdf32_load((float *) (q->tr + start_pos_tr_i + 1)); // M2I
 
 
-        // Find maximum score; global alignment: maxize only over last row and last column
-        const bool findMaxInnerLoop = (local || i == queryLength);
-        const int targetLength = t->L;
+            // Find maximum score; global alignment: maxize only over last row and last column
+            const bool findMaxInnerLoop = (local || i == queryLength);
 #ifdef VITERBI_SS_SCORE
-        if(ss_hmm_mode == HMM::NO_SS_INFORMATION){
-            // set all to log(1.0) = 0.0
-            memset(ss_score, 0, (targetLength+1)*VECSIZE_FLOAT*sizeof(float));
-        }else {
-            const float * score;
-            if(ss_hmm_mode == HMM::PRED_PRED){
-                score = &S33[ (int)q_s->ss_pred[i]][ (int)q_s->ss_conf[i]][0][0];
-            }else if (ss_hmm_mode == HMM::DSSP_PRED){
-                score = &S73[ (int)q_s->ss_dssp[i]][0][0];
-            }else{
-                score = &S37[ (int)q_s->ss_pred[i]][ (int)q_s->ss_conf[i]][0];
+            if(ss_hmm_mode == HMM::NO_SS_INFORMATION){
+                // set all to log(1.0) = 0.0
+                if (jmin <= jmax) {
+                    memset(ss_score + jmin * VECSIZE_FLOAT, 0, (jmax - jmin + 1) * VECSIZE_FLOAT * sizeof(float));
+                }
+            }else {
+                const float * score;
+                if(ss_hmm_mode == HMM::PRED_PRED){
+                    score = &S33[ (int)q_s->ss_pred[i]][ (int)q_s->ss_conf[i]][0][0];
+                }else if (ss_hmm_mode == HMM::DSSP_PRED){
+                    score = &S73[ (int)q_s->ss_dssp[i]][0][0];
+                }else{
+                    score = &S37[ (int)q_s->ss_pred[i]][ (int)q_s->ss_conf[i]][0];
+                }
+                // access SS scores of the columns jmin..jmax and write them to the ss_score array
+                for (j = jmin * VECSIZE_FLOAT; j < (jmax + 1) * VECSIZE_FLOAT; j++) // Loop through template positions j
+                {
+                    ss_score[j] = ssw * score[t_index[j]];
+                }
             }
-            // access SS scores and write them to the ss_score array
-            for (j = 0; j <= (targetLength*VECSIZE_FLOAT); j++) // Loop through template positions j
-            {
-                ss_score[j] = ssw * score[t_index[j]];
-            }
-        }
 #endif
-        for (j=1; j <= targetLength; ++j) // Loop through template positions j
-        {
-            simd_int index_vec;
-            simd_int res_gt_vec;
-            // cache line optimized reading
-            const unsigned int start_pos_tr_j_1 = (j-1) * 7;
-            const unsigned int start_pos_tr_j = (j) * 7;
-
-            const simd_float t_m2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+2)); // M2M
-            const simd_float t_m2d = simdf32_load((float *) (t->tr+start_pos_tr_j_1+3)); // M2D
-            const simd_float t_d2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+4)); // D2M
-            const simd_float t_d2d = simdf32_load((float *) (t->tr+start_pos_tr_j_1+5)); // D2D
-            const simd_float t_i2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+6)); // I2m
-            const simd_float t_i2i = simdf32_load((float *) (t->tr+start_pos_tr_j));   // I2i
-            const simd_float t_m2i = simdf32_load((float *) (t->tr+start_pos_tr_j+1));     // M2I
-            
-            // Find max value
-            // CALCULATE_MAX6( sMM_i_j,
-            //                 smin,
-            //                 sMM_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][M2M],
-            //                 sGD_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][D2M],
-            //                 sIM_i_1_j_1 + q->tr[i-1][I2M] + t->tr[j-1][M2M],
-            //                 sDG_i_1_j_1 + q->tr[i-1][D2M] + t->tr[j-1][M2M],
-            //                 sMI_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][I2M],
-            //                 bMM[i][j]
-            //                 );
-            // same as sMM_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][M2M]
-            simd_float mm_m2m_m2m_vec = simdf32_add( simdf32_add(sMM_i_1_j_1, q_m2m), t_m2m);
-            // if mm > min { 2 }
-            res_gt_vec       = (simd_int)simdf32_gt(mm_m2m_m2m_vec, smin_vec);
-            byte_result_vec  = simdi_and(res_gt_vec, mm_vec);
-            sMM_i_j = simdf32_max(smin_vec, mm_m2m_m2m_vec);
-            
-            // same as sGD_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][D2M]
-            simd_float gd_m2m_d2m_vec = simdf32_add( simdf32_add(sGD_i_1_j_1, q_m2m), t_d2m);
-            // if gd > max { 3 }
-            res_gt_vec       = (simd_int)simdf32_gt(gd_m2m_d2m_vec, sMM_i_j);
-            index_vec        = simdi_and( res_gt_vec, gd_vec);
-            byte_result_vec  = simdi_or(  index_vec,  byte_result_vec);
-            
-            sMM_i_j = simdf32_max(sMM_i_j, gd_m2m_d2m_vec);
-            
-            
-            // same as sIM_i_1_j_1 + q->tr[i-1][I2M] + t->tr[j-1][M2M]
-            simd_float im_m2m_d2m_vec = simdf32_add( simdf32_add(sIM_i_1_j_1, q_i2m), t_m2m);
-            // if im > max { 4 }
-            MAX2(im_m2m_d2m_vec, sMM_i_j, im_vec,byte_result_vec);
-            sMM_i_j = simdf32_max(sMM_i_j, im_m2m_d2m_vec);
-            
-            // same as sDG_i_1_j_1 + q->tr[i-1][D2M] + t->tr[j-1][M2M]
-            simd_float dg_m2m_d2m_vec = simdf32_add( simdf32_add(sDG_i_1_j_1, q_d2m), t_m2m);
-            // if dg > max { 5 }
-            MAX2(dg_m2m_d2m_vec, sMM_i_j, dg_vec,byte_result_vec);
-            sMM_i_j = simdf32_max(sMM_i_j, dg_m2m_d2m_vec);
-            
-            // same as sMI_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][I2M],
-            simd_float mi_m2m_d2m_vec = simdf32_add( simdf32_add(sMI_i_1_j_1, q_m2m), t_i2m);
-            // if mi > max { 6 }
-            MAX2(mi_m2m_d2m_vec, sMM_i_j, mi_vec, byte_result_vec);
-            sMM_i_j = simdf32_max(sMM_i_j, mi_m2m_d2m_vec);
-            
-            // TODO add secondary structure score
-            // calculate amino acid profile-profile scores
-            Si_vec = log2f4(ScalarProd20Vec((simd_float *) q->p[i],(simd_float *) t->p[j]));
+            for (j=jmin; j <= jmax; ++j) // Loop through template positions j
+            {
+                simd_int index_vec;
+                simd_int res_gt_vec;
+                // cache line optimized reading
+                const unsigned int start_pos_tr_j_1 = (j-1) * 7;
+                const unsigned int start_pos_tr_j = (j) * 7;
+
+                const simd_float t_m2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+2)); // M2M
+                const simd_float t_m2d = simdf32_load((float *) (t->tr+start_pos_tr_j_1+3)); // M2D
+                const simd_float t_d2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+4)); // D2M
+                const simd_float t_d2d = simdf32_load((float *) (t->tr+start_pos_tr_j_1+5)); // D2D
+                const simd_float t_i2m = simdf32_load((float *) (t->tr+start_pos_tr_j_1+6)); // I2m
+                const simd_float t_i2i = simdf32_load((float *) (t->tr+start_pos_tr_j));   // I2i
+                const simd_float t_m2i = simdf32_load((float *) (t->tr+start_pos_tr_j+1));     // M2I
+            
+                // Find max value
+                // CALCULATE_MAX6( sMM_i_j,
+                //                 smin,
+                //                 sMM_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][M2M],
+                //                 sGD_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][D2M],
+                //                 sIM_i_1_j_1 + q->tr[i-1][I2M] + t->tr[j-1][M2M],
+                //                 sDG_i_1_j_1 + q->tr[i-1][D2M] + t->tr[j-1][M2M],
+                //                 sMI_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][I2M],
+                //                 bMM[i][j]
+                //                 );
+                // same as sMM_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][M2M]
+                simd_float mm_m2m_m2m_vec = simdf32_add( simdf32_add(sMM_i_1_j_1, q_m2m), t_m2m);
+                // if mm > min { 2 }
+                res_gt_vec       = (simd_int)simdf32_gt(mm_m2m_m2m_vec, smin_vec);
+                byte_result_vec  = simdi_and(res_gt_vec, mm_vec);
+                sMM_i_j = simdf32_max(smin_vec, mm_m2m_m2m_vec);
+            
+                // same as sGD_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][D2M]
+                simd_float gd_m2m_d2m_vec = simdf32_add( simdf32_add(sGD_i_1_j_1, q_m2m), t_d2m);
+                // if gd > max { 3 }
+                res_gt_vec       = (simd_int)simdf32_gt(gd_m2m_d2m_vec, sMM_i_j);
+                index_vec        = simdi_and( res_gt_vec, gd_vec);
+                byte_result_vec  = simdi_or(  index_vec,  byte_result_vec);
+            
+                sMM_i_j = simdf32_max(sMM_i_j, gd_m2m_d2m_vec);
+            
+            
+                // same as sIM_i_1_j_1 + q->tr[i-1][I2M] + t->tr[j-1][M2M]
+                simd_float im_m2m_d2m_vec = simdf32_add( simdf32_add(sIM_i_1_j_1, q_i2m), t_m2m);
+                // if im > max { 4 }
+                MAX2(im_m2m_d2m_vec, sMM_i_j, im_vec,byte_result_vec);
+                sMM_i_j = simdf32_max(sMM_i_j, im_m2m_d2m_vec);
+            
+                // same as sDG_i_1_j_1 + q->tr[i-1][D2M] + t->tr[j-1][M2M]
+                simd_float dg_m2m_d2m_vec = simdf32_add( simdf32_add(sDG_i_1_j_1, q_d2m), t_m2m);
+                // if dg > max { 5 }
+                MAX2(dg_m2m_d2m_vec, sMM_i_j, dg_vec,byte_result_vec);
+                sMM_i_j = simdf32_max(sMM_i_j, dg_m2m_d2m_vec);
+            
+                // same as sMI_i_1_j_1 + q->tr[i-1][M2M] + t->tr[j-1][I2M],
+                simd_float mi_m2m_d2m_vec = simdf32_add( simdf32_add(sMI_i_1_j_1, q_m2m), t_i2m);
+                // if mi > max { 6 }
+                MAX2(mi_m2m_d2m_vec, sMM_i_j, mi_vec, byte_result_vec);
+                sMM_i_j = simdf32_max(sMM_i_j, mi_m2m_d2m_vec);
+            
+                // TODO add secondary structure score
+                // calculate amino acid profile-profile scores
+                Si_vec = (score_tile_i != NULL) ? score_tile_i[j]
+                                                : log2f4(ScalarProd20Vec((simd_float *) q->p[i],(simd_float *) t->p[j]));
 #ifdef VITERBI_SS_SCORE
-            Si_vec = simdf32_add(ss_score_vec[j], Si_vec);
+                Si_vec = simdf32_add(ss_score_vec[j], Si_vec);
 #endif
-            Si_vec = simdf32_add(Si_vec, shift_vec);
-            
-            sMM_i_j = simdf32_add(sMM_i_j, Si_vec);
-            //+ ScoreSS(q,t,i,j) + shift + (Sstruc==NULL? 0: Sstruc[i][j]);
-            
-            const unsigned int index_pos_j   = (j * 5);
-            const unsigned int index_pos_j_1 = (j - 1) * 5;
-            const simd_float sMM_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 0));
-            const simd_float sGD_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 3));
-            const simd_float sIM_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 4));
-            const simd_float sMM_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 0));
-            const simd_float sDG_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 1));
-            const simd_float sMI_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 2));
-            sMM_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 0));
-            sDG_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 1));
-            sMI_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 2));
-            sGD_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 3));
-            sIM_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 4));
-            
-            //            sGD_i_j = max2
-            //            (
-            //             sMM[j-1] + t->tr[j-1][M2D], // MM->GD gap opening in query
-            //             sGD[j-1] + t->tr[j-1][D2D], // GD->GD gap extension in query
-            //             bGD[i][j]
-            //             );
-            //sMM_DG_GD_MI_IM_vec
-            simd_float mm_gd_vec = simdf32_add(sMM_j_1, t_m2d); // MM->GD gap opening in query
-            simd_float gd_gd_vec = simdf32_add(sGD_j_1, t_d2d); // GD->GD gap extension in query
-            // if mm_gd > gd_dg { 8 }
-            MAX2_SET_MASK(mm_gd_vec, gd_gd_vec,gd_mm_vec, byte_result_vec);
-            
-            sGD_i_j = simdf32_max(
-                                 mm_gd_vec,
-                                 gd_gd_vec
-                                 );
-            //            sIM_i_j = max2
-            //            (
-            //             sMM[j-1] + q->tr[i][M2I] + t->tr[j-1][M2M] ,
-            //             sIM[j-1] + q->tr[i][I2I] + t->tr[j-1][M2M], // IM->IM gap extension in query
-            //             bIM[i][j]
-            //             );
-            
-            
-            simd_float mm_mm_vec = simdf32_add(simdf32_add(sMM_j_1, q_m2i), t_m2m);
-            simd_float im_im_vec = simdf32_add(simdf32_add(sIM_j_1, q_i2i), t_m2m); // IM->IM gap extension in query
-            // if mm_mm > im_im { 16 }
-            MAX2_SET_MASK(mm_mm_vec,im_im_vec, im_mm_vec, byte_result_vec);
-            
-            sIM_i_j = simdf32_max(
-                                  mm_mm_vec,
-                                  im_im_vec
-                                  );
-            
-            //            sDG_i_j = max2
-            //            (
-            //             sMM[j] + q->tr[i-1][M2D],
-            //             sDG[j] + q->tr[i-1][D2D], //gap extension (DD) in query
-            //             bDG[i][j]
-            //             );
-            simd_float mm_dg_vec = simdf32_add(sMM_j, q_m2d);
-            simd_float dg_dg_vec = simdf32_add(sDG_j, q_d2d); //gap extension (DD) in query
-            // if mm_dg > dg_dg { 32 }
-            MAX2_SET_MASK(mm_dg_vec,dg_dg_vec, dg_mm_vec, byte_result_vec);
-            
-            sDG_i_j = simdf32_max( mm_dg_vec
-                                  ,
-                                  dg_dg_vec
-                                  );
-            
-
-            
-            //            sMI_i_j = max2
-            //            (
-            //             sMM[j] + q->tr[i-1][M2M] + t->tr[j][M2I], // MM->MI gap opening M2I in template
-            //             sMI[j] + q->tr[i-1][M2M] + t->tr[j][I2I], // MI->MI gap extension I2I in template
-            //             bMI[i][j]
-            //             );
-            simd_float mm_mi_vec = simdf32_add( simdf32_add(sMM_j, q_m2m), t_m2i);  // MM->MI gap opening M2I in template
-            simd_float mi_mi_vec = simdf32_add( simdf32_add(sMI_j, q_m2m), t_i2i);  // MI->MI gap extension I2I in template
-            // if mm_mi > mi_mi { 64 }
-            MAX2_SET_MASK(mm_mi_vec, mi_mi_vec,mi_mm_vec, byte_result_vec);
-            
-            sMI_i_j = simdf32_max(
-                                  mm_mi_vec,
-                                  mi_mi_vec
-                                  );
-
-            
-            // Cell of logic
-            // if (cell_off[i][j])
-            //shift   10000000100000001000000010000000 -> 01000000010000000100000001000000
-            //because 10000000000000000000000000000000 = -2147483648 kills cmplt
+                Si_vec = simdf32_add(Si_vec, shift_vec);
+            
+                sMM_i_j = simdf32_add(sMM_i_j, Si_vec);
+                //+ ScoreSS(q,t,i,j) + shift + (Sstruc==NULL? 0: Sstruc[i][j]);
+            
+                const unsigned int index_pos_j   = (j * 5);
+                const unsigned int index_pos_j_1 = (j - 1) * 5;
+                const simd_float sMM_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 0));
+                const simd_float sGD_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 3));
+                const simd_float sIM_j_1 = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j_1 + 4));
+                const simd_float sMM_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 0));
+                const simd_float sDG_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 1));
+                const simd_float sMI_j   = simdf32_load((float *) (sMM_DG_MI_GD_IM_vec + index_pos_j + 2));
+                sMM_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 0));
+                sDG_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 1));
+                sMI_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 2));
+                sGD_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 3));
+                sIM_i_1_j_1 = simdf32_load((float *)(sMM_DG_MI_GD_IM_vec + index_pos_j + 4));
+            
+                //            sGD_i_j = max2
+                //            (
+                //             sMM[j-1] + t->tr[j-1][M2D], // MM->GD gap opening in query
+                //             sGD[j-1] + t->tr[j-1][D2D], // GD->GD gap extension in query
+                //             bGD[i][j]
+                //             );
+                //sMM_DG_GD_MI_IM_vec
+                simd_float mm_gd_vec = simdf32_add(sMM_j_1, t_m2d); // MM->GD gap opening in query
+                simd_float gd_gd_vec = simdf32_add(sGD_j_1, t_d2d); // GD->GD gap extension in query
+                // if mm_gd > gd_dg { 8 }
+                MAX2_SET_MASK(mm_gd_vec, gd_gd_vec,gd_mm_vec, byte_result_vec);
+            
+                sGD_i_j = simdf32_max(
+                                     mm_gd_vec,
+                                     gd_gd_vec
+                                     );
+                //            sIM_i_j = max2
+                //            (
+                //             sMM[j-1] + q->tr[i][M2I] + t->tr[j-1][M2M] ,
+                //             sIM[j-1] + q->tr[i][I2I] + t->tr[j-1][M2M], // IM->IM gap extension in query
+                //             bIM[i][j]
+                //             );
+            
+            
+                simd_float mm_mm_vec = simdf32_add(simdf32_add(sMM_j_1, q_m2i), t_m2m);
+                simd_float im_im_vec = simdf32_add(simdf32_add(sIM_j_1, q_i2i), t_m2m); // IM->IM gap extension in query
+                // if mm_mm > im_im { 16 }
+                MAX2_SET_MASK(mm_mm_vec,im_im_vec, im_mm_vec, byte_result_vec);
+            
+                sIM_i_j = simdf32_max(
+                                      mm_mm_vec,
+                                      im_im_vec
+                                      );
+            
+                //            sDG_i_j = max2
+                //            (
+                //             sMM[j] + q->tr[i-1][M2D],
+                //             sDG[j] + q->tr[i-1][D2D], //gap extension (DD) in query
+                //             bDG[i][j]
+                //             );
+                simd_float mm_dg_vec = simdf32_add(sMM_j, q_m2d);
+                simd_float dg_dg_vec = simdf32_add(sDG_j, q_d2d); //gap extension (DD) in query
+                // if mm_dg > dg_dg { 32 }
+                MAX2_SET_MASK(mm_dg_vec,dg_dg_vec, dg_mm_vec, byte_result_vec);
+            
+                sDG_i_j = simdf32_max( mm_dg_vec
+                                      ,
+                                      dg_dg_vec
+                                      );
+            
+
+            
+                //            sMI_i_j = max2
+                //            (
+                //             sMM[j] + q->tr[i-1][M2M] + t->tr[j][M2I], // MM->MI gap opening M2I in template
+                //             sMI[j] + q->tr[i-1][M2M] + t->tr[j][I2I], // MI->MI gap extension I2I in template
+                //             bMI[i][j]
+                //             );
+                simd_float mm_mi_vec = simdf32_add( simdf32_add(sMM_j, q_m2m), t_m2i);  // MM->MI gap opening M2I in template
+                simd_float mi_mi_vec = simdf32_add( simdf32_add(sMI_j, q_m2m), t_i2i);  // MI->MI gap extension I2I in template
+                // if mm_mi > mi_mi { 64 }
+                MAX2_SET_MASK(mm_mi_vec, mi_mi_vec,mi_mm_vec, byte_result_vec);
+            
+                sMI_i_j = simdf32_max(
+                                      mm_mi_vec,
+                                      mi_mi_vec
+                                      );
+
+            
+                // Cell of logic
+                // if (cell_off[i][j])
+                //shift   10000000100000001000000010000000 -> 01000000010000000100000001000000
+                //because 10000000000000000000000000000000 = -2147483648 kills cmplt
 #ifdef VITERBI_CELLOFF
+#ifdef AVX512
+                const simd_int matrix_vec = _mm512_cvtepu8_epi32(_mm_loadu_si128(&sCO_MI_DG_IM_GD_MM_vec[j]));
+                const __mmask16 cell_off_mask = _mm512_test_epi32_mask(matrix_vec, co_vec);
+                simd_float cell_off_float_min_vec = (simd_float) _mm512_maskz_mov_epi32(cell_off_mask, float_min_vec);
+#else
 #ifdef AVX2
-            simd_int matrix_vec    = _mm256_set1_epi64x(sCO_MI_DG_IM_GD_MM_vec[j]>>1);
-            matrix_vec             = _mm256_shuffle_epi8(matrix_vec,shuffle_mask_celloff);
+                simd_int matrix_vec    = _mm256_set1_epi64x(sCO_MI_DG_IM_GD_MM_vec[j]>>1);
+                matrix_vec             = _mm256_shuffle_epi8(matrix_vec,shuffle_mask_celloff);
 #else
-//            if(((sCO_MI_DG_IM_GD_MM_vec[j]  >>1) & 0x40404040) > 0){
-//                std::cout << ((sCO_MI_DG_IM_GD_MM_vec[j]  >>1) & 0x40404040   ) << std::endl;
-//            }
-            simd_int matrix_vec    = simdi32_set(sCO_MI_DG_IM_GD_MM_vec[j]>>1);
+    //            if(((sCO_MI_DG_IM_GD_MM_vec[j]  >>1) & 0x40404040) > 0){
+    //                std::cout << ((sCO_MI_DG_IM_GD_MM_vec[j]  >>1) & 0x40404040   ) << std::endl;
+    //            }
+                simd_int matrix_vec    = simdi32_set(sCO_MI_DG_IM_GD_MM_vec[j]>>1);
 
 #endif
-            simd_int cell_off_vec  = simdi_and(matrix_vec, co_vec);
-            simd_int res_eq_co_vec = simdi32_gt(co_vec, cell_off_vec    ); // shift is because signed can't be checked here
-            simd_float  cell_off_float_min_vec = (simd_float) simdi_andnot(res_eq_co_vec, float_min_vec); // inverse
-            sMM_i_j = simdf32_add(sMM_i_j,cell_off_float_min_vec);    // add the cell off vec to sMM_i_j. Set -FLT_MAX to cell off
-            sGD_i_j = simdf32_add(sGD_i_j,cell_off_float_min_vec);
-            sIM_i_j = simdf32_add(sIM_i_j,cell_off_float_min_vec);
-            sDG_i_j = simdf32_add(sDG_i_j,cell_off_float_min_vec);
-            sMI_i_j = simdf32_add(sMI_i_j,cell_off_float_min_vec);
+                simd_int cell_off_vec  = simdi_and(matrix_vec, co_vec);
+                simd_int res_eq_co_vec = simdi32_gt(co_vec, cell_off_vec    ); // shift is because signed can't be checked here
+                simd_float  cell_off_float_min_vec = (simd_float) simdi_andnot(res_eq_co_vec, float_min_vec); // inverse
+#endif
+                sMM_i_j = simdf32_add(sMM_i_j,cell_off_float_min_vec);    // add the cell off vec to sMM_i_j. Set -FLT_MAX to cell off
+                sGD_i_j = simdf32_add(sGD_i_j,cell_off_float_min_vec);
+                sIM_i_j = simdf32_add(sIM_i_j,cell_off_float_min_vec);
+                sDG_i_j = simdf32_add(sDG_i_j,cell_off_float_min_vec);
+                sMI_i_j = simdf32_add(sMI_i_j,cell_off_float_min_vec);
 #endif
             
             
             
-            simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 0), sMM_i_j);
-            simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 1), sDG_i_j);
-            simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 2), sMI_i_j);
-            simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 3), sGD_i_j);
-            simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 4), sIM_i_j);
-
-            // write values back to ViterbiMatrix
-#ifdef AVX2
-            /* byte_result_vec        000H  000G  000F  000E   000D  000C  000B  000A */
-            /* abcdefgh               0000  0000  HGFE  0000   0000  0000  0000  DCBA */
-            const __m256i abcdefgh = _mm256_shuffle_epi8(byte_result_vec, shuffle_mask_extract);
-            /* abcd                                            0000  0000  0000  DCBA */
-            const __m128i abcd     = _mm256_castsi256_si128(abcdefgh);
-            /* efgh                                            0000  0000  HGFE  0000 */
-            const __m128i efgh     = _mm256_extracti128_si256(abcdefgh, 1);
-            _mm_storel_epi64((__m128i*)&sCO_MI_DG_IM_GD_MM_vec[j], _mm_or_si128(abcd, efgh));
+                simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 0), sMM_i_j);
+                simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 1), sDG_i_j);
+                simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 2), sMI_i_j);
+                simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 3), sGD_i_j);
+                simdf32_store((float *)(sMM_DG_MI_GD_IM_vec+index_pos_j + 4), sIM_i_j);
+
+                // write values back to ViterbiMatrix
+#ifdef AVX512
+                // 16 lanes with values < 128 truncated to the 16 backtrace bytes
+                _mm_storeu_si128(&sCO_MI_DG_IM_GD_MM_vec[j], _mm512_cvtepi32_epi8(byte_result_vec));
+#elif defined(AVX2)
+                /* byte_result_vec        000H  000G  000F  000E   000D  000C  000B  000A */
+                /* abcdefgh               0000  0000  HGFE  0000   0000  0000  0000  DCBA */
+                const __m256i abcdefgh = _mm256_shuffle_epi8(byte_result_vec, shuffle_mask_extract);
+                /* abcd                                            0000  0000  0000  DCBA */
+                const __m128i abcd     = _mm256_castsi256_si128(abcdefgh);
+                /* efgh                                            0000  0000  HGFE  0000 */
+                const __m128i efgh     = _mm256_extracti128_si256(abcdefgh, 1);
+                _mm_storel_epi64((__m128i*)&sCO_MI_DG_IM_GD_MM_vec[j], _mm_or_si128(abcd, efgh));
 #elif defined(SSE)
 
-            byte_result_vec = _mm_packs_epi32(byte_result_vec, byte_result_vec);
-            byte_result_vec = _mm_packus_epi16(byte_result_vec, byte_result_vec);
-            int int_result  = _mm_cvtsi128_si32(byte_result_vec);
-            sCO_MI_DG_IM_GD_MM_vec[j] = int_result;
+                byte_result_vec = _mm_packs_epi32(byte_result_vec, byte_result_vec);
+                byte_result_vec = _mm_packus_epi16(byte_result_vec, byte_result_vec);
+                int int_result  = _mm_cvtsi128_si32(byte_result_vec);
+                sCO_MI_DG_IM_GD_MM_vec[j] = int_result;
 #endif
             
 
             
-            // Find maximum score; global alignment: maxize only over last row and last column
-            // if(sMM_i_j>score && (par.loc || i==q->L)) { i2=i; j2=j; score=sMM_i_j; }
-            if (findMaxInnerLoop){
+                // Find maximum score; global alignment: maxize only over last row and last column
+                // if(sMM_i_j>score && (par.loc || i==q->L)) { i2=i; j2=j; score=sMM_i_j; }
+                if (findMaxInnerLoop){
+                
+                    // new score is higer
+                    // output
+                    //  0   0   0   MAX
+                    simd_int lookup_mask_hi = (simd_int) simdf32_gt(sMM_i_j,score_vec);
+                    if (j_first > 1) {
+                        // the previous stripes have visited cells of later rows, equal scores
+                        // go to the first cell in row order as without stripes
+                        const simd_int earlier_row = simdi32_gt(i2_vec, simdi32_set(i));
+                        lookup_mask_hi = simdi_or(lookup_mask_hi,
+                                                  simdi_and((simd_int) simdf32_eq(sMM_i_j, score_vec), earlier_row));
+                    }
+                    simd_int lookup_mask_lo = simdi_andnot(lookup_mask_hi,simdi32_set(-1));
+
+                    //simd_int lookup_mask_lo = (simd_int) simdf32_gt(score_vec,sMM_i_j);
+
+                    // old score is higher
+                    // output
+                    //  MAX MAX MAX 0
+                    //simd_int lookup_mask_lo = (simd_int) simdf32_lt(sMM_i_j,score_vec);
                 
+                
+                    simd_int curr_pos_j   = simdi32_set(j);
+                    simd_int new_j_pos_hi = simdi_and(lookup_mask_hi,curr_pos_j);
+                    simd_int old_j_pos_lo = simdi_and(lookup_mask_lo,j2_vec);
+                    j2_vec = simdi32_add(new_j_pos_hi,old_j_pos_lo);
+                    simd_int curr_pos_i   = simdi32_set(i);
+                    simd_int new_i_pos_hi = simdi_and(lookup_mask_hi,curr_pos_i);
+                    simd_int old_i_pos_lo = simdi_and(lookup_mask_lo,i2_vec);
+                    i2_vec = simdi32_add(new_i_pos_hi,old_i_pos_lo);
+                
+                    score_vec=simdf32_max(sMM_i_j,score_vec);
+    //                printf("%d %d ",i, j);
+    //                for(int seq_index=0; seq_index < maxres; seq_index++){
+    //                    printf("(%d %d %d %.3f %.3f %d %d)\t",  seq_index, ((int*)&lookup_mask_hi)[seq_index], ((int*)&lookup_mask_lo)[seq_index], ((float*)&sMM_i_j)[seq_index], ((float*)&score_vec)[seq_index],
+    //                           ((int*)&i2_vec)[seq_index], ((int*)&j2_vec)[seq_index]);
+    //                }
+    //                printf("\n");
+                }
+            
+            
+            
+            } //end for j
+
+            // the last cell of row i in the stripe, the next stripe starts to the right of it
+            if (j_last < targetLength) {
+                for (int state = 0; state < 5; state++) {
+                    stripe_boundary_i[state] = sMM_DG_MI_GD_IM_vec[j_last * 5 + state];
+                }
+            }
+
+            // (i,jmax+1) lies right of the band, row i+1 reads it above its last cell
+            if (jmax < j_last) {
+                const unsigned int index_pos_j = (jmax + 1) * 5;
+                sMM_DG_MI_GD_IM_vec[index_pos_j + 0] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_j + 1] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_j + 2] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_j + 3] = simdf32_set(-FLT_MAX);
+                sMM_DG_MI_GD_IM_vec[index_pos_j + 4] = simdf32_set(-FLT_MAX);
+            }
+        
+            // if global alignment: look for best cell in last column
+            if (!local){
+            
                 // new score is higer
                 // output
                 //  0   0   0   MAX
                 simd_int lookup_mask_hi = (simd_int) simdf32_gt(sMM_i_j,score_vec);
+    //            simd_int lookup_mask_lo;
                 simd_int lookup_mask_lo = simdi_andnot(lookup_mask_hi,simdi32_set(-1));
 
-                //simd_int lookup_mask_lo = (simd_int) simdf32_gt(score_vec,sMM_i_j);
-
                 // old score is higher
                 // output
                 //  MAX MAX MAX 0
-                //simd_int lookup_mask_lo = (simd_int) simdf32_lt(sMM_i_j,score_vec);
-                
-                
-                simd_int curr_pos_j   = simdi32_set(j);
+
+            
+                simd_int curr_pos_j   = simdi32_set(j-1);
                 simd_int new_j_pos_hi = simdi_and(lookup_mask_hi,curr_pos_j);
                 simd_int old_j_pos_lo = simdi_and(lookup_mask_lo,j2_vec);
                 j2_vec = simdi32_add(new_j_pos_hi,old_j_pos_lo);
@@ -445,47 +604,15 @@ void Viterbi::AlignWithOutCellOff(HMMSimd* q, HMMSimd* t,ViterbiMatrix * viterbi
                 simd_int new_i_pos_hi = simdi_and(lookup_mask_hi,curr_pos_i);
                 simd_int old_i_pos_lo = simdi_and(lookup_mask_lo,i2_vec);
                 i2_vec = simdi32_add(new_i_pos_hi,old_i_pos_lo);
-                
-                score_vec=simdf32_max(sMM_i_j,score_vec);
-//                printf("%d %d ",i, j);
-//                for(int seq_index=0; seq_index < maxres; seq_index++){
-//                    printf("(%d %d %d %.3f %.3f %d %d)\t",  seq_index, ((int*)&lookup_mask_hi)[seq_index], ((int*)&lookup_mask_lo)[seq_index], ((float*)&sMM_i_j)[seq_index], ((float*)&score_vec)[seq_index],
-//                           ((int*)&i2_vec)[seq_index], ((int*)&j2_vec)[seq_index]);
-//                }
-//                printf("\n");
-            }
-            
-            
             
-        } //end for j
-        
-        // if global alignment: look for best cell in last column
-        if (!local){
-            
-            // new score is higer
-            // output
-            //  0   0   0   MAX
-            simd_int lookup_mask_hi = (simd_int) simdf32_gt(sMM_i_j,score_vec);
-//            simd_int lookup_mask_lo;
-            simd_int lookup_mask_lo = simdi_andnot(lookup_mask_hi,simdi32_set(-1));
-
-            // old score is higher
-            // output
-            //  MAX MAX MAX 0
-
-            
-            simd_int curr_pos_j   = simdi32_set(j-1);
-            simd_int new_j_pos_hi = simdi_and(lookup_mask_hi,curr_pos_j);
-            simd_int old_j_pos_lo = simdi_and(lookup_mask_lo,j2_vec);
-            j2_vec = simdi32_add(new_j_pos_hi,old_j_pos_lo);
-            simd_int curr_pos_i   = simdi32_set(i);
-            simd_int new_i_pos_hi = simdi_and(lookup_mask_hi,curr_pos_i);
-            simd_int old_i_pos_lo = simdi_and(lookup_mask_lo,i2_vec);
-            i2_vec = simdi32_add(new_i_pos_hi,old_i_pos_lo);
-            
-            score_vec = simdf32_max(sMM_i_j,score_vec);
-        }    // end for j
-    }     // end for i
+                score_vec = simdf32_max(sMM_i_j,score_vec);
+            }    // end for j
+        }     // end for i
+    }     // end for stripes
+    if (segment >= 0 && i_first <= i_last) {
+        memcpy(viterbiMatrix->getCheckpoint(segment), sMM_DG_MI_GD_IM_vec,
+               (targetLength + 1) * 5 * sizeof(simd_float));
+    }
     
     for(int seq_index=0; seq_index < maxres; seq_index++){
         result->score[seq_index]=((float*)&score_vec)[seq_index];
@@ -25,6 +25,14 @@ inline void ViterbiMatrix::setCellOff(bool value){
 
 
 inline void ViterbiMatrix::setCellOff(int row,int col,int elem,bool value){
+    if(checkpointed){
+        // applied by SetSegment
+        if(value){
+            cell_off_cells[row].push_back((col*VECSIZE_FLOAT)+elem);
+            this->setCellOff(true);
+        }
+        return;
+    }
     if(value){
         BIT_SET(this->bCO_MI_DG_IM_GD_MM_vec[row][(col*VECSIZE_FLOAT)+elem],7);
         this->setCellOff(true);
@@ -33,6 +41,39 @@ inline void ViterbiMatrix::setCellOff(int row,int col,int elem,bool value){
     }
 }
 
+inline void ViterbiMatrix::setSegmentCellOff(int row,int col,int elem){
+    BIT_SET(this->bCO_MI_DG_IM_GD_MM_vec[row][(col*VECSIZE_FLOAT)+elem],7);
+}
+
+inline bool ViterbiMatrix::fitsFullMatrix(int Nq, int Nt){
+    return ICEIL(Nq + 1, VECSIZE_FLOAT) <= max_query_length
+        && ICEIL((Nt + 1) * VECSIZE_FLOAT, VECSIZE_FLOAT) <= max_template_length;
+}
+
+inline bool ViterbiMatrix::isCheckpointed(){
+    return this->checkpointed;
+}
+
+inline int ViterbiMatrix::getSegments(){
+    return (query_length + checkpoint_distance - 1) / checkpoint_distance;
+}
+
+inline int ViterbiMatrix::getSegmentFirstRow(int segment){
+    return segment * checkpoint_distance + 1;
+}
+
+inline int ViterbiMatrix::getSegmentLastRow(int segment){
+    return imin((segment + 1) * checkpoint_distance, query_length);
+}
+
+inline int ViterbiMatrix::getSegment(){
+    return this->segment;
+}
+
+inline simd_float * ViterbiMatrix::getCheckpoint(int segment){
+    return this->checkpoints + (size_t) segment * checkpoint_row_size;
+}
+
 inline void ViterbiMatrix::setMatIns(int row,int col,int elem,bool value){
     if(value){
         BIT_SET(this->bCO_MI_DG_IM_GD_MM_vec[row][(col*VECSIZE_FLOAT)+elem],6);
@@ -109,6 +150,41 @@ inline int  ViterbiMatrix::getMatMat(int row,int col,int elem){
     return (int) (vCO_MI_DG_GD_MM & 7);
 }
 
+// all bits of the lanes whose cell is turned off are set
+inline simd_int ViterbiMatrix::getCellOffVec(int row,int col){
+    const unsigned char * cell = &this->bCO_MI_DG_IM_GD_MM_vec[row][col*VECSIZE_FLOAT];
+#ifdef AVX512
+    return _mm512_srai_epi32(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *) cell)), 31);
+#elif defined(AVX2)
+    return _mm256_srai_epi32(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) cell)), 31);
+#else
+    // replicate each byte to its 32 bit lane, the sign bit is the cell off bit
+    simd_int bytes = _mm_cvtsi32_si128(*(const int *) cell);
+    bytes = _mm_unpacklo_epi8(bytes, bytes);
+    bytes = _mm_unpacklo_epi16(bytes, bytes);
+    return _mm_srai_epi32(bytes, 31);
+#endif
+}
+
+// sets the MatMat states (< 8) of all lanes, the flags of the cells are kept
+inline void ViterbiMatrix::setMatMatVec(int row,int col,simd_int value){
+    unsigned char * cell = &this->bCO_MI_DG_IM_GD_MM_vec[row][col*VECSIZE_FLOAT];
+#ifdef AVX512
+    const __m128i flags = _mm_and_si128(_mm_loadu_si128((const __m128i *) cell), _mm_set1_epi8((char) 0xF8));
+    _mm_storeu_si128((__m128i *) cell, _mm_or_si128(flags, _mm512_cvtepi32_epi8(value)));
+#elif defined(AVX2)
+    value = _mm256_packs_epi32(value, value);    // 16 bit lanes, alternating every 4 lanes
+    const __m128i states = _mm_packus_epi16(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+    const __m128i flags = _mm_and_si128(_mm_loadl_epi64((const __m128i *) cell), _mm_set1_epi8((char) 0xF8));
+    // states holds the bytes 0-3, 0-3, 4-7, 4-7
+    _mm_storel_epi64((__m128i *) cell, _mm_or_si128(flags, _mm_shuffle_epi32(states, _MM_SHUFFLE(3, 3, 2, 0))));
+#else
+    value = _mm_packs_epi32(value, value);
+    value = _mm_packus_epi16(value, value);
+    *(int *) cell = (*(const int *) cell & 0xF8F8F8F8) | _mm_cvtsi128_si32(value);
+#endif
+}
+
 inline void ViterbiMatrix::printCellOff(int row_size,int col_size,int elem){
     for(int row = 0; row < row_size; row++){
         for(int col = 0; col < col_size;col++){
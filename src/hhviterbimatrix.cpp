@@ -10,11 +10,28 @@
 #define HHVITERBIMATRIX_c
 #include "hhviterbimatrix.h"
 
+#include <cmath>
+#include <cstring>
+
 ViterbiMatrix::ViterbiMatrix(){
     this->bCO_MI_DG_IM_GD_MM_vec=NULL;
     this->cellOff = false;
     this->max_query_length = 0;
     this->max_template_length = 0;
+    this->full_matrix = NULL;
+    this->checkpointed = false;
+    this->query_length = 0;
+    this->checkpoint_distance = 1;
+    this->checkpoint_row_size = 0;
+    this->segment = 0;
+    this->segment_row_length = 0;
+    this->segment_matrix = NULL;
+    this->segment_matrix_rows = 0;
+    this->segment_matrix_row_length = 0;
+    this->segment_rows = NULL;
+    this->segment_rows_size = 0;
+    this->checkpoints = NULL;
+    this->checkpoints_size = 0;
 }
 
 
@@ -31,7 +48,8 @@ void ViterbiMatrix::AllocateBacktraceMatrix(int Nq, int Nt)
     int tmp_template_length = ICEIL((Nt + 1) * VECSIZE_FLOAT, VECSIZE_FLOAT);
 
     if(tmp_query_length > max_query_length || tmp_template_length > max_template_length) {
-        DeleteBacktraceMatrix();
+        free(full_matrix);
+        full_matrix = NULL;
     }
     else {
         return;
@@ -41,9 +59,90 @@ void ViterbiMatrix::AllocateBacktraceMatrix(int Nq, int Nt)
     max_template_length = tmp_template_length;
 
     // Allocate posterior prob matrix (matrix rows are padded to make them aligned to multiples of ALIGN_FLOAT)
-    bCO_MI_DG_IM_GD_MM_vec = malloc_matrix<unsigned char>(max_query_length + 2, max_template_length + (2 * VECSIZE_FLOAT));
-    if (!bCO_MI_DG_IM_GD_MM_vec)
+    full_matrix = malloc_matrix<unsigned char>(max_query_length + 2, max_template_length + (2 * VECSIZE_FLOAT));
+    if (!full_matrix)
         MemoryError("m_probabilities", __FILE__, __LINE__, __func__);
+    if (!checkpointed)
+        bCO_MI_DG_IM_GD_MM_vec = full_matrix;
+}
+
+// A checkpoint row holds 5 scores per cell, a backtrace row one byte: with a distance
+// of sqrt(5 * sizeof(float) * Nq), the checkpoints and the segment take the same memory
+int ViterbiMatrix::getCheckpointDistance(int Nq)
+{
+    return imax(1, imin(Nq, (int) ceil(sqrt(5.0 * sizeof(float) * Nq))));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Select the full or the checkpointed backtrace matrix for the next alignment
+/////////////////////////////////////////////////////////////////////////////////////
+void ViterbiMatrix::SetAlignmentSize(int Nq, int Nt)
+{
+    if (checkpointed) {
+        // the cells turned off for the last checkpointed alignment were kept until its backtrace
+        cellOff = false;
+        for (size_t row = 0; row < cell_off_cells.size(); row++)
+            cell_off_cells[row].clear();
+    }
+
+    if (fitsFullMatrix(Nq, Nt)) {
+        checkpointed = false;
+        bCO_MI_DG_IM_GD_MM_vec = full_matrix;
+        return;
+    }
+
+    checkpointed = true;
+    query_length = Nq;
+    checkpoint_distance = getCheckpointDistance(Nq);
+    checkpoint_row_size = (Nt + 1) * 5;
+    segment_row_length = (Nt + 1) * VECSIZE_FLOAT + (2 * VECSIZE_FLOAT);
+
+    if (checkpoint_distance > segment_matrix_rows || segment_row_length > segment_matrix_row_length) {
+        free(segment_matrix);
+        segment_matrix_rows = imax(segment_matrix_rows, checkpoint_distance);
+        segment_matrix_row_length = imax(segment_matrix_row_length, segment_row_length);
+        segment_matrix = malloc_matrix<unsigned char>(segment_matrix_rows, segment_matrix_row_length);
+        if (!segment_matrix)
+            MemoryError("segment_matrix", __FILE__, __LINE__, __func__);
+    }
+    if (Nq + 2 > segment_rows_size) {
+        delete[] segment_rows;
+        segment_rows_size = Nq + 2;
+        segment_rows = new unsigned char*[segment_rows_size];
+    }
+    segment_rows[0] = segment_matrix[0];
+    for (int row = 1; row < Nq + 2; row++)
+        segment_rows[row] = segment_matrix[(row - 1) % checkpoint_distance];
+
+    const size_t size = (size_t) getSegments() * checkpoint_row_size;
+    if (size > checkpoints_size) {
+        free(checkpoints);
+        checkpoints_size = size;
+        checkpoints = malloc_simd_float(checkpoints_size * sizeof(simd_float));
+        if (!checkpoints)
+            MemoryError("checkpoints", __FILE__, __LINE__, __func__);
+    }
+    if ((int) cell_off_cells.size() < Nq + 2)
+        cell_off_cells.resize(Nq + 2);
+
+    bCO_MI_DG_IM_GD_MM_vec = segment_rows;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Turn off the cells of a segment of the checkpointed backtrace matrix
+/////////////////////////////////////////////////////////////////////////////////////
+void ViterbiMatrix::SetSegment(int segment)
+{
+    this->segment = segment;
+    if (!cellOff)
+        return;
+
+    for (int row = getSegmentFirstRow(segment); row <= getSegmentLastRow(segment); row++) {
+        // the row still holds cells of the segment computed before
+        memset(bCO_MI_DG_IM_GD_MM_vec[row], 0, segment_row_length);
+        for (size_t cell = 0; cell < cell_off_cells[row].size(); cell++)
+            BIT_SET(bCO_MI_DG_IM_GD_MM_vec[row][cell_off_cells[row][cell]], 7);
+    }
 }
 
 
@@ -52,11 +151,25 @@ void ViterbiMatrix::AllocateBacktraceMatrix(int Nq, int Nt)
 //// Delete memory for dynamic programming matrix
 /////////////////////////////////////////////////////////////////////////////////////
 void ViterbiMatrix::DeleteBacktraceMatrix() {
+    free(segment_matrix);
+    segment_matrix = NULL;
+    segment_matrix_rows = 0;
+    segment_matrix_row_length = 0;
+    delete[] segment_rows;
+    segment_rows = NULL;
+    segment_rows_size = 0;
+    free(checkpoints);
+    checkpoints = NULL;
+    checkpoints_size = 0;
+    cell_off_cells.clear();
+    checkpointed = false;
+
     if(max_query_length == 0) {
         return;
     }
 
-    free(bCO_MI_DG_IM_GD_MM_vec);
+    free(full_matrix);
+    full_matrix = NULL;
     bCO_MI_DG_IM_GD_MM_vec = NULL;
 
     max_query_length = 0;
@@ -8,6 +8,8 @@
 #ifndef HHVITERBIMATRIX_h
 #define HHVITERBIMATRIX_h
 
+#include <vector>
+
 #include "hhutil.h"
 #include "simd.h"
 #include "hhhmmsimd.h"
@@ -52,6 +54,25 @@ public:
     void AllocateBacktraceMatrix(int Nq, int Nt);
     void DeleteBacktraceMatrix();
 
+    // Prepares the matrix for the next Nq x Nt alignment, before cells are turned off.
+    // Alignments that do not fit into the allocated matrix use a checkpointed backtrace:
+    // every checkpoint_distance-th row of scores is stored, and the backtrace rows of
+    // one segment between two checkpoints are recomputed at a time (see Viterbi::Backtrace).
+    void SetAlignmentSize(int Nq, int Nt);
+    // true if an Nq x Nt alignment fits into the allocated matrix (not checkpointed)
+    bool fitsFullMatrix(int Nq, int Nt);
+    // rows per segment of a checkpointed alignment of a query of length Nq
+    static int getCheckpointDistance(int Nq);
+    bool isCheckpointed();
+    int getSegments();
+    int getSegmentFirstRow(int segment);
+    int getSegmentLastRow(int segment);
+    // makes the rows of segment available, with their cells turned off
+    void SetSegment(int segment);
+    int getSegment();
+    // scores of the last row of segment
+    simd_float * getCheckpoint(int segment);
+
     bool getCellOff(int row,int col,int elem); 
     bool getMatIns(int row,int col,int elem); 
     bool getGapDel(int row,int col,int elem); 
@@ -60,11 +81,17 @@ public:
     int  getMatMat(int row,int col,int elem); 
     
     void setCellOff(int row,int col,int elem,bool value);
+    // turns off a cell of the current segment of the checkpointed matrix, until the next SetSegment
+    void setSegmentCellOff(int row,int col,int elem);
     void setMatIns(int row,int col,int elem,bool value);
     void setDelGap(int row,int col,int elem,bool value);
     void setInsMat(int row,int col,int elem,bool value);
     void setGapDel(int row,int col,int elem,bool value);
     void setMatMat(int row,int col,int elem,unsigned char value);
+
+    // all VECSIZE_FLOAT lanes of a cell at once (32 bit lanes)
+    simd_int getCellOffVec(int row,int col);
+    void setMatMatVec(int row,int col,simd_int value);
     
     bool hasCellOff();
     void setCellOff(bool value);
@@ -81,6 +108,26 @@ private:
     int max_query_length;
     int max_template_length;
 
+    // full matrix of AllocateBacktraceMatrix
+    unsigned char ** full_matrix;
+
+    // checkpointed backtrace: row i lies in row (i - 1) % checkpoint_distance of
+    // segment_matrix, cells turned off are kept by row until their segment is computed
+    bool checkpointed;
+    int query_length;
+    int checkpoint_distance;
+    int checkpoint_row_size;
+    int segment;
+    int segment_row_length;
+    unsigned char ** segment_matrix;
+    int segment_matrix_rows;
+    int segment_matrix_row_length;
+    unsigned char ** segment_rows;
+    int segment_rows_size;
+    simd_float * checkpoints;
+    size_t checkpoints_size;
+    std::vector<std::vector<int> > cell_off_cells;
+
 };
 
 #include "hhviterbimatrix-inl.h"
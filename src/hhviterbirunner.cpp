@@ -1,5 +1,7 @@
 #include "hhviterbirunner.h"
 
+#include <climits>
+
 #ifdef OPENMP
 #include <omp.h>
 #endif
@@ -21,11 +23,61 @@ void ViterbiConsumerThread::align(int maxres, int nseqdis, const float smin) {
     ss_hmm_mode = (ss_hmm_mode == 0) ? consensus_ss_hmm_mode & HMM::DSSP_PRED : 0;
     ss_hmm_mode = (ss_hmm_mode == 0) ? consensus_ss_hmm_mode & HMM::PRED_PRED : 0;
 
-    Viterbi::ViterbiResult* viterbiResult = viterbiAlgo->Align(q_simd, t_hmm_simd, viterbiMatrix, maxres, ss_hmm_mode);
+    // Band around the diagonals of the prefilter alignments of all templates (first alignment only,
+    // cells turned off for alternative alignments need the full matrix)
+    bool banded = (viterbi_band > 0 && viterbiMatrix->hasCellOff() == false);
+    int diagonal_min = INT_MAX;
+    int diagonal_max = INT_MIN;
+    for (int elem = 0; banded && elem < maxres; elem++) {
+        const int diagonal = t_hmm_simd->GetHMM(elem)->entry->prefilter_diagonal;
+        if (diagonal == PrefilterEntry::NO_DIAGONAL || diagonal <= -q_simd->L || diagonal >= t_hmm_simd->GetHMM(elem)->L) {
+            banded = false;
+        }
+        diagonal_min = imin(diagonal_min, diagonal);
+        diagonal_max = imax(diagonal_max, diagonal);
+    }
+
+    // The band is doubled until no best path touches its edges or it covers the whole matrix
+    Viterbi::ViterbiResult* viterbiResult;
+    std::vector<Viterbi::BacktraceResult> backtraceResults(maxres);
+    for (int band = viterbi_band; ; band *= 2) {
+        const int diagonal_lo = (banded) ? diagonal_min - band : 0;
+        const int diagonal_hi = (banded) ? diagonal_max + band : 0;
+        banded = banded && (diagonal_lo > 1 - q_simd->L || diagonal_hi < t_hmm_simd->L - 1);
+        if (banded) {
+            viterbiAlgo->SetBand(diagonal_lo, diagonal_hi);
+        } else {
+            viterbiAlgo->ClearBand();
+        }
+
+        viterbiResult = viterbiAlgo->Align(q_simd, t_hmm_simd, viterbiMatrix, maxres, ss_hmm_mode);
+        viterbiAlgo->Backtrace(q_simd, t_hmm_simd, viterbiMatrix, maxres, ss_hmm_mode, viterbiResult, backtraceResults);
+        bool touches_band = false;
+        for (int elem = 0; elem < maxres; elem++) {
+            for (int step = 1; banded && step <= backtraceResults[elem].count; step++) {
+                const int i = backtraceResults[elem].i_steps[step];
+                const int j = backtraceResults[elem].j_steps[step];
+                if ((j - i <= diagonal_lo && j > 1) || (j - i >= diagonal_hi && i > 1)) {
+                    touches_band = true;
+                }
+            }
+        }
+        if (touches_band == false) {
+            break;
+        }
+
+        for (int elem = 0; elem < maxres; elem++) {
+            delete[] backtraceResults[elem].i_steps;
+            delete[] backtraceResults[elem].j_steps;
+            delete[] backtraceResults[elem].states;
+        }
+        delete viterbiResult;
+    }
+    viterbiAlgo->ClearBand();
+
     for (int elem = 0; elem < maxres; elem++) {
         HMM * curr_t_hmm = t_hmm_simd->GetHMM(elem);
-        Viterbi::BacktraceResult backtraceResult = Viterbi::Backtrace(viterbiMatrix,
-                                                                      elem, viterbiResult->i, viterbiResult->j);
+        Viterbi::BacktraceResult& backtraceResult = backtraceResults[elem];
 
         Viterbi::BacktraceScore backtraceScore = viterbiAlgo->ScoreForBacktrace(
                                                                                 q_simd, t_hmm_simd, elem, &backtraceResult, viterbiResult->score, ss_hmm_mode);
@@ -141,7 +193,7 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
 //                    }
                     int format_tmp = 0;
                     char wg = 1; // performance reason
-                    entry->getTemplateHMM(par, wg, qsc, format_tmp, pb, S, Sim, t_hmm[current_t_index + i]);
+                    template_cache->getTemplateHMM(entry, par, wg, qsc, format_tmp, pb, S, Sim, R, t_hmm[current_t_index + i]);
                     t_hmm[current_t_index + i]->entry = entry;
 
                     PrepareTemplateHMM(par, q, t_hmm[current_t_index + i], format_tmp, false, pb, R);
@@ -149,6 +201,7 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
 
                 }
                 t_hmm_simd[current_thread_id]->MapHMMVector(templates_to_align);
+                viterbiMatrix[current_thread_id]->SetAlignmentSize(q_simd->L, t_hmm_simd[current_thread_id]->L);
                 exclude_alignments(maxResElem, q_simd, t_hmm_simd[current_thread_id],
                                    excludeAlignments, viterbiMatrix[current_thread_id]);
 
@@ -195,6 +248,8 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
 
     // clean memory
     for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+        // the realignment uses the full backtrace matrix again
+        viterbiMatrix[thread_id]->SetAlignmentSize(0, 0);
         delete t_hmm_simd[thread_id];
         delete threads[thread_id];
     }
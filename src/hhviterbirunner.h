@@ -5,6 +5,7 @@
 #include "hhviterbimatrix.h"
 #include "hhviterbi.h"
 #include "hhfunc.h"
+#include "hhtemplatecache.h"
 #include <vector>
 #include <map>
 
@@ -17,6 +18,8 @@ class ViterbiConsumerThread
 	ViterbiMatrix* viterbiMatrix;
 	int job_size;
 	const int ssm_mode;
+	// initial half width of the band around the prefilter diagonals (0: full matrix)
+	const int viterbi_band;
 
 public:
 
@@ -28,9 +31,11 @@ public:
 			t_hmm_simd(t_hmm_simd),
 			viterbiMatrix(pviterbiMatrix),
 			job_size(0),
-			ssm_mode(ssm_mode){
+			ssm_mode(ssm_mode),
+			viterbi_band(par.viterbi_band){
 		viterbiAlgo = new Viterbi(par.maxres, par.loc, par.egq, par.egt,
 				par.corr, par.min_overlap, par.shift, ssm_mode, par.ssw, S73, S33, S37);
+		viterbiAlgo->SetScoreTile(par.viterbi_score_tile);
 	}
 
 	~ViterbiConsumerThread(){
@@ -49,8 +54,10 @@ public:
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 class ViterbiRunner {
 public:
-	ViterbiRunner(ViterbiMatrix ** viterbiMatrix, std::vector<HHblitsDatabase*> &databases, int threads)
-			: viterbiMatrix(viterbiMatrix), databases(databases), thread_count(threads) { }
+	ViterbiRunner(ViterbiMatrix ** viterbiMatrix, std::vector<HHblitsDatabase*> &databases, int threads,
+			TemplateHMMCache* template_cache)
+			: viterbiMatrix(viterbiMatrix), databases(databases), thread_count(threads),
+			  template_cache(template_cache) { }
 
 	std::vector<Hit> alignment(Parameters& par, HMMSimd * q_simd, std::vector<HHEntry*> dbfiles, const float qsc, float* pb,
 			const float S[20][20], const float Sim[20][20], const float R[20][20],
@@ -61,6 +68,8 @@ private:
 	ViterbiMatrix** viterbiMatrix;
 	std::vector<HHblitsDatabase* > databases;
 	int thread_count;
+	// prepared template HMMs of the query
+	TemplateHMMCache* template_cache;
 
 	void merge_thread_results(std::vector<Hit> &all_hits,
 			std::vector<HHEntry*> &dbfiles_to_align,
@@ -12,20 +12,20 @@
 
 #include "log.h"
 
-#ifdef AVX512
+#if defined(AVX512) && !defined(AVX2)
 #define AVX2
 #endif
 
-#ifdef AVX2
+#if defined(AVX2) && !defined(AVX)
 #define AVX
 #endif
 
-#ifdef AVX
+#if defined(AVX) && !defined(SSE)
 #define SSE
 #endif
 
 #ifdef AVX512
-#include <zmmintrin.h.h> // AVX512
+#include <immintrin.h> // AVX512
 // double support
 #ifndef SIMD_DOUBLE
 #define SIMD_DOUBLE
@@ -44,12 +44,15 @@ typedef __m512d simd_double;
 #define simdf64_set4(x,y,z,t) _mm512_set_pd(x,y,z,t,x,y,z,t)
 #define simdf64_set8(x0,x1,x2,x3,x4,x5,x6,x7) _mm512_set_pd(x0,x1,x2,x3,x4,x5,x6,x7)
 #define simdf64_setzero(x)  _mm512_setzero_pd()
-#define simdf64_gt(x,y)     _mm512_cmpnle_pd_mask(x,y)
-#define simdf64_lt(x,y)     _mm512_cmplt_pd_mask(x,y)
-#define simdf64_or(x,y)     _mm512_or_si512(x,y)
-#define simdf64_and(x,y)    _mm512_and_si512 (x,y)
-#define simdf64_andnot(x,y) _mm512_andnot_si512(x,y)
-#define simdf64_xor(x,y)    _mm512_xor_si512(x,y)
+// comparisons return vectors with all bits of the true elements set, like SSE and AVX
+#define simdf64_mask(m)     _mm512_castsi512_pd(_mm512_maskz_mov_epi64(m, _mm512_set1_epi64(-1)))
+#define simdf64_gt(x,y)     simdf64_mask(_mm512_cmp_pd_mask(x,y,_CMP_GT_OS))
+#define simdf64_lt(x,y)     simdf64_mask(_mm512_cmp_pd_mask(x,y,_CMP_LT_OS))
+#define simdf64_or(x,y)     _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(x),_mm512_castpd_si512(y)))
+#define simdf64_and(x,y)    _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(x),_mm512_castpd_si512(y)))
+#define simdf64_andnot(x,y) _mm512_castsi512_pd(_mm512_andnot_si512(_mm512_castpd_si512(x),_mm512_castpd_si512(y)))
+#define simdf64_xor(x,y)    _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(x),_mm512_castpd_si512(y)))
+#define simdf64_movemask(x) ((unsigned int) _mm512_test_epi64_mask(_mm512_castpd_si512(x),_mm512_castpd_si512(x)))
 #endif //SIMD_DOUBLE
 // float support
 #ifndef SIMD_FLOAT
@@ -71,29 +74,50 @@ typedef __m512  simd_float;
 #define simdf32_set4(x,y,z,t) _mm512_set_ps(x,y,z,t,x,y,z,t,x,y,z,t,x,y,z,t)
 #define simdf32_set8(x0,x1,x2,x3,x4,x5,x6,x7) _mm512_set_ps(x0,x1,x2,x3,x4,x5,x6,x7,x0,x1,x2,x3,x4,x5,x6,x7)
 #define simdf32_setzero(x)  _mm512_setzero_ps()
-#define simdf32_gt(x,y)     _mm512_cmpnle_ps_mask(x,y)
-#define simdf32_eq(x,y)     _mm512_cmpeq_ps_mask(x,y)
-#define simdf32_lt(x,y)     _mm512_cmplt_ps_mask(x,y)
-#define simdf32_or(x,y)     _mm512_or_si512(x,y)
-#define simdf32_and(x,y)    _mm512_and_si512(x,y)
-#define simdf32_andnot(x,y) _mm512_andnot_si512(x,y)
-#define simdf32_xor(x,y)    _mm512_xor_si512(x,y)
+// comparisons return vectors with all bits of the true elements set, like SSE and AVX
+#define simdf32_mask(m)     _mm512_castsi512_ps(_mm512_maskz_mov_epi32(m, _mm512_set1_epi32(-1)))
+#define simdf32_gt(x,y)     simdf32_mask(_mm512_cmp_ps_mask(x,y,_CMP_GT_OS))
+#define simdf32_eq(x,y)     simdf32_mask(_mm512_cmp_ps_mask(x,y,_CMP_EQ_OS))
+#define simdf32_lt(x,y)     simdf32_mask(_mm512_cmp_ps_mask(x,y,_CMP_LT_OS))
+#define simdf32_or(x,y)     _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(x),_mm512_castps_si512(y)))
+#define simdf32_and(x,y)    _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x),_mm512_castps_si512(y)))
+#define simdf32_andnot(x,y) _mm512_castsi512_ps(_mm512_andnot_si512(_mm512_castps_si512(x),_mm512_castps_si512(y)))
+#define simdf32_xor(x,y)    _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x),_mm512_castps_si512(y)))
 #define simdf32_f2i(x) 	    _mm512_cvtps_epi32(x)  // convert s.p. float to integer
 #define simdf_f2icast(x)    _mm512_castps_si512 (x)
+#define simdf32_movemask(x) ((unsigned int) _mm512_test_epi32_mask(_mm512_castps_si512(x),_mm512_castps_si512(x)))
+// convert the lower/upper half of the float lanes to doubles and back
+#define simdf32_f2d_lo(x)   _mm512_cvtps_pd(_mm512_castps512_ps256(x))
+#define simdf32_f2d_hi(x)   _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x),1)))
+#define simdf64_d2f(lo,hi)  _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))),_mm256_castps_pd(_mm512_cvtpd_ps(hi)),1))
 #endif //SIMD_FLOAT
 // integer support 
 #ifndef SIMD_INT
 #define SIMD_INT
 #define ALIGN_INT       64
 #define VECSIZE_INT     16
+
+// byte shifts over the whole 512 bit register, _mm512_alignr_epi8 only shifts within 128 bit lanes
+template  <unsigned int N> __m512i _mm512_shift_left(__m512i a)
+{
+    __m512i mask = _mm512_maskz_shuffle_i32x4(0xFFF0, a, a, _MM_SHUFFLE(2,1,0,0));
+    return _mm512_alignr_epi8(a,mask,16-N);
+}
+
+template  <unsigned int N> __m512i _mm512_shift_right(__m512i a)
+{
+    __m512i mask = _mm512_maskz_shuffle_i32x4(0x0FFF, a, a, _MM_SHUFFLE(3,3,2,1));
+    return _mm512_alignr_epi8(mask,a,N);
+}
+
 typedef __m512i simd_int;
 #define simdi32_add(x,y)    _mm512_add_epi32(x,y)
-#define simdui8_adds(x,y)   NOT_YET_IMP()
+#define simdui8_adds(x,y)   _mm512_adds_epu8(x,y)
 #define simdi32_sub(x,y)    _mm512_sub_epi32(x,y)
-#define simdui8_subs(x,y)   NOT_YET_IMP()
+#define simdui8_subs(x,y)   _mm512_subs_epu8(x,y)
 #define simdi32_mul(x,y)    _mm512_mullo_epi32(x,y)
 #define simdi32_max(x,y)    _mm512_max_epi32(x,y) 
-#define simdui8_max(x,y)    NOT_YET_IMP()
+#define simdui8_max(x,y)    _mm512_max_epu8(x,y)
 #define simdi_load(x)       _mm512_load_si512(x)
 #define simdi_store(x,y)    _mm512_store_si512(x,y)
 #define simdi32_set(x)      _mm512_set1_epi32(x)
@@ -102,21 +126,27 @@ typedef __m512i simd_int;
 #define simdi32_set8(x0,x1,x2,x3,x4,x5,x6,x7) _mm512_set_epi32(x0,x1,x2,x3,x4,x5,x6,x7,x0,x1,x2,x3,x4,x5,x6,x7)
 #define simdi8_set(x)       _mm512_set1_epi8(x)
 #define simdi_setzero(x)    _mm512_setzero_si512()
-#define simdi32_gt(x,y)     _mm512_cmpgt_epi32(x,y)
-#define simdi8_gt(x,y)      NOT_YET_IMP()
-#define simdi8_eq(x,y)      NOT_YET_IMP()
-#define simdi32_lt(x,y)     _mm512_cmplt_epi32(x,y)
+#define simdi32_gt(x,y)     _mm512_maskz_mov_epi32(_mm512_cmpgt_epi32_mask(x,y), _mm512_set1_epi32(-1))
+#define simdi8_gt(x,y)      _mm512_movm_epi8(_mm512_cmpgt_epi8_mask(x,y))
+#define simdi8_eq(x,y)      _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(x,y))
+#define simdi32_lt(x,y)     _mm512_maskz_mov_epi32(_mm512_cmplt_epi32_mask(x,y), _mm512_set1_epi32(-1))
 #define simdi_or(x,y)       _mm512_or_si512(x,y)
 #define simdi_and(x,y)      _mm512_and_si512(x,y)
 #define simdi_andnot(x,y)   _mm512_andnot_si512(x,y)
 #define simdi_xor(x,y)      _mm512_xor_si512(x,y)
-#define simdi8_shiftl(x,y)  NOT_YET_IMP()
-#define simdi8_shiftr(x,y)  NOT_YET_IMP()
-#define simdi8_movemask(x)  NOT_YET_IMP()
+#define simdi8_shiftl(x,y)  _mm512_shift_left<y>(x)
+#define simdi8_shiftr(x,y)  _mm512_shift_right<y>(x)
+#define simdi8_movemask(x)  _mm512_movepi8_mask(x)
+#define simdi8_eq_mask(x,y) _mm512_cmpeq_epi8_mask(x,y) // compares directly into a mask register
+#define SIMD_MOVEMASK_MAX   0xffffffffffffffffULL
+typedef unsigned long long simd_movemask; // holds simdi8_movemask of all 64 bytes
 #define simdi32_slli(x,y)	_mm512_slli_epi32(x,y) // shift integers in a left by y
 #define simdi32_srli(x,y)	_mm512_srli_epi32(x,y) // shift integers in a right by y
 #define simdi32_i2f(x) 	    _mm512_cvtepi32_ps(x)  // convert integer to s.p. float
 #define simdi_i2fcast(x)    _mm512_castsi512_ps(x)
+// widen the 32 bit lane masks of the lower/upper half to masks of the double lanes
+#define simdi32_mask2d_lo(x) _mm512_castsi512_pd(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(x)))
+#define simdi32_mask2d_hi(x) _mm512_castsi512_pd(_mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(x,1)))
 
 #endif //SIMD_INT
 #endif //AVX512_SUPPORT
@@ -164,10 +194,16 @@ typedef __m256i simd_int;
 #define simdi8_shiftl(x,y)  _mm256_shift_left<y>(x)
 #define simdi8_shiftr(x,y)  _mm256_srli_si256(x,y)
 #define simdi8_movemask(x)  _mm256_movemask_epi8(x)
+#define simdi8_eq_mask(x,y) ((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x,y)))
+#define SIMD_MOVEMASK_MAX   0xffffffff
+typedef int simd_movemask;
 #define simdi32_slli(x,y)   _mm256_slli_epi32(x,y) // shift integers in a left by y
 #define simdi32_srli(x,y)   _mm256_srli_epi32(x,y) // shift integers in a right by y
 #define simdi32_i2f(x) 	    _mm256_cvtepi32_ps(x)  // convert integer to s.p. float
 #define simdi_i2fcast(x)    _mm256_castsi256_ps(x)
+// widen the 32 bit lane masks of the lower/upper half to masks of the double lanes
+#define simdi32_mask2d_lo(x) _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)))
+#define simdi32_mask2d_hi(x) _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(x,1)))
 #endif //SIMD_INT
 #endif //AVX2
 
@@ -196,6 +232,7 @@ typedef __m256d simd_double;
 #define simdf64_and(x,y)    _mm256_and_pd(x,y)
 #define simdf64_andnot(x,y) _mm256_andnot_pd(x,y)
 #define simdf64_xor(x,y)    _mm256_xor_pd(x,y)
+#define simdf64_movemask(x) ((unsigned int) _mm256_movemask_pd(x))
 #endif //SIMD_DOUBLE
 // float support (usable with AVX1)
 #ifndef SIMD_FLOAT
@@ -227,6 +264,11 @@ typedef __m256 simd_float;
 #define simdf32_f2i(x) 	    _mm256_cvtps_epi32(x)  // convert s.p. float to integer
 #define simdf32_extract(x,imm) _mm_extract_ps(_mm256_castps256_ps128(x),imm)
 #define simdf_f2icast(x)    _mm256_castps_si256(x) // compile time cast
+#define simdf32_movemask(x) ((unsigned int) _mm256_movemask_ps(x))
+// convert the lower/upper half of the float lanes to doubles and back
+#define simdf32_f2d_lo(x)   _mm256_cvtps_pd(_mm256_castps256_ps128(x))
+#define simdf32_f2d_hi(x)   _mm256_cvtps_pd(_mm256_extractf128_ps(x,1))
+#define simdf64_d2f(lo,hi)  _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),_mm256_cvtpd_ps(hi),1)
 #endif //SIMD_FLOAT
 #endif //AVX_SUPPORT
 
@@ -256,6 +298,7 @@ typedef __m128d simd_double;
 #define simdf64_and(x,y)    _mm_and_pd(x,y)
 #define simdf64_andnot(x,y) _mm_andnot_pd(x,y)
 #define simdf64_xor(x,y)    _mm_xor_pd(x,y)
+#define simdf64_movemask(x) ((unsigned int) _mm_movemask_pd(x))
 #endif //SIMD_DOUBLE
 
 // float support
@@ -287,6 +330,11 @@ typedef __m128  simd_float;
 #define simdf32_f2i(x) 	    _mm_cvtps_epi32(x)  // convert s.p. float to integer
 #define simdf32_extract(x,imm) _mm_extract_ps(x,imm)
 #define simdf_f2icast(x)    _mm_castps_si128(x) // compile time cast
+#define simdf32_movemask(x) ((unsigned int) _mm_movemask_ps(x))
+// convert the lower/upper half of the float lanes to doubles and back
+#define simdf32_f2d_lo(x)   _mm_cvtps_pd(x)
+#define simdf32_f2d_hi(x)   _mm_cvtps_pd(_mm_movehl_ps(x,x))
+#define simdf64_d2f(lo,hi)  _mm_movelh_ps(_mm_cvtpd_ps(lo),_mm_cvtpd_ps(hi))
 #endif //SIMD_FLOAT
 // integer support 
 #ifndef SIMD_INT
@@ -317,10 +365,16 @@ typedef __m128i simd_int;
 #define simdi8_shiftl(x,y)  _mm_slli_si128(x,y)
 #define simdi8_shiftr(x,y)  _mm_srli_si128(x,y)
 #define simdi8_movemask(x)  _mm_movemask_epi8(x)
+#define simdi8_eq_mask(x,y) ((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(x,y)))
+#define SIMD_MOVEMASK_MAX   0xffff
+typedef int simd_movemask;
 #define simdi32_slli(x,y)	_mm_slli_epi32(x,y) // shift integers in a left by y
 #define simdi32_srli(x,y)	_mm_srli_epi32(x,y) // shift integers in a right by y
 #define simdi32_i2f(x) 	    _mm_cvtepi32_ps(x)  // convert integer to s.p. float
 #define simdi_i2fcast(x)    _mm_castsi128_ps(x)
+// widen the 32 bit lane masks of the lower/upper half to masks of the double lanes
+#define simdi32_mask2d_lo(x) _mm_castsi128_pd(_mm_unpacklo_epi32(x,x))
+#define simdi32_mask2d_hi(x) _mm_castsi128_pd(_mm_unpackhi_epi32(x,x))
 
 #define simdi32_set4(x,y,z,t) _mm_set_epi32(x,y,z,t)  // Added with Power8, hhviterbialgorithm needs _set4
 
@@ -428,6 +482,9 @@ typedef __vector unsigned char simd_u8;
 #define simdi8_shiftl(x,y)   (simd_int)vec_sll(x,vec_splats((char)y)) // shift integers in a left by y
 #define simdi8_shiftr(x,y)   (simd_int)vec_srl(x,vec_splats((char)y)) // shift integers in a right by y
 #define simdi8_movemask(x)  v_movemask(x)
+#define simdi8_eq_mask(x,y) ((unsigned int) v_movemask(simdi8_eq(x,y)))
+#define SIMD_MOVEMASK_MAX   0xffff
+typedef int simd_movemask;
 
 
 // There is no altivec/vsx equivalent, C version 
@@ -116,7 +116,9 @@ inline float fast_log2(float x) {
     float prev = 0.0f;
     lg2[0] = 0.0f;
     for (int i = 1; i <= 1024; ++i) {
-      lg2[i] = log(float(1024 + i)) * 1.442695041 - 10.0f;
+      // log(double) in every translation unit: the table is filled by whichever inlined copy
+      // runs first, and log(float) resolved to logf where the float overload was declared
+      lg2[i] = log(double(1024 + i)) * 1.442695041 - 10.0f;
       diff[i - 1] = (lg2[i] - prev) * 1.2352E-4;
       prev = lg2[i];
     }
@@ -272,6 +274,25 @@ inline bool is_directory(const char *fn) {
   return ret;
 }
 
+// Fold size and modification time of a file into a 64 bit FNV-1a fingerprint
+// (FILE_FINGERPRINT_SEED for the first file), a missing file counts as empty
+#define FILE_FINGERPRINT_SEED 14695981039346656037ULL
+inline uint64_t file_fingerprint(uint64_t fingerprint, const char *fn) {
+  uint64_t values[2] = {0, 0};
+  struct stat fstats;
+  if (stat(fn, &fstats) == 0) {
+    values[0] = fstats.st_size;
+    values[1] = fstats.st_mtime;
+  }
+
+  const unsigned char* bytes = (const unsigned char*) values;
+  for (size_t i = 0; i < sizeof(values); i++) {
+    fingerprint ^= bytes[i];
+    fingerprint *= 1099511628211ULL;
+  }
+  return fingerprint;
+}
+
 // Normalize a float array such that it sums to one
 // If it sums to 0 then assign def_array elements to array (optional)
 inline float NormalizeTo1(float* array, int length, const float* def_array = NULL) {